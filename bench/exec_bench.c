@@ -0,0 +1,332 @@
+#include "../include/command_hash.h"
+#include "../include/supervisor.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The number of lookups timed for each way of finding a command.
+ */
+#define BENCH_LOOKUPS 100000
+
+/**
+ * The number of commands run for each way of running one, each a fork, an exec and a wait.
+ */
+#define BENCH_RUNS 2000
+
+/**
+ * The longest full name of a command built by the walk of the path.
+ */
+#define BENCH_NAME_MAX 4096
+
+/**
+ * The command found and run: on the path everywhere, and quick to exit.
+ */
+#define BENCH_COMMAND "true"
+
+/**
+ * The latencies of a set of lookups or runs.
+ */
+struct latencies
+{
+    long *nanoseconds;      // one per lookup or run
+    size_t count;           // number timed
+};
+
+/**
+ * walk_path
+ * <p>
+ * Find a command the way the shell did before the command hash table: join each directory of
+ * PATH to the name, in order, until a file that can be run is found.
+ * </p>
+ * @param name the name of the command
+ * @param file filled with the full name of the command
+ * @return 0 if found, -1 otherwise
+ */
+int walk_path(const char *name, char *file);
+
+/**
+ * join_name
+ * <p>
+ * Join a directory of PATH and the name of a command into a full name.
+ * </p>
+ * @param directory the directory, not null terminated
+ * @param length the length of the directory
+ * @param name the name of the command
+ * @param file filled with the full name, of at most BENCH_NAME_MAX bytes
+ * @return true if the full name fits, false otherwise
+ */
+bool join_name(const char *directory, size_t length, const char *name, char *file);
+
+/**
+ * exec_walk
+ * <p>
+ * Run a command the way the shell's child did before the command hash table: execv the name
+ * joined to each directory of PATH, in order, until one does not return.
+ * </p>
+ * @param argv the arguments, the name of the command first
+ */
+void exec_walk(char *const *argv);
+
+/**
+ * time_lookups
+ * <p>
+ * Time finding the command, through the table or by walking the path.
+ * </p>
+ * @param hash the table, or NULL to walk the path
+ * @param latencies filled with the time of each lookup
+ * @return 0 on success, -1 if the command was not found
+ */
+int time_lookups(struct command_hash *hash, struct latencies *latencies);
+
+/**
+ * time_runs
+ * <p>
+ * Time running the command to its end: fork, exec through the table or by walking the path,
+ * and wait.
+ * </p>
+ * @param hash the table, or NULL to walk the path
+ * @param latencies filled with the time of each run
+ * @return 0 on success, -1 if a run failed
+ */
+int time_runs(struct command_hash *hash, struct latencies *latencies);
+
+/**
+ * percentile
+ * <p>
+ * Sort latencies and take one of their percentiles.
+ * </p>
+ * @param latencies the latencies
+ * @param percent the percentile
+ * @return the latency, in nanoseconds
+ */
+long percentile(struct latencies *latencies, size_t percent);
+
+/**
+ * compare_latencies
+ * <p>
+ * Order two latencies for qsort.
+ * </p>
+ * @param a the first latency
+ * @param b the second latency
+ * @return less than, equal to or more than 0 as a is less than, equal to or more than b
+ */
+int compare_latencies(const void *a, const void *b);
+
+/**
+ * elapsed
+ * <p>
+ * The nanoseconds between two times.
+ * </p>
+ * @param start the earlier time
+ * @param end the later time
+ * @return the nanoseconds
+ */
+long elapsed(const struct timespec *start, const struct timespec *end);
+
+int main(void)
+{
+    struct supervisor   *supvis;
+    struct command_hash *hash;
+    struct latencies    latencies;
+    char                file[BENCH_NAME_MAX];
+    const char          *path;
+    size_t              directories;
+    int                 status;
+    
+    supvis                = init_supervisor();
+    hash                  = (supvis) ? command_hash_create(supvis) : NULL;
+    latencies.nanoseconds = (long *) malloc(BENCH_LOOKUPS * sizeof(long));
+    if (!hash || !latencies.nanoseconds || walk_path(BENCH_COMMAND, file) == -1)
+    {
+        (void) fprintf(stderr, "exec_bench: could not set up, or %s is not on the path\n", BENCH_COMMAND);
+        return EXIT_FAILURE;
+    }
+    
+    path        = getenv("PATH"); // NOLINT(concurrency-mt-unsafe): no threads here
+    directories = 1;
+    for (const char *c = path; *c; ++c)
+    {
+        directories += (*c == ':') ? 1 : 0;
+    }
+    (void) printf("%s, found as %s, with %zu directories on the path\n", BENCH_COMMAND, file, directories);
+    (void) printf("%-16s %23s %23s\n", "", "lookup p50/p99", "fork+exec+wait p50/p99");
+    
+    status = time_lookups(hash, &latencies);
+    if (status == 0)
+    {
+        (void) printf("%-16s %9ldns / %9ldns", "hash+execveat", percentile(&latencies, 50),
+                      percentile(&latencies, 99));
+        status = time_runs(hash, &latencies);
+    }
+    if (status == 0)
+    {
+        (void) printf(" %9ldns / %9ldns\n", percentile(&latencies, 50), percentile(&latencies, 99));
+        status = time_lookups(NULL, &latencies);
+    }
+    if (status == 0)
+    {
+        (void) printf("%-16s %9ldns / %9ldns", "path walk", percentile(&latencies, 50), percentile(&latencies, 99));
+        status = time_runs(NULL, &latencies);
+    }
+    if (status == 0)
+    {
+        (void) printf(" %9ldns / %9ldns\n", percentile(&latencies, 50), percentile(&latencies, 99));
+    }
+    
+    command_hash_destroy(supvis, hash);
+    free(latencies.nanoseconds);
+    destroy_supervisor(supvis);
+    
+    return (status == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int walk_path(const char *name, char *file)
+{
+    const char *directory;
+    const char *end;
+    size_t     length;
+    
+    directory = getenv("PATH"); // NOLINT(concurrency-mt-unsafe): no threads here
+    while (directory)
+    {
+        end    = strchr(directory, ':');
+        length = (end) ? (size_t) (end - directory) : strlen(directory);
+        if (length && join_name(directory, length, name, file) && access(file, X_OK) == 0)
+        {
+            return 0;
+        }
+        directory = (end) ? end + 1 : NULL;
+    }
+    
+    return -1;
+}
+
+void exec_walk(char *const *argv)
+{
+    char       file[BENCH_NAME_MAX];
+    const char *directory;
+    const char *end;
+    size_t     length;
+    
+    directory = getenv("PATH"); // NOLINT(concurrency-mt-unsafe): no threads here
+    while (directory)
+    {
+        end    = strchr(directory, ':');
+        length = (end) ? (size_t) (end - directory) : strlen(directory);
+        if (length && join_name(directory, length, *argv, file))
+        {
+            (void) execv(file, argv);
+        }
+        directory = (end) ? end + 1 : NULL;
+    }
+}
+
+bool join_name(const char *directory, size_t length, const char *name, char *file)
+{
+    size_t name_length;
+    
+    name_length = strlen(name);
+    if (length + name_length + 2 > BENCH_NAME_MAX)
+    {
+        return false;
+    }
+    memcpy(file, directory, length);
+    *(file + length) = '/';
+    memcpy(file + length + 1, name, name_length + 1);
+    
+    return true;
+}
+
+int time_lookups(struct command_hash *hash, struct latencies *latencies)
+{
+    struct timespec start;
+    struct timespec end;
+    char            file[BENCH_NAME_MAX];
+    bool            found;
+    int             error;
+    
+    // The first lookup fills the table, as the shell's first run of a command does.
+    if (hash && !command_hash_find(hash, BENCH_COMMAND, &error))
+    {
+        return -1;
+    }
+    for (latencies->count = 0; latencies->count < BENCH_LOOKUPS; ++latencies->count)
+    {
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        found = (hash) ? command_hash_find(hash, BENCH_COMMAND, &error) != NULL : walk_path(BENCH_COMMAND, file) == 0;
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        if (!found)
+        {
+            return -1;
+        }
+        *(latencies->nanoseconds + latencies->count) = elapsed(&start, &end);
+    }
+    
+    return 0;
+}
+
+int time_runs(struct command_hash *hash, struct latencies *latencies)
+{
+    char            name[] = BENCH_COMMAND;
+    char *const     argv[] = {name, NULL};
+    struct timespec start;
+    struct timespec end;
+    pid_t           pid;
+    int             status;
+    
+    for (latencies->count = 0; latencies->count < BENCH_RUNS; ++latencies->count)
+    {
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        pid = fork();
+        if (pid == -1)
+        {
+            return -1;
+        }
+        if (pid == 0)
+        {
+            if (hash)
+            {
+                (void) command_hash_exec(hash, BENCH_COMMAND, argv);
+            } else
+            {
+                exec_walk(argv);
+            }
+            _exit(127);
+        }
+        if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            return -1;
+        }
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        *(latencies->nanoseconds + latencies->count) = elapsed(&start, &end);
+    }
+    
+    return 0;
+}
+
+long percentile(struct latencies *latencies, size_t percent)
+{
+    qsort(latencies->nanoseconds, latencies->count, sizeof(long), compare_latencies);
+    
+    return *(latencies->nanoseconds + (latencies->count - 1) * percent / 100);
+}
+
+int compare_latencies(const void *a, const void *b)
+{
+    long first;
+    long second;
+    
+    first  = *(const long *) a;
+    second = *(const long *) b;
+    
+    return (first > second) - (first < second);
+}
+
+long elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
@@ -0,0 +1,348 @@
+#include "../include/history.h"
+#include "../include/history_index.h"
+#include "../include/supervisor.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The number of lookups timed at each history size.
+ */
+#define BENCH_LOOKUPS 20000
+
+/**
+ * The number of lookups timed for the linear scan, which takes far longer each.
+ */
+#define BENCH_SCAN_LOOKUPS 200
+
+/**
+ * The longest command of the history, and so the longest prefix looked up.
+ */
+#define BENCH_COMMAND_MAX 128
+
+/**
+ * The latencies of a set of lookups.
+ */
+struct latencies
+{
+    long *nanoseconds;      // one per lookup
+    size_t count;           // number of lookups timed
+};
+
+/**
+ * fill_history
+ * <p>
+ * Append commands to a history until it holds a number of them. A quarter of them are distinct,
+ * in a handful of shapes, as in a real history where the same commands come back.
+ * </p>
+ * @param history the history
+ * @param size the number of commands
+ * @param seed the state of the random numbers
+ * @return 0 on success, -1 on failure
+ */
+int fill_history(struct history *history, size_t size, unsigned long *seed);
+
+/**
+ * random_number
+ * <p>
+ * The next number of a fixed sequence, so every run looks up the same prefixes.
+ * </p>
+ * @param seed the state of the sequence
+ * @return the number
+ */
+unsigned long random_number(unsigned long *seed);
+
+/**
+ * pick_prefix
+ * <p>
+ * Take the start of a command of the history, as typed so far on a line: any length from one
+ * byte to the whole command, as each keystroke looks the line up again.
+ * </p>
+ * @param history the history
+ * @param size the number of commands in the history
+ * @param seed the state of the random numbers
+ * @param prefix filled with the prefix
+ * @return the length of the prefix
+ */
+size_t pick_prefix(struct history *history, size_t size, unsigned long *seed, char *prefix);
+
+/**
+ * time_suggest
+ * <p>
+ * Time autosuggestions: the most recent command starting with a prefix, from the index.
+ * </p>
+ * @param index the index
+ * @param size the number of commands in the history
+ * @param seed the state of the random numbers
+ * @param latencies filled with the time of each lookup
+ */
+void time_suggest(struct history_index *index, size_t size, unsigned long *seed, struct latencies *latencies);
+
+/**
+ * time_search
+ * <p>
+ * Time the first step of a reverse search: starting it and finding its first command.
+ * </p>
+ * @param index the index
+ * @param size the number of commands in the history
+ * @param seed the state of the random numbers
+ * @param latencies filled with the time of each lookup
+ */
+void time_search(struct history_index *index, size_t size, unsigned long *seed, struct latencies *latencies);
+
+/**
+ * time_scan
+ * <p>
+ * Time the lookup the index replaces: walking the history from the newest command to the
+ * first one starting with the prefix.
+ * </p>
+ * @param history the history
+ * @param size the number of commands in the history
+ * @param seed the state of the random numbers
+ * @param latencies filled with the time of each lookup
+ */
+void time_scan(struct history *history, size_t size, unsigned long *seed, struct latencies *latencies);
+
+/**
+ * percentile
+ * <p>
+ * Sort latencies and take one of their percentiles.
+ * </p>
+ * @param latencies the latencies
+ * @param percent the percentile
+ * @return the latency, in nanoseconds
+ */
+long percentile(struct latencies *latencies, size_t percent);
+
+/**
+ * compare_latencies
+ * <p>
+ * Order two latencies for qsort.
+ * </p>
+ * @param a the first latency
+ * @param b the second latency
+ * @return less than, equal to or more than 0 as a is less than, equal to or more than b
+ */
+int compare_latencies(const void *a, const void *b);
+
+/**
+ * elapsed
+ * <p>
+ * The nanoseconds between two times.
+ * </p>
+ * @param start the earlier time
+ * @param end the later time
+ * @return the nanoseconds
+ */
+long elapsed(const struct timespec *start, const struct timespec *end);
+
+int main(void)
+{
+    const size_t         sizes[] = {1000, 10000, 100000, 1000000};
+    struct supervisor    *supvis;
+    struct history       *history;
+    struct history_index *index;
+    struct history_entry entry;
+    struct latencies     latencies;
+    struct timespec      start;
+    struct timespec      end;
+    char                 path[] = "/tmp/csh_history_bench.XXXXXX";
+    unsigned long        seed;
+    size_t               size;
+    long                 build;
+    int                  fd;
+    
+    supvis                = init_supervisor();
+    latencies.nanoseconds = (long *) malloc(BENCH_LOOKUPS * sizeof(long));
+    fd                    = mkstemp(path);
+    if (!supvis || !latencies.nanoseconds || fd == -1)
+    {
+        (void) fprintf(stderr, "history_bench: could not set up\n");
+        return EXIT_FAILURE;
+    }
+    (void) close(fd);
+    
+    (void) printf("%9s %9s %23s %23s %23s\n", "commands", "build", "suggest p50/p99", "search p50/p99",
+                  "linear scan p50/p99");
+    history = history_open(supvis, path);
+    seed    = 1;
+    size    = 0;
+    for (size_t i = 0; history && i < sizeof(sizes) / sizeof(*sizes); ++i)
+    {
+        // Each size adds to the history of the one before.
+        if (fill_history(history, sizes[i] - size, &seed) == -1 || history_refresh(history) == -1)
+        {
+            break;
+        }
+        size = sizes[i];
+        
+        // A fresh index, as a session opening this history would build on its first keystroke.
+        index = history_index_create(supvis, history);
+        if (!index)
+        {
+            break;
+        }
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        (void) history_index_suggest(index, "", 0, &entry);
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        build = elapsed(&start, &end);
+        
+        (void) printf("%9zu %7ldms", size, build / 1000000);
+        time_suggest(index, size, &seed, &latencies);
+        (void) printf(" %9ldns / %9ldns", percentile(&latencies, 50), percentile(&latencies, 99));
+        time_search(index, size, &seed, &latencies);
+        (void) printf(" %9ldns / %9ldns", percentile(&latencies, 50), percentile(&latencies, 99));
+        time_scan(history, size, &seed, &latencies);
+        (void) printf(" %9ldns / %9ldns\n", percentile(&latencies, 50), percentile(&latencies, 99));
+        history_index_destroy(supvis, index);
+    }
+    
+    if (history)
+    {
+        history_close(supvis, history);
+    }
+    (void) unlink(path);
+    free(latencies.nanoseconds);
+    destroy_supervisor(supvis);
+    
+    return (size == sizes[sizeof(sizes) / sizeof(*sizes) - 1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int fill_history(struct history *history, size_t size, unsigned long *seed)
+{
+    const char *shapes[] = {"git commit -m fix-", "make -j8 target", "ls -la src/dir", "cd ~/projects/p",
+                            "ssh build", "grep -rn TODO file", "vim notes/", "./run.sh --case "};
+    char       text[BENCH_COMMAND_MAX];
+    int        length;
+    
+    for (size_t i = 0; i < size; ++i)
+    {
+        unsigned long n;
+        
+        n      = random_number(seed);
+        length = snprintf(text, sizeof(text), "%s%lu", *(shapes + n % (sizeof(shapes) / sizeof(*shapes))),
+                          (n >> 8) % (size / 4 + 1));
+        if (length < 0 || history_append(history, text, (size_t) length, 0, time(NULL), 1) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+unsigned long random_number(unsigned long *seed)
+{
+    // xorshift64: the same sequence on every run and every platform.
+    *seed ^= *seed << 13U;
+    *seed ^= *seed >> 7U;
+    *seed ^= *seed << 17U;
+    
+    return *seed;
+}
+
+size_t pick_prefix(struct history *history, size_t size, unsigned long *seed, char *prefix)
+{
+    struct history_entry entry;
+    size_t               length;
+    
+    if (!history_get(history, random_number(seed) % size, &entry))
+    {
+        return 0;
+    }
+    length = (entry.length) ? 1 + random_number(seed) % entry.length : 0;
+    length = (length < BENCH_COMMAND_MAX) ? length : BENCH_COMMAND_MAX;
+    memcpy(prefix, entry.text, length);
+    
+    return length;
+}
+
+void time_suggest(struct history_index *index, size_t size, unsigned long *seed, struct latencies *latencies)
+{
+    struct history_entry entry;
+    struct timespec      start;
+    struct timespec      end;
+    char                 prefix[BENCH_COMMAND_MAX];
+    size_t               length;
+    
+    for (latencies->count = 0; latencies->count < BENCH_LOOKUPS; ++latencies->count)
+    {
+        length = pick_prefix(index->history, size, seed, prefix);
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        (void) history_index_suggest(index, prefix, length, &entry);
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        *(latencies->nanoseconds + latencies->count) = elapsed(&start, &end);
+    }
+}
+
+void time_search(struct history_index *index, size_t size, unsigned long *seed, struct latencies *latencies)
+{
+    struct history_search search;
+    struct history_entry  entry;
+    struct timespec       start;
+    struct timespec       end;
+    char                  prefix[BENCH_COMMAND_MAX];
+    size_t                length;
+    
+    for (latencies->count = 0; latencies->count < BENCH_LOOKUPS; ++latencies->count)
+    {
+        length = pick_prefix(index->history, size, seed, prefix);
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        if (history_index_search_start(index, &search, prefix, length) == 0)
+        {
+            (void) history_index_search_next(index, &search, &entry);
+            history_index_search_end(&search);
+        }
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        *(latencies->nanoseconds + latencies->count) = elapsed(&start, &end);
+    }
+}
+
+void time_scan(struct history *history, size_t size, unsigned long *seed, struct latencies *latencies)
+{
+    struct history_entry entry;
+    struct timespec      start;
+    struct timespec      end;
+    char                 prefix[BENCH_COMMAND_MAX];
+    size_t               length;
+    
+    for (latencies->count = 0; latencies->count < BENCH_SCAN_LOOKUPS; ++latencies->count)
+    {
+        length = pick_prefix(history, size, seed, prefix);
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t n = 0; history_get(history, n, &entry); ++n)
+        {
+            if (entry.length >= length && memcmp(entry.text, prefix, length) == 0)
+            {
+                break;
+            }
+        }
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        *(latencies->nanoseconds + latencies->count) = elapsed(&start, &end);
+    }
+}
+
+long percentile(struct latencies *latencies, size_t percent)
+{
+    qsort(latencies->nanoseconds, latencies->count, sizeof(long), compare_latencies);
+    
+    return *(latencies->nanoseconds + (latencies->count - 1) * percent / 100);
+}
+
+int compare_latencies(const void *a, const void *b)
+{
+    long first;
+    long second;
+    
+    first  = *(const long *) a;
+    second = *(const long *) b;
+    
+    return (first > second) - (first < second);
+}
+
+long elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
@@ -0,0 +1,271 @@
+#include "legacy_parse.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#define IN_DIRECT_REGEX "([ \t\f\v]<.*)"
+#define OUT_DIRECT_REGEX "([ \t\f\v][1]?>[>]?.*)"
+#define ERR_DIRECT_REGEX "([ \t\f\v]2>[>]?.*)"
+#define CMD_REGEX "([^<>]*).*"
+
+/**
+ * legacy_regex_substring
+ * <p>
+ * Run one regular expression over a line and take the part it matched.
+ * </p>
+ * @param regex the regular expression
+ * @param line the line
+ * @param overwrite set if the part is a redirection that truncates, or NULL
+ * @param is_io whether the part is a redirection
+ * @param substring set to the part, or NULL if the expression does not match
+ * @return 0 on success, -1 on failure
+ */
+int legacy_regex_substring(const regex_t *regex, const char *line, bool *overwrite, bool is_io, char **substring);
+
+/**
+ * legacy_check_io
+ * <p>
+ * Walk the operator of a redirection.
+ * </p>
+ * @param line the line
+ * @param rm_so the offset of the whitespace before the operator
+ * @param overwrite set if the redirection truncates, or NULL
+ * @return the offset after the operator, or 0 if the operator is invalid
+ */
+size_t legacy_check_io(const char *line, size_t rm_so, bool *overwrite);
+
+/**
+ * legacy_filename
+ * <p>
+ * Walk the file of a redirection, from the end of its operator to the next whitespace.
+ * </p>
+ * @param line the line
+ * @param st_substr the offset after the operator
+ * @return the file, or NULL on failure
+ */
+char *legacy_filename(const char *line, size_t st_substr);
+
+/**
+ * legacy_expand_filename
+ * <p>
+ * Replace a file by its expansion.
+ * </p>
+ * @param filename the file, freed
+ * @return the expanded file, or NULL on failure
+ */
+char *legacy_expand_filename(char *filename);
+
+int legacy_parser_init(struct legacy_parser *parser)
+{
+    memset(parser, 0, sizeof(struct legacy_parser));
+    if (regcomp(&parser->in_redirect_regex, IN_DIRECT_REGEX, REG_EXTENDED) != 0)
+    {
+        return -1;
+    }
+    if (regcomp(&parser->out_redirect_regex, OUT_DIRECT_REGEX, REG_EXTENDED) != 0)
+    {
+        regfree(&parser->in_redirect_regex);
+        return -1;
+    }
+    if (regcomp(&parser->err_redirect_regex, ERR_DIRECT_REGEX, REG_EXTENDED) != 0)
+    {
+        regfree(&parser->in_redirect_regex);
+        regfree(&parser->out_redirect_regex);
+        return -1;
+    }
+    if (regcomp(&parser->command_regex, CMD_REGEX, REG_EXTENDED) != 0)
+    {
+        regfree(&parser->in_redirect_regex);
+        regfree(&parser->out_redirect_regex);
+        regfree(&parser->err_redirect_regex);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int legacy_parse_line(const struct legacy_parser *parser, const char *line, struct legacy_command *command,
+                      bool expand)
+{
+    char *newline;
+    char **files[3];
+    
+    memset(command, 0, sizeof(struct legacy_command));
+    if (legacy_regex_substring(&parser->command_regex, line, NULL, false, &command->command) == -1
+        || legacy_regex_substring(&parser->in_redirect_regex, line, NULL, true, &command->stdin_file) == -1
+        || legacy_regex_substring(&parser->out_redirect_regex, line, &command->stdout_overwrite, true,
+                               &command->stdout_file) == -1
+        || legacy_regex_substring(&parser->err_redirect_regex, line, &command->stderr_overwrite, true,
+                               &command->stderr_file) == -1)
+    {
+        legacy_command_free(command);
+        return -1;
+    }
+    if (!expand)
+    {
+        return 0;
+    }
+    
+    newline = strchr(command->command, '\n');
+    if (newline)
+    {
+        *newline = '\0';
+    }
+    if (wordexp(command->command, &command->words, 0) != 0) // NOLINT(concurrency-mt-unsafe): no threads here
+    {
+        legacy_command_free(command);
+        return -1;
+    }
+    command->expanded = true;
+    
+    files[0] = &command->stdin_file;
+    files[1] = &command->stdout_file;
+    files[2] = &command->stderr_file;
+    for (size_t i = 0; i < sizeof(files) / sizeof(*files); ++i)
+    {
+        if (!**(files + i))
+        {
+            continue;
+        }
+        
+        **(files + i) = legacy_expand_filename(**(files + i));
+        if (!**(files + i))
+        {
+            legacy_command_free(command);
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+int legacy_regex_substring(const regex_t *regex, const char *line, bool *overwrite, bool is_io, char **substring)
+{
+    regmatch_t regmatch[2];
+    size_t     st_substr;
+    size_t     en_substr;
+    
+    *substring = NULL;
+    switch (regexec(regex, line, 2, regmatch, 0))
+    {
+        case 0:
+        {
+            break;
+        }
+        case REG_NOMATCH:
+        {
+            return 0;
+        }
+        default:
+        {
+            return -1;
+        }
+    }
+    
+    st_substr = (size_t) regmatch[1].rm_so;
+    en_substr = (size_t) regmatch[1].rm_eo;
+    if (is_io)
+    {
+        st_substr = legacy_check_io(line, st_substr, overwrite);
+        if (!st_substr)
+        {
+            return -1;
+        }
+        *substring = legacy_filename(line, st_substr);
+    } else
+    {
+        // If an error io redirect, the regex will not capture the 2.
+        if (en_substr > st_substr && *(line + en_substr - 1) == '2')
+        {
+            --en_substr;
+        }
+        *substring = strndup(line + st_substr, en_substr - st_substr);
+    }
+    
+    return (*substring) ? 0 : -1;
+}
+
+size_t legacy_check_io(const char *line, size_t rm_so, bool *overwrite)
+{
+    size_t st_substr;
+    size_t indicator_count;
+    char   io_indicator;
+    
+    // Regex matches the space character as the first character; adding one will get the first io character.
+    st_substr    = rm_so + 1;
+    io_indicator = (*(line + st_substr) == '2') ? *(line + ++st_substr) : *(line + st_substr);
+    
+    indicator_count = 1;
+    while ((*(line + ++st_substr) == io_indicator) && indicator_count <= 2)
+    {
+        indicator_count++;
+    }
+    
+    if ((io_indicator == '>' && indicator_count > 2) || (io_indicator == '<' && indicator_count > 1))
+    {
+        return 0;
+    }
+    if (overwrite && io_indicator == '>' && indicator_count == 1)
+    {
+        *overwrite = true;
+    }
+    
+    return st_substr;
+}
+
+char *legacy_filename(const char *line, size_t st_substr)
+{
+    size_t en_substr;
+    
+    while (isspace((unsigned char) *(line + st_substr)))
+    {
+        ++st_substr;
+    }
+    
+    // The line ends with a newline, so the walk stops on it at the latest.
+    en_substr = st_substr;
+    while (*(line + en_substr) && !isspace((unsigned char) *(line + en_substr)))
+    {
+        ++en_substr;
+    }
+    
+    return strndup(line + st_substr, en_substr - st_substr);
+}
+
+char *legacy_expand_filename(char *filename)
+{
+    wordexp_t we;
+    char      *expanded;
+    
+    if (wordexp(filename, &we, 0) != 0) // NOLINT(concurrency-mt-unsafe): no threads here
+    {
+        free(filename);
+        return NULL;
+    }
+    expanded = (we.we_wordc) ? strdup(*we.we_wordv) : NULL;
+    wordfree(&we);
+    free(filename);
+    
+    return expanded;
+}
+
+void legacy_command_free(struct legacy_command *command)
+{
+    free(command->command);
+    free(command->stdin_file);
+    free(command->stdout_file);
+    free(command->stderr_file);
+    if (command->expanded)
+    {
+        wordfree(&command->words);
+    }
+    memset(command, 0, sizeof(struct legacy_command));
+}
+
+void legacy_parser_free(struct legacy_parser *parser)
+{
+    regfree(&parser->command_regex);
+    regfree(&parser->in_redirect_regex);
+    regfree(&parser->out_redirect_regex);
+    regfree(&parser->err_redirect_regex);
+}
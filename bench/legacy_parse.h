@@ -0,0 +1,87 @@
+#ifndef CSH_LEGACY_PARSE_H
+#define CSH_LEGACY_PARSE_H
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <wordexp.h>
+
+/**
+ * struct legacy_parser
+ * <p>
+ * The four regular expressions the shell used to parse a line with before it had a tokenizer,
+ * kept for the benchmarks to compare against.
+ * </p>
+ */
+struct legacy_parser
+{
+    regex_t command_regex;          // the command, up to the first redirection
+    regex_t in_redirect_regex;      // < file
+    regex_t out_redirect_regex;     // > file, >> file
+    regex_t err_redirect_regex;     // 2> file, 2>> file
+};
+
+/**
+ * struct legacy_command
+ * <p>
+ * A line parsed by the old path.
+ * </p>
+ */
+struct legacy_command
+{
+    char *command;                  // the command, without its redirections
+    char *stdin_file;               // the file of <, or NULL
+    char *stdout_file;              // the file of > or >>, or NULL
+    char *stderr_file;              // the file of 2> or 2>>, or NULL
+    bool stdout_overwrite;          // whether stdout_file is truncated
+    bool stderr_overwrite;          // whether stderr_file is truncated
+    bool expanded;                  // whether words holds the expanded command
+    wordexp_t words;                // the words of the command, if expanded
+};
+
+/**
+ * legacy_parser_init
+ * <p>
+ * Compile the regular expressions of the old path.
+ * </p>
+ * @param parser the parser
+ * @return 0 on success, -1 on failure
+ */
+int legacy_parser_init(struct legacy_parser *parser);
+
+/**
+ * legacy_parse_line
+ * <p>
+ * Parse a line the way parse_command did: each regular expression is run over the whole line,
+ * and each redirection found is walked a character at a time, as check_io_valid and
+ * get_filename did. Expanding runs wordexp over the command and each file, as expand_cmds and
+ * expand_filename did; without it, only the boundaries are found.
+ * </p>
+ * @param parser the parser
+ * @param line the line, ending with a newline, null terminated
+ * @param command filled with the parts of the line; free with legacy_command_free
+ * @param expand whether to expand the command and the files
+ * @return 0 on success, -1 on failure
+ */
+int legacy_parse_line(const struct legacy_parser *parser, const char *line, struct legacy_command *command,
+                      bool expand);
+
+/**
+ * legacy_command_free
+ * <p>
+ * Free the parts of a parsed line.
+ * </p>
+ * @param command the command
+ */
+void legacy_command_free(struct legacy_command *command);
+
+/**
+ * legacy_parser_free
+ * <p>
+ * Free the regular expressions of the old path.
+ * </p>
+ * @param parser the parser
+ */
+void legacy_parser_free(struct legacy_parser *parser);
+
+#endif //CSH_LEGACY_PARSE_H
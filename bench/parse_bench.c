@@ -0,0 +1,303 @@
+#include "../include/command.h"
+#include "../include/state.h"
+#include "../include/supervisor.h"
+#include "../include/tokenizer.h"
+#include "../include/util.h"
+#include "legacy_parse.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The number of times each path parses the corpus; the fastest run is reported.
+ */
+#define BENCH_ROUNDS 20
+
+/**
+ * The number of times the corpus is parsed in a run, so a run lasts long enough to time.
+ */
+#define BENCH_REPEAT 200
+
+/**
+ * Command lines as found in shell histories and scripts. The old path parsed a line as a single
+ * command with at most one redirection of each stream, so the corpus stays within that for
+ * both paths to do the same work.
+ */
+const char *const corpus[] = {
+        "ls -la /usr/local/bin\n",
+        "grep -rn 'TODO' src/ > todo.txt\n",
+        "make -j8 all 2> build.log\n",
+        "gcc -O2 -Wall -o main main.c util.c\n",
+        "git commit -m \"fix the parser\"\n",
+        "cp -r ./assets /var/www/html/assets\n",
+        "find . -name '*.o' -type f\n",
+        "tar -czf backup.tar.gz docs notes > /dev/null\n",
+        "sort -u < names.txt > sorted.txt\n",
+        "echo \"$HOME/bin\" >> paths.txt\n",
+        "ssh -p 2222 deploy@example.com uptime\n",
+        "curl -sSL https://example.com/install.sh -o install.sh\n",
+        "python3 -m venv .venv\n",
+        "chmod 755 scripts/deploy.sh\n",
+        "mkdir -p build/release/obj\n",
+        "wc -l src/main.c src/util.c > counts.txt 2> errors.txt\n",
+        "cat notes.md > /tmp/notes.bak\n",
+        "diff -u old.c new.c > change.patch\n",
+        "rsync -av --delete src/ backup/src/\n",
+        "kill -TERM 12345\n",
+        "cd ~/projects/csh\n",
+        "awk '{ print $1 }' access.log > ips.txt\n",
+        "sed -e 's/foo/bar/g' input.txt > output.txt\n",
+        "vim +42 src/execute.c\n",
+        "ping -c 3 10.0.0.1 > ping.log\n",
+        "journalctl -u nginx --since today\n",
+        "docker build -t app:latest .\n",
+        "ssh-keygen -t ed25519 -C \"me@example.com\"\n",
+};
+
+/**
+ * The paths being timed.
+ */
+enum parse_path
+{
+    PARSE_PATH_REGEX,           // the old path, finding the command and redirections only
+    PARSE_PATH_REGEX_WORDEXP,   // the old path, with the words expanded as parse_command did
+    PARSE_PATH_TOKENIZER,       // the tokenizer and parser, every line lexed
+    PARSE_PATH_CACHED,          // the tokenizer and parser, lines seen before replayed from the parse cache
+};
+
+/**
+ * parse_legacy
+ * <p>
+ * Parse the corpus once with the old path.
+ * </p>
+ * @param parser the old path's regular expressions
+ * @param expand whether to expand the words as well
+ * @return 0 on success, -1 if a line did not parse
+ */
+int parse_legacy(const struct legacy_parser *parser, bool expand);
+
+/**
+ * parse_corpus
+ * <p>
+ * Parse the corpus once as the shell does now: lex each line, split it into commands, check
+ * their redirections and expand their words, then reset the state for the next line.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state
+ * @return 0 on success, -1 if a line did not parse
+ */
+int parse_corpus(struct supervisor *supvis, struct state *state);
+
+/**
+ * run_path
+ * <p>
+ * Parse the corpus BENCH_REPEAT times with one path.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state
+ * @param parser the old path's regular expressions
+ * @param path the path
+ * @return 0 on success, -1 if a line did not parse
+ */
+int run_path(struct supervisor *supvis, struct state *state, const struct legacy_parser *parser,
+             enum parse_path path);
+
+/**
+ * time_path
+ * <p>
+ * Time a path over BENCH_ROUNDS runs and print its best time per line.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state
+ * @param parser the old path's regular expressions
+ * @param name the name printed for the path
+ * @param path the path
+ * @return 0 on success, -1 if a line did not parse
+ */
+int time_path(struct supervisor *supvis, struct state *state, const struct legacy_parser *parser, const char *name,
+              enum parse_path path);
+
+/**
+ * elapsed
+ * <p>
+ * The nanoseconds between two times.
+ * </p>
+ * @param start the earlier time
+ * @param end the later time
+ * @return the nanoseconds
+ */
+long elapsed(const struct timespec *start, const struct timespec *end);
+
+int main(void)
+{
+    struct supervisor    *supvis;
+    struct legacy_parser parser;
+    struct state         state;
+    int                  status;
+    
+    if (legacy_parser_init(&parser) == -1)
+    {
+        (void) fprintf(stderr, "parse_bench: could not compile the regular expressions\n");
+        return EXIT_FAILURE;
+    }
+    
+    // A shell running a command string: not interactive, and reading nothing from stdin.
+    supvis = init_supervisor();
+    memset(&state, 0, sizeof(struct state));
+    state.stdin          = stdin;
+    state.stdout         = stdout;
+    state.stderr         = stderr;
+    state.command_string = "";
+    errno                = 0;
+    if (!supvis || !do_init_state(supvis, &state) || state.fatal_error)
+    {
+        (void) fprintf(stderr, "parse_bench: could not set up the shell\n");
+        legacy_parser_free(&parser);
+        return EXIT_FAILURE;
+    }
+    
+    (void) printf("%zu command lines, parsed %d times a run, best of %d runs\n", sizeof(corpus) / sizeof(*corpus),
+                  BENCH_REPEAT, BENCH_ROUNDS);
+    status = time_path(supvis, &state, &parser, "regex", PARSE_PATH_REGEX);
+    if (status == 0)
+    {
+        status = time_path(supvis, &state, &parser, "regex+wordexp", PARSE_PATH_REGEX_WORDEXP);
+    }
+    if (status == 0)
+    {
+        status = time_path(supvis, &state, &parser, "tokenizer", PARSE_PATH_TOKENIZER);
+    }
+    if (status == 0)
+    {
+        status = time_path(supvis, &state, &parser, "tokenizer+cache", PARSE_PATH_CACHED);
+    }
+    
+    do_destroy_state(supvis, &state);
+    destroy_supervisor(supvis);
+    legacy_parser_free(&parser);
+    
+    return (status == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int parse_legacy(const struct legacy_parser *parser, bool expand)
+{
+    struct legacy_command command;
+    
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(*corpus); ++i)
+    {
+        if (legacy_parse_line(parser, *(corpus + i), &command, expand) == -1)
+        {
+            (void) fprintf(stderr, "parse_bench: the old path did not parse %s", *(corpus + i));
+            return -1;
+        }
+        legacy_command_free(&command);
+    }
+    
+    return 0;
+}
+
+int parse_corpus(struct supervisor *supvis, struct state *state)
+{
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(*corpus); ++i)
+    {
+        // The shell hands the tokenizer a line without its newline.
+        tokenizer_feed_line(state->tokenizer, *(corpus + i), strlen(*(corpus + i)) - 1);
+        do_separate_commands(supvis, state);
+        if (!errno)
+        {
+            do_parse_commands(supvis, state);
+        }
+        for (struct command *command = state->commands; command && !errno; command = command->next)
+        {
+            parse_command(supvis, state, command);
+        }
+        if (errno || state->fatal_error)
+        {
+            (void) fprintf(stderr, "parse_bench: the tokenizer did not parse %s", *(corpus + i));
+            return -1;
+        }
+        do_reset_state(supvis, state);
+    }
+    
+    return 0;
+}
+
+int run_path(struct supervisor *supvis, struct state *state, const struct legacy_parser *parser,
+             enum parse_path path)
+{
+    struct parse_cache *cache;
+    int                status;
+    
+    cache                  = state->tokenizer->cache;
+    state->tokenizer->cache = (path == PARSE_PATH_CACHED) ? cache : NULL;
+    status                 = 0;
+    for (int i = 0; i < BENCH_REPEAT && status == 0; ++i)
+    {
+        switch (path)
+        {
+            case PARSE_PATH_REGEX:
+            case PARSE_PATH_REGEX_WORDEXP:
+            {
+                status = parse_legacy(parser, path == PARSE_PATH_REGEX_WORDEXP);
+                break;
+            }
+            case PARSE_PATH_TOKENIZER:
+            case PARSE_PATH_CACHED:
+            {
+                status = parse_corpus(supvis, state);
+                break;
+            }
+            default:
+            {
+                status = -1;
+            }
+        }
+    }
+    state->tokenizer->cache = cache;
+    
+    return status;
+}
+
+int time_path(struct supervisor *supvis, struct state *state, const struct legacy_parser *parser, const char *name,
+              enum parse_path path)
+{
+    struct timespec start;
+    struct timespec end;
+    long            best;
+    long            nanoseconds;
+    long            lines;
+    
+    // A first run checks that every line parses, and fills the parse cache.
+    if (run_path(supvis, state, parser, path) == -1)
+    {
+        return -1;
+    }
+    best = 0;
+    for (int i = 0; i < BENCH_ROUNDS; ++i)
+    {
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        if (run_path(supvis, state, parser, path) == -1)
+        {
+            return -1;
+        }
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        nanoseconds = elapsed(&start, &end);
+        if (i == 0 || nanoseconds < best)
+        {
+            best = nanoseconds;
+        }
+    }
+    
+    lines = (long) (sizeof(corpus) / sizeof(*corpus)) * BENCH_REPEAT;
+    (void) printf("%-16s %7ld ns/line %10ld lines/s\n", name, best / lines,
+                  (best) ? lines * 1000000000L / best : 0);
+    
+    return 0;
+}
+
+long elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
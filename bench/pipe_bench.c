@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The number of bytes sent down the pipeline, large enough that starting its processes is lost
+ * in the time spent moving the data.
+ */
+#define BENCH_BYTES ((long) 1024 * 1024 * 1024)
+
+/**
+ * The number of times the pipeline runs at each pipe size; the fastest run is reported.
+ */
+#define BENCH_ROUNDS 5
+
+/**
+ * The longest command line given to the shell.
+ */
+#define BENCH_COMMAND_MAX 256
+
+/**
+ * run_pipeline
+ * <p>
+ * Run a three stage pipeline in the shell, producer to filter to consumer, with pipes of a
+ * size, and wait for it.
+ * </p>
+ * @param shell the path of the shell
+ * @param pipe_size the size of the pipes asked for with set -o pipesize, or 0 for the default
+ * @return 0 on success, -1 if the shell could not run or the pipeline failed
+ */
+int run_pipeline(const char *shell, int pipe_size);
+
+/**
+ * time_pipeline
+ * <p>
+ * Time the pipeline over BENCH_ROUNDS runs and print its best throughput.
+ * </p>
+ * @param shell the path of the shell
+ * @param pipe_size the size of the pipes, or 0 for the default
+ * @return 0 on success, -1 on failure
+ */
+int time_pipeline(const char *shell, int pipe_size);
+
+/**
+ * elapsed
+ * <p>
+ * The nanoseconds between two times.
+ * </p>
+ * @param start the earlier time
+ * @param end the later time
+ * @return the nanoseconds
+ */
+long elapsed(const struct timespec *start, const struct timespec *end);
+
+int main(int argc, char *argv[])
+{
+    // 0 leaves the pipes at the system's default, 64 KiB on Linux.
+    const int pipe_sizes[] = {0, 256 * 1024, 1024 * 1024};
+    int       status;
+    
+    if (argc != 2)
+    {
+        (void) fprintf(stderr, "usage: pipe_bench <path of csh>\n");
+        return EXIT_FAILURE;
+    }
+    
+    (void) printf("head -c %ld /dev/zero | cat | cat > /dev/null, best of %d runs\n", BENCH_BYTES, BENCH_ROUNDS);
+    status = 0;
+    for (size_t i = 0; status == 0 && i < sizeof(pipe_sizes) / sizeof(*pipe_sizes); ++i)
+    {
+        status = time_pipeline(argv[1], *(pipe_sizes + i));
+    }
+    
+    return (status == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int run_pipeline(const char *shell, int pipe_size)
+{
+    char  command[BENCH_COMMAND_MAX];
+    pid_t pid;
+    int   length;
+    int   status;
+    
+    if (pipe_size)
+    {
+        length = snprintf(command, sizeof(command),
+                          "set -o pipesize=%d; head -c %ld /dev/zero | cat | cat > /dev/null", pipe_size,
+                          BENCH_BYTES);
+    } else
+    {
+        length = snprintf(command, sizeof(command), "head -c %ld /dev/zero | cat | cat > /dev/null", BENCH_BYTES);
+    }
+    if (length < 0 || (size_t) length >= sizeof(command))
+    {
+        return -1;
+    }
+    
+    // Anything printed so far goes out once, not again from the child.
+    (void) fflush(stdout);
+    pid = fork();
+    if (pid == -1)
+    {
+        return -1;
+    }
+    if (pid == 0)
+    {
+        (void) execl(shell, shell, "-c", command, (char *) NULL);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) == -1)
+    {
+        return -1;
+    }
+    
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+int time_pipeline(const char *shell, int pipe_size)
+{
+    struct timespec start;
+    struct timespec end;
+    long            best;
+    long            nanoseconds;
+    
+    best = 0;
+    for (int i = 0; i < BENCH_ROUNDS; ++i)
+    {
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        if (run_pipeline(shell, pipe_size) == -1)
+        {
+            (void) fprintf(stderr, "pipe_bench: the pipeline failed under %s\n", shell);
+            return -1;
+        }
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        nanoseconds = elapsed(&start, &end);
+        if (i == 0 || nanoseconds < best)
+        {
+            best = nanoseconds;
+        }
+    }
+    
+    // Bytes per nanosecond are gigabytes per second; a thousand times that is megabytes.
+    if (pipe_size)
+    {
+        (void) printf("pipesize=%-8d", pipe_size);
+    } else
+    {
+        (void) printf("%-17s", "default");
+    }
+    (void) printf(" %9.1f MB/s\n", (double) BENCH_BYTES * 1000 / (double) ((best) ? best : 1));
+    
+    return 0;
+}
+
+long elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
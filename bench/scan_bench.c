@@ -0,0 +1,319 @@
+#include "../include/scanner.h"
+#include "legacy_parse.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The scanning paths of scanner.c, timed one by one rather than through the dispatch of
+ * scan_structure.
+ */
+int scan_scalar(struct scan_index *index, const char *text, size_t offset, size_t length);
+#if defined(__SSE2__)
+int scan_sse2(struct scan_index *index, const char *text, size_t length, size_t *offset);
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+int scan_avx2(struct scan_index *index, const char *text, size_t length, size_t *offset);
+#endif
+
+/**
+ * The size of the script scanned, large enough that the timings are not lost in clock jitter.
+ */
+#define BENCH_SCRIPT_SIZE ((size_t) 64 * 1024 * 1024)
+
+/**
+ * The part of the script the old path parses. It runs at a few megabytes a second, so it gets
+ * the first few megabytes; its throughput is per byte all the same.
+ */
+#define BENCH_LEGACY_SIZE ((size_t) 2 * 1024 * 1024)
+
+/**
+ * The number of times each path scans the script; the fastest run is reported.
+ */
+#define BENCH_ROUNDS 10
+
+/**
+ * The longest line of the script, for the old path, which parses a null terminated copy of
+ * each line as getline gave it.
+ */
+#define BENCH_LINE_MAX 4096
+
+/**
+ * The paths being timed.
+ */
+enum scan_path
+{
+    SCAN_PATH_LEGACY,
+    SCAN_PATH_SCALAR,
+    SCAN_PATH_SSE2,
+    SCAN_PATH_AVX2,
+};
+
+/**
+ * fill_script
+ * <p>
+ * Fill a buffer with copies of a script of ordinary density: words, quotes, pipes, redirections
+ * and comments.
+ * </p>
+ * @param text the buffer
+ * @param length the size of the buffer
+ */
+void fill_script(char *text, size_t length);
+
+/**
+ * run_path
+ * <p>
+ * Scan a script once with one path, the tail left by a vector path done a byte at a time as
+ * scan_structure does.
+ * </p>
+ * @param index the index to fill
+ * @param parser the old path's regular expressions
+ * @param path the path
+ * @param text the script
+ * @param length the length of the script
+ * @param found set to the number of structural bytes indexed, or of lines the old path parsed
+ * @return 0 on success, -1 on failure
+ */
+int run_path(struct scan_index *index, const struct legacy_parser *parser, enum scan_path path, const char *text,
+             size_t length, size_t *found);
+
+/**
+ * run_legacy
+ * <p>
+ * Find the command and redirections of each line of a script the way the shell did before the
+ * scanner: each line copied out as getline did, then parsed by the four regular expressions and
+ * walked by check_io_valid and get_filename.
+ * </p>
+ * @param parser the old path's regular expressions
+ * @param text the script
+ * @param length the length of the script
+ * @param found set to the number of lines parsed
+ * @return 0 on success, -1 on failure
+ */
+int run_legacy(const struct legacy_parser *parser, const char *text, size_t length, size_t *found);
+
+/**
+ * time_path
+ * <p>
+ * Time a path over BENCH_ROUNDS scans of a script and print its best throughput.
+ * </p>
+ * @param parser the old path's regular expressions
+ * @param name the name printed for the path
+ * @param path the path
+ * @param text the script
+ * @param length the length of the script
+ * @return 0 on success, -1 on failure
+ */
+int time_path(const struct legacy_parser *parser, const char *name, enum scan_path path, const char *text,
+              size_t length);
+
+/**
+ * elapsed
+ * <p>
+ * The nanoseconds between two times.
+ * </p>
+ * @param start the earlier time
+ * @param end the later time
+ * @return the nanoseconds
+ */
+long elapsed(const struct timespec *start, const struct timespec *end);
+
+int main(void)
+{
+    struct legacy_parser parser;
+    char                 *text;
+    int                  status;
+    
+    if (legacy_parser_init(&parser) == -1)
+    {
+        (void) fprintf(stderr, "scan_bench: could not compile the regular expressions\n");
+        return EXIT_FAILURE;
+    }
+    text = (char *) malloc(BENCH_SCRIPT_SIZE);
+    if (!text)
+    {
+        (void) fprintf(stderr, "scan_bench: out of memory\n");
+        legacy_parser_free(&parser);
+        return EXIT_FAILURE;
+    }
+    fill_script(text, BENCH_SCRIPT_SIZE);
+    
+    (void) printf("%zu MiB script (the old path parses the first %zu MiB), best of %d scans\n",
+                  BENCH_SCRIPT_SIZE / (1024 * 1024), BENCH_LEGACY_SIZE / (1024 * 1024), BENCH_ROUNDS);
+    status = time_path(&parser, "regex", SCAN_PATH_LEGACY, text, BENCH_LEGACY_SIZE);
+    if (status == 0)
+    {
+        status = time_path(&parser, "scalar", SCAN_PATH_SCALAR, text, BENCH_SCRIPT_SIZE);
+    }
+#if defined(__SSE2__)
+    if (status == 0)
+    {
+        status = time_path(&parser, "sse2", SCAN_PATH_SSE2, text, BENCH_SCRIPT_SIZE);
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    if (status == 0 && __builtin_cpu_supports("avx2"))
+    {
+        status = time_path(&parser, "avx2", SCAN_PATH_AVX2, text, BENCH_SCRIPT_SIZE);
+    }
+#endif
+    free(text);
+    legacy_parser_free(&parser);
+    
+    return (status == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void fill_script(char *text, size_t length)
+{
+    const char *sample;
+    size_t     sample_length;
+    size_t     copied;
+    size_t     chunk;
+    
+    sample = "# rotate the logs of the day\n"
+             "for file in /var/log/app/*.log; do\n"
+             "    name=\"${file##*/}\"\n"
+             "    grep -v 'DEBUG' \"$file\" | gzip -c > \"/srv/archive/${name}.gz\" && rm -f \"$file\"\n"
+             "    echo \"rotated $name\" >> /srv/archive/rotate.log 2>&1\n"
+             "done\n"
+             "test -d /srv/archive/old || mkdir -p /srv/archive/old; echo done\n";
+    sample_length = strlen(sample);
+    
+    for (copied = 0; copied < length; copied += chunk)
+    {
+        chunk = (length - copied < sample_length) ? length - copied : sample_length;
+        memcpy(text + copied, sample, chunk);
+    }
+}
+
+int run_path(struct scan_index *index, const struct legacy_parser *parser, enum scan_path path, const char *text,
+             size_t length, size_t *found)
+{
+    size_t offset;
+    int    status;
+    
+    index->count = 0;
+    offset       = 0;
+    status       = 0;
+    switch (path)
+    {
+        case SCAN_PATH_LEGACY:
+        {
+            return run_legacy(parser, text, length, found);
+        }
+        case SCAN_PATH_SCALAR:
+        {
+            break;
+        }
+#if defined(__SSE2__)
+        case SCAN_PATH_SSE2:
+        {
+            status = scan_sse2(index, text, length, &offset);
+            break;
+        }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+        case SCAN_PATH_AVX2:
+        {
+            status = scan_avx2(index, text, length, &offset);
+            break;
+        }
+#endif
+        default:
+        {
+            return -1;
+        }
+    }
+    if (status == -1 || scan_scalar(index, text, offset, length) == -1)
+    {
+        return -1;
+    }
+    *found = index->count;
+    
+    return 0;
+}
+
+int run_legacy(const struct legacy_parser *parser, const char *text, size_t length, size_t *found)
+{
+    struct legacy_command command;
+    char                  line[BENCH_LINE_MAX];
+    const char            *newline;
+    size_t                offset;
+    size_t                line_length;
+    
+    *found = 0;
+    for (offset = 0; offset < length; offset += line_length)
+    {
+        newline     = memchr(text + offset, '\n', length - offset);
+        line_length = (newline) ? (size_t) (newline - (text + offset)) + 1 : length - offset;
+        if (line_length >= sizeof(line))
+        {
+            return -1;
+        }
+        memcpy(line, text + offset, line_length);
+        *(line + line_length) = '\0';
+        
+        // A line cut short by the end of the buffer is not a line getline would have given.
+        if (!newline)
+        {
+            break;
+        }
+        if (legacy_parse_line(parser, line, &command, false) == -1)
+        {
+            return -1;
+        }
+        legacy_command_free(&command);
+        ++*found;
+    }
+    
+    return 0;
+}
+
+int time_path(const struct legacy_parser *parser, const char *name, enum scan_path path, const char *text,
+              size_t length)
+{
+    struct scan_index index;
+    struct timespec   start;
+    struct timespec   end;
+    size_t            found;
+    long              best;
+    long              nanoseconds;
+    
+    memset(&index, 0, sizeof(index));
+    best = 0;
+    
+    // A first scan grows the index to its full size, so the rounds time scanning alone.
+    if (run_path(&index, parser, path, text, length, &found) == -1)
+    {
+        scan_free(&index);
+        return -1;
+    }
+    for (int i = 0; i < BENCH_ROUNDS; ++i)
+    {
+        (void) clock_gettime(CLOCK_MONOTONIC, &start);
+        if (run_path(&index, parser, path, text, length, &found) == -1)
+        {
+            scan_free(&index);
+            return -1;
+        }
+        (void) clock_gettime(CLOCK_MONOTONIC, &end);
+        nanoseconds = elapsed(&start, &end);
+        if (i == 0 || nanoseconds < best)
+        {
+            best = nanoseconds;
+        }
+    }
+    
+    // Bytes per nanosecond are gigabytes per second; a thousand times that is megabytes.
+    (void) printf("%-8s %9.1f MB/s  %zu %s\n", name, (double) length * 1000 / (double) ((best) ? best : 1), found,
+                  (path == SCAN_PATH_LEGACY) ? "lines parsed" : "structural bytes");
+    scan_free(&index);
+    
+    return 0;
+}
+
+long elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
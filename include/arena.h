@@ -0,0 +1,145 @@
+#ifndef CSH_ARENA_H
+#define CSH_ARENA_H
+
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/**
+ * The size of the first block of an arena. Later blocks double in size.
+ */
+#define ARENA_BLOCK_SIZE 4096
+
+/**
+ * struct arena_block
+ * <p>
+ * A block of memory handed out by an arena.
+ * </p>
+ */
+struct arena_block
+{
+    struct arena_block *next;   // the block filled before this one
+    size_t size;                // bytes in data
+    size_t used;                // bytes of data handed out
+    max_align_t data[];         // the memory
+};
+
+/**
+ * struct arena
+ * <p>
+ * A bump allocator for the memory of one command. Allocating is an addition in the current
+ * block; nothing is freed on its own, and arena_reset releases everything at once. The largest
+ * block is kept, so once it has grown to fit a command, commands allocate no memory at all.
+ * </p>
+ * <p>
+ * An object of unknown size (eg. an argument list) can be grown at the top of the arena with
+ * arena_grow and completed with arena_finish; no other allocation may be made in between.
+ * </p>
+ */
+struct arena
+{
+    struct arena_block *block;  // the block being filled, NULL until the first allocation
+    size_t object_start;        // offset in block of the object being grown
+    bool growing;               // whether an object is being grown
+    unsigned long blocks;       // number of blocks allocated since the arena was created
+};
+
+/**
+ * arena_create
+ * <p>
+ * Create an empty arena.
+ * </p>
+ * @param supvis the supervisor object
+ * @return the arena, or NULL on failure
+ */
+struct arena *arena_create(struct supervisor *supvis);
+
+/**
+ * arena_alloc
+ * <p>
+ * Allocate memory from an arena, aligned for any type.
+ * </p>
+ * @param arena the arena
+ * @param size the number of bytes
+ * @return the memory, or NULL on failure
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * arena_calloc
+ * <p>
+ * Allocate zeroed memory for an array from an arena.
+ * </p>
+ * @param arena the arena
+ * @param count the number of elements
+ * @param size the size of an element
+ * @return the memory, or NULL on failure
+ */
+void *arena_calloc(struct arena *arena, size_t count, size_t size);
+
+/**
+ * arena_strndup
+ * <p>
+ * Copy a string into an arena.
+ * </p>
+ * @param arena the arena
+ * @param text the string (need not be null terminated)
+ * @param length the length of the string
+ * @return the null terminated copy, or NULL on failure
+ */
+char *arena_strndup(struct arena *arena, const char *text, size_t length);
+
+/**
+ * arena_grow
+ * <p>
+ * Append bytes to the object being grown, beginning one if none is. The object may move.
+ * </p>
+ * @param arena the arena
+ * @param data the bytes, or NULL to append zeros
+ * @param length the number of bytes
+ * @return 0 on success, -1 on failure
+ */
+int arena_grow(struct arena *arena, const void *data, size_t length);
+
+/**
+ * arena_object_size
+ * <p>
+ * Get the number of bytes in the object being grown.
+ * </p>
+ * @param arena the arena
+ * @return the number of bytes, 0 if no object is being grown
+ */
+size_t arena_object_size(const struct arena *arena);
+
+/**
+ * arena_finish
+ * <p>
+ * Complete the object being grown. It no longer moves.
+ * </p>
+ * @param arena the arena
+ * @return the object, or NULL if it is empty
+ */
+void *arena_finish(struct arena *arena);
+
+/**
+ * arena_reset
+ * <p>
+ * Release everything allocated from an arena. The largest block is kept for reuse.
+ * </p>
+ * @param arena the arena
+ */
+void arena_reset(struct arena *arena);
+
+/**
+ * arena_destroy
+ * <p>
+ * Free an arena and all its blocks.
+ * </p>
+ * @param supvis the supervisor object
+ * @param arena the arena
+ */
+void arena_destroy(struct supervisor *supvis, struct arena *arena);
+
+#endif //CSH_ARENA_H
@@ -0,0 +1,152 @@
+#ifndef CSH_ARITH_H
+#define CSH_ARITH_H
+
+#include "state.h"
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * The number of compiled expressions kept. A power of two.
+ */
+#define ARITH_CACHE_SIZE 64
+
+/**
+ * The longest variable name an expression may use.
+ */
+#define ARITH_NAME_MAX 255
+
+/**
+ * arith_opcode
+ * <p>
+ * The operations of a compiled expression. The operations work on a stack of values: each takes
+ * its operands from the top of the stack and pushes its result.
+ * </p>
+ */
+enum arith_opcode
+{
+    ARITH_PUSH,             // push value
+    ARITH_LOAD,             // push the value of a variable
+    ARITH_STORE,            // pop a value, combine it with the variable by binary, set the variable and push it
+    ARITH_POP,              // drop the top value
+    ARITH_STATUS,           // push $?
+    ARITH_PID,              // push $$
+    ARITH_NEGATE,           // -a
+    ARITH_NOT,              // !a
+    ARITH_COMPLEMENT,       // ~a
+    ARITH_TRUTH,            // a != 0, as 0 or 1
+    ARITH_MULTIPLY,         // a * b
+    ARITH_DIVIDE,           // a / b
+    ARITH_REMAINDER,        // a % b
+    ARITH_ADD,              // a + b
+    ARITH_SUBTRACT,         // a - b
+    ARITH_SHIFT_LEFT,       // a << b
+    ARITH_SHIFT_RIGHT,      // a >> b
+    ARITH_LESS,             // a < b
+    ARITH_LESS_EQUAL,       // a <= b
+    ARITH_GREATER,          // a > b
+    ARITH_GREATER_EQUAL,    // a >= b
+    ARITH_EQUAL,            // a == b
+    ARITH_NOT_EQUAL,        // a != b
+    ARITH_BIT_AND,          // a & b
+    ARITH_BIT_XOR,          // a ^ b
+    ARITH_BIT_OR,           // a | b
+    ARITH_JUMP,             // go to the op at value
+    ARITH_JUMP_IF_ZERO,     // pop a value; if it is 0, go to the op at value
+    ARITH_JUMP_IF_NONZERO   // pop a value; if it is not 0, go to the op at value
+};
+
+/**
+ * struct arith_op
+ * <p>
+ * One operation of a compiled expression.
+ * </p>
+ */
+struct arith_op
+{
+    enum arith_opcode code;     // what the operation does
+    enum arith_opcode binary;   // ARITH_STORE: the operator of a compound assignment, ARITH_PUSH for =
+    int64_t value;              // ARITH_PUSH: the constant; jumps: the index of the op to go to
+    size_t name;                // ARITH_LOAD, ARITH_STORE: offset of the variable name in the expression
+    size_t name_length;         // ARITH_LOAD, ARITH_STORE: length of the variable name
+};
+
+/**
+ * struct arith_entry
+ * <p>
+ * An expression of a $((...)) and the operations it compiles to. Variables are read and set
+ * when the operations run, so the same entry serves every evaluation of the expression.
+ * </p>
+ */
+struct arith_entry
+{
+    uint64_t hash;              // hash of the expression
+    size_t length;              // length of the expression
+    struct arith_op *ops;       // the operations, in order
+    size_t op_count;            // number of operations
+    size_t op_capacity;         // number of operations allocated
+    int64_t *stack;             // room for the values of the expression while it runs (op_count of them)
+    char text[];                // the expression, null terminated
+};
+
+/**
+ * struct arith_cache
+ * <p>
+ * The expressions most recently compiled, so an expression met again is run from its compiled
+ * form rather than parsed again. An expression goes in the slot its hash selects, replacing the
+ * one there.
+ * </p>
+ */
+struct arith_cache
+{
+    struct arith_entry *entries[ARITH_CACHE_SIZE];  // compiled expressions, by hash
+    unsigned long hits;                             // lookups that found the expression compiled
+    unsigned long misses;                           // lookups that compiled it
+};
+
+/**
+ * arith_compile
+ * <p>
+ * Get the compiled form of an expression, from the cache or by compiling it. The expression has
+ * the syntax of C integer expressions on 64-bit values: constants in decimal, octal or hex,
+ * variables by name (or as $NAME, ${NAME}), $? and $$, and every C operator but the ones for
+ * pointers, including assignment, ++, --, ?: and the comma. On a syntax error, a message is
+ * printed and errno is set to EINVAL.
+ * </p>
+ * @param cache the cache
+ * @param text the expression (not null terminated)
+ * @param length the length of the expression
+ * @param ostream the stream on which to print errors
+ * @return the compiled expression, or NULL on failure
+ */
+const struct arith_entry *arith_compile(struct arith_cache *cache, const char *text, size_t length, FILE *ostream);
+
+/**
+ * arith_evaluate
+ * <p>
+ * Run a compiled expression. Variables are environment variables: an unset or empty one is 0,
+ * and an assignment exports the result. Arithmetic wraps around on overflow. On division by zero
+ * or a variable that does not hold an integer, a message is printed to state->stdout and errno
+ * is set to EINVAL.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param entry the compiled expression
+ * @param result set to the value of the expression
+ * @return 0 on success, -1 on failure
+ */
+int arith_evaluate(struct supervisor *supvis, struct state *state, const struct arith_entry *entry, int64_t *result);
+
+/**
+ * arith_cache_destroy
+ * <p>
+ * Free a cache and the expressions in it.
+ * </p>
+ * @param cache the cache
+ */
+void arith_cache_destroy(struct arith_cache *cache);
+
+#endif //CSH_ARITH_H
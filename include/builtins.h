@@ -4,6 +4,16 @@
 #include "command.h"
 #include "supervisor.h"
 
+/**
+ * is_builtin
+ * <p>
+ * Check whether a command is run by the shell itself.
+ * </p>
+ * @param name the command name
+ * @return true if the command is a builtin, false otherwise
+ */
+bool is_builtin(const char *name);
+
 /**
  * builtin_cd
  * <p>
@@ -16,16 +26,111 @@
  */
 int builtin_cd(struct command *command, FILE *ostream);
 
+/**
+ * builtin_exit
+ * <p>
+ * Set the status the shell exits with: the number given, modulo 256, or the status of the last
+ * command run if there is none. A word that is not a number is reported and exits with 2; more
+ * than one argument is reported and does not exit.
+ * </p>
+ * @param state the state object holding the status of the last command
+ * @param command the command structure, whose exit_code is set
+ * @param ostream the stream on which to print errors
+ * @return 0 if the shell exits, -1 otherwise
+ */
+int builtin_exit(const struct state *state, struct command *command, FILE *ostream);
+
 /**
  * builtin_which
  * <p>
- * Print to the stream specified by ostream the location of a command that exists on the path.
+ * Print to the stream specified by ostream the file a command runs: the command itself if it
+ * holds a '/', otherwise the file found for it on the path through the command hash table.
  * </p>
+ * @param state the state object holding the command hash table
  * @param cmd the command to search for
- * @param path the path on which to search
  * @param ostream the stream on which to print the result
  * @return 0 on success, -1 on failure
  */
-int builtin_which(char *cmd, char **path, FILE *ostream);
+int builtin_which(struct state *state, const char *cmd, FILE *ostream);
+
+/**
+ * builtin_hash
+ * <p>
+ * Manage the table of where commands were found on the path. With no arguments, print each
+ * command with the number of times it was looked up and its file. hash -r forgets every command,
+ * hash -d name... forgets the ones named, and hash name... searches the path for them again.
+ * </p>
+ * @param state the state object holding the command hash table
+ * @param command the command structure
+ * @param ostream the stream on which to print the table and errors
+ * @return 0 on success, -1 on failure
+ */
+int builtin_hash(struct state *state, struct command *command, FILE *ostream);
+
+/**
+ * builtin_exec
+ * <p>
+ * Do the redirections of exec on the shell itself, so they last for the commands after it:
+ * exec 3>>log opens a descriptor every later command can write to with >&3, and exec 3>&-
+ * closes it. The shell's own descriptors cannot be redirected. Replacing the shell with a
+ * command is not supported.
+ * </p>
+ * @param state the state object
+ * @param command the command structure
+ * @param ostream the stream on which to print errors
+ * @return 0 on success, -1 on failure
+ */
+int builtin_exec(struct state *state, struct command *command, FILE *ostream);
+
+/**
+ * builtin_compgen
+ * <p>
+ * Print the completions of a word, one per line: command names on the path (compgen -c word)
+ * or file names (compgen -f word), with a '/' after directories.
+ * </p>
+ * @param state the state object holding the completion engine
+ * @param command the command structure
+ * @param ostream the stream on which to print the completions and errors
+ * @return 0 on success, -1 on failure
+ */
+int builtin_compgen(struct state *state, struct command *command, FILE *ostream);
+
+/**
+ * builtin_history
+ * <p>
+ * Print the most recent commands in the history (history [count]), oldest first, with when each
+ * was entered, its exit code and how long it took. Prints 16 commands if no count is given.
+ * With -s prefix, print the distinct commands starting with prefix, most recent first.
+ * </p>
+ * @param state the state object holding the history
+ * @param command the command structure
+ * @param ostream the stream on which to print the history and errors
+ * @return 0 on success, -1 on failure
+ */
+int builtin_history(struct state *state, struct command *command, FILE *ostream);
+
+/**
+ * builtin_set
+ * <p>
+ * Turn shell options on (set -o option) or off (set +o option). With no option named, print
+ * the options and whether each is on.
+ * </p>
+ * <ul>
+ * <li>exportpwd: export PWD and OLDPWD, kept in step with the cached working directory</li>
+ * <li>forkexec: start external commands with fork and exec instead of posix_spawn</li>
+ * <li>promptdeadline=N: wait at most N milliseconds for slow prompt segments (-o only)</li>
+ * <li>parsecache=N: keep the tokens of the last N distinct lines (+o parsecache turns the cache
+ * off); the options listing shows its hits and misses</li>
+ * <li>pipefail: a pipeline's status is that of its last stage to fail, not of its last stage</li>
+ * <li>pipesize=N: ask for pipes of N bytes between the stages of a pipeline (+o pipesize
+ * restores the system default); ignored where pipes cannot be resized</li>
+ * </ul>
+ * @param supvis the supervisor object
+ * @param state the state object holding the options
+ * @param command the command structure
+ * @param ostream the stream on which to print options and errors
+ * @return 0 on success, -1 on failure
+ */
+int builtin_set(struct supervisor *supvis, struct state *state, struct command *command, FILE *ostream);
 
 #endif //CSH_BUILTINS_H
@@ -6,32 +6,91 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <sys/types.h>
+
+/**
+ * The status of a line that does not parse, as in other shells.
+ */
+#define PARSE_ERROR_STATUS 2
+
+/**
+ * command_separator
+ * <p>
+ * How a command of a list follows the command before it.
+ * </p>
+ */
+enum command_separator
+{
+    SEPARATOR_SEQUENCE,     // ; (or the first command of the line): always run
+    SEPARATOR_AND,          // &&: run if the last command run succeeded
+    SEPARATOR_OR,           // ||: run if the last command run failed
+    SEPARATOR_PIPE          // |: read the output of the command before it, in the same pipeline
+};
+
+/**
+ * redirection_kind
+ * <p>
+ * What a redirection does to its descriptor.
+ * </p>
+ */
+enum redirection_kind
+{
+    REDIRECT_FILE,      // <, >, >>, &>, &>>: open a file on the descriptor
+    REDIRECT_DUP,       // <&n, >&n: make the descriptor a copy of descriptor n
+    REDIRECT_CLOSE      // <&-, >&-: close the descriptor
+};
+
+/**
+ * struct redirection
+ * <p>
+ * A redirection of a command, done on the raw descriptor. The redirections of a command are
+ * done in the order they were written, so >file 2>&1 sends both outputs to the file while
+ * 2>&1 >file sends only stdout there.
+ * </p>
+ */
+struct redirection
+{
+    int fd;                         // the descriptor redirected
+    enum redirection_kind kind;     // what is done to it
+    const char *file;               // REDIRECT_FILE: the file
+    int flags;                      // REDIRECT_FILE: the flags to open the file with
+    int source;                     // REDIRECT_DUP: the descriptor copied
+    int opened;                     // REDIRECT_FILE: where the shell opened the file to spawn the command, or -1
+    bool cached;                    // REDIRECT_FILE: whether opened belongs to state->file_cache, and stays open
+    struct redirection *next;       // the redirection after this one, or NULL
+};
 
 /**
  * struct command
  * <p>
- * Stores information about the command to be executed.
+ * Stores information about a command to be executed. The commands of a line form a list, in
+ * the order they appear.
  * </p>
  */
 struct command
 {
-    char *line;             // current command line
-    char *command;          // current command
-    size_t argc;            // the number of command arguments
-    char **argv;            // the command arguments
-    char *stdin_file;       // file from which to redirect stdin
-    char *stdout_file;      // file to which to redirect stdout
-    bool stdout_overwrite;  // whether to overwrite the stdout file (vs. append)
-    char *stderr_file;      // file to which to redirect stderr
-    bool stderr_overwrite;  // whether to overwite the stderr file (vs. append)
-    int exit_code;          // the exit code from the program/builtin
+    char *command;                      // current command
+    size_t argc;                        // the number of command arguments
+    char **argv;                        // the command arguments
+    struct redirection *redirections;   // the redirections, in the order written, or NULL
+    int exit_code;                      // the exit code from the program/builtin
+    struct command *next;               // the command after this one on the line, or NULL
+    enum command_separator separator;   // how the command follows the one before it
+    size_t first_token;                 // index of the command's first token in state->tokenizer
+    size_t token_count;                 // number of tokens in the command
+    pid_t pid;                          // the process running the command, while its pipeline runs
+    const char *subshell;               // the commands of a ( ... ) group, without the parentheses, or NULL
+    size_t subshell_length;             // length of subshell
 };
 
 /**
  * do_separate_commands
  * <p>
- * Given a state object with a filled current line field, construct a command structure in that state.
- * Then, separate the individual commands in the current_line and store them into the command structure.
+ * Given a state object whose tokenizer holds the tokens of the current line, split the tokens at
+ * each ;, &&, || and | into the list of commands in state->commands; the commands joined by |
+ * form a pipeline. A separator with no command before it, or &&, || or | with none after it, is
+ * a parse error: a message is printed to state->stdout, errno is set to EINVAL, the status is
+ * set to PARSE_ERROR_STATUS and no command is run.
  * </p>
  * @param supvis the supervisor object
  * @param state the state object
@@ -41,8 +100,10 @@ void do_separate_commands(struct supervisor *supvis, struct state *state);
 /**
  * do_parse_commands
  * <p>
- * For each command in the state, parse the command->line for the information necessary to execute
- * the command.
+ * Check the syntax of every command in the state before any of them runs: each redirection
+ * operator must be followed by a filename or descriptor. On a parse error, the status is set to
+ * PARSE_ERROR_STATUS. The words are expanded later, by parse_command, as each command is about
+ * to run, since an earlier command on the line may change what they expand to.
  * </p>
  * @param supvis the supervisor object
  * @param state the state object
@@ -52,7 +113,8 @@ void do_parse_commands(struct supervisor *supvis, struct state *state);
 /**
  * parse_command
  * <p>
- * Parse the command by using the command->line to fill the rest of the command fields.
+ * Expand the command's tokens in state->tokenizer to fill the command fields. On failure errno
+ * is set, and state->fatal_error too if the shell cannot go on.
  * </p>
  * @param supvis the supervisor object
  * @param state the state object
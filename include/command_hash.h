@@ -0,0 +1,147 @@
+#ifndef CSH_COMMAND_HASH_H
+#define CSH_COMMAND_HASH_H
+
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The number of buckets of the command hash table. A power of two.
+ */
+#define COMMAND_HASH_BUCKETS 64
+
+/**
+ * struct command_hash_entry
+ * <p>
+ * Where a command was found on the path, or that it was not.
+ * </p>
+ */
+struct command_hash_entry
+{
+    struct command_hash_entry *next;    // the next entry in the bucket
+    uint64_t hash;                      // hash of the name
+    int directory;                      // descriptor of the directory the command was found in, -1 if it was not found
+    char *path;                         // the file the command runs, NULL if it was not found
+    int error;                          // why it was not found: ENOENT, or EACCES if a file exists but cannot be run
+    unsigned long hits;                 // lookups answered by the entry
+    char name[];                        // the name of the command, null terminated
+};
+
+/**
+ * struct command_hash
+ * <p>
+ * Maps command names to the files they run, so the path is searched once per command rather
+ * than once per run. Names not found are kept too, so a missing command does not search the
+ * path every time. The entries are dropped when PATH changes, and an entry whose file no longer
+ * exists is searched for again; a command added to the path after it was not found is seen
+ * once the entries are cleared (hash -r). The directories of the path are held open, so a
+ * command is looked for and run relative to its directory rather than by building and walking
+ * the full name of every file tried.
+ * </p>
+ */
+struct command_hash
+{
+    struct command_hash_entry *buckets[COMMAND_HASH_BUCKETS];   // entries, chained by hash
+    size_t count;                                               // number of entries
+    char *path;                                                 // the value of PATH the entries were found with
+    char **directories;                                         // the directories of path
+    int *directory_fds;                                         // O_PATH descriptors of directories, -1 for those that could not be opened
+    size_t directory_count;                                     // number of directories
+};
+
+/**
+ * command_hash_create
+ * <p>
+ * Create an empty command hash table.
+ * </p>
+ * @param supvis the supervisor object
+ * @return the table, or NULL on failure
+ */
+struct command_hash *command_hash_create(struct supervisor *supvis);
+
+/**
+ * command_hash_find
+ * <p>
+ * Find the file a command name runs, from the table or by searching the directories of PATH.
+ * The name must not hold a '/'.
+ * </p>
+ * @param hash the table
+ * @param name the name of the command
+ * @param error set to EACCES if the command was found but cannot be run, to ENOMEM if memory ran
+ * out, and left alone otherwise
+ * @return the file, owned by the table, or NULL if the command was not found
+ */
+const char *command_hash_find(struct command_hash *hash, const char *name, int *error);
+
+/**
+ * command_hash_exec
+ * <p>
+ * Run the file a command name was found as with execveat, relative to its directory. A script
+ * cannot be run this way, as the directory is closed on exec; it is run by its full name.
+ * Returns only on failure.
+ * </p>
+ * @param hash the table
+ * @param name the name of the command, found by command_hash_find
+ * @param argv the arguments, NULL terminated
+ * @return -1, with errno set
+ */
+int command_hash_exec(struct command_hash *hash, const char *name, char *const *argv);
+
+/**
+ * command_hash_raise
+ * <p>
+ * Move the directories of the path held at or below a descriptor above it, close-on-exec. Called
+ * in a child before it redirects descriptors up to that one, so a redirection such as 10>file
+ * does not replace the directory command_hash_exec runs the command relative to.
+ * </p>
+ * @param hash the table
+ * @param fd the highest descriptor the child redirects
+ * @return 0 on success, -1 with errno set if a directory could not be moved
+ */
+int command_hash_raise(struct command_hash *hash, int fd);
+
+/**
+ * command_hash_remove
+ * <p>
+ * Forget where a command was found.
+ * </p>
+ * @param hash the table
+ * @param name the name of the command
+ * @return true if the command had an entry, false otherwise
+ */
+bool command_hash_remove(struct command_hash *hash, const char *name);
+
+/**
+ * command_hash_clear
+ * <p>
+ * Forget every command.
+ * </p>
+ * @param hash the table
+ */
+void command_hash_clear(struct command_hash *hash);
+
+/**
+ * command_executable
+ * <p>
+ * Check whether a file can be run as a command.
+ * </p>
+ * @param directory the descriptor of the directory a relative file is in, or AT_FDCWD
+ * @param file the file
+ * @param error set to EACCES if the file exists but cannot be run; left alone otherwise
+ * @return true if it can, false otherwise
+ */
+bool command_executable(int directory, const char *file, int *error);
+
+/**
+ * command_hash_destroy
+ * <p>
+ * Free a command hash table.
+ * </p>
+ * @param supvis the supervisor object
+ * @param hash the table
+ */
+void command_hash_destroy(struct supervisor *supvis, struct command_hash *hash);
+
+#endif //CSH_COMMAND_HASH_H
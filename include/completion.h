@@ -0,0 +1,152 @@
+#ifndef CSH_COMPLETION_H
+#define CSH_COMPLETION_H
+
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The number of directories whose listings are kept for completing file arguments.
+ */
+#define COMPLETION_FILE_DIRS 16
+
+/**
+ * struct completion_entry
+ * <p>
+ * A name in a directory listing.
+ * </p>
+ */
+struct completion_entry
+{
+    const char *name;       // the name, pointing into the listing's names
+    size_t length;          // length of the name
+    bool directory;         // whether the name is a directory (or a link to one)
+};
+
+/**
+ * struct completion_dir
+ * <p>
+ * The listing of one directory, kept until inotify reports that the directory changed.
+ * </p>
+ */
+struct completion_dir
+{
+    char *path;                         // the directory
+    int watch;                          // inotify watch descriptor, -1 if not watched
+    bool stale;                         // whether the directory must be listed again before use
+    bool executables;                   // whether only executable files are listed
+    char *names;                        // the names, back to back and null terminated
+    size_t names_length;                // bytes used in names
+    size_t names_capacity;              // bytes allocated for names
+    struct completion_entry *entries;   // the names, sorted
+    size_t count;                       // number of entries
+    size_t capacity;                    // number of entries allocated
+    unsigned long used;                 // when the listing was last used, to choose which to replace
+};
+
+/**
+ * struct trie_node
+ * <p>
+ * A node of the command name trie. Children are a list, sorted by byte, through sibling.
+ * Nodes are numbered from 1; 0 is the absence of a node.
+ * </p>
+ */
+struct trie_node
+{
+    uint32_t child;         // first child
+    uint32_t sibling;       // next child of the same parent
+    unsigned char byte;     // the byte leading to this node
+    bool terminal;          // whether a command name ends here
+};
+
+/**
+ * struct completion
+ * <p>
+ * Completes command names from the executables on PATH, and file arguments from directory
+ * listings. Directories are listed with getdents64 the first time they are needed and watched
+ * with inotify; after that, only the directories inotify reports as changed are listed again.
+ * Command names are held in a prefix trie, so completing one costs no system calls unless a
+ * directory on PATH changed.
+ * </p>
+ */
+struct completion
+{
+    int inotify_fd;                                 // reports changes to the listed directories, -1 if unavailable
+    struct completion_dir *commands;                // one listing per PATH directory
+    size_t command_dir_count;                       // number of PATH directories
+    struct completion_dir files[COMPLETION_FILE_DIRS]; // listings for file arguments
+    size_t file_dir_count;                          // number of listings in files
+    unsigned long clock;                            // counts file listing uses
+    struct trie_node *trie;                         // the command name trie; node 1 is the root
+    size_t trie_count;                              // number of nodes used, counting the unused node 0
+    size_t trie_capacity;                           // number of nodes allocated
+    bool trie_stale;                                // whether a PATH directory changed since the trie was built
+};
+
+/**
+ * completion_create
+ * <p>
+ * Create a completion engine for the directories of a PATH. Nothing is listed until needed.
+ * </p>
+ * @param supvis the supervisor object
+ * @param path the NULL terminated PATH directories
+ * @return the completion engine, or NULL on failure
+ */
+struct completion *completion_create(struct supervisor *supvis, char **path);
+
+/**
+ * completion_refresh
+ * <p>
+ * Read the changes inotify has reported and mark the directories involved as stale. Called
+ * before each command is read, so that completing does not have to.
+ * </p>
+ * @param completion the completion engine
+ */
+void completion_refresh(struct completion *completion);
+
+/**
+ * completion_commands
+ * <p>
+ * Find the command names on PATH starting with prefix, in order.
+ * </p>
+ * @param completion the completion engine
+ * @param prefix the prefix (need not be null terminated)
+ * @param prefix_length the length of the prefix
+ * @param found called with each command name and the argument arg
+ * @param arg passed to found
+ * @return the number of names found, or -1 on failure
+ */
+ssize_t completion_commands(struct completion *completion, const char *prefix, size_t prefix_length,
+                            void (*found)(const char *name, size_t length, bool directory, void *arg), void *arg);
+
+/**
+ * completion_files
+ * <p>
+ * Find the files completing a word, in order. The part of the word up to its last '/' names
+ * the directory, relative to cwd unless it is absolute. Hidden files are only found if the
+ * rest of the word starts with '.'.
+ * </p>
+ * @param completion the completion engine
+ * @param cwd the working directory
+ * @param word the word (need not be null terminated)
+ * @param word_length the length of the word
+ * @param found called with each file name (without the directory) and the argument arg
+ * @param arg passed to found
+ * @return the number of files found, or -1 on failure
+ */
+ssize_t completion_files(struct completion *completion, const char *cwd, const char *word, size_t word_length,
+                         void (*found)(const char *name, size_t length, bool directory, void *arg), void *arg);
+
+/**
+ * completion_destroy
+ * <p>
+ * Free a completion engine and stop watching its directories.
+ * </p>
+ * @param supvis the supervisor object
+ * @param completion the completion engine
+ */
+void completion_destroy(struct supervisor *supvis, struct completion *completion);
+
+#endif //CSH_COMPLETION_H
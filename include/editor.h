@@ -0,0 +1,163 @@
+#ifndef CSH_EDITOR_H
+#define CSH_EDITOR_H
+
+#include "history_index.h"
+#include "state.h"
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <termios.h>
+
+/**
+ * editor_read_line returns this when the line was cancelled with ^C.
+ */
+#define EDITOR_CANCELLED 2
+
+/**
+ * The longest escape sequence the editor reads from the terminal.
+ */
+#define EDITOR_SEQUENCE_MAX 16
+
+/**
+ * The number of bytes read from the terminal at once.
+ */
+#define EDITOR_CHUNK_SIZE 4096
+
+/**
+ * The most completions listed below the line; the number of the others is shown instead.
+ */
+#define EDITOR_LIST_MAX 100
+
+/**
+ * The sequence a terminal sends at the start of a bracketed paste.
+ */
+#define EDITOR_PASTE_START "\033[200~"
+
+/**
+ * The sequence a terminal sends at the end of a bracketed paste.
+ */
+#define EDITOR_PASTE_END "\033[201~"
+
+/**
+ * struct edit_buffer
+ * <p>
+ * A growable byte buffer.
+ * </p>
+ */
+struct edit_buffer
+{
+    char *data;         // the bytes
+    size_t length;      // bytes used
+    size_t capacity;    // bytes allocated
+};
+
+/**
+ * struct line_editor
+ * <p>
+ * Edits command lines on a terminal in raw mode. The screen is redrawn by comparing what is
+ * shown with what should be, and writing only the cells that differ, so the cost of a keystroke
+ * does not grow with the length of the line. Whole reads are processed before redrawing, so
+ * typed-ahead keys and pastes are drawn once.
+ * </p>
+ * <p>
+ * Accepted lines are queued as pending input for the tokenizer. A paste of many lines is queued
+ * at once, and its commands are read one after the other without prompting in between.
+ * </p>
+ */
+struct line_editor
+{
+    int fd;                             // the terminal
+    struct termios saved;               // the terminal settings to restore after a line
+    size_t columns;                     // width of the terminal
+    struct edit_buffer line;            // the line being edited
+    size_t cursor;                      // offset of the cursor in line
+    size_t dirty;                       // first offset of line changed since the last redraw
+    struct edit_buffer kill;            // the text last killed, for yanking
+    struct edit_buffer prompt;          // the prompt shown before the line
+    size_t prompt_width;                // cells taken by the prompt
+    struct edit_buffer label;           // the prompt shown while searching
+    struct edit_buffer frame;           // what is on the screen after the prompt
+    struct edit_buffer next;            // what should be on the screen, while redrawing
+    size_t frame_plain;                 // bytes of frame showing the line; the rest is a suggestion
+    size_t screen;                      // cell of the terminal's cursor, from the start of the prompt
+    struct edit_buffer suggestion;      // the rest of the most recent history entry starting with the line
+    struct edit_buffer output;          // escape sequences and text for the next write to the terminal
+    char input[EDITOR_CHUNK_SIZE];      // bytes read from the terminal
+    size_t input_start;                 // first byte of input not yet processed
+    size_t input_end;                   // end of the bytes in input
+    char sequence[EDITOR_SEQUENCE_MAX]; // a partly read escape sequence, finished by the next read
+    size_t sequence_length;             // bytes in sequence
+    bool pasting;                       // whether a bracketed paste is being read
+    size_t paste_end_matched;           // bytes of the end of paste sequence read so far
+    size_t history_position;            // how far back in the history the line is from, 0 if new
+    struct edit_buffer draft;           // the new line, kept while browsing the history
+    bool searching;                     // whether an incremental history search is under way
+    struct edit_buffer query;           // the prefix searched for
+    struct history_search search;       // the search
+    bool search_started;                // whether search holds a started search
+    struct edit_buffer pending;         // accepted input not yet tokenized
+    size_t pending_start;               // first byte of pending not yet tokenized
+    int result;                         // what editor_read_line returns, once the line is done
+    bool done;                          // whether the line is done
+};
+
+/**
+ * editor_create
+ * <p>
+ * Create a line editor on a terminal.
+ * </p>
+ * @param supvis the supervisor object
+ * @param fd the terminal
+ * @return the editor, or NULL if fd is not a terminal or on failure
+ */
+struct line_editor *editor_create(struct supervisor *supvis, int fd);
+
+/**
+ * editor_read_line
+ * <p>
+ * Show a prompt, let the user edit a line and queue it as pending input. History entries are
+ * suggested as the line is typed (right arrow accepts), ^R searches the history, up and down
+ * browse it and tab completes commands and files. Returns at once if input is still pending.
+ * </p>
+ * @param editor the editor
+ * @param state the state object holding the history and completion engine
+ * @param prompt the prompt
+ * @param prompt_length the length of the prompt
+ * @return 1 if a line was queued, EDITOR_CANCELLED if it was cancelled, 0 at the end of input,
+ * -1 on failure
+ */
+int editor_read_line(struct line_editor *editor, struct state *state, const char *prompt, size_t prompt_length);
+
+/**
+ * editor_pending
+ * <p>
+ * Get the input queued by the editor that has not yet been consumed.
+ * </p>
+ * @param editor the editor
+ * @param length set to the number of bytes pending
+ * @return the pending bytes
+ */
+const char *editor_pending(const struct line_editor *editor, size_t *length);
+
+/**
+ * editor_consume
+ * <p>
+ * Mark pending input as consumed.
+ * </p>
+ * @param editor the editor
+ * @param length the number of bytes consumed
+ */
+void editor_consume(struct line_editor *editor, size_t length);
+
+/**
+ * editor_destroy
+ * <p>
+ * Free a line editor.
+ * </p>
+ * @param supvis the supervisor object
+ * @param editor the editor
+ */
+void editor_destroy(struct supervisor *supvis, struct line_editor *editor);
+
+#endif //CSH_EDITOR_H
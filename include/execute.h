@@ -7,7 +7,9 @@
 /**
  * do_execute_commands
  * <p>
- * Run the execute function.
+ * Run the commands of the line in order. A command after && runs only if the last command run
+ * succeeded, and one after || only if it failed; the words of a command are expanded just
+ * before it runs. Stop at exit or on a fatal error.
  * </p>
  * @param supvis the supervisor object
  * @param state the state object
@@ -26,4 +28,44 @@ int do_execute_commands(struct supervisor *supvis, struct state *state);
  */
 int do_handle_error(struct state *state);
 
+/**
+ * open_pipe
+ * <p>
+ * Create a pipe whose ends are closed on exec, sized to state->pipe_size if it is set and the
+ * system allows it.
+ * </p>
+ * @param state the state object
+ * @param fds filled with the read and write ends
+ * @return 0 on success, -1 on failure
+ */
+int open_pipe(const struct state *state, int *fds);
+
+/**
+ * apply_redirections
+ * <p>
+ * Do the redirections of a command on the descriptors of the process, in order, with open and
+ * dup2; used by forked children, and by exec for the shell itself. The descriptors redirected
+ * are left open across exec, and the files opened for them are not. On failure, a message is
+ * printed to state->stdout.
+ * </p>
+ * @param state the state object
+ * @param command the command object
+ * @return 0 on success, -1 on failure
+ */
+int apply_redirections(struct state *state, const struct command *command);
+
+/**
+ * execute_subshell
+ * <p>
+ * In the child of a command substitution or ( ... ) group, whose streams are already set up,
+ * run a command line through the shell's own separate, parse and execute steps, then exit with
+ * the status of the last command run. Never returns.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param text the command line; it may hold several lines
+ * @param length the length of text
+ */
+void execute_subshell(struct supervisor *supvis, struct state *state, const char *text, size_t length);
+
 #endif //CSH_EXECUTE_H
@@ -0,0 +1,124 @@
+#ifndef CSH_EXPAND_H
+#define CSH_EXPAND_H
+
+#include "arith.h"
+#include "pattern.h"
+#include "state.h"
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/**
+ * The expander's buffers are released after a command if one grew larger than this,
+ * so one very large glob does not stay resident for the rest of the session.
+ */
+#define EXPANDER_RETAIN_SIZE 65536
+
+/**
+ * The size of the first mapping that holds the output of a command substitution.
+ */
+#define EXPANDER_CAPTURE_SIZE 16384
+
+/**
+ * The field separators used when IFS is not set.
+ */
+#define EXPANDER_DEFAULT_IFS " \t\n"
+
+/**
+ * struct expander
+ * <p>
+ * Expands words in the shell's own process: tilde, $NAME and ${NAME} with its operators, command substitution,
+ * arithmetic, quote removal, IFS field splitting and pathname expansion. The command of a $(...) or `...`
+ * runs in a child of the shell, through the shell's own execute path, and its output is read
+ * from a pipe into a mapping kept from one substitution to the next. A field is built in pattern form, where the bytes that must
+ * match themselves are escaped with a '\', and is written into the arena unescaped, or replaced
+ * by the pathnames it matches. The buffers are kept from one command to the next, so expanding
+ * a word allocates no memory once they have grown.
+ * </p>
+ */
+struct expander
+{
+    char *field;                     // the field being built, in pattern form
+    size_t field_length;             // bytes used in field
+    size_t field_capacity;           // bytes allocated for field
+    bool field_started;              // whether the field exists, even if empty (eg. "")
+    bool field_glob;                 // whether the field has an unquoted *, ? or [
+    bool white_ended;                // whether IFS white space ended the last field, with nothing since
+    size_t field_count;              // number of fields written for the word
+    const char *ifs;                 // the field separators, looked up at the command's first unquoted expansion
+    char *path;                      // the pathname being matched, while globbing
+    size_t path_capacity;            // bytes allocated for path
+    char *names;                     // the matching pathnames, back to back and null terminated
+    size_t names_length;             // bytes used in names
+    size_t names_capacity;           // bytes allocated for names
+    size_t match_count;              // number of pathnames in names
+    const char **matches;            // the matching pathnames, for sorting
+    size_t matches_capacity;         // number of pointers allocated for matches
+    char *capture;                   // the output of the last command substitution (mapped)
+    size_t capture_capacity;         // bytes mapped for capture
+    struct arith_cache *arith;       // the compiled form of recent $((...)) expressions, NULL until the first
+    struct pattern_cache *patterns;  // the compiled form of recent ${...} patterns, NULL until the first
+    bool in_operand;                 // whether the operand of a ${...} is being expanded, which is not split
+    bool failed;                     // whether memory ran out while expanding the word
+};
+
+/**
+ * expander_create
+ * <p>
+ * Create a word expander.
+ * </p>
+ * @param supvis the supervisor object
+ * @return the expander, or NULL on failure
+ */
+struct expander *expander_create(struct supervisor *supvis);
+
+/**
+ * expand_word
+ * <p>
+ * Expand a word as the tokenizer produced it (quoting intact) and append its fields, null
+ * terminated, to the object being grown in state->arena. A word may expand to no fields (eg.
+ * an unset $NAME) or to many. On a syntax error, a message is printed to state->stdout and
+ * errno is set to EINVAL.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object holding the expander and the arena
+ * @param word the null terminated word
+ * @return the number of fields appended, or -1 on failure
+ */
+ssize_t expand_word(struct supervisor *supvis, struct state *state, const char *word);
+
+/**
+ * substitution_end
+ * <p>
+ * Find the end of a command substitution or ( ... ) group, skipping quoted and escaped bytes
+ * and nested parentheses the same way the tokenizer does.
+ * </p>
+ * @param text the command, just past "$(", '(' or '`'
+ * @param backquoted whether the substitution is `...` (vs. $(...))
+ * @return the closing ')' or '`', or NULL if there is none
+ */
+const char *substitution_end(const char *text, bool backquoted);
+
+/**
+ * expander_reset
+ * <p>
+ * Forget the field separators, which may change before the next command, and release buffers
+ * (and the capture mapping) that grew larger than EXPANDER_RETAIN_SIZE.
+ * </p>
+ * @param expander the expander
+ */
+void expander_reset(struct expander *expander);
+
+/**
+ * expander_destroy
+ * <p>
+ * Free an expander.
+ * </p>
+ * @param supvis the supervisor object
+ * @param expander the expander
+ */
+void expander_destroy(struct supervisor *supvis, struct expander *expander);
+
+#endif //CSH_EXPAND_H
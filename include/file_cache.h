@@ -0,0 +1,136 @@
+#ifndef CSH_FILE_CACHE_H
+#define CSH_FILE_CACHE_H
+
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/**
+ * The lowest descriptor the shell keeps its own files on. Those below are left to scripts, for
+ * exec 3>file and the like.
+ */
+#define SHELL_FD_MIN 10
+
+/**
+ * struct file_cache_entry
+ * <p>
+ * A file a command redirected to, held open.
+ * </p>
+ */
+struct file_cache_entry
+{
+    uint64_t hash;          // hash of the path
+    int flags;              // the flags the file was opened with
+    int fd;                 // the open file, close-on-exec
+    dev_t device;           // the device of the file when it was opened
+    ino_t inode;            // the inode of the file when it was opened
+    unsigned long used;     // the cache's clock when the entry was last used
+    char path[];            // the path, as the command wrote it, null terminated
+};
+
+/**
+ * struct file_cache
+ * <p>
+ * The files most recently appended to by redirections of spawned commands, held open so a
+ * script that logs to the same file from command after command opens it once. Before an open
+ * file is used again, its path is looked up to check it still names the same file: a file that
+ * was removed, renamed or replaced, or a relative path met in another directory, opens the path
+ * again. A file whose permissions change while it is held open can still be appended to.
+ * </p>
+ */
+struct file_cache
+{
+    struct file_cache_entry **entries;  // capacity slots, NULL if empty
+    size_t count;                       // number of entries
+    size_t capacity;                    // most files held open; 0 disables the cache
+    unsigned long clock;                // lookups so far, to find the least recently used entry
+    unsigned long pinned;               // entries used at or after this clock are held by the command being started
+    unsigned long hits;                 // lookups that found the file open
+    unsigned long misses;               // lookups that opened it
+};
+
+/**
+ * file_cache_create
+ * <p>
+ * Create an empty, disabled file cache.
+ * </p>
+ * @param supvis the supervisor object
+ * @return the cache, or NULL on failure
+ */
+struct file_cache *file_cache_create(struct supervisor *supvis);
+
+/**
+ * file_cache_resize
+ * <p>
+ * Close every file in the cache and change the number it holds.
+ * </p>
+ * @param cache the cache
+ * @param capacity the most files held open; 0 disables the cache
+ * @return 0 on success, -1 if memory ran out (the cache is then disabled)
+ */
+int file_cache_resize(struct file_cache *cache, size_t capacity);
+
+/**
+ * file_cache_accepts
+ * <p>
+ * Check whether a file opened with some flags may be held by the cache. Only files appended to
+ * are: every write goes to the end, wherever the last command left the offset, whereas a file
+ * read or written from its start would share one offset between the commands holding it.
+ * A full cache accepts no file while every file in it is held by the command being started.
+ * </p>
+ * @param cache the cache
+ * @param flags the flags the file is opened with
+ * @return true if it may, false otherwise
+ */
+bool file_cache_accepts(const struct file_cache *cache, int flags);
+
+/**
+ * file_cache_begin
+ * <p>
+ * Start on the redirections of a command. The files it gets from the cache are not replaced
+ * until the next command starts, as their descriptors are in use until it is spawned.
+ * </p>
+ * @param cache the cache
+ */
+void file_cache_begin(struct file_cache *cache);
+
+/**
+ * file_cache_open
+ * <p>
+ * Get a descriptor of a file, open in the cache or opened and added to it, replacing the least
+ * recently used file if the cache is full. The descriptor is close-on-exec and belongs to the
+ * cache.
+ * </p>
+ * @param cache the cache, which must accept flags
+ * @param path the file
+ * @param flags the flags to open the file with
+ * @return the descriptor, or -1 with errno set
+ */
+int file_cache_open(struct file_cache *cache, const char *path, int flags);
+
+/**
+ * shell_descriptor
+ * <p>
+ * Move a descriptor the shell holds on to to SHELL_FD_MIN or above, close-on-exec, so it is not
+ * in the way of the descriptors scripts use. The descriptor stays where it is if it cannot be
+ * moved.
+ * </p>
+ * @param fd the descriptor, or -1
+ * @return the descriptor moved, or fd
+ */
+int shell_descriptor(int fd);
+
+/**
+ * file_cache_destroy
+ * <p>
+ * Close the files in a cache and free it.
+ * </p>
+ * @param supvis the supervisor object
+ * @param cache the cache
+ */
+void file_cache_destroy(struct supervisor *supvis, struct file_cache *cache);
+
+#endif //CSH_FILE_CACHE_H
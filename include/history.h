@@ -0,0 +1,148 @@
+#ifndef CSH_HISTORY_H
+#define CSH_HISTORY_H
+
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * The name of the history file in the home directory, used if HISTFILE is not set.
+ */
+#define HISTORY_FILE_NAME ".csh_history"
+
+/**
+ * Marks the end of a well formed history record.
+ */
+#define HISTORY_MAGIC 0x43534848U
+
+/**
+ * struct history_trailer
+ * <p>
+ * Follows the text of every record in the history log. Records are found by walking the log
+ * backwards from its end, trailer to trailer, so the log never has to be read from the start.
+ * </p>
+ */
+struct history_trailer
+{
+    uint32_t length;        // length of the text before the trailer
+    int32_t exit_code;      // exit code of the command
+    int64_t started;        // when the command was entered (seconds since the epoch)
+    uint32_t duration;      // how long the command took (milliseconds)
+    uint32_t magic;         // HISTORY_MAGIC
+};
+
+/**
+ * struct history_entry
+ * <p>
+ * A command from the history, pointing into the mapped log.
+ * </p>
+ */
+struct history_entry
+{
+    const char *text;       // the command (not null terminated)
+    size_t length;          // length of the command
+    int exit_code;          // exit code of the command
+    time_t started;         // when the command was entered
+    long duration;          // how long the command took (milliseconds)
+    size_t end;             // offset just past the record in the log, identifying it
+};
+
+/**
+ * struct history
+ * <p>
+ * An append-only log of commands shared by every session of a user. Each record is appended
+ * with a single O_APPEND write, so concurrent sessions never interleave records and need no
+ * lock. The log is mapped rather than read, and records are indexed lazily from the newest
+ * back, so opening a history of any size costs the same. A record whose write was cut short,
+ * by a full disk or a crash, is skipped; the records around it are kept.
+ * </p>
+ */
+struct history
+{
+    int fd;                 // the log, opened for appending
+    char *map;              // the log as mapped, or NULL if it was empty
+    size_t map_length;      // bytes mapped
+    size_t length;          // bytes of the log known to this session
+    size_t *older;          // offsets of the records present when mapped, newest first
+    size_t older_count;     // number of offsets in older
+    size_t older_capacity;  // number of offsets allocated for older
+    size_t scanned;         // offset down to which the log has been indexed, 0 once all of it is
+    size_t *newer;          // offsets of the records appended since, oldest first
+    size_t newer_count;     // number of offsets in newer
+    size_t newer_capacity;  // number of offsets allocated for newer
+};
+
+/**
+ * history_open
+ * <p>
+ * Open (creating if needed) and map a history log.
+ * </p>
+ * @param supvis the supervisor object
+ * @param path the log
+ * @return the history, or NULL on failure
+ */
+struct history *history_open(struct supervisor *supvis, const char *path);
+
+/**
+ * history_append
+ * <p>
+ * Append a command to the log.
+ * </p>
+ * @param history the history
+ * @param text the command
+ * @param length the length of the command
+ * @param exit_code the exit code of the command
+ * @param started when the command was entered
+ * @param duration how long the command took (milliseconds)
+ * @return 0 on success, -1 on failure
+ */
+int history_append(struct history *history, const char *text, size_t length, int exit_code, time_t started,
+                   long duration);
+
+/**
+ * history_refresh
+ * <p>
+ * Map the records appended to the log, by this or another session, since it was last mapped.
+ * </p>
+ * @param history the history
+ * @return 0 on success, -1 on failure
+ */
+int history_refresh(struct history *history);
+
+/**
+ * history_get
+ * <p>
+ * Get a command from the history, 0 being the most recent.
+ * </p>
+ * @param history the history
+ * @param n how many commands back to go
+ * @param entry filled with the command
+ * @return true if there is such a command, false otherwise
+ */
+bool history_get(struct history *history, size_t n, struct history_entry *entry);
+
+/**
+ * history_read
+ * <p>
+ * Get the command whose record ends at end, as found in history_entry.end.
+ * </p>
+ * @param history the history
+ * @param end the offset just past the record
+ * @param entry filled with the command
+ */
+void history_read(const struct history *history, size_t end, struct history_entry *entry);
+
+/**
+ * history_close
+ * <p>
+ * Unmap and close the log and free the history.
+ * </p>
+ * @param supvis the supervisor object
+ * @param history the history
+ */
+void history_close(struct supervisor *supvis, struct history *history);
+
+#endif //CSH_HISTORY_H
@@ -0,0 +1,120 @@
+#ifndef CSH_HISTORY_INDEX_H
+#define CSH_HISTORY_INDEX_H
+
+#include "history.h"
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * struct history_index
+ * <p>
+ * A prefix index over the distinct commands of a history. The commands are kept sorted, so
+ * the commands starting with a prefix are a contiguous range found by binary search, and a
+ * tree of the minimum age over the sorted order finds the most recent commands in that range
+ * without looking at the others. Commands added to the history after the index is built are
+ * few, and are looked at one by one before the index.
+ * </p>
+ */
+struct history_index
+{
+    struct history *history;    // the history indexed
+    size_t *ends;               // the distinct commands, as record ends, sorted by text
+    uint32_t *tree;             // tree[count + i] is how far back command i was last used when the index
+                                // was built, tree[i] the minimum of tree[2i] and tree[2i + 1]
+    size_t count;               // number of distinct commands
+    size_t newer_at_build;      // history->newer_count when the index was built
+    bool built;                 // whether the index reflects the history
+};
+
+/**
+ * struct history_search
+ * <p>
+ * An incremental search for the commands starting with a prefix, most recent first.
+ * </p>
+ */
+struct history_search
+{
+    char *prefix;               // the prefix searched for
+    size_t prefix_length;       // the length of the prefix
+    size_t fresh;               // next command added since the index was built to look at
+    size_t fresh_count;         // number of commands added since the index was built
+    size_t *heap;               // tree nodes still to visit, ordered by their minimum age
+    size_t heap_count;          // number of nodes in heap
+    size_t heap_capacity;       // number of nodes allocated for heap
+};
+
+/**
+ * history_index_create
+ * <p>
+ * Create an index over a history. It is built the first time it is searched.
+ * </p>
+ * @param supvis the supervisor object
+ * @param history the history to index
+ * @return the index, or NULL on failure
+ */
+struct history_index *history_index_create(struct supervisor *supvis, struct history *history);
+
+/**
+ * history_index_search_start
+ * <p>
+ * Begin a search for the commands starting with prefix, building the index if needed.
+ * </p>
+ * @param index the index
+ * @param search the search to begin
+ * @param prefix the prefix (need not be null terminated)
+ * @param prefix_length the length of the prefix
+ * @return 0 on success, -1 on failure
+ */
+int history_index_search_start(struct history_index *index, struct history_search *search, const char *prefix,
+                               size_t prefix_length);
+
+/**
+ * history_index_search_next
+ * <p>
+ * Get the next most recent command matching a search. Each distinct command is found once.
+ * </p>
+ * @param index the index
+ * @param search the search
+ * @param entry filled with the command
+ * @return true if a command was found, false if there are no more
+ */
+bool history_index_search_next(struct history_index *index, struct history_search *search,
+                               struct history_entry *entry);
+
+/**
+ * history_index_search_end
+ * <p>
+ * Free the memory held by a search.
+ * </p>
+ * @param search the search
+ */
+void history_index_search_end(struct history_search *search);
+
+/**
+ * history_index_suggest
+ * <p>
+ * Get the most recent command starting with prefix, to suggest completing the line with it.
+ * </p>
+ * @param index the index
+ * @param prefix the prefix (need not be null terminated)
+ * @param prefix_length the length of the prefix
+ * @param entry filled with the command
+ * @return true if there is such a command, false otherwise
+ */
+bool history_index_suggest(struct history_index *index, const char *prefix, size_t prefix_length,
+                           struct history_entry *entry);
+
+/**
+ * history_index_destroy
+ * <p>
+ * Free an index. The history is not closed.
+ * </p>
+ * @param supvis the supervisor object
+ * @param index the index
+ */
+void history_index_destroy(struct supervisor *supvis, struct history_index *index);
+
+#endif //CSH_HISTORY_INDEX_H
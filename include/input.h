@@ -9,11 +9,13 @@
 /**
  * do_read_commands
  * <p>
- * Print the prompt onto state->stdout. Read from the state->stdin into the state->command_line.
+ * Print the prompt onto state->stdout if the shell is interactive. Read the next line from
+ * state->script if the input is held in memory, otherwise from state->stdin, into
+ * state->current_line.
  * </p>
  * @param supvis the supervisor object
  * @param state the state object
- * @return the size of the state->command_line
+ * @return the size of the state->current_line, or 0 at the end of input
  */
 size_t do_read_commands(struct supervisor *supvis, struct state *state);
 
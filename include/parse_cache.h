@@ -0,0 +1,149 @@
+#ifndef CSH_PARSE_CACHE_H
+#define CSH_PARSE_CACHE_H
+
+#include "supervisor.h"
+#include "tokenizer.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The number of command lines whose tokens are kept unless set -o parsecache= says otherwise.
+ */
+#define PARSE_CACHE_DEFAULT_CAPACITY 1024
+
+/**
+ * struct parse_cache_entry
+ * <p>
+ * The tokens of one command line. The tokens, the line and the words are held in data, in that
+ * order, so an entry is a single allocation.
+ * </p>
+ */
+struct parse_cache_entry
+{
+    struct parse_cache_entry *chain;    // next entry in the same bucket
+    struct parse_cache_entry *newer;    // entry used after this one, NULL if this is the newest
+    struct parse_cache_entry *older;    // entry used before this one, NULL if this is the oldest
+    uint64_t hash;                      // hash of the line
+    size_t line_length;                 // length of the line
+    size_t text_length;                 // bytes of words
+    size_t token_count;                 // number of tokens
+    max_align_t data[];                 // the tokens, then the line, then the words
+};
+
+/**
+ * struct parse_cache
+ * <p>
+ * Maps command lines to their tokens, so a line seen before is not lexed again. Lines are found
+ * by a hash of their bytes, and the least recently used line is dropped when the cache is full.
+ * Only what the tokenizer produces is kept; words are expanded every time they are used, as
+ * their values depend on the environment and the file system.
+ * </p>
+ */
+struct parse_cache
+{
+    struct parse_cache_entry **buckets; // hash chains; the number of buckets is a power of two
+    size_t bucket_count;                // number of buckets
+    struct parse_cache_entry *newest;   // most recently used entry
+    struct parse_cache_entry *oldest;   // least recently used entry
+    size_t count;                       // number of entries
+    size_t capacity;                    // most entries kept; 0 disables the cache
+    unsigned long hits;                 // lookups that found their line
+    unsigned long misses;               // lookups that did not
+};
+
+/**
+ * parse_cache_create
+ * <p>
+ * Create an empty parse cache.
+ * </p>
+ * @param supvis the supervisor object
+ * @param capacity the most lines kept
+ * @return the cache, or NULL on failure
+ */
+struct parse_cache *parse_cache_create(struct supervisor *supvis, size_t capacity);
+
+/**
+ * parse_cache_hash
+ * <p>
+ * Hash a command line (FNV-1a).
+ * </p>
+ * @param line the line
+ * @param length the length of the line
+ * @return the hash
+ */
+uint64_t parse_cache_hash(const char *line, size_t length);
+
+/**
+ * parse_cache_lookup
+ * <p>
+ * Find the tokens of a line, and make it the most recently used.
+ * </p>
+ * @param cache the cache
+ * @param line the line
+ * @param length the length of the line
+ * @param hash the hash of the line
+ * @return the entry, or NULL if the line is not in the cache
+ */
+const struct parse_cache_entry *parse_cache_lookup(struct parse_cache *cache, const char *line, size_t length,
+                                                   uint64_t hash);
+
+/**
+ * parse_cache_insert
+ * <p>
+ * Keep the tokens of a line, dropping the least recently used line if the cache is full.
+ * Nothing is kept for a line with no tokens, or if memory runs out.
+ * </p>
+ * @param cache the cache
+ * @param line the line
+ * @param length the length of the line
+ * @param hash the hash of the line
+ * @param tokenizer the tokenizer holding the tokens of the line
+ */
+void parse_cache_insert(struct parse_cache *cache, const char *line, size_t length, uint64_t hash,
+                        const struct tokenizer *tokenizer);
+
+/**
+ * parse_cache_tokens
+ * <p>
+ * Get the tokens of an entry.
+ * </p>
+ * @param entry the entry
+ * @return the tokens
+ */
+const struct token *parse_cache_tokens(const struct parse_cache_entry *entry);
+
+/**
+ * parse_cache_text
+ * <p>
+ * Get the words of an entry, back to back and null terminated as in tokenizer->text.
+ * </p>
+ * @param entry the entry
+ * @return the words
+ */
+const char *parse_cache_text(const struct parse_cache_entry *entry);
+
+/**
+ * parse_cache_resize
+ * <p>
+ * Change the number of lines kept, dropping the least recently used lines that no longer fit.
+ * </p>
+ * @param cache the cache
+ * @param capacity the most lines kept; 0 empties and disables the cache
+ * @return 0 on success, -1 on failure
+ */
+int parse_cache_resize(struct parse_cache *cache, size_t capacity);
+
+/**
+ * parse_cache_destroy
+ * <p>
+ * Free a parse cache and its entries.
+ * </p>
+ * @param supvis the supervisor object
+ * @param cache the cache
+ */
+void parse_cache_destroy(struct supervisor *supvis, struct parse_cache *cache);
+
+#endif //CSH_PARSE_CACHE_H
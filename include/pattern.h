@@ -0,0 +1,111 @@
+#ifndef CSH_PATTERN_H
+#define CSH_PATTERN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The number of compiled patterns kept. A power of two.
+ */
+#define PATTERN_CACHE_SIZE 64
+
+/**
+ * pattern_kind
+ * <p>
+ * The parts a pattern compiles to.
+ * </p>
+ */
+enum pattern_kind
+{
+    PATTERN_LITERAL,    // bytes that match only themselves
+    PATTERN_ANY,        // ?, any one byte
+    PATTERN_SET,        // [...], one byte of a set
+    PATTERN_STAR        // *, any bytes
+};
+
+/**
+ * struct pattern_element
+ * <p>
+ * One part of a compiled pattern.
+ * </p>
+ */
+struct pattern_element
+{
+    enum pattern_kind kind;     // what the part matches
+    size_t offset;              // PATTERN_LITERAL: offset of the bytes in the pattern's literals
+    size_t length;              // PATTERN_LITERAL: number of bytes
+    unsigned char set[32];      // PATTERN_SET: one bit for each byte in the set
+};
+
+/**
+ * struct pattern
+ * <p>
+ * A glob pattern of a ${NAME#pattern}, ${NAME%pattern} or ${NAME/pattern/string}, compiled to
+ * the parts it is made of. Runs of ordinary bytes are one part, a bracket expression becomes a
+ * set of bytes and consecutive *s are one part, so matching does not read the pattern again.
+ * </p>
+ */
+struct pattern
+{
+    uint64_t hash;                      // hash of the pattern
+    size_t length;                      // length of the pattern
+    struct pattern_element *elements;   // the parts, in order
+    size_t element_count;               // number of parts
+    char *literals;                     // the bytes of every PATTERN_LITERAL, unescaped
+    size_t min_length;                  // the fewest bytes a match can have
+    bool fixed;                         // whether the pattern has no *, so matches have exactly min_length bytes
+    char text[];                        // the pattern, null terminated
+};
+
+/**
+ * struct pattern_cache
+ * <p>
+ * The patterns most recently compiled, so a pattern met again is matched from its compiled
+ * form. A pattern goes in the slot its hash selects, replacing the one there.
+ * </p>
+ */
+struct pattern_cache
+{
+    struct pattern *entries[PATTERN_CACHE_SIZE];    // compiled patterns, by hash
+    unsigned long hits;                             // lookups that found the pattern compiled
+    unsigned long misses;                           // lookups that compiled it
+};
+
+/**
+ * pattern_compile
+ * <p>
+ * Get the compiled form of a pattern, from the cache or by compiling it. The pattern is in the
+ * expander's pattern form: a byte escaped with a '\' matches only itself, and an unescaped *, ?
+ * or [...] is a wildcard. Bracket expressions may be negated with ! or ^ and hold ranges and
+ * [:class:] names; bytes are compared as they are, whatever the locale.
+ * </p>
+ * @param cache the cache
+ * @param text the pattern (not null terminated)
+ * @param length the length of the pattern
+ * @return the compiled pattern, or NULL if memory ran out
+ */
+const struct pattern *pattern_compile(struct pattern_cache *cache, const char *text, size_t length);
+
+/**
+ * pattern_match
+ * <p>
+ * Check whether a pattern matches the whole of some text.
+ * </p>
+ * @param pattern the compiled pattern
+ * @param text the text (not null terminated)
+ * @param length the length of the text
+ * @return true if it matches, false otherwise
+ */
+bool pattern_match(const struct pattern *pattern, const char *text, size_t length);
+
+/**
+ * pattern_cache_destroy
+ * <p>
+ * Free a cache and the patterns in it.
+ * </p>
+ * @param cache the cache
+ */
+void pattern_cache_destroy(struct pattern_cache *cache);
+
+#endif //CSH_PATTERN_H
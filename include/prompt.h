@@ -0,0 +1,89 @@
+#ifndef CSH_PROMPT_H
+#define CSH_PROMPT_H
+
+#include "supervisor.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * The default number of milliseconds to wait for a prompt segment before showing its last value.
+ */
+#define PROMPT_DEFAULT_DEADLINE 20
+
+/**
+ * The largest VCS branch name shown in the prompt.
+ */
+#define PROMPT_BRANCH_MAX 256
+
+/**
+ * struct prompt_worker
+ * <p>
+ * A helper thread computing the expensive segments of the prompt (the VCS branch). The shell
+ * posts a request before each prompt and waits for the answer only until its deadline; the
+ * worker keeps the last value it computed so a late answer never delays the prompt.
+ * </p>
+ */
+struct prompt_worker
+{
+    pthread_t thread;                   // the helper thread
+    pthread_mutex_t lock;               // guards the fields below
+    pthread_cond_t requested;           // signalled when a request is posted or the worker must stop
+    pthread_cond_t completed;           // signalled when a request has been answered
+    char cwd[PATH_MAX];                 // the directory of the latest request
+    unsigned long request;              // number of the latest request
+    unsigned long answer;               // number of the latest request answered
+    char branch[PROMPT_BRANCH_MAX];     // the branch of the latest answer, empty if none
+    bool stop;                          // whether the worker must exit
+};
+
+/**
+ * prompt_worker_create
+ * <p>
+ * Create a prompt worker and start its thread.
+ * </p>
+ * @param supvis the supervisor object
+ * @return the worker, or NULL on failure
+ */
+struct prompt_worker *prompt_worker_create(struct supervisor *supvis);
+
+/**
+ * prompt_worker_branch
+ * <p>
+ * Ask the worker for the VCS branch of cwd and wait at most deadline milliseconds for it.
+ * If the worker has not answered by then, the branch it computed last is used.
+ * </p>
+ * @param worker the worker
+ * @param cwd the working directory
+ * @param deadline the number of milliseconds to wait
+ * @param branch the buffer into which to copy the branch
+ * @param size the size of the buffer
+ */
+void prompt_worker_branch(struct prompt_worker *worker, const char *cwd, long deadline, char *branch, size_t size);
+
+/**
+ * prompt_worker_destroy
+ * <p>
+ * Stop the worker's thread and free the worker.
+ * </p>
+ * @param supvis the supervisor object
+ * @param worker the worker
+ */
+void prompt_worker_destroy(struct supervisor *supvis, struct prompt_worker *worker);
+
+/**
+ * find_vcs_branch
+ * <p>
+ * Find the branch checked out in the git or mercurial repository containing dir by reading
+ * its metadata files. A detached git HEAD is shown as the abbreviated commit.
+ * </p>
+ * @param dir the directory
+ * @param branch the buffer into which to copy the branch
+ * @param size the size of the buffer
+ * @return true if dir is in a repository, false otherwise
+ */
+bool find_vcs_branch(const char *dir, char *branch, size_t size);
+
+#endif //CSH_PROMPT_H
@@ -0,0 +1,73 @@
+#ifndef CSH_SCANNER_H
+#define CSH_SCANNER_H
+
+#include <stdlib.h>
+
+/**
+ * struct scan_index
+ * <p>
+ * The offsets, in order, of every structural byte in a script: newlines, quotes, backslashes,
+ * comment markers and the metacharacters '<', '>', '|', ';' and '&'. Everything between two
+ * offsets is plain text that later stages do not need to look at byte by byte.
+ * </p>
+ */
+struct scan_index
+{
+    size_t *positions;  // offsets of the structural bytes
+    size_t count;       // number of offsets
+    size_t capacity;    // number of offsets allocated
+    size_t cursor;      // first offset not yet consumed by scan_statement
+};
+
+/**
+ * struct statement
+ * <p>
+ * The boundaries of one statement of a script, as offsets into the script.
+ * </p>
+ */
+struct statement
+{
+    size_t end;         // the unquoted newline ending the statement, or the end of the script
+    size_t comment;     // the unquoted '#' starting a comment, or end
+};
+
+/**
+ * scan_structure
+ * <p>
+ * Build the structural index of a script. The script is scanned 32 bytes at a time with AVX2
+ * when the processor supports it, 16 bytes at a time with SSE2 otherwise, and a byte at a time
+ * where neither is available and for the tail of the script.
+ * </p>
+ * @param index the index to fill
+ * @param text the script
+ * @param length the length of the script
+ * @return 0 on success, -1 on failure
+ */
+int scan_structure(struct scan_index *index, const char *text, size_t length);
+
+/**
+ * scan_statement
+ * <p>
+ * Find the boundaries of the statement beginning at start, following quotes and backslashes
+ * through the index rather than through the text. Consumes the index up to the end of the
+ * statement, so statements must be requested in order.
+ * </p>
+ * @param index the structural index of text
+ * @param text the script
+ * @param start the offset of the statement
+ * @param length the length of the script
+ * @param statement filled with the boundaries of the statement
+ */
+void scan_statement(struct scan_index *index, const char *text, size_t start, size_t length,
+                    struct statement *statement);
+
+/**
+ * scan_free
+ * <p>
+ * Free the offsets held by an index.
+ * </p>
+ * @param index the index
+ */
+void scan_free(struct scan_index *index);
+
+#endif //CSH_SCANNER_H
@@ -0,0 +1,136 @@
+#ifndef CSH_SCRIPT_CACHE_H
+#define CSH_SCRIPT_CACHE_H
+
+#include "supervisor.h"
+#include "tokenizer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+/**
+ * The bytes at the start of a compiled script.
+ */
+#define SCRIPT_CACHE_MAGIC "CSHC"
+
+/**
+ * The version of the compiled script format. Files of any other version are rebuilt.
+ */
+#define SCRIPT_CACHE_VERSION 6
+
+/**
+ * The suffix of compiled script files.
+ */
+#define SCRIPT_CACHE_SUFFIX ".cshc"
+
+/**
+ * struct script_cache_header
+ * <p>
+ * The start of a compiled script file. Every position in the file is an offset from its start,
+ * so the file can be mapped anywhere.
+ * </p>
+ */
+struct script_cache_header
+{
+    char magic[4];              // SCRIPT_CACHE_MAGIC
+    uint32_t version;           // SCRIPT_CACHE_VERSION
+    uint32_t token_size;        // sizeof(struct token) in the shell that wrote the file
+    uint32_t reserved;          // zero
+    uint64_t script_size;       // size of the script compiled
+    int64_t script_mtime;       // modification time of the script, seconds
+    int64_t script_mtime_nsec;  // modification time of the script, nanoseconds
+    uint64_t script_hash;       // FNV-1a hash of the script
+    uint64_t statement_count;   // number of statements, which follow the header
+    uint64_t tokens_offset;     // offset of the tokens of all statements
+    uint64_t text_offset;       // offset of the words of all statements
+    uint64_t length;            // length of the file
+};
+
+/**
+ * struct cached_statement
+ * <p>
+ * One statement of a compiled script, as read_script_line would have tokenized it.
+ * </p>
+ */
+struct cached_statement
+{
+    uint64_t line_offset;       // offset of the statement in the script
+    uint64_t line_length;       // length of the statement, without its comment or newline
+    uint64_t first_token;       // index of its first token
+    uint64_t token_count;       // number of tokens
+    uint64_t text_start;        // offset of its words from the start of the words
+    uint64_t text_length;       // bytes of words
+};
+
+/**
+ * struct script_cache
+ * <p>
+ * The tokens of every statement of a script, stored in a file under the cache directory
+ * ($CSH_CACHE_DIR, or csh under $XDG_CACHE_HOME or ~/.cache). The file is checked against the
+ * size, modification time and hash of the script and mapped into memory, so a script that has
+ * not changed runs without being scanned or tokenized. A missing or stale file is rebuilt by
+ * tokenizing the whole script before it runs.
+ * </p>
+ */
+struct script_cache
+{
+    char *data;                                 // the compiled script
+    size_t length;                              // length of data
+    bool mapped;                                // whether data is mapped from the file (vs. allocated)
+    const struct cached_statement *statements;  // the statements
+    const struct token *tokens;                 // the tokens of all statements
+    const char *text;                           // the words of all statements
+    size_t next;                                // index of the next statement to run
+};
+
+/**
+ * script_cache_open
+ * <p>
+ * Get the compiled form of a script, from the cache if it is up to date, otherwise by compiling
+ * the script and writing the result to the cache. Failing to write the cache is not an error.
+ * </p>
+ * @param supvis the supervisor object
+ * @param path the path of the script
+ * @param status the status of the script
+ * @param script the text of the script
+ * @param max_text_length the longest command accepted
+ * @return the compiled script, or NULL if the script cannot be compiled (it is then run as it is read)
+ */
+struct script_cache *script_cache_open(struct supervisor *supvis, const char *path, const struct stat *status,
+                                       const char *script, size_t max_text_length);
+
+/**
+ * script_cache_next
+ * <p>
+ * Get the next statement of a compiled script.
+ * </p>
+ * @param cache the compiled script
+ * @return the statement, or NULL after the last one
+ */
+const struct cached_statement *script_cache_next(struct script_cache *cache);
+
+/**
+ * script_cache_load
+ * <p>
+ * Make the tokens of a statement the current command of a tokenizer.
+ * </p>
+ * @param cache the compiled script
+ * @param statement the statement
+ * @param tokenizer the tokenizer
+ * @return 0 on success, -1 on failure
+ */
+int script_cache_load(const struct script_cache *cache, const struct cached_statement *statement,
+                      struct tokenizer *tokenizer);
+
+/**
+ * script_cache_close
+ * <p>
+ * Unmap or free a compiled script.
+ * </p>
+ * @param supvis the supervisor object
+ * @param cache the compiled script
+ */
+void script_cache_close(struct supervisor *supvis, struct script_cache *cache);
+
+#endif //CSH_SCRIPT_CACHE_H
@@ -27,10 +27,13 @@ enum State
 /**
  * run
  * <p>
- * Run the program.
+ * Run the program. With no arguments, commands are read from stdin. "csh script" runs the
+ * commands in the script file and "csh -c command" runs the single command string.
  * </p>
+ * @param argc the number of command line arguments
+ * @param argv the command line arguments
  * @return the exit code of the program.
  */
-int run(void);
+int run(int argc, char *argv[]);
 
 #endif //CSH_SHELL_H
@@ -1,10 +1,10 @@
 #ifndef CSH_STATE_H
 #define CSH_STATE_H
 
-#include <regex.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 /**
  * struct state
@@ -18,18 +18,48 @@ struct state
     FILE *stdin;                    // stream from which to read commands
     FILE *stdout;                   // stream on which to print the prompt
     FILE *stderr;                   // stream on which to print error messages
-    regex_t *command_regex;         // command regex
-    regex_t *in_redirect_regex;     // stdin regex
-    regex_t *out_redirect_regex;    // stdout regex
-    regex_t *err_redirect_regex;    // stderr regex
     char **path;                    // tokenized path
+    struct completion *completion;  // completes command names and file arguments, if interactive
     char *prompt;                   // prompt to display before a command is entered
     size_t max_line_length;         // largest possible line
-   
+    const char *script_path;        // script to run (csh script), or NULL
+    const char *command_string;     // command string to run (csh -c), or NULL
+    bool interactive;               // whether commands are read from a terminal (prompt is shown)
+    char *script;                   // script text, when the whole input is held in memory
+    size_t script_length;           // length of the script text
+    size_t script_offset;           // offset of the next line in the script text
+    size_t script_map_length;       // length of the script mapping, 0 if the script is not mapped
+    struct scan_index *script_index; // offsets of the structural bytes in the script
+    struct script_cache *script_cache; // compiled form of the script file, NULL if it is lexed as it runs
+    struct arena *arena;            // memory for the current command, released at once by do_reset_state
+    struct tokenizer *tokenizer;    // lexer for all commands; reads stdin when the input is not held in memory
+    struct expander *expander;      // expands the words of commands
+    struct parse_cache *parse_cache; // tokens of recently read lines, shared by every input path
+    struct subshell *subshell;      // runs subshells made only of builtins without forking
+    struct command_hash *command_hash; // where commands were found on the path
+    struct file_cache *file_cache;  // files appended to by spawned commands, held open (set -o filecache=)
+    char *cwd;                      // the working directory, refreshed when cd succeeds
+    char *prompt_line;              // the prompt rendered with the working directory
+    size_t prompt_line_length;      // length of the rendered prompt
+    size_t prompt_prefix_length;    // length of the "[cwd] " part of prompt_line
+    bool prompt_dynamic;            // whether the prompt has segments (%?, %b) filled in when displayed
+    long prompt_deadline;           // milliseconds to wait for slow prompt segments (set -o promptdeadline=)
+    struct prompt_worker *prompt_worker; // computes the VCS branch segment, NULL if PS1 has no %b
+    bool export_pwd;                // whether PWD and OLDPWD are exported (set -o exportpwd)
+    bool fork_exec;                 // whether external commands are forked rather than spawned (set -o forkexec)
+    bool pipefail;                  // whether a pipeline fails if any stage does (set -o pipefail)
+    int pipe_size;                  // capacity of the pipes of a pipeline, 0 for the default (set -o pipesize=)
+    int exit_code;                  // exit code of the most recently executed command
+    struct history *history;        // the command history, NULL if not interactive or unavailable
+    struct history_index *history_index; // prefix index over the history, for search and suggestions
+    struct line_editor *editor;     // edits command lines on the terminal, NULL if not interactive
+    
     /* Impermanent settings */
     char *current_line;             // line most recently entered
     size_t current_line_length;     // len of most recent line
-    struct command *command;        // the commands to execute (current only)
+    time_t command_time;            // when the current command was entered
+    struct timespec command_started; // when the current command was entered (monotonic, for its duration)
+    struct command *commands;       // the commands of the current line, in order
     bool fatal_error;               // whether a fatal error has occurred
 };
 
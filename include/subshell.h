@@ -0,0 +1,107 @@
+#ifndef CSH_SUBSHELL_H
+#define CSH_SUBSHELL_H
+
+#include "arena.h"
+#include "expand.h"
+#include "state.h"
+#include "supervisor.h"
+#include "tokenizer.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * struct subshell
+ * <p>
+ * Runs a subshell made only of builtins, a ( ... ) group or a command substitution, in the
+ * shell's own process instead of a forked copy of it. The line gets its own tokenizer, arena
+ * and expander, so the command that holds it is left as it was. Nothing is copied when the
+ * subshell starts: the working directory, the environment and the options are saved only when
+ * something that can change them (cd, set, an assignment) first runs, and are put back when the
+ * subshell ends. Virtual subshells do not nest; one started inside another is forked.
+ * </p>
+ */
+struct subshell
+{
+    struct tokenizer *tokenizer;    // lexer for the subshell's commands
+    struct arena *arena;            // memory for the subshell's commands
+    struct expander *expander;      // expands the words of the subshell's commands
+    bool active;                    // whether a virtual subshell is running
+    bool saved;                     // whether the shell's state has been saved for this run
+    int cwd_fd;                     // the working directory before the subshell, -1 if saved as cwd
+    char *cwd;                      // the working directory before the subshell, if it could not be opened
+    char **environment;             // copies of the environment's NAME=value strings before the subshell
+    size_t environment_count;       // number of strings in environment
+    bool export_pwd;                // set -o exportpwd before the subshell
+    bool fork_exec;                 // set -o forkexec before the subshell
+    bool pipefail;                  // set -o pipefail before the subshell
+    int pipe_size;                  // set -o pipesize before the subshell
+    long prompt_deadline;           // set -o promptdeadline before the subshell
+    size_t parse_cache_capacity;    // set -o parsecache before the subshell
+    size_t file_cache_capacity;     // set -o filecache before the subshell
+    unsigned long runs;             // subshells run without a fork
+};
+
+/**
+ * subshell_create
+ * <p>
+ * Create the resources for virtual subshells.
+ * </p>
+ * @param supvis the supervisor object
+ * @param max_text_length the longest command accepted
+ * @return the subshell, or NULL on failure
+ */
+struct subshell *subshell_create(struct supervisor *supvis, size_t max_text_length);
+
+/**
+ * subshell_can_run
+ * <p>
+ * Check whether a command line can run as a virtual subshell: no virtual subshell is running,
+ * and every command of the line is a builtin named by a plain word, with no pipeline,
+ * redirection, background job or ( ... ) group. hash and exec are forked, as what they change
+ * (the command hash table, the shell's descriptors) is not saved.
+ * </p>
+ * @param subshell the subshell
+ * @param text the command line; it may hold several lines
+ * @param length the length of text
+ * @return true if it can, false if it must be forked
+ */
+bool subshell_can_run(struct subshell *subshell, const char *text, size_t length);
+
+/**
+ * subshell_run
+ * <p>
+ * Run a command line that subshell_can_run accepted, with state->stdout set to out, then put
+ * back the state it changed. exit ends the subshell, not the shell.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param text the command line
+ * @param length the length of text
+ * @param out the stream to which the subshell writes
+ * @return the exit status of the last command run
+ */
+int subshell_run(struct supervisor *supvis, struct state *state, const char *text, size_t length, FILE *out);
+
+/**
+ * subshell_save
+ * <p>
+ * Save the working directory, the environment and the options, if a virtual subshell is running
+ * and they have not been saved yet. Called before a builtin or an assignment that can change them.
+ * </p>
+ * @param state the state object
+ */
+void subshell_save(struct state *state);
+
+/**
+ * subshell_destroy
+ * <p>
+ * Free the resources for virtual subshells.
+ * </p>
+ * @param supvis the supervisor object
+ * @param subshell the subshell
+ */
+void subshell_destroy(struct supervisor *supvis, struct subshell *subshell);
+
+#endif //CSH_SUBSHELL_H
@@ -0,0 +1,234 @@
+#ifndef CSH_TOKENIZER_H
+#define CSH_TOKENIZER_H
+
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * The number of bytes read from the input at a time.
+ */
+#define TOKENIZER_CHUNK_SIZE 4096
+
+/**
+ * The word buffer is released after a command if it grew larger than this,
+ * so one very long line does not stay resident for the rest of the session.
+ */
+#define TOKENIZER_RETAIN_SIZE 65536
+
+/**
+ * token_type
+ * <p>
+ * The kinds of token produced by the tokenizer.
+ * </p>
+ */
+enum token_type
+{
+    TOKEN_WORD,     // a word, with its quoting intact
+    TOKEN_LESS,     // <
+    TOKEN_GREAT,    // >
+    TOKEN_DGREAT,   // >>
+    TOKEN_LESSAND,  // <&
+    TOKEN_GREATAND, // >&
+    TOKEN_ANDGREAT, // &>
+    TOKEN_ANDDGREAT, // &>>
+    TOKEN_SEMI,     // ;
+    TOKEN_AND_IF,   // &&
+    TOKEN_OR_IF,    // ||
+    TOKEN_AMP,      // &
+    TOKEN_PIPE,     // |
+    TOKEN_SUBSHELL  // ( ... ), the group as it was written
+};
+
+/**
+ * lexer_state
+ * <p>
+ * Where the tokenizer is within a command. Carried across chunk boundaries.
+ * </p>
+ */
+enum lexer_state
+{
+    LEX_BLANK,          // between tokens
+    LEX_WORD,           // in the unquoted part of a word
+    LEX_SINGLE_QUOTE,   // in '...'
+    LEX_DOUBLE_QUOTE,   // in "..."
+    LEX_COMMENT,        // after an unquoted # at the start of a word
+    LEX_LESS,           // after <, which may become <&
+    LEX_GREAT,          // after > or &>, which may become >>, >& or &>>
+    LEX_AMP,            // after &, which may become && or &>
+    LEX_PIPE,           // after |, which may become ||
+    LEX_SUBSTITUTION,   // in $(...) or ${...}, which is part of the word
+    LEX_BACKQUOTE       // in `...`, which is part of the word
+};
+
+/**
+ * struct token
+ * <p>
+ * A token of the current command.
+ * </p>
+ */
+struct token
+{
+    enum token_type type;   // the kind of token
+    int io_number;          // the fd a redirection applies to, or -1 for the default
+    size_t offset;          // offset of the word in tokenizer->text (TOKEN_WORD and TOKEN_SUBSHELL only)
+};
+
+/**
+ * struct tokenizer
+ * <p>
+ * Reads commands from a file descriptor in fixed size chunks and splits them into tokens.
+ * Words are stored back to back, null terminated, in a single buffer that is reused for
+ * every command.
+ * </p>
+ */
+struct tokenizer
+{
+    int fd;                             // descriptor from which to read
+    char chunk[TOKENIZER_CHUNK_SIZE];   // bytes read but not yet tokenized
+    size_t chunk_start;                 // first unconsumed byte in chunk
+    size_t chunk_end;                   // end of the bytes read into chunk
+    enum lexer_state lex_state;         // lexer state at the end of the last byte consumed
+    bool escape;                        // whether the last byte consumed was an unquoted '\'
+    bool in_word;                       // whether a word is being accumulated
+    bool dollar;                        // whether the last byte consumed was an unquoted or double quoted '$'
+    enum lexer_state outer_state;       // the state to return to at the end of a substitution
+    char open;                          // the bracket that opened the current substitution: '(' or '{'
+    size_t depth;                       // brackets open in the current $(...) or ${...}
+    char quote;                         // the quote open in the current $(...) or ${...}, or '\0'
+    char *text;                         // the words of the current command
+    size_t text_length;                 // bytes used in text
+    size_t text_capacity;               // bytes allocated for text
+    size_t max_text_length;             // longest command accepted
+    bool overflow;                      // whether the current command exceeded max_text_length
+    struct token *tokens;               // the tokens of the current command
+    size_t token_count;                 // number of tokens in the current command
+    size_t token_capacity;              // number of tokens allocated
+    size_t consumed;                    // bytes of input consumed by the current command
+    bool keep_source;                   // whether to keep the input of the current command in source
+    char *source;                       // the current command as read (keep_source only)
+    size_t source_length;               // bytes used in source
+    size_t source_capacity;             // bytes allocated for source
+    struct parse_cache *cache;          // tokens of lines seen before, NULL if lines are always lexed
+};
+
+/**
+ * tokenizer_create
+ * <p>
+ * Create a tokenizer reading from fd.
+ * </p>
+ * @param supvis the supervisor object
+ * @param fd the file descriptor from which to read commands
+ * @param max_text_length the longest command accepted
+ * @return the tokenizer, or NULL on failure
+ */
+struct tokenizer *tokenizer_create(struct supervisor *supvis, int fd, size_t max_text_length);
+
+/**
+ * tokenizer_read_command
+ * <p>
+ * Read chunks from the tokenizer's descriptor until a whole command has been tokenized.
+ * A command ends at an unquoted newline or at the end of input.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @return 1 if a command was read, 0 at the end of input, -1 on failure
+ */
+int tokenizer_read_command(struct tokenizer *tokenizer);
+
+/**
+ * tokenizer_feed
+ * <p>
+ * Tokenize bytes of input, stopping after the newline that ends a command. If the input starts
+ * a command with a whole line found in tokenizer->cache, the line's tokens are taken from the
+ * cache instead.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param input the bytes to tokenize
+ * @param length the number of bytes
+ * @param complete set to true if a command was completed
+ * @return the number of bytes consumed
+ */
+size_t tokenizer_feed(struct tokenizer *tokenizer, const char *input, size_t length, bool *complete);
+
+/**
+ * tokenizer_feed_line
+ * <p>
+ * Tokenize a whole command given without its newline, as tokenizer_feed followed by
+ * tokenizer_finish would.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param line the command
+ * @param length the length of the command
+ */
+void tokenizer_feed_line(struct tokenizer *tokenizer, const char *line, size_t length);
+
+/**
+ * tokenizer_load
+ * <p>
+ * Make tokens produced earlier the tokens of the current command, as if its input had been
+ * tokenized.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param tokens the tokens
+ * @param token_count the number of tokens
+ * @param text the words of the tokens
+ * @param text_length the bytes of words
+ * @param consumed the bytes of input the command took
+ * @return 0 on success, -1 on failure
+ */
+int tokenizer_load(struct tokenizer *tokenizer, const struct token *tokens, size_t token_count, const char *text,
+                   size_t text_length, size_t consumed);
+
+/**
+ * tokenizer_finish
+ * <p>
+ * End the current command at the end of input.
+ * </p>
+ * @param tokenizer the tokenizer
+ */
+void tokenizer_finish(struct tokenizer *tokenizer);
+
+/**
+ * tokenizer_source
+ * <p>
+ * Get the input of the current command as it was read, without its final newline. Only
+ * available if tokenizer->keep_source was set before the command was read.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param length set to the length of the input
+ * @return the input (not null terminated), or NULL if none was kept
+ */
+const char *tokenizer_source(const struct tokenizer *tokenizer, size_t *length);
+
+/**
+ * tokenizer_word
+ * <p>
+ * Get the text of a word token.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param token the token
+ * @return the null terminated word
+ */
+const char *tokenizer_word(const struct tokenizer *tokenizer, const struct token *token);
+
+/**
+ * tokenizer_reset
+ * <p>
+ * Discard the tokens of the current command. Unconsumed input is kept for the next command.
+ * </p>
+ * @param tokenizer the tokenizer
+ */
+void tokenizer_reset(struct tokenizer *tokenizer);
+
+/**
+ * tokenizer_destroy
+ * <p>
+ * Free a tokenizer and its buffers.
+ * </p>
+ * @param supvis the supervisor object
+ * @param tokenizer the tokenizer
+ */
+void tokenizer_destroy(struct supervisor *supvis, struct tokenizer *tokenizer);
+
+#endif //CSH_TOKENIZER_H
@@ -13,12 +13,20 @@
  * </p>
  *
  * <ul>
- * <li>in_redirect_regex: "[&#x2216;t&#x2216;f&#x2216;v]<.*"</li>
- * <li>out_redirect_regex: "[&#x2216;t&#x2216;f&#x2216;v][1^2]?>[>]?.*"</li>
- * <li>err_redirect_regex: "[&#x2216;t&#x2216;f&#x2216;v]2>[>].*"</li>
  * <li>path: the PATH env var separated into directories</li>
  * <li>prompt: the PS1 env var if set, otherwise "$"</li>
  * <li>max_line_length: the value of _SC_ARG_MAX (see sysconfig)</li>
+ * <li>script: the command string or mapped script file, if not reading from stdin</li>
+ * <li>script_cache: the compiled form of a script file (see script_cache_open)</li>
+ * <li>script_index: the structural index of the script, if it has no compiled form (see scan_structure)</li>
+ * <li>cwd: the working directory, and prompt_line: the prompt rendered with it</li>
+ * <li>tokenizer: the lexer for all commands, reading stdin if the input is not held in memory</li>
+ * <li>expander: the word expander</li>
+ * <li>parse_cache: the tokens of the last PARSE_CACHE_DEFAULT_CAPACITY distinct lines</li>
+ * <li>arena: the memory for each command, released when the state is reset</li>
+ * <li>history: the command history, if interactive</li>
+ * <li>completion: the completion engine over path, if interactive</li>
+ * <li>editor: the line editor on the terminal, if interactive</li>
  * </ul>
  * @param supvis the supervisor object
  * @param state the state to initialize
@@ -27,25 +35,47 @@
 struct state *do_init_state(struct supervisor *supvis, struct state *state);
 
 /**
- * do_reset_state
+ * do_update_working_dir
  * <p>
- * Reset the state for the next read by freeing dynamically allocated memory
- * of impermanent settings. Reset the error object.
+ * Refresh state->cwd from the process working directory and render the prompt again. If
+ * state->export_pwd is set, export the new directory as PWD and the previous one as OLDPWD.
+ * Only needs to be called when the working directory has changed (see builtin_cd).
  * </p>
  * @param supvis the supervisor object
- * @param state the state to reset
+ * @param state the state object
+ * @return 0 on success, -1 on failure
  */
-void do_reset_state(struct supervisor *supvis, struct state *state);
+int do_update_working_dir(struct supervisor *supvis, struct state *state);
+
+/**
+ * do_start_command
+ * <p>
+ * Note when the command just read was entered, for its history record.
+ * </p>
+ * @param state the state object
+ */
+void do_start_command(struct state *state);
 
 /**
- * do_reset_command
+ * do_record_history
  * <p>
- * Reset the command struct by freeing dynamically allocated memory and clearing variables.
+ * Append the command just executed to the history, with its exit code and how long it took.
+ * Does nothing if there is no history.
+ * </p>
+ * @param state the state object
+ */
+void do_record_history(struct state *state);
+
+/**
+ * do_reset_state
+ * <p>
+ * Reset the state for the next read by releasing the memory of impermanent settings, which is
+ * all in state->arena, at once. Reset the error object.
  * </p>
  * @param supvis the supervisor object
- * @param command the command object to reset
+ * @param state the state to reset
  */
-void do_reset_command(struct supervisor *supvis, struct command *command);
+void do_reset_state(struct supervisor *supvis, struct state *state);
 
 /**
  * do_destroy_state
@@ -0,0 +1,211 @@
+#include "../include/arena.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * arena_reserve
+ * <p>
+ * Make sure the current block has room for size more bytes after the object being grown, or
+ * after the aligned top if none is. A new block is at least twice the size of the current one;
+ * an object being grown is moved into it.
+ * </p>
+ * @param arena the arena
+ * @param size the number of bytes
+ * @return 0 on success, -1 on failure
+ */
+int arena_reserve(struct arena *arena, size_t size);
+
+/**
+ * align_up
+ * <p>
+ * Round an offset up to the alignment of any type.
+ * </p>
+ * @param offset the offset
+ * @return the aligned offset
+ */
+size_t align_up(size_t offset);
+
+struct arena *arena_create(struct supervisor *supvis)
+{
+    return mm_calloc(1, sizeof(struct arena), supvis->mm, __FILE__, __func__, __LINE__);
+}
+
+size_t align_up(size_t offset)
+{
+    return (offset + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+}
+
+int arena_reserve(struct arena *arena, size_t size)
+{
+    struct arena_block *block;
+    size_t             start;
+    size_t             moved;
+    size_t             block_size;
+    
+    start = (arena->growing) ? arena->object_start : align_up((arena->block) ? arena->block->used : 0);
+    moved = (arena->growing) ? arena->block->used - start : 0;
+    if (arena->block && start <= arena->block->size && arena->block->size - start - moved >= size)
+    {
+        return 0;
+    }
+    if (size > SIZE_MAX / 2 - moved)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    
+    block_size = (arena->block) ? arena->block->size * 2 : ARENA_BLOCK_SIZE;
+    while (block_size < moved + size)
+    {
+        block_size *= 2;
+    }
+    block = (struct arena_block *) malloc(sizeof(struct arena_block) + block_size);
+    if (!block)
+    {
+        return -1;
+    }
+    block->next = arena->block;
+    block->size = block_size;
+    block->used = 0;
+    
+    if (arena->growing)
+    {
+        memcpy(block->data, (char *) arena->block->data + start, moved);
+        arena->block->used  = start;
+        block->used         = moved;
+        arena->object_start = 0;
+    }
+    arena->block = block;
+    ++arena->blocks;
+    
+    return 0;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    void *memory;
+    
+    if (arena->growing || arena_reserve(arena, size) == -1)
+    {
+        return NULL;
+    }
+    
+    arena->block->used = align_up(arena->block->used);
+    memory = (char *) arena->block->data + arena->block->used;
+    arena->block->used += size;
+    
+    return memory;
+}
+
+void *arena_calloc(struct arena *arena, size_t count, size_t size)
+{
+    void *memory;
+    
+    if (size && count > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    memory = arena_alloc(arena, count * size);
+    if (memory)
+    {
+        memset(memory, 0, count * size);
+    }
+    
+    return memory;
+}
+
+char *arena_strndup(struct arena *arena, const char *text, size_t length)
+{
+    char *copy;
+    
+    copy = (char *) arena_alloc(arena, length + 1);
+    if (copy)
+    {
+        memcpy(copy, text, length);
+        *(copy + length) = '\0';
+    }
+    
+    return copy;
+}
+
+int arena_grow(struct arena *arena, const void *data, size_t length)
+{
+    char *top;
+    
+    if (arena_reserve(arena, length) == -1)
+    {
+        return -1;
+    }
+    if (!arena->growing)
+    {
+        arena->block->used  = align_up(arena->block->used);
+        arena->object_start = arena->block->used;
+        arena->growing      = true;
+    }
+    
+    top = (char *) arena->block->data + arena->block->used;
+    if (data)
+    {
+        memcpy(top, data, length);
+    } else
+    {
+        memset(top, 0, length);
+    }
+    arena->block->used += length;
+    
+    return 0;
+}
+
+size_t arena_object_size(const struct arena *arena)
+{
+    return (arena->growing) ? arena->block->used - arena->object_start : 0;
+}
+
+void *arena_finish(struct arena *arena)
+{
+    if (!arena->growing)
+    {
+        return NULL;
+    }
+    
+    arena->growing = false;
+    
+    return (char *) arena->block->data + arena->object_start;
+}
+
+void arena_reset(struct arena *arena)
+{
+    struct arena_block *block;
+    
+    if (!arena->block)
+    {
+        return;
+    }
+    
+    // The current block is the largest; the ones before it are freed.
+    while (arena->block->next)
+    {
+        block              = arena->block->next;
+        arena->block->next = block->next;
+        free(block);
+    }
+    arena->block->used = 0;
+    arena->growing     = false;
+}
+
+void arena_destroy(struct supervisor *supvis, struct arena *arena)
+{
+    struct arena_block *block;
+    
+    while (arena->block)
+    {
+        block        = arena->block;
+        arena->block = block->next;
+        free(block);
+    }
+    supvis->mm->mm_free(supvis->mm, arena);
+}
@@ -0,0 +1,1187 @@
+#include "../include/arith.h"
+#include "../include/parse_cache.h"
+#include "../include/subshell.h"
+
+#include <ctype.h>
+#include <dc_posix/dc_stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The number of levels of binary operators, from || (0) to * / % (9).
+ */
+#define ARITH_LEVEL_COUNT 10
+
+/**
+ * struct arith_parser
+ * <p>
+ * The state of the compiler while it parses an expression.
+ * </p>
+ */
+struct arith_parser
+{
+    struct arith_entry *entry;  // the expression, which receives the operations
+    const char *cursor;         // the next byte of the expression
+    bool failed;                // whether the expression is invalid or memory ran out
+    bool out_of_memory;         // whether memory ran out
+};
+
+/**
+ * compile_entry
+ * <p>
+ * Compile the expression of an entry into its operations.
+ * </p>
+ * @param entry the entry
+ * @param ostream the stream on which to print errors
+ * @return 0 on success, -1 on failure
+ */
+int compile_entry(struct arith_entry *entry, FILE *ostream);
+
+/**
+ * parse_comma
+ * <p>
+ * Compile a, b: the value is that of b.
+ * </p>
+ * @param parser the parser
+ */
+void parse_comma(struct arith_parser *parser);
+
+/**
+ * parse_assignment
+ * <p>
+ * Compile NAME = a and the compound assignments, or a conditional expression.
+ * </p>
+ * @param parser the parser
+ */
+void parse_assignment(struct arith_parser *parser);
+
+/**
+ * parse_conditional
+ * <p>
+ * Compile c ? a : b, or a binary expression. Only the operand chosen is evaluated.
+ * </p>
+ * @param parser the parser
+ */
+void parse_conditional(struct arith_parser *parser);
+
+/**
+ * parse_binary
+ * <p>
+ * Compile the binary operators of a level and the levels above it, left to right. The right
+ * operand of && and || is evaluated only if it decides the value.
+ * </p>
+ * @param parser the parser
+ * @param level the level, 0 for ||
+ */
+void parse_binary(struct arith_parser *parser, size_t level);
+
+/**
+ * parse_unary
+ * <p>
+ * Compile +a, -a, !a, ~a, ++NAME and --NAME, or a primary expression.
+ * </p>
+ * @param parser the parser
+ */
+void parse_unary(struct arith_parser *parser);
+
+/**
+ * parse_primary
+ * <p>
+ * Compile a constant, a variable, NAME++, NAME--, $?, $$ or a parenthesized expression.
+ * </p>
+ * @param parser the parser
+ */
+void parse_primary(struct arith_parser *parser);
+
+/**
+ * binary_operator
+ * <p>
+ * If the next operator belongs to a level, consume it.
+ * </p>
+ * @param parser the parser
+ * @param level the level
+ * @return the operation of the operator, or ARITH_PUSH if the next operator is not of the level
+ */
+enum arith_opcode binary_operator(struct arith_parser *parser, size_t level);
+
+/**
+ * assignment_operator
+ * <p>
+ * If the next operator is =, *=, /=, %=, +=, -=, <<=, >>=, &=, ^= or |=, consume it.
+ * </p>
+ * @param parser the parser
+ * @param binary set to the operation of a compound assignment, or ARITH_PUSH for =
+ * @return true if it was an assignment operator, false otherwise
+ */
+bool assignment_operator(struct arith_parser *parser, enum arith_opcode *binary);
+
+/**
+ * accept_operator
+ * <p>
+ * If the next operator is op, consume it.
+ * </p>
+ * @param parser the parser
+ * @param op the operator
+ * @return true if it was, false otherwise
+ */
+bool accept_operator(struct arith_parser *parser, const char *op);
+
+/**
+ * operator_length
+ * <p>
+ * Get the length of the longest operator at the start of text, as C reads them.
+ * </p>
+ * @param text the text
+ * @return the length, 0 if text does not start with an operator
+ */
+size_t operator_length(const char *text);
+
+/**
+ * is_operator
+ * <p>
+ * Check whether the operator at the start of text is op.
+ * </p>
+ * @param text the text
+ * @param length the length of the operator at the start of text
+ * @param op the operator
+ * @return true if it is, false otherwise
+ */
+bool is_operator(const char *text, size_t length, const char *op);
+
+/**
+ * read_name
+ * <p>
+ * If a variable, as NAME, $NAME or ${NAME}, is next, consume it.
+ * </p>
+ * @param parser the parser
+ * @param name set to the offset of the name in the expression
+ * @param length set to the length of the name
+ * @return true if a variable was next, false otherwise
+ */
+bool read_name(struct arith_parser *parser, size_t *name, size_t *length);
+
+/**
+ * skip_blanks
+ * <p>
+ * Consume the white space before the next token.
+ * </p>
+ * @param parser the parser
+ */
+void skip_blanks(struct arith_parser *parser);
+
+/**
+ * emit_op
+ * <p>
+ * Add an operation to the expression.
+ * </p>
+ * @param parser the parser
+ * @param code the operation
+ * @param value the constant or jump target
+ * @return the operation, valid until the next one is added, or NULL on failure
+ */
+struct arith_op *emit_op(struct arith_parser *parser, enum arith_opcode code, int64_t value);
+
+/**
+ * emit_name
+ * <p>
+ * Add an operation on a variable to the expression.
+ * </p>
+ * @param parser the parser
+ * @param code ARITH_LOAD or ARITH_STORE
+ * @param binary the operator of a compound assignment, or ARITH_PUSH
+ * @param name the offset of the name in the expression
+ * @param length the length of the name
+ */
+void emit_name(struct arith_parser *parser, enum arith_opcode code, enum arith_opcode binary, size_t name,
+               size_t length);
+
+/**
+ * patch_jump
+ * <p>
+ * Make a jump go to the next operation to be added.
+ * </p>
+ * @param parser the parser
+ * @param jump the index of the jump
+ */
+void patch_jump(struct arith_parser *parser, size_t jump);
+
+/**
+ * apply_operator
+ * <p>
+ * Apply a binary operation, wrapping around on overflow.
+ * </p>
+ * @param state the state object
+ * @param code the operation
+ * @param a the left operand
+ * @param b the right operand
+ * @param result set to the result
+ * @return 0 on success, -1 on division by zero
+ */
+int apply_operator(struct state *state, enum arith_opcode code, int64_t a, int64_t b, int64_t *result);
+
+/**
+ * load_variable
+ * <p>
+ * Get the value of a variable of an expression.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param entry the expression
+ * @param op the operation naming the variable
+ * @param value set to the value
+ * @return 0 on success, -1 if the variable does not hold an integer
+ */
+int load_variable(struct supervisor *supvis, struct state *state, const struct arith_entry *entry,
+                  const struct arith_op *op, int64_t *value);
+
+/**
+ * store_variable
+ * <p>
+ * Set a variable of an expression, in the environment. In a virtual subshell the environment
+ * is saved first, so the variable is put back when the subshell ends.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param entry the expression
+ * @param op the operation naming the variable
+ * @param value the value
+ */
+void store_variable(struct supervisor *supvis, struct state *state, const struct arith_entry *entry,
+                    const struct arith_op *op, int64_t value);
+
+/**
+ * parse_value
+ * <p>
+ * Read the value of a variable as an integer constant, with an optional sign and white space.
+ * </p>
+ * @param text the value
+ * @param value set to the integer
+ * @return 0 on success, -1 if text is not an integer
+ */
+int parse_value(const char *text, int64_t *value);
+
+/**
+ * free_entry
+ * <p>
+ * Free a compiled expression.
+ * </p>
+ * @param entry the entry
+ */
+void free_entry(struct arith_entry *entry);
+
+const struct arith_entry *arith_compile(struct arith_cache *cache, const char *text, size_t length, FILE *ostream)
+{
+    struct arith_entry **slot;
+    struct arith_entry *entry;
+    uint64_t           hash;
+    
+    hash  = parse_cache_hash(text, length);
+    slot  = cache->entries + (hash & (ARITH_CACHE_SIZE - 1));
+    entry = *slot;
+    if (entry && entry->hash == hash && entry->length == length && memcmp(entry->text, text, length) == 0)
+    {
+        ++cache->hits;
+        return entry;
+    }
+    ++cache->misses;
+    
+    entry = (struct arith_entry *) calloc(1, sizeof(struct arith_entry) + length + 1);
+    if (!entry)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    entry->hash   = hash;
+    entry->length = length;
+    memcpy(entry->text, text, length);
+    *(entry->text + length) = '\0';
+    
+    if (compile_entry(entry, ostream) == -1)
+    {
+        free_entry(entry);
+        return NULL;
+    }
+    
+    if (*slot)
+    {
+        free_entry(*slot);
+    }
+    *slot = entry;
+    
+    return entry;
+}
+
+int compile_entry(struct arith_entry *entry, FILE *ostream)
+{
+    struct arith_parser parser;
+    
+    parser.entry         = entry;
+    parser.cursor        = entry->text;
+    parser.failed        = false;
+    parser.out_of_memory = false;
+    
+    // $(()) is 0.
+    skip_blanks(&parser);
+    if (*parser.cursor)
+    {
+        parse_comma(&parser);
+        skip_blanks(&parser);
+        parser.failed = parser.failed || *parser.cursor;
+    } else
+    {
+        (void) emit_op(&parser, ARITH_PUSH, 0);
+    }
+    
+    if (!parser.failed)
+    {
+        // No operation pushes more than one value, so the stack never needs more than one per operation.
+        entry->stack = (int64_t *) malloc(entry->op_count * sizeof(int64_t));
+        if (!entry->stack)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        return 0;
+    }
+    
+    if (!parser.out_of_memory)
+    {
+        (void) fprintf(ostream, "csh: arithmetic syntax error: \'%s\'\n", entry->text);
+        errno = EINVAL;
+    }
+    
+    return -1;
+}
+
+void parse_comma(struct arith_parser *parser)
+{
+    parse_assignment(parser);
+    while (!parser->failed && accept_operator(parser, ","))
+    {
+        (void) emit_op(parser, ARITH_POP, 0);
+        parse_assignment(parser);
+    }
+}
+
+void parse_assignment(struct arith_parser *parser)
+{
+    const char        *start;
+    enum arith_opcode binary;
+    size_t            name;
+    size_t            length;
+    
+    skip_blanks(parser);
+    start = parser->cursor;
+    if (read_name(parser, &name, &length) && assignment_operator(parser, &binary))
+    {
+        parse_assignment(parser);
+        emit_name(parser, ARITH_STORE, binary, name, length);
+        return;
+    }
+    
+    parser->cursor = start;
+    parse_conditional(parser);
+}
+
+void parse_conditional(struct arith_parser *parser)
+{
+    size_t else_jump;
+    size_t end_jump;
+    
+    parse_binary(parser, 0);
+    if (parser->failed || !accept_operator(parser, "?"))
+    {
+        return;
+    }
+    
+    (void) emit_op(parser, ARITH_JUMP_IF_ZERO, 0);
+    else_jump = parser->entry->op_count - 1;
+    parse_comma(parser);
+    if (!accept_operator(parser, ":"))
+    {
+        parser->failed = true;
+        return;
+    }
+    (void) emit_op(parser, ARITH_JUMP, 0);
+    end_jump = parser->entry->op_count - 1;
+    patch_jump(parser, else_jump);
+    parse_assignment(parser);
+    patch_jump(parser, end_jump);
+}
+
+void parse_binary(struct arith_parser *parser, size_t level)
+{
+    enum arith_opcode code;
+    size_t            short_jump;
+    size_t            end_jump;
+    
+    if (level == ARITH_LEVEL_COUNT)
+    {
+        parse_unary(parser);
+        return;
+    }
+    
+    parse_binary(parser, level + 1);
+    
+    // a || b is a, jump to 1 if true, else b != 0; a && b is the same with 0 if false.
+    if (level <= 1)
+    {
+        while (!parser->failed && accept_operator(parser, (level == 0) ? "||" : "&&"))
+        {
+            (void) emit_op(parser, (level == 0) ? ARITH_JUMP_IF_NONZERO : ARITH_JUMP_IF_ZERO, 0);
+            short_jump = parser->entry->op_count - 1;
+            parse_binary(parser, level + 1);
+            (void) emit_op(parser, ARITH_TRUTH, 0);
+            (void) emit_op(parser, ARITH_JUMP, 0);
+            end_jump = parser->entry->op_count - 1;
+            patch_jump(parser, short_jump);
+            (void) emit_op(parser, ARITH_PUSH, (level == 0) ? 1 : 0);
+            patch_jump(parser, end_jump);
+        }
+        return;
+    }
+    
+    for (code = binary_operator(parser, level); !parser->failed && code != ARITH_PUSH;
+         code = binary_operator(parser, level))
+    {
+        parse_binary(parser, level + 1);
+        (void) emit_op(parser, code, 0);
+    }
+}
+
+void parse_unary(struct arith_parser *parser)
+{
+    size_t length;
+    size_t name;
+    size_t name_length;
+    char   c;
+    
+    skip_blanks(parser);
+    length = operator_length(parser->cursor);
+    if (is_operator(parser->cursor, length, "++") || is_operator(parser->cursor, length, "--"))
+    {
+        c = *parser->cursor;
+        parser->cursor += length;
+        skip_blanks(parser);
+        if (!read_name(parser, &name, &name_length))
+        {
+            parser->failed = true;
+            return;
+        }
+        (void) emit_op(parser, ARITH_PUSH, 1);
+        emit_name(parser, ARITH_STORE, (c == '+') ? ARITH_ADD : ARITH_SUBTRACT, name, name_length);
+        return;
+    }
+    
+    if (length == 1 && strchr("+-!~", *parser->cursor))
+    {
+        c = *parser->cursor++;
+        parse_unary(parser);
+        if (c != '+')
+        {
+            (void) emit_op(parser, (c == '-') ? ARITH_NEGATE : (c == '!') ? ARITH_NOT : ARITH_COMPLEMENT, 0);
+        }
+        return;
+    }
+    
+    parse_primary(parser);
+}
+
+void parse_primary(struct arith_parser *parser)
+{
+    char               *end;
+    unsigned long long value;
+    size_t             name;
+    size_t             name_length;
+    size_t             length;
+    int                saved_errno;
+    
+    skip_blanks(parser);
+    if (*parser->cursor == '(')
+    {
+        ++parser->cursor;
+        parse_comma(parser);
+        parser->failed = parser->failed || !accept_operator(parser, ")");
+        return;
+    }
+    
+    if (isdigit((unsigned char) *parser->cursor))
+    {
+        // Constants past 64 bits are cut to the largest; C would not compile them.
+        saved_errno = errno;
+        value       = strtoull(parser->cursor, &end, 0);
+        errno       = saved_errno;
+        if (isalnum((unsigned char) *end) || *end == '_')
+        {
+            parser->failed = true;
+            return;
+        }
+        parser->cursor = end;
+        (void) emit_op(parser, ARITH_PUSH, (int64_t) value);
+        return;
+    }
+    
+    if (*parser->cursor == '$' && (*(parser->cursor + 1) == '?' || *(parser->cursor + 1) == '$'))
+    {
+        (void) emit_op(parser, (*(parser->cursor + 1) == '?') ? ARITH_STATUS : ARITH_PID, 0);
+        parser->cursor += 2;
+        return;
+    }
+    
+    if (!read_name(parser, &name, &name_length))
+    {
+        parser->failed = true;
+        return;
+    }
+    emit_name(parser, ARITH_LOAD, ARITH_PUSH, name, name_length);
+    
+    // NAME++ leaves the old value: load, add 1 and store, then drop the new value.
+    skip_blanks(parser);
+    length = operator_length(parser->cursor);
+    if (is_operator(parser->cursor, length, "++") || is_operator(parser->cursor, length, "--"))
+    {
+        (void) emit_op(parser, ARITH_PUSH, 1);
+        emit_name(parser, ARITH_STORE, (*parser->cursor == '+') ? ARITH_ADD : ARITH_SUBTRACT, name, name_length);
+        (void) emit_op(parser, ARITH_POP, 0);
+        parser->cursor += length;
+    }
+}
+
+enum arith_opcode binary_operator(struct arith_parser *parser, size_t level)
+{
+    enum arith_opcode code;
+    const char        *text;
+    size_t            length;
+    
+    skip_blanks(parser);
+    text   = parser->cursor;
+    length = operator_length(text);
+    code   = ARITH_PUSH;
+    switch (level)
+    {
+        case 2:
+        {
+            code = (is_operator(text, length, "|")) ? ARITH_BIT_OR : ARITH_PUSH;
+            break;
+        }
+        case 3:
+        {
+            code = (is_operator(text, length, "^")) ? ARITH_BIT_XOR : ARITH_PUSH;
+            break;
+        }
+        case 4:
+        {
+            code = (is_operator(text, length, "&")) ? ARITH_BIT_AND : ARITH_PUSH;
+            break;
+        }
+        case 5:
+        {
+            code = (is_operator(text, length, "==")) ? ARITH_EQUAL
+                   : (is_operator(text, length, "!=")) ? ARITH_NOT_EQUAL : ARITH_PUSH;
+            break;
+        }
+        case 6:
+        {
+            code = (is_operator(text, length, "<")) ? ARITH_LESS
+                   : (is_operator(text, length, "<=")) ? ARITH_LESS_EQUAL
+                   : (is_operator(text, length, ">")) ? ARITH_GREATER
+                   : (is_operator(text, length, ">=")) ? ARITH_GREATER_EQUAL : ARITH_PUSH;
+            break;
+        }
+        case 7:
+        {
+            code = (is_operator(text, length, "<<")) ? ARITH_SHIFT_LEFT
+                   : (is_operator(text, length, ">>")) ? ARITH_SHIFT_RIGHT : ARITH_PUSH;
+            break;
+        }
+        case 8:
+        {
+            code = (is_operator(text, length, "+")) ? ARITH_ADD
+                   : (is_operator(text, length, "-")) ? ARITH_SUBTRACT : ARITH_PUSH;
+            break;
+        }
+        case 9:
+        {
+            code = (is_operator(text, length, "*")) ? ARITH_MULTIPLY
+                   : (is_operator(text, length, "/")) ? ARITH_DIVIDE
+                   : (is_operator(text, length, "%")) ? ARITH_REMAINDER : ARITH_PUSH;
+            break;
+        }
+        default: // || and && are compiled with jumps
+        {
+            break;
+        }
+    }
+    
+    if (code != ARITH_PUSH)
+    {
+        parser->cursor += length;
+    }
+    
+    return code;
+}
+
+bool assignment_operator(struct arith_parser *parser, enum arith_opcode *binary)
+{
+    const char *text;
+    size_t     length;
+    
+    skip_blanks(parser);
+    text   = parser->cursor;
+    length = operator_length(text);
+    if (length == 0 || *(text + length - 1) != '=' || is_operator(text, length, "==")
+        || is_operator(text, length, "!=") || is_operator(text, length, "<=") || is_operator(text, length, ">="))
+    {
+        return false;
+    }
+    
+    // The operator is the assignment without its '='.
+    switch (*text)
+    {
+        case '*':
+        {
+            *binary = ARITH_MULTIPLY;
+            break;
+        }
+        case '/':
+        {
+            *binary = ARITH_DIVIDE;
+            break;
+        }
+        case '%':
+        {
+            *binary = ARITH_REMAINDER;
+            break;
+        }
+        case '+':
+        {
+            *binary = ARITH_ADD;
+            break;
+        }
+        case '-':
+        {
+            *binary = ARITH_SUBTRACT;
+            break;
+        }
+        case '<':
+        {
+            *binary = ARITH_SHIFT_LEFT;
+            break;
+        }
+        case '>':
+        {
+            *binary = ARITH_SHIFT_RIGHT;
+            break;
+        }
+        case '&':
+        {
+            *binary = ARITH_BIT_AND;
+            break;
+        }
+        case '^':
+        {
+            *binary = ARITH_BIT_XOR;
+            break;
+        }
+        case '|':
+        {
+            *binary = ARITH_BIT_OR;
+            break;
+        }
+        default:
+        {
+            *binary = ARITH_PUSH;
+        }
+    }
+    parser->cursor += length;
+    
+    return true;
+}
+
+bool accept_operator(struct arith_parser *parser, const char *op)
+{
+    size_t length;
+    
+    skip_blanks(parser);
+    length = operator_length(parser->cursor);
+    if (!is_operator(parser->cursor, length, op))
+    {
+        return false;
+    }
+    parser->cursor += length;
+    
+    return true;
+}
+
+size_t operator_length(const char *text)
+{
+    const char *pairs;
+    
+    if (!*text)
+    {
+        return 0;
+    }
+    if (strncmp(text, "<<=", 3) == 0 || strncmp(text, ">>=", 3) == 0)
+    {
+        return 3;
+    }
+    
+    pairs = "<=>===!=&&||++--+=-=*=/=%=&=^=|=<<>>";
+    for (const char *pair = pairs; *pair; pair += 2)
+    {
+        if (*text == *pair && *(text + 1) == *(pair + 1))
+        {
+            return 2;
+        }
+    }
+    
+    return (strchr("+-*/%<>=!~&^|?:,()", *text)) ? 1 : 0;
+}
+
+bool is_operator(const char *text, size_t length, const char *op)
+{
+    return length && strlen(op) == length && strncmp(text, op, length) == 0;
+}
+
+bool read_name(struct arith_parser *parser, size_t *name, size_t *length)
+{
+    const char *start;
+    bool       braced;
+    size_t     count;
+    
+    start  = parser->cursor;
+    braced = false;
+    if (*start == '$')
+    {
+        ++start;
+        braced = (*start == '{');
+        start += (braced) ? 1 : 0;
+    }
+    
+    if (!isalpha((unsigned char) *start) && *start != '_')
+    {
+        return false;
+    }
+    for (count = 1; isalnum((unsigned char) *(start + count)) || *(start + count) == '_'; ++count)
+    {
+    }
+    if ((braced && *(start + count) != '}') || count > ARITH_NAME_MAX)
+    {
+        return false;
+    }
+    
+    *name          = (size_t) (start - parser->entry->text);
+    *length        = count;
+    parser->cursor = start + count + ((braced) ? 1 : 0);
+    
+    return true;
+}
+
+void skip_blanks(struct arith_parser *parser)
+{
+    while (isspace((unsigned char) *parser->cursor))
+    {
+        ++parser->cursor;
+    }
+}
+
+struct arith_op *emit_op(struct arith_parser *parser, enum arith_opcode code, int64_t value)
+{
+    struct arith_entry *entry;
+    struct arith_op    *op;
+    
+    if (parser->failed)
+    {
+        return NULL;
+    }
+    
+    entry = parser->entry;
+    if (entry->op_count == entry->op_capacity)
+    {
+        size_t          capacity;
+        struct arith_op *ops;
+        
+        capacity = (entry->op_capacity) ? entry->op_capacity * 2 : 16;
+        ops      = (struct arith_op *) realloc(entry->ops, capacity * sizeof(struct arith_op));
+        if (!ops)
+        {
+            parser->failed        = true;
+            parser->out_of_memory = true;
+            errno = ENOMEM;
+            return NULL;
+        }
+        entry->ops         = ops;
+        entry->op_capacity = capacity;
+    }
+    
+    op = entry->ops + entry->op_count++;
+    op->code        = code;
+    op->binary      = ARITH_PUSH;
+    op->value       = value;
+    op->name        = 0;
+    op->name_length = 0;
+    
+    return op;
+}
+
+void emit_name(struct arith_parser *parser, enum arith_opcode code, enum arith_opcode binary, size_t name,
+               size_t length)
+{
+    struct arith_op *op;
+    
+    op = emit_op(parser, code, 0);
+    if (op)
+    {
+        op->binary      = binary;
+        op->name        = name;
+        op->name_length = length;
+    }
+}
+
+void patch_jump(struct arith_parser *parser, size_t jump)
+{
+    if (!parser->failed)
+    {
+        (parser->entry->ops + jump)->value = (int64_t) parser->entry->op_count;
+    }
+}
+
+int arith_evaluate(struct supervisor *supvis, struct state *state, const struct arith_entry *entry, int64_t *result)
+{
+    const struct arith_op *op;
+    int64_t               *top;
+    int64_t               value;
+    
+    top = entry->stack;
+    for (size_t pc = 0; pc < entry->op_count; ++pc)
+    {
+        op = entry->ops + pc;
+        switch (op->code)
+        {
+            case ARITH_PUSH:
+            {
+                *top++ = op->value;
+                break;
+            }
+            case ARITH_LOAD:
+            {
+                if (load_variable(supvis, state, entry, op, top) == -1)
+                {
+                    return -1;
+                }
+                ++top;
+                break;
+            }
+            case ARITH_STORE:
+            {
+                if (op->binary != ARITH_PUSH)
+                {
+                    if (load_variable(supvis, state, entry, op, &value) == -1
+                        || apply_operator(state, op->binary, value, *(top - 1), top - 1) == -1)
+                    {
+                        return -1;
+                    }
+                }
+                store_variable(supvis, state, entry, op, *(top - 1));
+                break;
+            }
+            case ARITH_POP:
+            {
+                --top;
+                break;
+            }
+            case ARITH_STATUS:
+            {
+                *top++ = state->exit_code;
+                break;
+            }
+            case ARITH_PID:
+            {
+                *top++ = getpid();
+                break;
+            }
+            case ARITH_NEGATE:
+            {
+                *(top - 1) = (int64_t) (0 - (uint64_t) *(top - 1));
+                break;
+            }
+            case ARITH_NOT:
+            {
+                *(top - 1) = !*(top - 1);
+                break;
+            }
+            case ARITH_COMPLEMENT:
+            {
+                *(top - 1) = ~*(top - 1);
+                break;
+            }
+            case ARITH_TRUTH:
+            {
+                *(top - 1) = *(top - 1) != 0;
+                break;
+            }
+            case ARITH_JUMP:
+            {
+                pc = (size_t) op->value - 1;
+                break;
+            }
+            case ARITH_JUMP_IF_ZERO:
+            case ARITH_JUMP_IF_NONZERO:
+            {
+                value = *--top;
+                if ((value == 0) == (op->code == ARITH_JUMP_IF_ZERO))
+                {
+                    pc = (size_t) op->value - 1;
+                }
+                break;
+            }
+            case ARITH_MULTIPLY:
+            case ARITH_DIVIDE:
+            case ARITH_REMAINDER:
+            case ARITH_ADD:
+            case ARITH_SUBTRACT:
+            case ARITH_SHIFT_LEFT:
+            case ARITH_SHIFT_RIGHT:
+            case ARITH_LESS:
+            case ARITH_LESS_EQUAL:
+            case ARITH_GREATER:
+            case ARITH_GREATER_EQUAL:
+            case ARITH_EQUAL:
+            case ARITH_NOT_EQUAL:
+            case ARITH_BIT_AND:
+            case ARITH_BIT_XOR:
+            case ARITH_BIT_OR:
+            default:
+            {
+                --top;
+                if (apply_operator(state, op->code, *(top - 1), *top, top - 1) == -1)
+                {
+                    return -1;
+                }
+            }
+        }
+    }
+    
+    *result = *(top - 1);
+    
+    return 0;
+}
+
+int apply_operator(struct state *state, enum arith_opcode code, int64_t a, int64_t b, int64_t *result)
+{
+    // Unsigned arithmetic wraps around where signed would overflow.
+    switch (code)
+    {
+        case ARITH_MULTIPLY:
+        {
+            *result = (int64_t) ((uint64_t) a * (uint64_t) b);
+            break;
+        }
+        case ARITH_DIVIDE:
+        case ARITH_REMAINDER:
+        {
+            if (b == 0)
+            {
+                (void) fprintf(state->stdout, "csh: arithmetic: division by zero\n");
+                errno = EINVAL;
+                return -1;
+            }
+            if (a == INT64_MIN && b == -1)
+            {
+                *result = (code == ARITH_DIVIDE) ? INT64_MIN : 0;
+            } else
+            {
+                *result = (code == ARITH_DIVIDE) ? a / b : a % b;
+            }
+            break;
+        }
+        case ARITH_ADD:
+        {
+            *result = (int64_t) ((uint64_t) a + (uint64_t) b);
+            break;
+        }
+        case ARITH_SUBTRACT:
+        {
+            *result = (int64_t) ((uint64_t) a - (uint64_t) b);
+            break;
+        }
+        case ARITH_SHIFT_LEFT:
+        {
+            *result = (int64_t) ((uint64_t) a << (b & 63));
+            break;
+        }
+        case ARITH_SHIFT_RIGHT:
+        {
+            *result = a >> (b & 63);
+            break;
+        }
+        case ARITH_LESS:
+        {
+            *result = a < b;
+            break;
+        }
+        case ARITH_LESS_EQUAL:
+        {
+            *result = a <= b;
+            break;
+        }
+        case ARITH_GREATER:
+        {
+            *result = a > b;
+            break;
+        }
+        case ARITH_GREATER_EQUAL:
+        {
+            *result = a >= b;
+            break;
+        }
+        case ARITH_EQUAL:
+        {
+            *result = a == b;
+            break;
+        }
+        case ARITH_NOT_EQUAL:
+        {
+            *result = a != b;
+            break;
+        }
+        case ARITH_BIT_AND:
+        {
+            *result = a & b;
+            break;
+        }
+        case ARITH_BIT_XOR:
+        {
+            *result = a ^ b;
+            break;
+        }
+        case ARITH_BIT_OR:
+        {
+            *result = a | b;
+            break;
+        }
+        case ARITH_PUSH: // = assigns the operand as it is
+        case ARITH_LOAD:
+        case ARITH_STORE:
+        case ARITH_POP:
+        case ARITH_STATUS:
+        case ARITH_PID:
+        case ARITH_NEGATE:
+        case ARITH_NOT:
+        case ARITH_COMPLEMENT:
+        case ARITH_TRUTH:
+        case ARITH_JUMP:
+        case ARITH_JUMP_IF_ZERO:
+        case ARITH_JUMP_IF_NONZERO:
+        default:
+        {
+            *result = b;
+        }
+    }
+    
+    return 0;
+}
+
+int load_variable(struct supervisor *supvis, struct state *state, const struct arith_entry *entry,
+                  const struct arith_op *op, int64_t *value)
+{
+    char       name[ARITH_NAME_MAX + 1];
+    const char *text;
+    
+    memcpy(name, entry->text + op->name, op->name_length);
+    *(name + op->name_length) = '\0';
+    
+    text = dc_getenv(supvis->env, name);
+    if (!text)
+    {
+        *value = 0;
+        return 0;
+    }
+    if (parse_value(text, value) == -1)
+    {
+        (void) fprintf(state->stdout, "csh: arithmetic: %s is not an integer: \'%s\'\n", name, text);
+        errno = EINVAL;
+        return -1;
+    }
+    
+    return 0;
+}
+
+void store_variable(struct supervisor *supvis, struct state *state, const struct arith_entry *entry,
+                    const struct arith_op *op, int64_t value)
+{
+    char name[ARITH_NAME_MAX + 1];
+    char number[24];
+    
+    memcpy(name, entry->text + op->name, op->name_length);
+    *(name + op->name_length) = '\0';
+    (void) snprintf(number, sizeof(number), "%" PRId64, value);
+    
+    subshell_save(state);
+    dc_setenv(supvis->env, supvis->err, name, number, true);
+}
+
+int parse_value(const char *text, int64_t *value)
+{
+    char               *end;
+    unsigned long long magnitude;
+    bool               negative;
+    int                saved_errno;
+    
+    while (isspace((unsigned char) *text))
+    {
+        ++text;
+    }
+    if (!*text)
+    {
+        *value = 0;
+        return 0;
+    }
+    
+    negative = (*text == '-');
+    if (*text == '-' || *text == '+')
+    {
+        ++text;
+    }
+    if (!isdigit((unsigned char) *text))
+    {
+        return -1;
+    }
+    
+    saved_errno = errno;
+    magnitude   = strtoull(text, &end, 0);
+    errno       = saved_errno;
+    while (isspace((unsigned char) *end))
+    {
+        ++end;
+    }
+    if (*end)
+    {
+        return -1;
+    }
+    
+    *value = (negative) ? (int64_t) (0 - (uint64_t) magnitude) : (int64_t) magnitude;
+    
+    return 0;
+}
+
+void free_entry(struct arith_entry *entry)
+{
+    free(entry->ops);
+    free(entry->stack);
+    free(entry);
+}
+
+void arith_cache_destroy(struct arith_cache *cache)
+{
+    for (size_t i = 0; i < ARITH_CACHE_SIZE; ++i)
+    {
+        if (*(cache->entries + i))
+        {
+            free_entry(*(cache->entries + i));
+        }
+    }
+    free(cache);
+}
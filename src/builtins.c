@@ -1,5 +1,15 @@
 #include "../include/builtins.h"
+#include "../include/command_hash.h"
+#include "../include/completion.h"
+#include "../include/execute.h"
+#include "../include/file_cache.h"
+#include "../include/history_index.h"
+#include "../include/parse_cache.h"
 
+#include <dc_posix/dc_stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -14,18 +24,6 @@
  */
 void cd_error_message(int err_code, const char *arg, FILE *ostream);
 
-/**
- * find_command
- * <p>
- * Assemble a path directory and a command together, then check if it exists.
- * </p>
- * @param cmd the command to check for existence
- * @param path the path on which to check existence
- * @param cmd_len the length of the command
- * @return the location if found, NULL otherwise
- */
-char *find_command(const char *cmd, const char *path, size_t cmd_len);
-
 /**
  * cd_error_message
  * <p>
@@ -37,6 +35,61 @@ char *find_command(const char *cmd, const char *path, size_t cmd_len);
  */
 void which_err_message(int err_code, const char *cmd, FILE *ostream);
 
+/**
+ * print_completion
+ * <p>
+ * Print a completion found by builtin_compgen.
+ * </p>
+ * @param name the completed name
+ * @param length the length of the name
+ * @param directory whether the name is a directory
+ * @param arg the stream on which to print the name
+ */
+void print_completion(const char *name, size_t length, bool directory, void *arg);
+
+/**
+ * search_history
+ * <p>
+ * Print the distinct commands in the history starting with a prefix, most recent first.
+ * </p>
+ * @param state the state object holding the history
+ * @param prefix the prefix
+ * @param ostream the stream on which to print the commands and errors
+ * @return 0 on success, -1 on failure
+ */
+int search_history(struct state *state, const char *prefix, FILE *ostream);
+
+/**
+ * set_option
+ * <p>
+ * Turn a shell option on or off.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object holding the options
+ * @param name the name of the option
+ * @param enable whether to turn the option on
+ * @param ostream the stream on which to print errors
+ * @return 0 on success, -1 if there is no such option
+ */
+int set_option(struct supervisor *supvis, struct state *state, const char *name, bool enable, FILE *ostream);
+
+/**
+ * print_options
+ * <p>
+ * Print each shell option and whether it is on.
+ * </p>
+ * @param state the state object holding the options
+ * @param ostream the stream on which to print the options
+ */
+void print_options(const struct state *state, FILE *ostream);
+
+bool is_builtin(const char *name)
+{
+    return strcmp(name, "cd") == 0 || strcmp(name, "exit") == 0 || strcmp(name, "compgen") == 0
+           || strcmp(name, "history") == 0 || strcmp(name, "set") == 0 || strcmp(name, "which") == 0
+           || strcmp(name, "where") == 0 || strcmp(name, "hash") == 0 || strcmp(name, "exec") == 0;
+}
+
 int builtin_cd(struct command *command, FILE *ostream)
 {
     int exit_code;
@@ -113,62 +166,163 @@ void cd_error_message(int err_code, const char *arg, FILE *ostream)
     }
 }
 
-int builtin_which(char *cmd, char **path, FILE *ostream)
+int builtin_which(struct state *state, const char *cmd, FILE *ostream)
 {
+    const char *location;
+    int        error;
+    
     if (!cmd)
     {
         (void) fprintf(ostream, "which: must provide an argument\n");
         return -1;
     }
     
-    int    status;
-    size_t cmd_len;
-    char   *location;
+    error = ENOENT;
+    if (strchr(cmd, '/'))
+    {
+        location = (command_executable(AT_FDCWD, cmd, &error)) ? cmd : NULL;
+    } else
+    {
+        location = command_hash_find(state->command_hash, cmd, &error);
+    }
     
-    cmd_len = strlen(cmd);
+    if (!location)
+    {
+        which_err_message(error, cmd, ostream);
+        return -1;
+    }
+    
+    (void) fprintf(ostream, "%s\n", location);
+    
+    return 0;
+}
+
+int builtin_hash(struct state *state, struct command *command, FILE *ostream)
+{
+    const struct command_hash_entry *entry;
+    const char                      *option;
+    int                             status;
+    int                             error;
     
-    location = NULL;
-    for (; *path && !location; ++path)
+    option = *(command->argv + 1);
+    if (!option)
     {
-        location = find_command(cmd, *path, cmd_len);
+        if (!state->command_hash->count)
+        {
+            (void) fprintf(ostream, "hash: hash table empty\n");
+            return 0;
+        }
+        (void) fprintf(ostream, "hits\tcommand\tpath\n");
+        for (size_t i = 0; i < COMMAND_HASH_BUCKETS; ++i)
+        {
+            for (entry = *(state->command_hash->buckets + i); entry; entry = entry->next)
+            {
+                (void) fprintf(ostream, "%4lu\t%s\t%s\n", entry->hits, entry->name,
+                               (entry->path) ? entry->path : "(not found)");
+            }
+        }
+        return 0;
     }
     
-    if (location)
+    if (strcmp(option, "-r") == 0)
     {
-        (void) fprintf(ostream, "%s\n", location);
-        status = 0;
-        free(location);
-    } else
+        command_hash_clear(state->command_hash);
+        return 0;
+    }
+    
+    status = 0;
+    if (strcmp(option, "-d") == 0)
     {
-        which_err_message(errno, cmd, ostream);
-        status = -1;
+        for (char **name = command->argv + 2; *name; ++name)
+        {
+            if (!command_hash_remove(state->command_hash, *name))
+            {
+                (void) fprintf(ostream, "hash: %s: not found\n", *name);
+                status = -1;
+            }
+        }
+        return status;
+    }
+    
+    // Naming a command searches the path for it again, as a command added to the path is not otherwise seen.
+    for (char **name = command->argv + 1; *name; ++name)
+    {
+        if (strchr(*name, '/'))
+        {
+            continue;
+        }
+        (void) command_hash_remove(state->command_hash, *name);
+        error = ENOENT;
+        if (!command_hash_find(state->command_hash, *name, &error))
+        {
+            (void) fprintf(ostream, "hash: %s: not found\n", *name);
+            status = -1;
+        }
     }
     
     return status;
 }
 
-char *find_command(const char *cmd, const char *path, const size_t cmd_len)
+int builtin_exec(struct state *state, struct command *command, FILE *ostream)
 {
-    size_t len;
-    char   *path_and_cmd;
-    int    status;
+    int flags;
+    
+    if (*(command->argv + 1))
+    {
+        (void) fprintf(ostream, "exec: %s: replacing the shell with a command is not supported\n", *(command->argv + 1));
+        return -1;
+    }
+    
+    // The shell's own descriptors are the close-on-exec ones; moving one would pull it from under the shell.
+    for (const struct redirection *redirection = command->redirections; redirection; redirection = redirection->next)
+    {
+        flags = fcntl(redirection->fd, F_GETFD);
+        if (flags != -1 && (flags & FD_CLOEXEC))
+        {
+            (void) fprintf(ostream, "exec: %d: descriptor in use by the shell\n", redirection->fd);
+            return -1;
+        }
+    }
+    errno = 0;
     
-    len          = strlen(path) + cmd_len + 2;
-    path_and_cmd = (char *) malloc(len);
-    strcpy(path_and_cmd, path);
-    strcat(path_and_cmd, "/");
-    strcat(path_and_cmd, cmd);
+    // Output is fully buffered when not interactive; flush it to where it was going.
+    (void) fflush(state->stdout);
+    (void) fflush(state->stderr);
     
-    status = access(path_and_cmd, F_OK);
+    return apply_redirections(state, command);
+}
+
+int builtin_exit(const struct state *state, struct command *command, FILE *ostream)
+{
+    const char *arg;
+    char       *end;
+    long       status;
     
-    if (!status)
+    arg = *(command->argv + 1);
+    if (!arg)
     {
-        return path_and_cmd;
+        command->exit_code = state->exit_code;
+        return 0;
+    }
+    if (*(command->argv + 2))
+    {
+        (void) fprintf(ostream, "exit: too many arguments\n");
+        command->exit_code = EXIT_FAILURE;
+        return -1;
     }
     
-    free(path_and_cmd);
+    errno  = 0;
+    status = strtol(arg, &end, 10);
+    if (errno || end == arg || *end)
+    {
+        errno = 0;
+        (void) fprintf(ostream, "exit: %s: numeric argument required\n", arg);
+        command->exit_code = 2;
+        return 0;
+    }
+    command->exit_code = (int) (status & 0xFF);
     
-    return NULL;
+    return 0;
 }
 
 void which_err_message(int err_code, const char *cmd, FILE *ostream)
@@ -211,3 +365,301 @@ void which_err_message(int err_code, const char *cmd, FILE *ostream)
         }
     }
 }
+
+int builtin_compgen(struct state *state, struct command *command, FILE *ostream)
+{
+    const char *word;
+    ssize_t    count;
+    
+    if (!*(command->argv + 1) || (strcmp(*(command->argv + 1), "-c") != 0 && strcmp(*(command->argv + 1), "-f") != 0))
+    {
+        (void) fprintf(ostream, "compgen: usage: compgen -c|-f [word]\n");
+        return -1;
+    }
+    
+    if (!state->completion)
+    {
+        (void) fprintf(ostream, "compgen: completion is only available interactively\n");
+        return -1;
+    }
+    
+    word  = (*(command->argv + 2)) ? *(command->argv + 2) : "";
+    count = (*(*(command->argv + 1) + 1) == 'c')
+            ? completion_commands(state->completion, word, strlen(word), print_completion, ostream)
+            : completion_files(state->completion, state->cwd, word, strlen(word), print_completion, ostream);
+    if (count == -1)
+    {
+        (void) fprintf(ostream, "compgen: %s\n", strerror(errno));
+        errno = 0;
+        return -1;
+    }
+    
+    return (count) ? 0 : 1;
+}
+
+void print_completion(const char *name, size_t length, bool directory, void *arg)
+{
+    (void) fprintf((FILE *) arg, "%.*s%s\n", (int) length, name, (directory) ? "/" : "");
+}
+
+int builtin_history(struct state *state, struct command *command, FILE *ostream)
+{
+    struct history_entry entry;
+    struct tm            local;
+    char                 when[32];
+    char                 *end;
+    long                 count;
+    size_t               available;
+    
+    if (!state->history)
+    {
+        (void) fprintf(ostream, "history: no history in this session\n");
+        return -1;
+    }
+    
+    if (*(command->argv + 1) && strcmp(*(command->argv + 1), "-s") == 0)
+    {
+        if (!*(command->argv + 2))
+        {
+            (void) fprintf(ostream, "history: usage: history -s prefix\n");
+            return -1;
+        }
+        return search_history(state, *(command->argv + 2), ostream);
+    }
+    
+    count = 16;
+    if (*(command->argv + 1))
+    {
+        errno = 0;
+        count = strtol(*(command->argv + 1), &end, 10);
+        if (errno || *end || count < 0)
+        {
+            errno = 0;
+            (void) fprintf(ostream, "history: usage: history [count]\n");
+            return -1;
+        }
+    }
+    
+    if (history_refresh(state->history) == -1)
+    {
+        (void) fprintf(ostream, "history: %s\n", strerror(errno));
+        errno = 0;
+        return -1;
+    }
+    
+    // Find how far back to go, no further than the history goes, then print forwards.
+    available = 0;
+    while (available < (size_t) count && history_get(state->history, available, &entry))
+    {
+        ++available;
+    }
+    for (count = (long) available; count > 0; --count)
+    {
+        (void) history_get(state->history, (size_t) count - 1, &entry);
+        if (!localtime_r(&entry.started, &local) || strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local) == 0)
+        {
+            *when = '\0';
+        }
+        (void) fprintf(ostream, "%s  %3d  %6ldms  %.*s\n", when, entry.exit_code, entry.duration,
+                       (int) entry.length, entry.text);
+    }
+    
+    return 0;
+}
+
+int search_history(struct state *state, const char *prefix, FILE *ostream)
+{
+    struct history_search search;
+    struct history_entry  entry;
+    
+    if (history_refresh(state->history) == -1
+        || history_index_search_start(state->history_index, &search, prefix, strlen(prefix)) == -1)
+    {
+        (void) fprintf(ostream, "history: %s\n", strerror(errno));
+        errno = 0;
+        return -1;
+    }
+    
+    while (history_index_search_next(state->history_index, &search, &entry))
+    {
+        (void) fprintf(ostream, "%.*s\n", (int) entry.length, entry.text);
+    }
+    history_index_search_end(&search);
+    
+    return 0;
+}
+
+int builtin_set(struct supervisor *supvis, struct state *state, struct command *command, FILE *ostream)
+{
+    char **arg;
+    bool enable;
+    int  status;
+    
+    arg = command->argv + 1;
+    if (!*arg || (strcmp(*arg, "-o") != 0 && strcmp(*arg, "+o") != 0))
+    {
+        (void) fprintf(ostream, "set: usage: set [-o|+o] [option ...]\n");
+        return -1;
+    }
+    
+    enable = (**arg == '-');
+    if (!*++arg)
+    {
+        print_options(state, ostream);
+        return 0;
+    }
+    
+    status = 0;
+    for (; *arg; ++arg)
+    {
+        if (set_option(supvis, state, *arg, enable, ostream) == -1)
+        {
+            status = -1;
+        }
+    }
+    
+    return status;
+}
+
+int set_option(struct supervisor *supvis, struct state *state, const char *name, bool enable, FILE *ostream)
+{
+    if (strncmp(name, "promptdeadline=", strlen("promptdeadline=")) == 0)
+    {
+        const char *value;
+        char       *end;
+        long       deadline;
+        
+        value    = name + strlen("promptdeadline=");
+        errno    = 0;
+        deadline = strtol(value, &end, 10);
+        if (!enable || errno || end == value || *end || deadline < 0)
+        {
+            errno = 0;
+            (void) fprintf(ostream, "set: promptdeadline: expected -o promptdeadline=milliseconds\n");
+            return -1;
+        }
+        state->prompt_deadline = deadline;
+        return 0;
+    }
+    
+    if (strncmp(name, "parsecache", strlen("parsecache")) == 0)
+    {
+        const char    *value;
+        char          *end;
+        unsigned long capacity;
+        
+        value = name + strlen("parsecache");
+        if (!enable && !*value)
+        {
+            return parse_cache_resize(state->parse_cache, 0);
+        }
+        
+        errno    = 0;
+        capacity = (*value == '=') ? strtoul(value + 1, &end, 10) : 0;
+        if (!enable || *value != '=' || errno || end == value + 1 || *end || *(value + 1) == '-')
+        {
+            errno = 0;
+            (void) fprintf(ostream, "set: parsecache: expected -o parsecache=lines or +o parsecache\n");
+            return -1;
+        }
+        if (parse_cache_resize(state->parse_cache, capacity) == -1)
+        {
+            errno = 0;
+            (void) fprintf(ostream, "set: parsecache: unable to allocate memory for the cache\n");
+            return -1;
+        }
+        return 0;
+    }
+    
+    if (strncmp(name, "filecache", strlen("filecache")) == 0)
+    {
+        const char    *value;
+        char          *end;
+        unsigned long capacity;
+        
+        value = name + strlen("filecache");
+        if (!enable && !*value)
+        {
+            return file_cache_resize(state->file_cache, 0);
+        }
+        
+        errno    = 0;
+        capacity = (*value == '=') ? strtoul(value + 1, &end, 10) : 0;
+        if (!enable || *value != '=' || errno || end == value + 1 || *end || *(value + 1) == '-')
+        {
+            errno = 0;
+            (void) fprintf(ostream, "set: filecache: expected -o filecache=files or +o filecache\n");
+            return -1;
+        }
+        if (file_cache_resize(state->file_cache, capacity) == -1)
+        {
+            errno = 0;
+            (void) fprintf(ostream, "set: filecache: unable to allocate memory for the cache\n");
+            return -1;
+        }
+        return 0;
+    }
+    
+    if (strncmp(name, "pipesize", strlen("pipesize")) == 0)
+    {
+        const char *value;
+        char       *end;
+        long       size;
+        
+        value = name + strlen("pipesize");
+        if (!enable && !*value)
+        {
+            state->pipe_size = 0;
+            return 0;
+        }
+        
+        errno = 0;
+        size  = (*value == '=') ? strtol(value + 1, &end, 10) : 0;
+        if (!enable || *value != '=' || errno || end == value + 1 || *end || size <= 0 || size > INT_MAX)
+        {
+            errno = 0;
+            (void) fprintf(ostream, "set: pipesize: expected -o pipesize=bytes or +o pipesize\n");
+            return -1;
+        }
+        state->pipe_size = (int) size;
+        return 0;
+    }
+    
+    if (strcmp(name, "forkexec") == 0)
+    {
+        state->fork_exec = enable;
+        return 0;
+    }
+    
+    if (strcmp(name, "pipefail") == 0)
+    {
+        state->pipefail = enable;
+        return 0;
+    }
+    
+    if (strcmp(name, "exportpwd") == 0)
+    {
+        state->export_pwd = enable;
+        if (enable && state->cwd)
+        {
+            dc_setenv(supvis->env, supvis->err, "PWD", state->cwd, true);
+        }
+        return 0;
+    }
+    
+    (void) fprintf(ostream, "set: no such option: %s\n", name);
+    return -1;
+}
+
+void print_options(const struct state *state, FILE *ostream)
+{
+    (void) fprintf(ostream, "exportpwd\t%s\n", (state->export_pwd) ? "on" : "off");
+    (void) fprintf(ostream, "filecache\t%zu\t(%lu hits, %lu misses)\n", state->file_cache->capacity,
+                   state->file_cache->hits, state->file_cache->misses);
+    (void) fprintf(ostream, "forkexec\t%s\n", (state->fork_exec) ? "on" : "off");
+    (void) fprintf(ostream, "promptdeadline\t%ld\n", state->prompt_deadline);
+    (void) fprintf(ostream, "parsecache\t%zu\t(%lu hits, %lu misses)\n", state->parse_cache->capacity,
+                   state->parse_cache->hits, state->parse_cache->misses);
+    (void) fprintf(ostream, "pipefail\t%s\n", (state->pipefail) ? "on" : "off");
+    (void) fprintf(ostream, "pipesize\t%d\n", state->pipe_size);
+}
@@ -1,415 +1,579 @@
+#include "../include/arena.h"
 #include "../include/command.h"
+#include "../include/expand.h"
+#include "../include/tokenizer.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
-#include <wordexp.h>
+#include <unistd.h>
 
 /**
- * get_regex_substring
+ * expand_filename
  * <p>
- * Get a substring based on a regex. In the case of an IO redirection, is_io should be set to true.
- * Overwrite points to a boolean that declares whether an IO redirection should be an overwrite or
- * an append.
+ * Expand the filename of a redirection, which must expand to exactly one field. If it does not,
+ * or if a parse error occurs, print a message to state->stdout and set errno to EINVAL.
  * </p>
  * @param supvis the supervisor object
- * @param regex the regex to compare against the line
- * @param line the line
- * @param overwrite whether to overwrite the contents of the file
- * @return the substring, or NULL on failure
+ * @param state the state object
+ * @param filename the filename to expand
+ * @return the expanded filename, allocated from state->arena, or NULL on failure
  */
-char *
-get_regex_substring(struct supervisor *supvis, struct state *state, regex_t *regex, const char *line, bool *overwrite,
-                    bool is_io);
+char *expand_filename(struct supervisor *supvis, struct state *state, const char *filename);
 
 /**
- * get_substring
+ * add_command
  * <p>
- * Get a substring from the line. If is_io, parse as a filename; otherwise,
- * parse as a command.
+ * Append a command holding a run of tokens to the list in state->commands.
  * </p>
- * @param supvis the supervisor object
- * @param substring the substring to be allocated
- * @param line the line to parse
- * @param st_substr the start of the substring
- * @param en_substr the end of the substring
- * @param overwrite whether, if is_io, to overwrite the contents of a file.
- * @param is_io whether to parse as io
- * @param out the stream on which to print error messages
- * @return the allocated substring, or NULL if the command is invalid.
+ * @param state the state object
+ * @param link where to store the command: state->commands or the next field of the last command
+ * @param separator how the command follows the one before it
+ * @param first_token index of the command's first token
+ * @param token_count number of tokens in the command
+ * @return the command, or NULL on failure
  */
-char *get_substring(struct supervisor *supvis, char *substring, const char *line, size_t st_substr, size_t en_substr,
-                    bool is_io, bool **overwrite, FILE *out);
+struct command *add_command(struct state *state, struct command **link, enum command_separator separator,
+                            size_t first_token, size_t token_count);
 
 /**
- * check_io_valid
+ * operator_text
  * <p>
- * Check whether the io command is valid. An io command is valid if it takes the form
- * "<", ">", "2>", ">>", or "2>>". In the case the io command takes the form ">>" or "2>>",
- * set the overwrite boolean to true.
+ * Get the text of an operator token, for messages.
  * </p>
- * @param line the line from which to read
- * @param rm_so the index at which to begin parsing the io command
- * @param overwrite whether the io command is an overwrite command
- * @param out the stream on which to print error messages
- * @return the index of the character immediately following the last '<' or '>', or 0 on a failure.
+ * @param type the kind of token
+ * @return the operator, eg. "&&"
  */
-size_t check_io_valid(const char *line, size_t rm_so, bool **overwrite, FILE *out);
+const char *operator_text(enum token_type type);
 
 /**
- * get_filename
+ * check_redirections
  * <p>
- * Parse the filename from the given line. Increment the start pointer until a non-whitespace character.
- * Then, increment the end pointer from the start pointer until a whitespace character. Generate and
- * store a substring between those two characters as the filename. Expand the filename to an absolute
- * path.
+ * Check that every redirection operator of a command is followed by a filename, and that a
+ * ( ... ) group is closed, comes first and is followed only by redirections. If not, print a
+ * message to state->stdout and set errno to EINVAL.
  * </p>
- * @param supvis the supervisor object
- * @param line the line to parse
- * @param st_substr the start of the substring
- * @return the substring containing the filename, or NULL on failure
+ * @param state the state object
+ * @param command the command object
+ * @return 0 on success, -1 on a parse error
  */
-char *get_filename(struct supervisor *supvis, const char *line, size_t st_substr, FILE *out);
+int check_redirections(struct state *state, const struct command *command);
 
 /**
- * substr
+ * parse_tokens
  * <p>
- * Get a substring from a string. Copy the characters from dest into src, starting from the
- * character at index st and ending at the character at index en.
+ * Parse a command from its tokens in state->tokenizer. Each word is expanded and its fields
+ * appended to command->argv; a redirection operator takes the word that follows it as its filename.
  * </p>
- * @param dest the destination string
- * @param src the source string
- * @param st the start index
- * @param en the end index
- * @return the substring
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param command the command object
  */
-char *substr(char *dest, const char *src, size_t st, size_t en);
+void parse_tokens(struct supervisor *supvis, struct state *state, struct command *command);
 
 /**
- * expand_filename
+ * finish_argv
  * <p>
- * Expand a single filename to an absolute filename. If a parse error occurs, print a message to out
- * and set errno to EINVAL.
+ * Complete an argument list whose strings were grown by expand_word. The pointers are placed after the strings,
+ * so the whole list is one block of the arena.
  * </p>
- * @param supvis the supervisor
- * @param filename the filename to expand
- * @return the expanded filename, or NULL on failure
+ * @param arena the arena
+ * @param argc the number of arguments
+ * @return the null terminated argument list, or NULL on failure
  */
-char *expand_filename(struct supervisor *supvis, char *filename, FILE *out);
+char **finish_argv(struct arena *arena, size_t argc);
 
 /**
- * get_command_name
+ * add_redirection
  * <p>
- * Get the command name and its arguments as a substring from the line.
+ * Append the redirection of a redirection token to the command's. On failure, print a message
+ * to state->stdout and set errno to EINVAL, or state->fatal_error if memory ran out.
  * </p>
- * @param supvis the supervisor object
- * @param line the line to parse
- * @param st_substr the start of the command substring
- * @param en_substr the end of the command substring
- * @return the command substring, or NULL on failure
+ * @param state the state object
+ * @param command the command object
+ * @param token the redirection token
+ * @param target the expanded word after the operator: a filename, or for <& and >& a descriptor or -
+ * @return 0 on success, -1 on failure
  */
-char *get_command_name(struct supervisor *supvis, const char *line, size_t st_substr, size_t en_substr);
+int add_redirection(struct state *state, struct command *command, const struct token *token, const char *target);
 
 /**
- * expand_cmds
+ * parse_descriptor
  * <p>
- * Expand all cmds from their condensed forms. If a parse error occurs, print a message to out
- * and set errno to EINVAL.
+ * Read a word made only of digits as a file descriptor.
  * </p>
- * @param supvis the supervisor object
- * @param line the cmds to expand
- * @param argc a pointer to variable holding the number of arguments in the command
- * @param out the stream on which to print errors
- * @return the list of expanded commands, or NULL if an error occurs
+ * @param word the word
+ * @return the descriptor, or -1 if the word is not one
  */
-char **expand_cmds(struct supervisor *supvis, const char *line, size_t *argc, FILE *out);
+int parse_descriptor(const char *word);
 
-/**
- * save_wordv_to_argv
- * <p>
- * Duplicate expanded arguments from a wordexp_t into a char * array.
- * </p>
- * @param supvis the supervisor object
- * @param argv the list into which expanded arguments shall be saved
- * @param exp_cmd_index the number of arguments to save
- * @param wordv the wordexp_t temporarily storing expanded arguments
- * @return the list of expanded arguments
- */
-char **save_wordv_to_argv(struct supervisor *supvis, char **wordv, char **argv, size_t argc);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
 
 void do_separate_commands(struct supervisor *supvis, struct state *state)
 {
-    struct command *command;
-    
-    command = mm_calloc(1, sizeof(struct command), supvis->mm,
-                        __FILE__, __func__, __LINE__);
-    
-    if (!command)
+    const struct tokenizer *tokenizer;
+    const struct token     *token;
+    struct command         **link;
+    enum command_separator separator;
+    size_t                 first;
+    
+    tokenizer = state->tokenizer;
+    if (tokenizer->overflow)
     {
-        state->fatal_error = true;
+        (void) fprintf(state->stdout, "csh: argument list too long\n");
+        state->exit_code = EXIT_FAILURE;
+        errno            = E2BIG;
         return;
     }
     
-    command->line = strdup(state->current_line);
-    supvis->mm->mm_add(supvis->mm, command->line);
+    link      = &state->commands;
+    separator = SEPARATOR_SEQUENCE;
+    first     = 0;
+    for (size_t i = 0; i < tokenizer->token_count; ++i)
+    {
+        token = tokenizer->tokens + i;
+        switch (token->type)
+        {
+            case TOKEN_SEMI:
+            case TOKEN_AND_IF:
+            case TOKEN_OR_IF:
+            case TOKEN_PIPE:
+            {
+                break;
+            }
+            case TOKEN_AMP:
+            {
+                (void) fprintf(state->stdout, "csh: background jobs are not supported\n");
+                state->exit_code = EXIT_FAILURE;
+                errno            = EINVAL;
+                return;
+            }
+            case TOKEN_WORD:
+            case TOKEN_SUBSHELL:
+            case TOKEN_LESS:
+            case TOKEN_GREAT:
+            case TOKEN_DGREAT:
+            case TOKEN_LESSAND:
+            case TOKEN_GREATAND:
+            case TOKEN_ANDGREAT:
+            case TOKEN_ANDDGREAT:
+            default:
+            {
+                continue;
+            }
+        }
+        
+        if (i == first)
+        {
+            (void) fprintf(state->stdout, "csh: parse error near \'%s\'\n", operator_text(token->type));
+            state->exit_code = PARSE_ERROR_STATUS;
+            errno            = EINVAL;
+            return;
+        }
+        
+        if (!add_command(state, link, separator, first, i - first))
+        {
+            return;
+        }
+        link      = &(*link)->next;
+        separator = (token->type == TOKEN_AND_IF) ? SEPARATOR_AND
+                    : (token->type == TOKEN_OR_IF) ? SEPARATOR_OR
+                    : (token->type == TOKEN_PIPE) ? SEPARATOR_PIPE : SEPARATOR_SEQUENCE;
+        first     = i + 1;
+    }
     
-    state->command = command;
+    // A line may end with ';', but &&, || and | need a command after them.
+    if (first == tokenizer->token_count && separator != SEPARATOR_SEQUENCE)
+    {
+        (void) fprintf(state->stdout, "csh: parse error near \'%s\'\n",
+                       operator_text((tokenizer->tokens + first - 1)->type));
+        state->exit_code = PARSE_ERROR_STATUS;
+        errno            = EINVAL;
+        return;
+    }
+    if (first < tokenizer->token_count)
+    {
+        (void) add_command(state, link, separator, first, tokenizer->token_count - first);
+    }
 }
 
 void do_parse_commands(struct supervisor *supvis, struct state *state)
 {
-    parse_command(supvis, state, state->command);
+    for (const struct command *command = state->commands; command; command = command->next)
+    {
+        if (check_redirections(state, command) == -1)
+        {
+            state->exit_code = PARSE_ERROR_STATUS;
+            return;
+        }
+    }
 }
 
 void parse_command(struct supervisor *supvis, struct state *state, struct command *command)
 {
-    command->command = get_regex_substring(supvis, state, state->command_regex, command->line,
-                                           NULL, false);
-    command->argv    = expand_cmds(supvis, command->command, &command->argc, state->stdout);
-    supvis->mm->mm_free(supvis->mm, command->command);
-    
-    command->command = (command->argv) ? *command->argv : NULL;
-    
-    command->stdin_file = get_regex_substring(supvis, state, state->in_redirect_regex, command->line,
-                                              NULL, true);
-    
-    command->stdout_file = get_regex_substring(supvis, state, state->out_redirect_regex, command->line,
-                                               &command->stdout_overwrite, true);
-    
-    command->stderr_file = get_regex_substring(supvis, state, state->err_redirect_regex, command->line,
-                                               &command->stderr_overwrite, true);
+    parse_tokens(supvis, state, command);
 }
 
-char *
-get_regex_substring(struct supervisor *supvis, struct state *state, regex_t *regex, const char *line,
-                    bool *overwrite, bool is_io)
+#pragma GCC diagnostic pop
+
+void parse_tokens(struct supervisor *supvis, struct state *state, struct command *command)
 {
-    char       *substring;
-    regmatch_t regmatch[2];
-    int        status;
-    
-    substring = NULL;
-    
-    status = regexec(regex, line, 2, regmatch, 0);
-    switch (status)
+    const struct tokenizer *tokenizer;
+    const struct token     *token;
+    const struct token     *end;
+    char                   **argv;
+    size_t                 argc;
+    char                   *filename;
+    ssize_t                fields;
+    
+    // The arguments are grown at the top of the arena, so redirections are handled after them.
+    // check_redirections has made sure every operator is followed by its filename.
+    tokenizer = state->tokenizer;
+    argc      = 0;
+    end       = tokenizer->tokens + command->first_token + command->token_count;
+    for (token = tokenizer->tokens + command->first_token; token < end; ++token)
     {
-        case 0: // success
+        if (token->type == TOKEN_SUBSHELL)
         {
-            substring = get_substring(supvis, substring, line,
-                                      regmatch[1].rm_so, regmatch[1].rm_eo, is_io,
-                                      &overwrite, state->stdout);
-            break;
+            // check_redirections has made sure the group is closed; it is run as it was written.
+            command->subshell        = tokenizer_word(tokenizer, token) + 1;
+            command->subshell_length = strlen(command->subshell) - 1;
+            continue;
         }
-        case REG_NOMATCH: // No match
+        if (token->type != TOKEN_WORD)
         {
-            break;
+            ++token; // the filename
+            continue;
         }
-        default: // other error
+        
+        fields = expand_word(supvis, state, tokenizer_word(tokenizer, token));
+        if (fields == -1)
         {
-            (void) fprintf(state->stderr, "csh: fatal error parsing command\n");
-            errno = ENOTRECOVERABLE;
-            state->fatal_error = true;
+            (void) arena_finish(state->arena);
+            state->fatal_error = (errno != EINVAL);
+            return;
         }
+        argc += (size_t) fields;
     }
     
-    return substring;
-}
-
-char *get_substring(struct supervisor *supvis, char *substring, const char *line, size_t st_substr, size_t en_substr,
-                    bool is_io, bool **overwrite, FILE *out)
-{
-    if (is_io)
+    argv = finish_argv(state->arena, argc);
+    if (!argv)
     {
-        st_substr = check_io_valid(line, st_substr, overwrite, out);
-        if (!st_substr)
+        state->fatal_error = true;
+        return;
+    }
+    
+    for (token = tokenizer->tokens + command->first_token; token < end; ++token)
+    {
+        if (token->type == TOKEN_WORD || token->type == TOKEN_SUBSHELL)
         {
-            return NULL; // Command is invalid
+            continue;
+        }
+        
+        ++token;
+        filename = expand_filename(supvis, state, tokenizer_word(tokenizer, token));
+        if (!filename || add_redirection(state, command, token - 1, filename) == -1)
+        {
+            return;
         }
-        substring = get_filename(supvis, line, st_substr, out);
-    } else
-    {
-        substring = get_command_name(supvis, line, st_substr, en_substr);
     }
     
-    return substring;
+    command->argc    = argc;
+    command->argv    = argv;
+    command->command = *argv;
 }
 
-size_t check_io_valid(const char *line, size_t rm_so, bool **overwrite, FILE *out)
+char **finish_argv(struct arena *arena, size_t argc)
 {
-    size_t st_substr;
-    size_t indicator_count;
-    char   io_indicator;
-    
-    // Regex matches the space character as the first character; adding one will get the first io character.
-    st_substr    = rm_so + 1;
-    io_indicator = (*(line + st_substr) == '2') ? *(line + ++st_substr) : *(line + st_substr); // NOLINT(bugprone-narrowing-conversions,cppcoreguidlines-narrowing-conversions): char -> char conversion
-    
-    // Get the number of > or < symbols
-    indicator_count = 1;
-    while ((*(line + ++st_substr) == io_indicator) && indicator_count <= 2)
-    {
-        indicator_count++;
-    }
-    
-    // if command looks like ">>> ..." or "<< ...", it is invalid.
-    if ((io_indicator == '>' && indicator_count > 2) || (io_indicator == '<' && indicator_count > 1))
+    char   *strings;
+    char   **argv;
+    size_t length;
+    size_t padding;
+    
+    length  = arena_object_size(arena);
+    padding = (sizeof(char *) - length % sizeof(char *)) % sizeof(char *);
+    if (arena_grow(arena, NULL, padding + (argc + 1) * sizeof(char *)) == -1)
     {
-        (void) fprintf(out, "csh: parse error in I/O redirection near \'%c\'\n", io_indicator);
-        errno = EINVAL;
-        return 0;
+        return NULL;
     }
     
-    if (io_indicator == '>' && indicator_count == 1)
+    strings = (char *) arena_finish(arena);
+    argv    = (char **) (void *) (strings + length + padding);
+    for (size_t arg = 0; arg < argc; ++arg)
     {
-        **overwrite = true; // NOLINT(clang-analyzer-core.NullDereference): branch not accessed when **overwrite = NULL
+        *(argv + arg) = strings;
+        strings += strlen(strings) + 1;
     }
+    *(argv + argc) = NULL;
     
-    return st_substr;
+    return argv;
 }
 
-char *get_filename(struct supervisor *supvis, const char *line, size_t st_substr, FILE *out)
+int add_redirection(struct state *state, struct command *command, const struct token *token, const char *target)
 {
-    char   *filename;
-    size_t en_substr;
-    size_t len;
+    struct redirection **link;
+    struct redirection *redirection;
+    enum token_type    type;
+    
+    // >&file, with no descriptor before it, is &>file, as in bash.
+    type = token->type;
+    if (type == TOKEN_GREATAND && token->io_number == -1 && parse_descriptor(target) == -1
+        && strcmp(target, "-") != 0)
+    {
+        type = TOKEN_ANDGREAT;
+    }
     
-    // if first char is whitespace, move the start pointer forward to the first non-whitespace character
-    switch (isspace(*(line + st_substr)))
+    redirection = arena_calloc(state->arena, 1, sizeof(struct redirection));
+    if (!redirection)
     {
-        case true:
+        state->fatal_error = true;
+        return -1;
+    }
+    redirection->fd     = (token->io_number != -1) ? token->io_number
+                          : (type == TOKEN_LESS || type == TOKEN_LESSAND) ? STDIN_FILENO : STDOUT_FILENO;
+    redirection->kind   = REDIRECT_FILE;
+    redirection->file   = target;
+    redirection->opened = -1;
+    switch (type)
+    {
+        case TOKEN_LESS:
+        {
+            redirection->flags = O_RDONLY;
+            break;
+        }
+        case TOKEN_GREAT:
+        case TOKEN_ANDGREAT:
+        {
+            redirection->flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        }
+        case TOKEN_DGREAT:
+        case TOKEN_ANDDGREAT:
         {
-            while (isspace(*(line + ++st_substr))); // NOLINT(hicpp-braces-around-statements,readability-braces-around-statements): braces not needed here
+            redirection->flags = O_WRONLY | O_CREAT | O_APPEND;
             break;
         }
+        case TOKEN_LESSAND:
+        case TOKEN_GREATAND:
+        {
+            redirection->kind   = (strcmp(target, "-") == 0) ? REDIRECT_CLOSE : REDIRECT_DUP;
+            redirection->source = parse_descriptor(target);
+            if (redirection->kind == REDIRECT_DUP && redirection->source == -1)
+            {
+                (void) fprintf(state->stdout, "csh: ambiguous redirect: \'%s\'\n", target);
+                errno = EINVAL;
+                return -1;
+            }
+            break;
+        }
+        case TOKEN_WORD:
+        case TOKEN_SEMI:
+        case TOKEN_AND_IF:
+        case TOKEN_OR_IF:
+        case TOKEN_AMP:
+        case TOKEN_PIPE:
+        case TOKEN_SUBSHELL:
         default:
         {
-            // do nothing haha
         }
     }
     
-    // set the end pointer to the start pointer, and move forward to the first whitespace character
-    en_substr = st_substr;
-    while (!isspace(*(line + ++en_substr))); // NOLINT(hicpp-braces-around-statements,readability-braces-around-statements): braces not needed here
-    
-    // Get the filename substring.
-    len      = en_substr - st_substr + 1;
-    filename = (char *) mm_malloc(len, supvis->mm, __FILE__, __func__, __LINE__);
+    link = &command->redirections;
+    while (*link)
+    {
+        link = &(*link)->next;
+    }
+    *link = redirection;
     
-    if (filename)
+    // &> also makes stderr a copy of the stdout it opened.
+    if (type == TOKEN_ANDGREAT || type == TOKEN_ANDDGREAT)
     {
-        filename = substr(filename, line, st_substr, en_substr);
-        filename = expand_filename(supvis, filename, out);
+        redirection->next = arena_calloc(state->arena, 1, sizeof(struct redirection));
+        if (!redirection->next)
+        {
+            state->fatal_error = true;
+            return -1;
+        }
+        redirection->next->fd     = STDERR_FILENO;
+        redirection->next->kind   = REDIRECT_DUP;
+        redirection->next->source = STDOUT_FILENO;
+        redirection->next->opened = -1;
     }
     
-    return filename;
+    return 0;
 }
 
-char *substr(char *dest, const char *src, size_t st, size_t en)
+int parse_descriptor(const char *word)
 {
-    dest = strncpy(dest, src + st, en - st);
+    int fd;
     
-    *(dest + en - st) = '\0';
-    
-    return dest;
-}
-
-char *expand_filename(struct supervisor *supvis, char *filename, FILE *out)
-{
-    wordexp_t we;
+    if (!*word || strlen(word) > 4)
+    {
+        return -1;
+    }
     
-    switch (wordexp(filename, &we, 0)) // NOLINT(concurrency-mt-unsafe): no threads here
+    fd = 0;
+    for (const char *c = word; *c; ++c)
     {
-        case 0:
-        {
-            supvis->mm->mm_free(supvis->mm, filename);
-            filename = strdup(*we.we_wordv);
-            supvis->mm->mm_add(supvis->mm, filename);
-            break;
-        }
-        default:
+        if (!isdigit((unsigned char) *c))
         {
-            (void) fprintf(out, "csh: parse error in command near: \'%s\'\n", filename);
-            supvis->mm->mm_free(supvis->mm, filename);
-            errno = EINVAL;
-            return NULL;
+            return -1;
         }
+        fd = fd * 10 + (*c - '0');
     }
     
-    wordfree(&we);
-    
-    return filename;
+    return fd;
 }
 
-char *get_command_name(struct supervisor *supvis, const char *line, size_t st_substr, size_t en_substr)
+char *expand_filename(struct supervisor *supvis, struct state *state, const char *filename)
 {
-    char   *substring;
-    size_t len;
+    ssize_t fields;
     
-    if (*(line + en_substr - 1) == '2') // If an error io redirect, the regex will not capture the 2.
+    fields = expand_word(supvis, state, filename);
+    if (fields == 1)
     {
-        --en_substr;
+        return (char *) arena_finish(state->arena);
     }
     
-    len = en_substr - st_substr + 1;
-    
-    substring = (char *) mm_malloc(len, supvis->mm, __FILE__, __func__, __LINE__);
-    
-    if (substring)
+    (void) arena_finish(state->arena);
+    if (fields != -1)
     {
-        substring = substr(substring, line, st_substr, en_substr);
+        (void) fprintf(state->stdout, "csh: ambiguous redirect: \'%s\'\n", filename);
+        errno = EINVAL;
     }
     
-    return substring;
+    return NULL;
 }
 
-char **expand_cmds(struct supervisor *supvis, const char *line, size_t *argc, FILE *out)
+struct command *add_command(struct state *state, struct command **link, enum command_separator separator,
+                            size_t first_token, size_t token_count)
 {
-    char      **argv;
-    wordexp_t we;
-    int       status;
-    char      *line_no_newline;
-    char      *newline_ptr;
-    
-    line_no_newline = strdup(line);
-    supvis->mm->mm_add(supvis->mm, line_no_newline);
-    
-    newline_ptr = strchr(line_no_newline, '\n');
-    if (newline_ptr)
-    {
-        *newline_ptr = '\0';
-    }
+    struct command *command;
     
-    status = wordexp(line_no_newline, &we, 0); // NOLINT(concurrency-mt-unsafe): no threads here
-    if (status)
+    command = arena_calloc(state->arena, 1, sizeof(struct command));
+    if (!command)
     {
-        (void) fprintf(out, "csh: parse error in command near: \'%s\'\n", line_no_newline);
-        errno = EINVAL;
+        state->fatal_error = true;
         return NULL;
     }
     
-    supvis->mm->mm_free(supvis->mm, line_no_newline);
+    command->separator   = separator;
+    command->first_token = first_token;
+    command->token_count = token_count;
+    *link                = command;
     
-    *argc = we.we_wordc;
-    argv = (char **) mm_malloc((*argc + 1) * sizeof(char *), supvis->mm,
-                               __FILE__, __func__, __LINE__);
-    if (argv)
+    return command;
+}
+
+const char *operator_text(enum token_type type)
+{
+    switch (type)
     {
-        argv = save_wordv_to_argv(supvis, we.we_wordv, argv, *argc);
+        case TOKEN_LESS:
+        {
+            return "<";
+        }
+        case TOKEN_GREAT:
+        {
+            return ">";
+        }
+        case TOKEN_DGREAT:
+        {
+            return ">>";
+        }
+        case TOKEN_LESSAND:
+        {
+            return "<&";
+        }
+        case TOKEN_GREATAND:
+        {
+            return ">&";
+        }
+        case TOKEN_ANDGREAT:
+        {
+            return "&>";
+        }
+        case TOKEN_ANDDGREAT:
+        {
+            return "&>>";
+        }
+        case TOKEN_SEMI:
+        {
+            return ";";
+        }
+        case TOKEN_AND_IF:
+        {
+            return "&&";
+        }
+        case TOKEN_OR_IF:
+        {
+            return "||";
+        }
+        case TOKEN_AMP:
+        {
+            return "&";
+        }
+        case TOKEN_PIPE:
+        {
+            return "|";
+        }
+        case TOKEN_WORD:
+        case TOKEN_SUBSHELL:
+        default:
+        {
+            return "";
+        }
     }
-    
-    wordfree(&we);
-    
-    return argv;
 }
 
-char **save_wordv_to_argv(struct supervisor *supvis, char **wordv, char **argv, size_t argc)
+int check_redirections(struct state *state, const struct command *command)
 {
-    for (size_t arg_index = 0; arg_index < argc; ++arg_index)
+    const struct token *token;
+    const struct token *end;
+    const char         *word;
+    const char         *closing;
+    bool               subshell;
+    
+    subshell = false;
+    end      = state->tokenizer->tokens + command->first_token + command->token_count;
+    for (token = state->tokenizer->tokens + command->first_token; token < end; ++token)
     {
-        *(argv + arg_index) = strdup(*(wordv + arg_index));
-        supvis->mm->mm_add(supvis->mm, *(argv + arg_index));
+        if (token->type == TOKEN_SUBSHELL)
+        {
+            word    = tokenizer_word(state->tokenizer, token);
+            closing = substitution_end(word + 1, false);
+            if (token != state->tokenizer->tokens + command->first_token || !closing || *(closing + 1))
+            {
+                (void) fprintf(state->stdout, "csh: parse error near \'(\'\n");
+                errno = EINVAL;
+                return -1;
+            }
+            subshell = true;
+            continue;
+        }
+        if (token->type == TOKEN_WORD)
+        {
+            if (subshell)
+            {
+                (void) fprintf(state->stdout, "csh: parse error near \'%s\'\n",
+                               tokenizer_word(state->tokenizer, token));
+                errno = EINVAL;
+                return -1;
+            }
+            continue;
+        }
+        
+        if (token + 1 == end || (token + 1)->type != TOKEN_WORD)
+        {
+            (void) fprintf(state->stdout, "csh: parse error in I/O redirection near \'%s\'\n",
+                           operator_text(token->type));
+            errno = EINVAL;
+            return -1;
+        }
+        ++token; // the filename
     }
     
-    *(argv + argc) = NULL;
-    
-    return argv;
+    return 0;
 }
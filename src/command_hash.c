@@ -0,0 +1,371 @@
+#include "../include/command_hash.h"
+#include "../include/file_cache.h"
+#include "../include/parse_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/**
+ * sync_path
+ * <p>
+ * Drop every entry and open the directories of PATH again if it has changed since the entries
+ * were found.
+ * </p>
+ * @param hash the table
+ * @return 0 on success, -1 if memory ran out
+ */
+int sync_path(struct command_hash *hash);
+
+/**
+ * close_directories
+ * <p>
+ * Close the directories of the path and free their names.
+ * </p>
+ * @param hash the table
+ */
+void close_directories(struct command_hash *hash);
+
+/**
+ * find_entry
+ * <p>
+ * Find the entry of a command name, searching the path for it if it has none.
+ * </p>
+ * @param hash the table
+ * @param name the name of the command
+ * @return the entry, or NULL if memory ran out
+ */
+struct command_hash_entry *find_entry(struct command_hash *hash, const char *name);
+
+/**
+ * search_path
+ * <p>
+ * Find a command in the directories of PATH and add the result, found or not, to the table.
+ * </p>
+ * @param hash the table
+ * @param name the name of the command
+ * @param name_hash the hash of the name
+ * @return the new entry, or NULL if memory ran out
+ */
+struct command_hash_entry *search_path(struct command_hash *hash, const char *name, uint64_t name_hash);
+
+/**
+ * drop_entry
+ * <p>
+ * Remove an entry from its bucket and free it.
+ * </p>
+ * @param hash the table
+ * @param link the pointer to the entry, in the bucket or in the entry before it
+ */
+void drop_entry(struct command_hash *hash, struct command_hash_entry **link);
+
+struct command_hash *command_hash_create(struct supervisor *supvis)
+{
+    return mm_calloc(1, sizeof(struct command_hash), supvis->mm, __FILE__, __func__, __LINE__);
+}
+
+const char *command_hash_find(struct command_hash *hash, const char *name, int *error)
+{
+    struct command_hash_entry *entry;
+    
+    entry = find_entry(hash, name);
+    if (!entry)
+    {
+        *error = ENOMEM;
+        return NULL;
+    }
+    
+    ++entry->hits;
+    if (!entry->path && entry->error == EACCES)
+    {
+        *error = EACCES;
+    }
+    
+    return entry->path;
+}
+
+int command_hash_exec(struct command_hash *hash, const char *name, char *const *argv)
+{
+    struct command_hash_entry *entry;
+    
+    entry = find_entry(hash, name);
+    if (!entry)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (!entry->path)
+    {
+        errno = entry->error;
+        return -1;
+    }
+    
+    // A script fails with ENOENT, as its interpreter cannot open it through a descriptor closed on exec.
+    (void) execveat(entry->directory, name, argv, environ, 0);
+    if (errno == ENOENT)
+    {
+        (void) execv(entry->path, argv);
+    }
+    
+    return -1;
+}
+
+struct command_hash_entry *find_entry(struct command_hash *hash, const char *name)
+{
+    struct command_hash_entry **link;
+    struct command_hash_entry *entry;
+    struct stat               status;
+    uint64_t                  name_hash;
+    
+    if (sync_path(hash) == -1)
+    {
+        return NULL;
+    }
+    
+    name_hash = parse_cache_hash(name, strlen(name));
+    for (link = hash->buckets + (name_hash & (COMMAND_HASH_BUCKETS - 1)); *link; link = &(*link)->next)
+    {
+        entry = *link;
+        if (entry->hash != name_hash || strcmp(entry->name, name) != 0)
+        {
+            continue;
+        }
+        
+        // A file that was removed or replaced by a directory sends the name back to the path.
+        if (entry->path && (fstatat(entry->directory, name, &status, 0) == -1 || S_ISDIR(status.st_mode)))
+        {
+            drop_entry(hash, link);
+            break;
+        }
+        
+        return entry;
+    }
+    
+    return search_path(hash, name, name_hash);
+}
+
+int sync_path(struct command_hash *hash)
+{
+    const char *path;
+    char       *copy;
+    char       *saved;
+    size_t     count;
+    
+    path = getenv("PATH"); // NOLINT(concurrency-mt-unsafe): no threads here
+    if ((!path && !hash->path) || (path && hash->path && strcmp(path, hash->path) == 0))
+    {
+        return 0;
+    }
+    
+    command_hash_clear(hash);
+    close_directories(hash);
+    if (!path)
+    {
+        return 0;
+    }
+    
+    // The directories point into a second copy of PATH, split in place; the first is compared.
+    count = 1;
+    for (const char *c = path; *c; ++c)
+    {
+        count += (*c == ':') ? 1 : 0;
+    }
+    hash->path          = (char *) malloc(2 * strlen(path) + 2);
+    hash->directories   = (char **) malloc(count * sizeof(char *));
+    hash->directory_fds = (int *) malloc(count * sizeof(int));
+    if (!hash->path || !hash->directories || !hash->directory_fds)
+    {
+        close_directories(hash);
+        return -1;
+    }
+    (void) strcpy(hash->path, path);
+    copy = hash->path + strlen(path) + 1;
+    (void) strcpy(copy, path);
+    
+    // Empty directories are skipped, as when the path is split at startup; missing ones stay at -1.
+    for (char *directory = strtok_r(copy, ":", &saved); directory; directory = strtok_r(NULL, ":", &saved))
+    {
+        *(hash->directories + hash->directory_count)   = directory;
+        *(hash->directory_fds + hash->directory_count) = shell_descriptor(open(directory, O_PATH | O_DIRECTORY | O_CLOEXEC));
+        ++hash->directory_count;
+    }
+    errno = 0;
+    
+    return 0;
+}
+
+void close_directories(struct command_hash *hash)
+{
+    for (size_t i = 0; i < hash->directory_count; ++i)
+    {
+        if (*(hash->directory_fds + i) != -1)
+        {
+            (void) close(*(hash->directory_fds + i));
+        }
+    }
+    free(hash->path);
+    free(hash->directories);
+    free(hash->directory_fds);
+    hash->path            = NULL;
+    hash->directories     = NULL;
+    hash->directory_fds   = NULL;
+    hash->directory_count = 0;
+}
+
+struct command_hash_entry *search_path(struct command_hash *hash, const char *name, uint64_t name_hash)
+{
+    struct command_hash_entry **bucket;
+    struct command_hash_entry *entry;
+    size_t                    name_length;
+    size_t                    length;
+    int                       error;
+    
+    name_length = strlen(name);
+    entry       = (struct command_hash_entry *) calloc(1, sizeof(struct command_hash_entry) + name_length + 1);
+    if (!entry)
+    {
+        return NULL;
+    }
+    entry->hash      = name_hash;
+    entry->directory = -1;
+    memcpy(entry->name, name, name_length + 1);
+    
+    // The name is looked up in each directory as it is; only the directory that has it is joined to it.
+    error = ENOENT;
+    for (size_t i = 0; i < hash->directory_count; ++i)
+    {
+        if (*(hash->directory_fds + i) == -1 || !command_executable(*(hash->directory_fds + i), name, &error))
+        {
+            continue;
+        }
+        
+        length      = strlen(*(hash->directories + i));
+        entry->path = (char *) malloc(length + name_length + 2);
+        if (!entry->path)
+        {
+            free(entry);
+            return NULL;
+        }
+        memcpy(entry->path, *(hash->directories + i), length);
+        *(entry->path + length) = '/';
+        memcpy(entry->path + length + 1, name, name_length + 1);
+        entry->directory = *(hash->directory_fds + i);
+        break;
+    }
+    entry->error = (entry->path) ? 0 : error;
+    
+    bucket      = hash->buckets + (name_hash & (COMMAND_HASH_BUCKETS - 1));
+    entry->next = *bucket;
+    *bucket     = entry;
+    ++hash->count;
+    
+    return entry;
+}
+
+int command_hash_raise(struct command_hash *hash, int fd)
+{
+    struct command_hash_entry *entry;
+    int                       directory;
+    int                       moved;
+    
+    for (size_t i = 0; i < hash->directory_count; ++i)
+    {
+        directory = *(hash->directory_fds + i);
+        if (directory == -1 || directory > fd)
+        {
+            continue;
+        }
+        
+        moved = fcntl(directory, F_DUPFD_CLOEXEC, fd + 1);
+        if (moved == -1)
+        {
+            return -1;
+        }
+        (void) close(directory);
+        *(hash->directory_fds + i) = moved;
+        
+        // The entries found in the directory hold its descriptor too.
+        for (size_t j = 0; j < COMMAND_HASH_BUCKETS; ++j)
+        {
+            for (entry = *(hash->buckets + j); entry; entry = entry->next)
+            {
+                if (entry->directory == directory)
+                {
+                    entry->directory = moved;
+                }
+            }
+        }
+    }
+    
+    return 0;
+}
+
+bool command_hash_remove(struct command_hash *hash, const char *name)
+{
+    struct command_hash_entry **link;
+    uint64_t                  name_hash;
+    
+    name_hash = parse_cache_hash(name, strlen(name));
+    for (link = hash->buckets + (name_hash & (COMMAND_HASH_BUCKETS - 1)); *link; link = &(*link)->next)
+    {
+        if ((*link)->hash == name_hash && strcmp((*link)->name, name) == 0)
+        {
+            drop_entry(hash, link);
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void drop_entry(struct command_hash *hash, struct command_hash_entry **link)
+{
+    struct command_hash_entry *entry;
+    
+    entry = *link;
+    *link = entry->next;
+    free(entry->path);
+    free(entry);
+    --hash->count;
+}
+
+void command_hash_clear(struct command_hash *hash)
+{
+    for (size_t i = 0; i < COMMAND_HASH_BUCKETS; ++i)
+    {
+        while (*(hash->buckets + i))
+        {
+            drop_entry(hash, hash->buckets + i);
+        }
+    }
+}
+
+bool command_executable(int directory, const char *file, int *error)
+{
+    struct stat status;
+    
+    // As with execv, a file that exists but cannot be run makes the command fail with EACCES.
+    if (faccessat(directory, file, X_OK, 0) == -1)
+    {
+        *error = (errno == ENOENT || errno == ENOTDIR) ? *error : EACCES;
+        return false;
+    }
+    if (fstatat(directory, file, &status, 0) == -1 || S_ISDIR(status.st_mode))
+    {
+        *error = EACCES;
+        return false;
+    }
+    
+    return true;
+}
+
+void command_hash_destroy(struct supervisor *supvis, struct command_hash *hash)
+{
+    command_hash_clear(hash);
+    close_directories(hash);
+    supvis->mm->mm_free(supvis->mm, hash);
+}
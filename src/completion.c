@@ -0,0 +1,824 @@
+#include "../include/completion.h"
+#include "../include/file_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+
+/**
+ * The changes to a directory that make its listing stale.
+ */
+#define COMPLETION_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB \
+                               | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+/**
+ * list_dir
+ * <p>
+ * List a directory again, and start watching it if it is not watched.
+ * </p>
+ * @param completion the completion engine
+ * @param dir the directory
+ * @return 0 on success, -1 on failure
+ */
+int list_dir(struct completion *completion, struct completion_dir *dir);
+
+/**
+ * read_names
+ * <p>
+ * Add the names in a directory to its listing: with getdents64 where available, readdir
+ * otherwise.
+ * </p>
+ * @param dir the listing
+ * @param fd the open directory
+ * @return 0 on success, -1 on failure
+ */
+int read_names(struct completion_dir *dir, int fd);
+
+/**
+ * add_name
+ * <p>
+ * Add a name to a listing, unless the listing only holds executables and it is not one.
+ * </p>
+ * @param dir the listing
+ * @param fd the open directory
+ * @param name the name
+ * @param type the d_type of the name, DT_UNKNOWN if not known
+ * @return 0 on success, -1 on failure
+ */
+int add_name(struct completion_dir *dir, int fd, const char *name, unsigned char type);
+
+/**
+ * compare_entries
+ * <p>
+ * Order listing entries by name, for qsort.
+ * </p>
+ * @param a the first completion_entry
+ * @param b the second completion_entry
+ * @return less than, equal to or greater than 0 as a sorts before, with or after b
+ */
+int compare_entries(const void *a, const void *b);
+
+/**
+ * free_dir
+ * <p>
+ * Free a listing and stop watching its directory.
+ * </p>
+ * @param completion the completion engine
+ * @param dir the listing
+ */
+void free_dir(struct completion *completion, struct completion_dir *dir);
+
+/**
+ * watch_shared
+ * <p>
+ * Check whether another listing uses the same inotify watch as a listing, as happens when the
+ * same directory is listed twice (eg. it is on PATH and file arguments are completed in it).
+ * </p>
+ * @param completion the completion engine
+ * @param dir the listing
+ * @return true if the watch is shared, false otherwise
+ */
+bool watch_shared(const struct completion *completion, const struct completion_dir *dir);
+
+/**
+ * mark_stale
+ * <p>
+ * Mark the listing of the directory behind an inotify watch as stale.
+ * </p>
+ * @param completion the completion engine
+ * @param watch the watch descriptor
+ * @param removed whether the watch was removed (the directory is gone)
+ */
+void mark_stale(struct completion *completion, int watch, bool removed);
+
+/**
+ * mark_all_stale
+ * <p>
+ * Mark every listing as stale, for when changes may have been missed.
+ * </p>
+ * @param completion the completion engine
+ */
+void mark_all_stale(struct completion *completion);
+
+/**
+ * build_trie
+ * <p>
+ * Build the command name trie from the listings of the PATH directories, listing again those
+ * that are stale.
+ * </p>
+ * @param completion the completion engine
+ * @return 0 on success, -1 on failure
+ */
+int build_trie(struct completion *completion);
+
+/**
+ * trie_insert
+ * <p>
+ * Add a command name to the trie.
+ * </p>
+ * @param completion the completion engine
+ * @param name the name
+ * @param length the length of the name
+ * @return 0 on success, -1 on failure
+ */
+int trie_insert(struct completion *completion, const char *name, size_t length);
+
+/**
+ * trie_child
+ * <p>
+ * Find the child of a trie node for a byte.
+ * </p>
+ * @param completion the completion engine
+ * @param node the node
+ * @param byte the byte
+ * @return the child, or 0 if there is none
+ */
+uint32_t trie_child(const struct completion *completion, uint32_t node, unsigned char byte);
+
+/**
+ * trie_walk
+ * <p>
+ * Report every command name ending at or below a trie node, in order.
+ * </p>
+ * @param completion the completion engine
+ * @param node the node
+ * @param name the name leading to the node, with room for NAME_MAX bytes and a null byte
+ * @param length the length of the name leading to the node
+ * @param found called with each command name and arg
+ * @param arg passed to found
+ * @return the number of names reported
+ */
+ssize_t trie_walk(const struct completion *completion, uint32_t node, char *name, size_t length,
+                  void (*found)(const char *name, size_t length, bool directory, void *arg), void *arg);
+
+/**
+ * find_file_dir
+ * <p>
+ * Find the listing of a directory for completing file arguments, replacing the least recently
+ * used listing if it is not held.
+ * </p>
+ * @param completion the completion engine
+ * @param path the absolute path of the directory
+ * @param length the length of the path
+ * @return the listing, or NULL on failure
+ */
+struct completion_dir *find_file_dir(struct completion *completion, const char *path, size_t length);
+
+struct completion *completion_create(struct supervisor *supvis, char **path)
+{
+    struct completion *completion;
+    size_t            count;
+    
+    completion = mm_calloc(1, sizeof(struct completion), supvis->mm, __FILE__, __func__, __LINE__);
+    if (!completion)
+    {
+        return NULL;
+    }
+    
+    for (count = 0; *(path + count); ++count)
+    {
+    }
+    
+    completion->commands = mm_calloc(count + 1, sizeof(struct completion_dir), supvis->mm, __FILE__, __func__,
+                                     __LINE__);
+    if (!completion->commands)
+    {
+        supvis->mm->mm_free(supvis->mm, completion);
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < count; ++i)
+    {
+        (completion->commands + i)->path        = *(path + i);
+        (completion->commands + i)->watch       = -1;
+        (completion->commands + i)->stale       = true;
+        (completion->commands + i)->executables = true;
+    }
+    completion->command_dir_count = count;
+    completion->trie_stale        = true;
+
+#if defined(__linux__)
+    completion->inotify_fd = shell_descriptor(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+#else
+    completion->inotify_fd = -1;
+#endif
+    errno = 0; // without inotify, listings are refreshed before every command
+    
+    return completion;
+}
+
+void completion_refresh(struct completion *completion)
+{
+#if defined(__linux__)
+    union
+    {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+    ssize_t bytes;
+    
+    if (completion->inotify_fd == -1)
+    {
+        mark_all_stale(completion);
+        return;
+    }
+    
+    while ((bytes = read(completion->inotify_fd, &buffer, sizeof(buffer))) > 0)
+    {
+        const char *position;
+        
+        for (position = buffer.bytes; position < buffer.bytes + bytes;)
+        {
+            struct inotify_event event;
+            
+            memcpy(&event, position, sizeof(event));
+            if (event.mask & IN_Q_OVERFLOW)
+            {
+                mark_all_stale(completion);
+            } else
+            {
+                mark_stale(completion, event.wd, (event.mask & IN_IGNORED) != 0);
+            }
+            position += sizeof(struct inotify_event) + event.len;
+        }
+    }
+    errno = 0; // EAGAIN once every event has been read
+#else
+    mark_all_stale(completion);
+#endif
+}
+
+void mark_stale(struct completion *completion, int watch, bool removed)
+{
+    struct completion_dir *dir;
+    
+    for (size_t i = 0; i < completion->command_dir_count + completion->file_dir_count; ++i)
+    {
+        dir = (i < completion->command_dir_count) ? completion->commands + i
+                                                  : completion->files + i - completion->command_dir_count;
+        if (dir->watch != watch)
+        {
+            continue;
+        }
+        
+        dir->stale = true;
+        if (removed)
+        {
+            dir->watch = -1;
+        }
+        if (i < completion->command_dir_count)
+        {
+            completion->trie_stale = true;
+        }
+    }
+}
+
+void mark_all_stale(struct completion *completion)
+{
+    for (size_t i = 0; i < completion->command_dir_count; ++i)
+    {
+        (completion->commands + i)->stale = true;
+    }
+    for (size_t i = 0; i < completion->file_dir_count; ++i)
+    {
+        (completion->files + i)->stale = true;
+    }
+    completion->trie_stale = true;
+}
+
+int list_dir(struct completion *completion, struct completion_dir *dir)
+{
+    int    fd;
+    int    status;
+    char   *name;
+    
+    dir->names_length = 0;
+    dir->count        = 0;
+    dir->stale        = false;
+
+#if defined(__linux__)
+    if (completion->inotify_fd != -1 && dir->watch == -1)
+    {
+        dir->watch = inotify_add_watch(completion->inotify_fd, dir->path, COMPLETION_WATCH_MASK | IN_ONLYDIR);
+    }
+#endif
+    
+    fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        errno = 0; // a missing directory has nothing to complete
+        return 0;
+    }
+    status = read_names(dir, fd);
+    (void) close(fd);
+    if (status == -1)
+    {
+        return -1;
+    }
+    
+    // The names are final now, so the entries can point into them.
+    name = dir->names;
+    for (size_t i = 0; i < dir->count; ++i)
+    {
+        (dir->entries + i)->name = name;
+        name += (dir->entries + i)->length + 1;
+    }
+    if (dir->count)
+    {
+        qsort(dir->entries, dir->count, sizeof(struct completion_entry), compare_entries);
+    }
+    
+    return 0;
+}
+
+int read_names(struct completion_dir *dir, int fd)
+{
+#if defined(__linux__)
+    union
+    {
+        struct dirent64 entry;
+        char bytes[32768];
+    } buffer;
+    ssize_t bytes;
+    
+    while ((bytes = getdents64(fd, &buffer, sizeof(buffer))) > 0)
+    {
+        const char *position;
+        
+        for (position = buffer.bytes; position < buffer.bytes + bytes;)
+        {
+            const struct dirent64 *entry;
+            
+            entry     = (const struct dirent64 *) (const void *) position;
+            position += entry->d_reclen;
+            if (add_name(dir, fd, entry->d_name, entry->d_type) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    
+    return (bytes == -1) ? -1 : 0;
+#else
+    DIR           *stream;
+    struct dirent *entry;
+    int           status;
+    
+    stream = fdopendir(fcntl(fd, F_DUPFD_CLOEXEC, 0));
+    if (!stream)
+    {
+        return -1;
+    }
+    
+    status = 0;
+    while (status == 0 && (entry = readdir(stream)))
+    {
+        status = add_name(dir, fd, entry->d_name, entry->d_type);
+    }
+    (void) closedir(stream);
+    
+    return status;
+#endif
+}
+
+int add_name(struct completion_dir *dir, int fd, const char *name, unsigned char type)
+{
+    struct stat status;
+    size_t      length;
+    bool        directory;
+    
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+    {
+        return 0;
+    }
+    
+    directory = (type == DT_DIR);
+    if (type == DT_UNKNOWN || type == DT_LNK)
+    {
+        // Follow the link to see what it is; a dangling link is listed as a file.
+        directory = fstatat(fd, name, &status, 0) == 0 && S_ISDIR(status.st_mode);
+    }
+    
+    if (dir->executables && (directory || faccessat(fd, name, X_OK, 0) == -1))
+    {
+        errno = 0;
+        return 0;
+    }
+    
+    length = strlen(name);
+    if (dir->names_length + length + 1 > dir->names_capacity)
+    {
+        size_t capacity;
+        char   *names;
+        
+        capacity = (dir->names_capacity) ? dir->names_capacity : 4096;
+        while (capacity < dir->names_length + length + 1)
+        {
+            capacity *= 2;
+        }
+        names = (char *) realloc(dir->names, capacity);
+        if (!names)
+        {
+            return -1;
+        }
+        dir->names          = names;
+        dir->names_capacity = capacity;
+    }
+    if (dir->count == dir->capacity)
+    {
+        size_t                  capacity;
+        struct completion_entry *entries;
+        
+        capacity = (dir->capacity) ? dir->capacity * 2 : 128;
+        entries  = (struct completion_entry *) realloc(dir->entries, capacity * sizeof(struct completion_entry));
+        if (!entries)
+        {
+            return -1;
+        }
+        dir->entries  = entries;
+        dir->capacity = capacity;
+    }
+    
+    memcpy(dir->names + dir->names_length, name, length + 1);
+    dir->names_length += length + 1;
+    
+    (dir->entries + dir->count)->name      = NULL; // set once every name has been read
+    (dir->entries + dir->count)->length    = length;
+    (dir->entries + dir->count)->directory = directory;
+    ++dir->count;
+    
+    return 0;
+}
+
+int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const struct completion_entry *) a)->name, ((const struct completion_entry *) b)->name);
+}
+
+int build_trie(struct completion *completion)
+{
+    struct completion_dir *dir;
+    
+    for (size_t i = 0; i < completion->command_dir_count; ++i)
+    {
+        dir = completion->commands + i;
+        if (dir->stale && list_dir(completion, dir) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    completion->trie_count = 1;
+    if (trie_insert(completion, "", 0) == -1) // the root
+    {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < completion->command_dir_count; ++i)
+    {
+        dir = completion->commands + i;
+        for (size_t j = 0; j < dir->count; ++j)
+        {
+            if (trie_insert(completion, (dir->entries + j)->name, (dir->entries + j)->length) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    completion->trie_stale = false;
+    
+    return 0;
+}
+
+int trie_insert(struct completion *completion, const char *name, size_t length)
+{
+    uint32_t node;
+    
+    // Room for the whole name, so that nodes do not move while being linked.
+    if (completion->trie_count + length + 1 > completion->trie_capacity)
+    {
+        size_t           capacity;
+        struct trie_node *trie;
+        
+        capacity = (completion->trie_capacity) ? completion->trie_capacity : 4096;
+        while (capacity < completion->trie_count + length + 1)
+        {
+            capacity *= 2;
+        }
+        if (capacity > UINT32_MAX)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        trie = (struct trie_node *) realloc(completion->trie, capacity * sizeof(struct trie_node));
+        if (!trie)
+        {
+            return -1;
+        }
+        completion->trie          = trie;
+        completion->trie_capacity = capacity;
+    }
+    
+    if (completion->trie_count == 1)
+    {
+        memset(completion->trie, 0, 2 * sizeof(struct trie_node));
+        completion->trie_count = 2;
+    }
+    
+    node = 1;
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char byte;
+        uint32_t      *link;
+        uint32_t      child;
+        
+        byte = (unsigned char) *(name + i);
+        
+        // Children are kept sorted, so walking the trie finds names in order.
+        for (link = &(completion->trie + node)->child;
+             *link && (completion->trie + *link)->byte < byte;
+             link = &(completion->trie + *link)->sibling)
+        {
+        }
+        
+        if (*link && (completion->trie + *link)->byte == byte)
+        {
+            node = *link;
+            continue;
+        }
+        
+        child = (uint32_t) completion->trie_count++;
+        (completion->trie + child)->child    = 0;
+        (completion->trie + child)->sibling  = *link;
+        (completion->trie + child)->byte     = byte;
+        (completion->trie + child)->terminal = false;
+        *link = child;
+        node  = child;
+    }
+    if (length)
+    {
+        (completion->trie + node)->terminal = true;
+    }
+    
+    return 0;
+}
+
+uint32_t trie_child(const struct completion *completion, uint32_t node, unsigned char byte)
+{
+    uint32_t child;
+    
+    for (child = (completion->trie + node)->child; child; child = (completion->trie + child)->sibling)
+    {
+        if ((completion->trie + child)->byte >= byte)
+        {
+            return ((completion->trie + child)->byte == byte) ? child : 0;
+        }
+    }
+    
+    return 0;
+}
+
+ssize_t trie_walk(const struct completion *completion, uint32_t node, char *name, size_t length,
+                  void (*found)(const char *name, size_t length, bool directory, void *arg), void *arg)
+{
+    ssize_t count;
+    
+    count = 0;
+    if ((completion->trie + node)->terminal)
+    {
+        *(name + length) = '\0';
+        found(name, length, false, arg);
+        ++count;
+    }
+    
+    if (length == NAME_MAX)
+    {
+        return count;
+    }
+    
+    for (uint32_t child = (completion->trie + node)->child; child; child = (completion->trie + child)->sibling)
+    {
+        *(name + length) = (char) (completion->trie + child)->byte;
+        count += trie_walk(completion, child, name, length + 1, found, arg);
+    }
+    
+    return count;
+}
+
+ssize_t completion_commands(struct completion *completion, const char *prefix, size_t prefix_length,
+                            void (*found)(const char *name, size_t length, bool directory, void *arg), void *arg)
+{
+    char     name[NAME_MAX + 1];
+    uint32_t node;
+    
+    if (completion->trie_stale && build_trie(completion) == -1)
+    {
+        return -1;
+    }
+    
+    if (prefix_length > NAME_MAX)
+    {
+        return 0;
+    }
+    
+    node = 1;
+    for (size_t i = 0; i < prefix_length && node; ++i)
+    {
+        node = trie_child(completion, node, (unsigned char) *(prefix + i));
+    }
+    if (!node)
+    {
+        return 0;
+    }
+    
+    memcpy(name, prefix, prefix_length);
+    
+    return trie_walk(completion, node, name, prefix_length, found, arg);
+}
+
+ssize_t completion_files(struct completion *completion, const char *cwd, const char *word, size_t word_length,
+                         void (*found)(const char *name, size_t length, bool directory, void *arg), void *arg)
+{
+    struct completion_dir *dir;
+    char                  path[PATH_MAX];
+    const char            *base;
+    size_t                base_length;
+    size_t                dir_length;
+    size_t                prefix_length;
+    size_t                length;
+    size_t                low;
+    size_t                high;
+    ssize_t               count;
+    
+    // Split the word into the directory and the start of the name.
+    for (base = word + word_length; base > word && *(base - 1) != '/'; --base)
+    {
+    }
+    base_length = word_length - (size_t) (base - word);
+    dir_length  = (size_t) (base - word);
+    
+    // An absolute directory is used as it is, a relative one from cwd ("cwd/").
+    prefix_length = (dir_length && *word == '/') ? 0 : strlen(cwd) + 1;
+    length        = prefix_length + dir_length;
+    if (length >= sizeof(path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (prefix_length)
+    {
+        memcpy(path, cwd, prefix_length - 1);
+        *(path + prefix_length - 1) = '/';
+    }
+    memcpy(path + prefix_length, word, dir_length);
+    *(path + length) = '\0';
+    
+    dir = find_file_dir(completion, path, length);
+    if (!dir || (dir->stale && list_dir(completion, dir) == -1))
+    {
+        return -1;
+    }
+    
+    // The names starting with base are together in the sorted listing.
+    low  = 0;
+    high = dir->count;
+    while (low < high)
+    {
+        size_t middle;
+        
+        middle = low + (high - low) / 2;
+        if (strncmp((dir->entries + middle)->name, base, base_length) < 0)
+        {
+            low = middle + 1;
+        } else
+        {
+            high = middle;
+        }
+    }
+    
+    count = 0;
+    for (; low < dir->count && strncmp((dir->entries + low)->name, base, base_length) == 0; ++low)
+    {
+        if (*(dir->entries + low)->name == '.' && (base_length == 0 || *base != '.'))
+        {
+            continue;
+        }
+        found((dir->entries + low)->name, (dir->entries + low)->length, (dir->entries + low)->directory, arg);
+        ++count;
+    }
+    
+    return count;
+}
+
+struct completion_dir *find_file_dir(struct completion *completion, const char *path, size_t length)
+{
+    struct completion_dir *dir;
+    
+    dir = NULL;
+    for (size_t i = 0; i < completion->file_dir_count; ++i)
+    {
+        if (strcmp((completion->files + i)->path, path) == 0)
+        {
+            dir = completion->files + i;
+            break;
+        }
+    }
+    
+    if (!dir)
+    {
+        if (completion->file_dir_count < COMPLETION_FILE_DIRS)
+        {
+            dir = completion->files + completion->file_dir_count++;
+        } else
+        {
+            dir = completion->files;
+            for (size_t i = 1; i < COMPLETION_FILE_DIRS; ++i)
+            {
+                if ((completion->files + i)->used < dir->used)
+                {
+                    dir = completion->files + i;
+                }
+            }
+            free_dir(completion, dir);
+        }
+        
+        memset(dir, 0, sizeof(struct completion_dir));
+        dir->path = (char *) malloc(length + 1);
+        if (!dir->path)
+        {
+            return NULL;
+        }
+        memcpy(dir->path, path, length + 1);
+        dir->watch = -1;
+        dir->stale = true;
+    }
+    
+    dir->used = ++completion->clock;
+    
+    return dir;
+}
+
+void free_dir(struct completion *completion, struct completion_dir *dir)
+{
+#if defined(__linux__)
+    if (dir->watch != -1 && !watch_shared(completion, dir))
+    {
+        (void) inotify_rm_watch(completion->inotify_fd, dir->watch);
+    }
+#endif
+    dir->watch = -1;
+    free(dir->names);
+    free(dir->entries);
+    dir->names          = NULL;
+    dir->names_length   = 0;
+    dir->names_capacity = 0;
+    dir->entries        = NULL;
+    dir->count          = 0;
+    dir->capacity       = 0;
+}
+
+bool watch_shared(const struct completion *completion, const struct completion_dir *dir)
+{
+    const struct completion_dir *other;
+    
+    for (size_t i = 0; i < completion->command_dir_count + completion->file_dir_count; ++i)
+    {
+        other = (i < completion->command_dir_count) ? completion->commands + i
+                                                    : completion->files + i - completion->command_dir_count;
+        if (other != dir && other->watch == dir->watch)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void completion_destroy(struct supervisor *supvis, struct completion *completion)
+{
+    for (size_t i = 0; i < completion->command_dir_count; ++i)
+    {
+        free_dir(completion, completion->commands + i);
+    }
+    for (size_t i = 0; i < completion->file_dir_count; ++i)
+    {
+        free_dir(completion, completion->files + i);
+        free((completion->files + i)->path);
+    }
+    if (completion->inotify_fd != -1)
+    {
+        (void) close(completion->inotify_fd);
+    }
+    free(completion->trie);
+    supvis->mm->mm_free(supvis->mm, completion->commands);
+    supvis->mm->mm_free(supvis->mm, completion);
+}
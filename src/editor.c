@@ -0,0 +1,1832 @@
+#include "../include/completion.h"
+#include "../include/editor.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/**
+ * struct completion_matches
+ * <p>
+ * The names found while completing a word.
+ * </p>
+ */
+struct completion_matches
+{
+    struct edit_buffer names;       // the names, back to back and null terminated
+    struct edit_buffer kinds;       // '/' for each name that is a directory, ' ' for the others
+    size_t count;                   // number of names
+    size_t widest;                  // length of the longest name
+    bool failed;                    // whether memory ran out
+};
+
+/**
+ * edit_reserve
+ * <p>
+ * Make room in a buffer for more bytes.
+ * </p>
+ * @param buffer the buffer
+ * @param extra the number of bytes to make room for
+ * @return 0 on success, -1 on failure
+ */
+int edit_reserve(struct edit_buffer *buffer, size_t extra);
+
+/**
+ * edit_insert
+ * <p>
+ * Insert bytes into a buffer.
+ * </p>
+ * @param buffer the buffer
+ * @param at the offset to insert at
+ * @param text the bytes
+ * @param length the number of bytes
+ * @return 0 on success, -1 on failure
+ */
+int edit_insert(struct edit_buffer *buffer, size_t at, const char *text, size_t length);
+
+/**
+ * edit_copy
+ * <p>
+ * Replace the contents of a buffer.
+ * </p>
+ * @param buffer the buffer
+ * @param text the new contents
+ * @param length the length of the new contents
+ * @return 0 on success, -1 on failure
+ */
+int edit_copy(struct edit_buffer *buffer, const char *text, size_t length);
+
+/**
+ * edit_failed
+ * <p>
+ * End the line after running out of memory.
+ * </p>
+ * @param editor the editor
+ */
+void edit_failed(struct line_editor *editor);
+
+/**
+ * emit
+ * <p>
+ * Add bytes to the output written to the terminal at the next flush.
+ * </p>
+ * @param editor the editor
+ * @param text the bytes
+ * @param length the number of bytes
+ */
+void emit(struct line_editor *editor, const char *text, size_t length);
+
+/**
+ * emit_move
+ * <p>
+ * Add a cursor movement to the output.
+ * </p>
+ * @param editor the editor
+ * @param count the number of rows or columns to move
+ * @param direction 'A' (up), 'B' (down), 'C' (right) or 'D' (left)
+ */
+void emit_move(struct line_editor *editor, size_t count, char direction);
+
+/**
+ * emit_visible
+ * <p>
+ * Add text to the output, with control characters replaced so that they cannot move the
+ * terminal's cursor. Newlines start a new row if newlines is true.
+ * </p>
+ * @param editor the editor
+ * @param text the text
+ * @param length the length of the text
+ * @param newlines whether newlines are output as such
+ */
+void emit_visible(struct line_editor *editor, const char *text, size_t length, bool newlines);
+
+/**
+ * flush_output
+ * <p>
+ * Write the output to the terminal at once.
+ * </p>
+ * @param editor the editor
+ */
+void flush_output(struct line_editor *editor);
+
+/**
+ * count_cells
+ * <p>
+ * Count the cells of the terminal that UTF-8 text takes.
+ * </p>
+ * @param text the text
+ * @param length the length of the text
+ * @return the number of cells
+ */
+size_t count_cells(const char *text, size_t length);
+
+/**
+ * prompt_cells
+ * <p>
+ * Count the cells that the last row of a prompt takes, skipping escape sequences.
+ * </p>
+ * @param prompt the prompt
+ * @param length the length of the prompt
+ * @return the number of cells
+ */
+size_t prompt_cells(const char *prompt, size_t length);
+
+/**
+ * move_to
+ * <p>
+ * Move the terminal's cursor to a cell, counted from the start of the last row of the prompt.
+ * </p>
+ * @param editor the editor
+ * @param cell the cell
+ */
+void move_to(struct line_editor *editor, size_t cell);
+
+/**
+ * redraw
+ * <p>
+ * Bring the screen up to date with the line and the suggestion. The frame that should be shown
+ * is compared with the frame that is, and only the cells from the first difference to the last
+ * are written.
+ * </p>
+ * @param editor the editor
+ */
+void redraw(struct line_editor *editor);
+
+/**
+ * full_redraw
+ * <p>
+ * Draw the prompt (the search label while searching) and the line again from the start of the
+ * prompt's last row.
+ * </p>
+ * @param editor the editor
+ * @param whole whether to draw every row of the prompt, when the cursor is on a row of its own
+ */
+void full_redraw(struct line_editor *editor, bool whole);
+
+/**
+ * insert_text
+ * <p>
+ * Insert text into the line at the cursor and move the cursor past it.
+ * </p>
+ * @param editor the editor
+ * @param text the text
+ * @param length the length of the text
+ */
+void insert_text(struct line_editor *editor, const char *text, size_t length);
+
+/**
+ * insert_escaped
+ * <p>
+ * Insert a completed name into the line, with the characters special to the shell escaped.
+ * </p>
+ * @param editor the editor
+ * @param name the name
+ * @param length the length of the name
+ */
+void insert_escaped(struct line_editor *editor, const char *name, size_t length);
+
+/**
+ * delete_range
+ * <p>
+ * Delete a range of the line, keeping it for yanking if kill is true.
+ * </p>
+ * @param editor the editor
+ * @param from the start of the range
+ * @param to the end of the range
+ * @param kill whether to keep the range for yanking
+ */
+void delete_range(struct line_editor *editor, size_t from, size_t to, bool kill);
+
+/**
+ * set_line
+ * <p>
+ * Replace the line and move the cursor to its end.
+ * </p>
+ * @param editor the editor
+ * @param text the new line
+ * @param length the length of the new line
+ */
+void set_line(struct line_editor *editor, const char *text, size_t length);
+
+/**
+ * char_left
+ * <p>
+ * Find the start of the character before an offset of the line.
+ * </p>
+ * @param editor the editor
+ * @param at the offset
+ * @return the start of the character
+ */
+size_t char_left(const struct line_editor *editor, size_t at);
+
+/**
+ * char_right
+ * <p>
+ * Find the end of the character at an offset of the line.
+ * </p>
+ * @param editor the editor
+ * @param at the offset
+ * @return the end of the character
+ */
+size_t char_right(const struct line_editor *editor, size_t at);
+
+/**
+ * word_left
+ * <p>
+ * Find the start of the word before the cursor.
+ * </p>
+ * @param editor the editor
+ * @return the start of the word
+ */
+size_t word_left(const struct line_editor *editor);
+
+/**
+ * word_right
+ * <p>
+ * Find the end of the word after the cursor.
+ * </p>
+ * @param editor the editor
+ * @return the end of the word
+ */
+size_t word_right(const struct line_editor *editor);
+
+/**
+ * process_input
+ * <p>
+ * Process bytes read from the terminal until the line is done.
+ * </p>
+ * @param editor the editor
+ * @param state the state object
+ * @param input the bytes
+ * @param length the number of bytes
+ * @return the number of bytes processed
+ */
+size_t process_input(struct line_editor *editor, struct state *state, const char *input, size_t length);
+
+/**
+ * process_paste
+ * <p>
+ * Insert pasted bytes into the line, up to the end of the paste.
+ * </p>
+ * @param editor the editor
+ * @param input the bytes
+ * @param length the number of bytes
+ * @return the number of bytes processed
+ */
+size_t process_paste(struct line_editor *editor, const char *input, size_t length);
+
+/**
+ * finish_paste
+ * <p>
+ * Queue the complete lines of a paste as pending input, echoing them in one write, and leave
+ * the rest on the line.
+ * </p>
+ * @param editor the editor
+ */
+void finish_paste(struct line_editor *editor);
+
+/**
+ * handle_key
+ * <p>
+ * Act on a control character.
+ * </p>
+ * @param editor the editor
+ * @param state the state object
+ * @param c the character
+ */
+void handle_key(struct line_editor *editor, struct state *state, char c);
+
+/**
+ * handle_sequence
+ * <p>
+ * Act on the escape sequence in editor->sequence.
+ * </p>
+ * @param editor the editor
+ * @param state the state object
+ */
+void handle_sequence(struct line_editor *editor, struct state *state);
+
+/**
+ * sequence_complete
+ * <p>
+ * Check whether editor->sequence holds a whole escape sequence.
+ * </p>
+ * @param editor the editor
+ * @return true if it does, false otherwise
+ */
+bool sequence_complete(const struct line_editor *editor);
+
+/**
+ * accept_line
+ * <p>
+ * Queue the line as pending input.
+ * </p>
+ * @param editor the editor
+ */
+void accept_line(struct line_editor *editor);
+
+/**
+ * cancel_line
+ * <p>
+ * Drop the line, as ^C does.
+ * </p>
+ * @param editor the editor
+ */
+void cancel_line(struct line_editor *editor);
+
+/**
+ * accept_suggestion
+ * <p>
+ * Complete the line with the suggestion.
+ * </p>
+ * @param editor the editor
+ */
+void accept_suggestion(struct line_editor *editor);
+
+/**
+ * update_suggestion
+ * <p>
+ * Find the most recent history entry starting with the line, when the cursor is at its end.
+ * </p>
+ * @param editor the editor
+ * @param state the state object
+ */
+void update_suggestion(struct line_editor *editor, struct state *state);
+
+/**
+ * browse_history
+ * <p>
+ * Replace the line with the history entry before or after the one shown.
+ * </p>
+ * @param editor the editor
+ * @param state the state object
+ * @param older whether to go back in the history
+ */
+void browse_history(struct line_editor *editor, struct state *state, bool older);
+
+/**
+ * start_search
+ * <p>
+ * Begin an incremental search of the history for the commands starting with a query.
+ * </p>
+ * @param editor the editor
+ */
+void start_search(struct line_editor *editor);
+
+/**
+ * search_step
+ * <p>
+ * Show the next command matching the search query, starting over if restart is true.
+ * </p>
+ * @param editor the editor
+ * @param state the state object
+ * @param restart whether the query changed
+ */
+void search_step(struct line_editor *editor, struct state *state, bool restart);
+
+/**
+ * search_key
+ * <p>
+ * Act on a control character while searching.
+ * </p>
+ * @param editor the editor
+ * @param state the state object
+ * @param c the character
+ * @return true if the character was used by the search, false if it ended the search and is
+ * still to be acted on
+ */
+bool search_key(struct line_editor *editor, struct state *state, char c);
+
+/**
+ * end_search
+ * <p>
+ * End the search, going back to the line from before it if restore is true.
+ * </p>
+ * @param editor the editor
+ * @param restore whether to go back to the line from before the search
+ */
+void end_search(struct line_editor *editor, bool restore);
+
+/**
+ * complete_word
+ * <p>
+ * Complete the word before the cursor: a command name at the start of a command, a file
+ * otherwise. A single match is inserted whole; several are completed to their common prefix,
+ * or listed below the line if there is none.
+ * </p>
+ * @param editor the editor
+ * @param state the state object
+ */
+void complete_word(struct line_editor *editor, struct state *state);
+
+/**
+ * collect_match
+ * <p>
+ * Add a name to a struct completion_matches; called by the completion engine.
+ * </p>
+ * @param name the name
+ * @param length the length of the name
+ * @param directory whether the name is a directory
+ * @param arg the struct completion_matches
+ */
+void collect_match(const char *name, size_t length, bool directory, void *arg);
+
+/**
+ * list_matches
+ * <p>
+ * List completions below the line, in columns, and draw the prompt again under them.
+ * </p>
+ * @param editor the editor
+ * @param matches the completions
+ */
+void list_matches(struct line_editor *editor, const struct completion_matches *matches);
+
+struct line_editor *editor_create(struct supervisor *supvis, int fd)
+{
+    struct line_editor *editor;
+    
+    if (!isatty(fd))
+    {
+        return NULL;
+    }
+    
+    editor = mm_calloc(1, sizeof(struct line_editor), supvis->mm, __FILE__, __func__, __LINE__);
+    if (editor)
+    {
+        editor->fd      = fd;
+        editor->columns = 80;
+    }
+    
+    return editor;
+}
+
+int edit_reserve(struct edit_buffer *buffer, size_t extra)
+{
+    size_t capacity;
+    char   *data;
+    
+    if (buffer->length + extra <= buffer->capacity)
+    {
+        return 0;
+    }
+    
+    capacity = (buffer->capacity) ? buffer->capacity : 64;
+    while (capacity < buffer->length + extra)
+    {
+        capacity *= 2;
+    }
+    data = (char *) realloc(buffer->data, capacity);
+    if (!data)
+    {
+        return -1;
+    }
+    buffer->data     = data;
+    buffer->capacity = capacity;
+    
+    return 0;
+}
+
+int edit_insert(struct edit_buffer *buffer, size_t at, const char *text, size_t length)
+{
+    if (!length)
+    {
+        return 0;
+    }
+    if (edit_reserve(buffer, length) == -1)
+    {
+        return -1;
+    }
+    
+    memmove(buffer->data + at + length, buffer->data + at, buffer->length - at);
+    memcpy(buffer->data + at, text, length);
+    buffer->length += length;
+    
+    return 0;
+}
+
+int edit_copy(struct edit_buffer *buffer, const char *text, size_t length)
+{
+    buffer->length = 0;
+    
+    return edit_insert(buffer, 0, text, length);
+}
+
+void edit_failed(struct line_editor *editor)
+{
+    editor->result = -1;
+    editor->done   = true;
+}
+
+void emit(struct line_editor *editor, const char *text, size_t length)
+{
+    if (edit_insert(&editor->output, editor->output.length, text, length) == -1)
+    {
+        edit_failed(editor);
+    }
+}
+
+void emit_move(struct line_editor *editor, size_t count, char direction)
+{
+    char sequence[32];
+    int  length;
+    
+    length = snprintf(sequence, sizeof(sequence), "\033[%zu%c", count, direction);
+    if (length > 0)
+    {
+        emit(editor, sequence, (size_t) length);
+    }
+}
+
+void emit_visible(struct line_editor *editor, const char *text, size_t length, bool newlines)
+{
+    size_t run;
+    
+    for (size_t i = 0; i < length; i = run)
+    {
+        for (run = i; run < length && (unsigned char) *(text + run) >= ' ' && *(text + run) != 0x7f; ++run)
+        {
+        }
+        emit(editor, text + i, run - i);
+        if (run == length)
+        {
+            break;
+        }
+        
+        if (*(text + run) == '\n' && newlines)
+        {
+            emit(editor, "\r\n", 2);
+        } else
+        {
+            emit(editor, (*(text + run) == '\t' || *(text + run) == '\n') ? " " : "?", 1);
+        }
+        ++run;
+    }
+}
+
+void flush_output(struct line_editor *editor)
+{
+    ssize_t written;
+    size_t  offset;
+    
+    for (offset = 0; offset < editor->output.length; offset += (size_t) written)
+    {
+        written = write(editor->fd, editor->output.data + offset, editor->output.length - offset);
+        if (written == -1 && errno == EINTR)
+        {
+            written = 0;
+            continue;
+        }
+        if (written == -1)
+        {
+            break;
+        }
+    }
+    editor->output.length = 0;
+}
+
+size_t count_cells(const char *text, size_t length)
+{
+    size_t cells;
+    
+    cells = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if ((*(text + i) & 0xC0) != 0x80)
+        {
+            ++cells;
+        }
+    }
+    
+    return cells;
+}
+
+size_t prompt_cells(const char *prompt, size_t length)
+{
+    size_t cells;
+    
+    cells = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char c;
+        
+        c = (unsigned char) *(prompt + i);
+        if (c == '\033' && i + 1 < length && *(prompt + i + 1) == '[')
+        {
+            // A control sequence ends with a byte from '@' to '~'.
+            for (i += 2; i < length && (*(prompt + i) < '@' || *(prompt + i) > '~'); ++i)
+            {
+            }
+            continue;
+        }
+        if (c == '\n')
+        {
+            cells = 0;
+        } else if (c >= ' ' && (c & 0xC0) != 0x80)
+        {
+            ++cells;
+        }
+    }
+    
+    return cells;
+}
+
+void move_to(struct line_editor *editor, size_t cell)
+{
+    size_t from_row;
+    size_t from_column;
+    size_t to_row;
+    size_t to_column;
+    
+    from_row    = editor->screen / editor->columns;
+    from_column = editor->screen % editor->columns;
+    to_row      = cell / editor->columns;
+    to_column   = cell % editor->columns;
+    
+    if (to_row < from_row)
+    {
+        emit_move(editor, from_row - to_row, 'A');
+    } else if (to_row > from_row)
+    {
+        emit_move(editor, to_row - from_row, 'B');
+    }
+    if (to_column == 0 && from_column != 0)
+    {
+        emit(editor, "\r", 1);
+    } else if (to_column > from_column)
+    {
+        emit_move(editor, to_column - from_column, 'C');
+    } else if (to_column < from_column)
+    {
+        emit_move(editor, from_column - to_column, 'D');
+    }
+    
+    editor->screen = cell;
+}
+
+void redraw(struct line_editor *editor)
+{
+    struct edit_buffer swap;
+    struct edit_buffer *next;
+    struct edit_buffer *frame;
+    size_t             plain;
+    size_t             shorter;
+    size_t             first;
+    size_t             end;
+    
+    next  = &editor->next;
+    frame = &editor->frame;
+    plain = editor->line.length;
+    
+    next->length = 0;
+    if (edit_reserve(next, editor->line.length + editor->suggestion.length) == -1)
+    {
+        edit_failed(editor);
+        return;
+    }
+    for (size_t i = 0; i < editor->line.length + editor->suggestion.length; ++i)
+    {
+        char c;
+        
+        c = (i < plain) ? *(editor->line.data + i) : *(editor->suggestion.data + i - plain);
+        *(next->data + next->length++) = ((unsigned char) c < ' ' || c == 0x7f) ? ((c == '\t') ? ' ' : '?') : c;
+    }
+    
+    // Everything before the first change to the line is on the screen already.
+    shorter = (frame->length < next->length) ? frame->length : next->length;
+    first   = (editor->dirty < shorter) ? editor->dirty : shorter;
+    while (first < shorter && *(frame->data + first) == *(next->data + first)
+           && (first < editor->frame_plain) == (first < plain))
+    {
+        ++first;
+    }
+    while (first > 0 && first < next->length && (*(next->data + first) & 0xC0) == 0x80)
+    {
+        --first;
+    }
+    
+    // When the length is unchanged, what follows the last difference is on the screen as well.
+    end = next->length;
+    if (frame->length == next->length)
+    {
+        size_t tail;
+        
+        for (tail = end; tail > first && *(frame->data + tail - 1) == *(next->data + tail - 1)
+                         && (tail - 1 < editor->frame_plain) == (tail - 1 < plain); --tail)
+        {
+        }
+        while (tail < end && (*(next->data + tail) & 0xC0) == 0x80)
+        {
+            ++tail;
+        }
+        if (count_cells(frame->data + first, tail - first) == count_cells(next->data + first, tail - first))
+        {
+            end = tail;
+        }
+    }
+    
+    if (first < end || next->length < frame->length)
+    {
+        move_to(editor, editor->prompt_width + count_cells(next->data, first));
+        if (first < end)
+        {
+            if (first < plain)
+            {
+                emit(editor, next->data + first, ((end < plain) ? end : plain) - first);
+            }
+            if (end > plain)
+            {
+                emit(editor, "\033[2m", 4);
+                emit(editor, next->data + ((first > plain) ? first : plain), end - ((first > plain) ? first : plain));
+                emit(editor, "\033[0m", 4);
+            }
+            
+            // A terminal holds its cursor on the last column of a full row; move it to the next.
+            editor->screen += count_cells(next->data + first, end - first);
+            if (editor->screen % editor->columns == 0)
+            {
+                emit(editor, "\r\n", 2);
+            }
+        }
+        if (next->length < frame->length)
+        {
+            emit(editor, "\033[J", 3);
+        }
+    }
+    move_to(editor, editor->prompt_width + count_cells(editor->line.data, editor->cursor));
+    
+    swap                = *frame;
+    *frame              = *next;
+    *next               = swap;
+    editor->frame_plain = plain;
+    editor->dirty       = editor->line.length;
+}
+
+void full_redraw(struct line_editor *editor, bool whole)
+{
+    const struct edit_buffer *prompt;
+    size_t                   start;
+    
+    prompt = (editor->searching) ? &editor->label : &editor->prompt;
+    start  = (whole) ? 0 : prompt->length;
+    while (start > 0 && *(prompt->data + start - 1) != '\n')
+    {
+        --start;
+    }
+    
+    move_to(editor, 0);
+    emit(editor, "\033[J", 3);
+    for (size_t i = start; i < prompt->length; ++i)
+    {
+        emit(editor, (*(prompt->data + i) == '\n') ? "\r\n" : prompt->data + i, (*(prompt->data + i) == '\n') ? 2 : 1);
+    }
+    
+    editor->prompt_width = prompt_cells(prompt->data, prompt->length);
+    editor->screen       = editor->prompt_width;
+    if (editor->screen && editor->screen % editor->columns == 0)
+    {
+        emit(editor, "\r\n", 2);
+    }
+    editor->frame.length = 0;
+    editor->frame_plain  = 0;
+    editor->dirty        = 0;
+    redraw(editor);
+}
+
+void insert_text(struct line_editor *editor, const char *text, size_t length)
+{
+    if (edit_insert(&editor->line, editor->cursor, text, length) == -1)
+    {
+        edit_failed(editor);
+        return;
+    }
+    
+    if (editor->dirty > editor->cursor)
+    {
+        editor->dirty = editor->cursor;
+    }
+    editor->cursor           += length;
+    editor->history_position = 0;
+}
+
+void insert_escaped(struct line_editor *editor, const char *name, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (strchr(" \t\\'\"|;&<>()$`*?[]#~{}!", *(name + i)))
+        {
+            insert_text(editor, "\\", 1);
+        }
+        insert_text(editor, name + i, 1);
+    }
+}
+
+void delete_range(struct line_editor *editor, size_t from, size_t to, bool kill)
+{
+    if (from >= to)
+    {
+        return;
+    }
+    if (kill && edit_copy(&editor->kill, editor->line.data + from, to - from) == -1)
+    {
+        edit_failed(editor);
+        return;
+    }
+    
+    memmove(editor->line.data + from, editor->line.data + to, editor->line.length - to);
+    editor->line.length -= to - from;
+    if (editor->dirty > from)
+    {
+        editor->dirty = from;
+    }
+    if (editor->cursor >= to)
+    {
+        editor->cursor -= to - from;
+    } else if (editor->cursor > from)
+    {
+        editor->cursor = from;
+    }
+    editor->history_position = 0;
+}
+
+void set_line(struct line_editor *editor, const char *text, size_t length)
+{
+    if (edit_copy(&editor->line, text, length) == -1)
+    {
+        edit_failed(editor);
+        return;
+    }
+    
+    editor->cursor = length;
+    editor->dirty  = 0;
+}
+
+size_t char_left(const struct line_editor *editor, size_t at)
+{
+    if (at > 0)
+    {
+        --at;
+    }
+    while (at > 0 && (*(editor->line.data + at) & 0xC0) == 0x80)
+    {
+        --at;
+    }
+    
+    return at;
+}
+
+size_t char_right(const struct line_editor *editor, size_t at)
+{
+    if (at < editor->line.length)
+    {
+        ++at;
+    }
+    while (at < editor->line.length && (*(editor->line.data + at) & 0xC0) == 0x80)
+    {
+        ++at;
+    }
+    
+    return at;
+}
+
+size_t word_left(const struct line_editor *editor)
+{
+    size_t at;
+    
+    at = editor->cursor;
+    while (at > 0 && strchr(" \t", *(editor->line.data + at - 1)))
+    {
+        --at;
+    }
+    while (at > 0 && !strchr(" \t", *(editor->line.data + at - 1)))
+    {
+        --at;
+    }
+    
+    return at;
+}
+
+size_t word_right(const struct line_editor *editor)
+{
+    size_t at;
+    
+    at = editor->cursor;
+    while (at < editor->line.length && strchr(" \t", *(editor->line.data + at)))
+    {
+        ++at;
+    }
+    while (at < editor->line.length && !strchr(" \t", *(editor->line.data + at)))
+    {
+        ++at;
+    }
+    
+    return at;
+}
+
+int editor_read_line(struct line_editor *editor, struct state *state, const char *prompt, size_t prompt_length)
+{
+    struct termios raw;
+    struct winsize size;
+    ssize_t        bytes;
+    
+    if (editor->pending_start < editor->pending.length)
+    {
+        return 1;
+    }
+    editor->pending.length = 0;
+    editor->pending_start  = 0;
+    
+    if (edit_copy(&editor->prompt, prompt, prompt_length) == -1 || tcgetattr(editor->fd, &editor->saved) == -1)
+    {
+        return -1;
+    }
+    raw = editor->saved;
+    raw.c_iflag &= ~(tcflag_t) (BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_oflag &= ~(tcflag_t) OPOST;
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(tcflag_t) (ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN]  = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(editor->fd, TCSADRAIN, &raw) == -1)
+    {
+        return -1;
+    }
+    
+    editor->columns = (ioctl(editor->fd, TIOCGWINSZ, &size) == 0 && size.ws_col) ? size.ws_col : 80;
+    if (state->history)
+    {
+        (void) history_refresh(state->history);
+    }
+    
+    // The line is not empty when a paste left an unfinished line on it.
+    editor->cursor           = editor->line.length;
+    editor->history_position = 0;
+    editor->searching        = false;
+    editor->result           = 1;
+    editor->done             = false;
+    editor->screen           = 0;
+    update_suggestion(editor, state);
+    emit(editor, "\033[?2004h", 8);
+    full_redraw(editor, true);
+    
+    while (!editor->done)
+    {
+        if (editor->input_start == editor->input_end)
+        {
+            flush_output(editor);
+            bytes = read(editor->fd, editor->input, sizeof(editor->input));
+            if (bytes == -1 && errno == EINTR)
+            {
+                errno = 0;
+                continue;
+            }
+            if (bytes <= 0)
+            {
+                editor->result = (bytes == 0) ? 0 : -1;
+                break;
+            }
+            editor->input_start = 0;
+            editor->input_end   = (size_t) bytes;
+        }
+        
+        // Typed-ahead lines stay in input for the next call.
+        editor->input_start += process_input(editor, state, editor->input + editor->input_start,
+                                             editor->input_end - editor->input_start);
+        
+        // Everything read at once is drawn at once; a paste is drawn when it ends.
+        if (!editor->done && !editor->pasting && editor->input_start == editor->input_end)
+        {
+            update_suggestion(editor, state);
+            redraw(editor);
+        }
+    }
+    
+    if (editor->searching)
+    {
+        editor->searching = false;
+        history_index_search_end(&editor->search);
+        editor->search_started = false;
+    }
+    emit(editor, "\033[?2004l", 8);
+    flush_output(editor);
+    (void) tcsetattr(editor->fd, TCSADRAIN, &editor->saved);
+    
+    return editor->result;
+}
+
+size_t process_input(struct line_editor *editor, struct state *state, const char *input, size_t length)
+{
+    size_t i;
+    
+    for (i = 0; i < length && !editor->done;)
+    {
+        char   c;
+        size_t run;
+        
+        if (editor->pasting)
+        {
+            i += process_paste(editor, input + i, length - i);
+            continue;
+        }
+        
+        c = *(input + i);
+        if (editor->sequence_length || c == '\033')
+        {
+            *(editor->sequence + editor->sequence_length++) = c;
+            ++i;
+            if (sequence_complete(editor))
+            {
+                handle_sequence(editor, state);
+                editor->sequence_length = 0;
+            } else if (editor->sequence_length == EDITOR_SEQUENCE_MAX)
+            {
+                editor->sequence_length = 0; // not a sequence the editor knows
+            }
+            continue;
+        }
+        
+        if ((unsigned char) c < ' ' || c == 0x7f)
+        {
+            ++i;
+            if (!editor->searching || !search_key(editor, state, c))
+            {
+                handle_key(editor, state, c);
+            }
+            continue;
+        }
+        
+        // Printable text is inserted a run at a time.
+        for (run = i; run < length && (unsigned char) *(input + run) >= ' ' && *(input + run) != 0x7f; ++run)
+        {
+        }
+        if (editor->searching)
+        {
+            if (edit_insert(&editor->query, editor->query.length, input + i, run - i) == -1)
+            {
+                edit_failed(editor);
+            }
+            search_step(editor, state, true);
+        } else
+        {
+            insert_text(editor, input + i, run - i);
+        }
+        i = run;
+    }
+    
+    return i;
+}
+
+size_t process_paste(struct line_editor *editor, const char *input, size_t length)
+{
+    size_t end_length;
+    size_t i;
+    
+    end_length = strlen(EDITOR_PASTE_END);
+    for (i = 0; i < length && editor->pasting && !editor->done;)
+    {
+        size_t run;
+        size_t at;
+        
+        if (*(input + i) == *(EDITOR_PASTE_END + editor->paste_end_matched))
+        {
+            ++i;
+            if (++editor->paste_end_matched == end_length)
+            {
+                editor->pasting           = false;
+                editor->paste_end_matched = 0;
+                finish_paste(editor);
+            }
+            continue;
+        }
+        if (editor->paste_end_matched)
+        {
+            // What looked like the end of the paste was pasted text.
+            insert_text(editor, EDITOR_PASTE_END, editor->paste_end_matched);
+            editor->paste_end_matched = 0;
+            continue;
+        }
+        
+        for (run = i; run < length && *(input + run) != '\033'; ++run)
+        {
+        }
+        at = editor->cursor;
+        insert_text(editor, input + i, run - i);
+        for (; at < editor->cursor && !editor->done; ++at)
+        {
+            if (*(editor->line.data + at) == '\r')
+            {
+                *(editor->line.data + at) = '\n';
+            }
+        }
+        i = run;
+    }
+    
+    return i;
+}
+
+void finish_paste(struct line_editor *editor)
+{
+    size_t accepted;
+    
+    for (accepted = editor->line.length; accepted > 0 && *(editor->line.data + accepted - 1) != '\n'; --accepted)
+    {
+    }
+    if (!accepted)
+    {
+        return;
+    }
+    
+    // The screen still shows the line from before the paste: replace it with the pasted lines.
+    move_to(editor, editor->prompt_width);
+    emit(editor, "\033[J", 3);
+    emit_visible(editor, editor->line.data, accepted, true);
+    
+    if (edit_insert(&editor->pending, editor->pending.length, editor->line.data, accepted) == -1)
+    {
+        edit_failed(editor);
+        return;
+    }
+    delete_range(editor, 0, accepted, false);
+    editor->cursor = editor->line.length;
+    editor->result = 1;
+    editor->done   = true;
+}
+
+bool sequence_complete(const struct line_editor *editor)
+{
+    char last;
+    
+    if (editor->sequence_length < 2)
+    {
+        return false;
+    }
+    
+    last = *(editor->sequence + editor->sequence_length - 1);
+    switch (*(editor->sequence + 1))
+    {
+        case '[':
+        {
+            return editor->sequence_length > 2 && last >= '@' && last <= '~';
+        }
+        case 'O':
+        {
+            return editor->sequence_length > 2;
+        }
+        default: // Alt and a key
+        {
+            return true;
+        }
+    }
+}
+
+void handle_sequence(struct line_editor *editor, struct state *state)
+{
+    const char *sequence;
+    size_t     length;
+    
+    sequence = editor->sequence;
+    length   = editor->sequence_length;
+    if (editor->searching)
+    {
+        end_search(editor, false);
+    }
+    
+    if (length == strlen(EDITOR_PASTE_START) && memcmp(sequence, EDITOR_PASTE_START, length) == 0)
+    {
+        editor->pasting = true;
+        return;
+    }
+    
+    // ESC [ and ESC O are the same for the keys below; modifiers come as ;3 (Alt) or ;5 (Ctrl).
+    if (*(sequence + 1) == '[' || *(sequence + 1) == 'O')
+    {
+        bool word;
+        
+        word = length == 6 && *(sequence + 2) == '1' && *(sequence + 3) == ';';
+        switch (*(sequence + length - 1))
+        {
+            case 'A':
+            {
+                browse_history(editor, state, true);
+                break;
+            }
+            case 'B':
+            {
+                browse_history(editor, state, false);
+                break;
+            }
+            case 'C':
+            {
+                if (word)
+                {
+                    editor->cursor = word_right(editor);
+                } else if (editor->cursor == editor->line.length)
+                {
+                    accept_suggestion(editor);
+                } else
+                {
+                    editor->cursor = char_right(editor, editor->cursor);
+                }
+                break;
+            }
+            case 'D':
+            {
+                editor->cursor = (word) ? word_left(editor) : char_left(editor, editor->cursor);
+                break;
+            }
+            case 'H':
+            {
+                editor->cursor = 0;
+                break;
+            }
+            case 'F':
+            {
+                editor->cursor = editor->line.length;
+                break;
+            }
+            case '~':
+            {
+                switch (*(sequence + 2))
+                {
+                    case '1':
+                    case '7':
+                    {
+                        editor->cursor = 0;
+                        break;
+                    }
+                    case '4':
+                    case '8':
+                    {
+                        editor->cursor = editor->line.length;
+                        break;
+                    }
+                    case '3':
+                    {
+                        delete_range(editor, editor->cursor, char_right(editor, editor->cursor), false);
+                        break;
+                    }
+                    default:
+                    {
+                        break;
+                    }
+                }
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+        return;
+    }
+    
+    switch (*(sequence + 1))
+    {
+        case 'b':
+        {
+            editor->cursor = word_left(editor);
+            break;
+        }
+        case 'f':
+        {
+            editor->cursor = word_right(editor);
+            break;
+        }
+        case 'd':
+        {
+            delete_range(editor, editor->cursor, word_right(editor), true);
+            break;
+        }
+        case 0x7f:
+        case '\b':
+        {
+            delete_range(editor, word_left(editor), editor->cursor, true);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+void handle_key(struct line_editor *editor, struct state *state, char c)
+{
+    switch (c)
+    {
+        case 0x01: // ^A
+        {
+            editor->cursor = 0;
+            break;
+        }
+        case 0x02: // ^B
+        {
+            editor->cursor = char_left(editor, editor->cursor);
+            break;
+        }
+        case 0x03: // ^C
+        {
+            cancel_line(editor);
+            break;
+        }
+        case 0x04: // ^D
+        {
+            if (!editor->line.length)
+            {
+                emit(editor, "\r\n", 2);
+                editor->result = 0;
+                editor->done   = true;
+            } else
+            {
+                delete_range(editor, editor->cursor, char_right(editor, editor->cursor), false);
+            }
+            break;
+        }
+        case 0x05: // ^E
+        case 0x06: // ^F
+        {
+            if (editor->cursor == editor->line.length)
+            {
+                accept_suggestion(editor);
+            } else
+            {
+                editor->cursor = (c == 0x05) ? editor->line.length : char_right(editor, editor->cursor);
+            }
+            break;
+        }
+        case '\b':
+        case 0x7f:
+        {
+            delete_range(editor, char_left(editor, editor->cursor), editor->cursor, false);
+            break;
+        }
+        case '\t':
+        {
+            complete_word(editor, state);
+            break;
+        }
+        case '\r':
+        case '\n':
+        {
+            accept_line(editor);
+            break;
+        }
+        case 0x0B: // ^K
+        {
+            delete_range(editor, editor->cursor, editor->line.length, true);
+            break;
+        }
+        case 0x0C: // ^L
+        {
+            emit(editor, "\033[H\033[2J", 7);
+            editor->screen = 0;
+            full_redraw(editor, true);
+            break;
+        }
+        case 0x0E: // ^N
+        {
+            browse_history(editor, state, false);
+            break;
+        }
+        case 0x10: // ^P
+        {
+            browse_history(editor, state, true);
+            break;
+        }
+        case 0x12: // ^R
+        {
+            start_search(editor);
+            break;
+        }
+        case 0x15: // ^U
+        {
+            delete_range(editor, 0, editor->cursor, true);
+            break;
+        }
+        case 0x17: // ^W
+        {
+            delete_range(editor, word_left(editor), editor->cursor, true);
+            break;
+        }
+        case 0x19: // ^Y
+        {
+            insert_text(editor, editor->kill.data, editor->kill.length);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+void accept_line(struct line_editor *editor)
+{
+    editor->suggestion.length = 0;
+    redraw(editor);
+    move_to(editor, editor->prompt_width + count_cells(editor->line.data, editor->line.length));
+    emit(editor, "\r\n", 2);
+    
+    if (edit_insert(&editor->pending, editor->pending.length, editor->line.data, editor->line.length) == -1
+        || edit_insert(&editor->pending, editor->pending.length, "\n", 1) == -1)
+    {
+        edit_failed(editor);
+        return;
+    }
+    editor->line.length = 0;
+    editor->cursor      = 0;
+    editor->result      = 1;
+    editor->done        = true;
+}
+
+void cancel_line(struct line_editor *editor)
+{
+    editor->suggestion.length = 0;
+    redraw(editor);
+    move_to(editor, editor->prompt_width + count_cells(editor->line.data, editor->line.length));
+    emit(editor, "^C\r\n", 4);
+    
+    editor->line.length = 0;
+    editor->cursor      = 0;
+    editor->result      = EDITOR_CANCELLED;
+    editor->done        = true;
+}
+
+void accept_suggestion(struct line_editor *editor)
+{
+    insert_text(editor, editor->suggestion.data, editor->suggestion.length);
+    editor->suggestion.length = 0;
+}
+
+void update_suggestion(struct line_editor *editor, struct state *state)
+{
+    struct history_entry entry;
+    const char           *end;
+    
+    editor->suggestion.length = 0;
+    if (!state->history_index || editor->searching || editor->history_position || !editor->line.length
+        || editor->cursor != editor->line.length)
+    {
+        return;
+    }
+    
+    if (history_index_suggest(state->history_index, editor->line.data, editor->line.length, &entry)
+        && entry.length > editor->line.length)
+    {
+        // Only the first line of a command spanning several is suggested.
+        end = memchr(entry.text + editor->line.length, '\n', entry.length - editor->line.length);
+        if (edit_copy(&editor->suggestion, entry.text + editor->line.length,
+                      (end) ? (size_t) (end - entry.text) - editor->line.length : entry.length - editor->line.length)
+            == -1)
+        {
+            editor->suggestion.length = 0;
+        }
+    }
+}
+
+void browse_history(struct line_editor *editor, struct state *state, bool older)
+{
+    struct history_entry entry;
+    
+    if (!state->history)
+    {
+        emit(editor, "\a", 1);
+        return;
+    }
+    
+    if (older)
+    {
+        if (!history_get(state->history, editor->history_position, &entry))
+        {
+            emit(editor, "\a", 1);
+            return;
+        }
+        if (!editor->history_position && edit_copy(&editor->draft, editor->line.data, editor->line.length) == -1)
+        {
+            edit_failed(editor);
+            return;
+        }
+        ++editor->history_position;
+        set_line(editor, entry.text, entry.length);
+        return;
+    }
+    
+    if (!editor->history_position)
+    {
+        emit(editor, "\a", 1);
+        return;
+    }
+    if (--editor->history_position)
+    {
+        (void) history_get(state->history, editor->history_position - 1, &entry);
+        set_line(editor, entry.text, entry.length);
+    } else
+    {
+        set_line(editor, editor->draft.data, editor->draft.length);
+    }
+}
+
+void start_search(struct line_editor *editor)
+{
+    if (edit_copy(&editor->draft, editor->line.data, editor->line.length) == -1)
+    {
+        edit_failed(editor);
+        return;
+    }
+    
+    editor->searching      = true;
+    editor->search_started = false;
+    editor->query.length   = 0;
+    if (edit_copy(&editor->label, "(search)`': ", 12) == -1)
+    {
+        edit_failed(editor);
+        return;
+    }
+    full_redraw(editor, false);
+}
+
+void search_step(struct line_editor *editor, struct state *state, bool restart)
+{
+    struct history_entry entry;
+    
+    if (restart)
+    {
+        // The label shows the query between `'; rebuild it and draw it with the match.
+        if (edit_copy(&editor->label, "(search)`", 9) == -1
+            || edit_insert(&editor->label, editor->label.length, editor->query.data, editor->query.length) == -1
+            || edit_insert(&editor->label, editor->label.length, "': ", 3) == -1)
+        {
+            edit_failed(editor);
+            return;
+        }
+        if (editor->search_started)
+        {
+            history_index_search_end(&editor->search);
+            editor->search_started = false;
+        }
+    }
+    
+    if (!state->history_index)
+    {
+        emit(editor, "\a", 1);
+    } else if (!editor->search_started
+               && history_index_search_start(state->history_index, &editor->search,
+                                             (editor->query.data) ? editor->query.data : "", editor->query.length) == -1)
+    {
+        edit_failed(editor);
+        return;
+    } else
+    {
+        editor->search_started = true;
+        if (history_index_search_next(state->history_index, &editor->search, &entry))
+        {
+            set_line(editor, entry.text, entry.length);
+        } else
+        {
+            emit(editor, "\a", 1);
+        }
+    }
+    
+    if (restart)
+    {
+        full_redraw(editor, false);
+    }
+}
+
+bool search_key(struct line_editor *editor, struct state *state, char c)
+{
+    switch (c)
+    {
+        case 0x12: // ^R
+        {
+            search_step(editor, state, false);
+            return true;
+        }
+        case '\b':
+        case 0x7f:
+        {
+            while (editor->query.length && (*(editor->query.data + --editor->query.length) & 0xC0) == 0x80)
+            {
+            }
+            search_step(editor, state, true);
+            return true;
+        }
+        case 0x03: // ^C
+        case 0x07: // ^G
+        {
+            end_search(editor, true);
+            return true;
+        }
+        default: // the search ends and the key acts on the line found
+        {
+            end_search(editor, false);
+            return false;
+        }
+    }
+}
+
+void end_search(struct line_editor *editor, bool restore)
+{
+    if (editor->search_started)
+    {
+        history_index_search_end(&editor->search);
+        editor->search_started = false;
+    }
+    editor->searching = false;
+    if (restore)
+    {
+        set_line(editor, editor->draft.data, editor->draft.length);
+    }
+    full_redraw(editor, false);
+}
+
+void complete_word(struct line_editor *editor, struct state *state)
+{
+    struct completion_matches matches;
+    struct edit_buffer        word;
+    const char                *name;
+    size_t                    start;
+    size_t                    base;
+    size_t                    common;
+    size_t                    before;
+    bool                      command;
+    ssize_t                   found;
+    
+    if (!state->completion)
+    {
+        emit(editor, "\a", 1);
+        return;
+    }
+    
+    // The word runs back to an unescaped blank or operator; its escapes are removed to look it up.
+    for (start = editor->cursor; start > 0; --start)
+    {
+        if (strchr(" \t|;&<>", *(editor->line.data + start - 1))
+            && !(start > 1 && *(editor->line.data + start - 2) == '\\'))
+        {
+            break;
+        }
+    }
+    memset(&word, 0, sizeof(struct edit_buffer));
+    memset(&matches, 0, sizeof(struct completion_matches));
+    for (size_t i = start; i < editor->cursor; ++i)
+    {
+        if (*(editor->line.data + i) == '\\' && i + 1 < editor->cursor)
+        {
+            ++i;
+        }
+        if (edit_insert(&word, word.length, editor->line.data + i, 1) == -1)
+        {
+            matches.failed = true;
+        }
+    }
+    
+    for (before = start; before > 0 && strchr(" \t", *(editor->line.data + before - 1)); --before)
+    {
+    }
+    command = (before == 0 || strchr("|;&", *(editor->line.data + before - 1)))
+              && !(word.length && memchr(word.data, '/', word.length));
+    
+    if (command)
+    {
+        found = completion_commands(state->completion, (word.data) ? word.data : "", word.length, collect_match,
+                                    &matches);
+    } else
+    {
+        found = completion_files(state->completion, state->cwd, (word.data) ? word.data : "", word.length,
+                                 collect_match, &matches);
+    }
+    
+    // Names are found without the directory part of the word.
+    for (base = word.length; base > 0 && *(word.data + base - 1) != '/'; --base)
+    {
+    }
+    free(word.data);
+    
+    if (found == -1 || matches.failed || !matches.count)
+    {
+        emit(editor, "\a", 1);
+    } else if (matches.count == 1)
+    {
+        insert_escaped(editor, matches.names.data + word.length - base, strlen(matches.names.data) - (word.length - base));
+        insert_text(editor, matches.kinds.data, 1);
+    } else
+    {
+        common = strlen(matches.names.data);
+        for (name = matches.names.data; name < matches.names.data + matches.names.length; name += strlen(name) + 1)
+        {
+            size_t same;
+            
+            for (same = 0; same < common && *(name + same) == *(matches.names.data + same); ++same)
+            {
+            }
+            common = same;
+        }
+        if (common > word.length - base)
+        {
+            insert_escaped(editor, matches.names.data + word.length - base, common - (word.length - base));
+        } else
+        {
+            list_matches(editor, &matches);
+        }
+    }
+    
+    free(matches.names.data);
+    free(matches.kinds.data);
+}
+
+void collect_match(const char *name, size_t length, bool directory, void *arg)
+{
+    struct completion_matches *matches;
+    
+    matches = (struct completion_matches *) arg;
+    if (edit_insert(&matches->names, matches->names.length, name, length) == -1
+        || edit_insert(&matches->names, matches->names.length, "", 1) == -1
+        || edit_insert(&matches->kinds, matches->kinds.length, (directory) ? "/" : " ", 1) == -1)
+    {
+        matches->failed = true;
+        return;
+    }
+    
+    ++matches->count;
+    if (length > matches->widest)
+    {
+        matches->widest = length;
+    }
+}
+
+void list_matches(struct line_editor *editor, const struct completion_matches *matches)
+{
+    const char *name;
+    char       line[64];
+    size_t     width;
+    size_t     per_row;
+    size_t     shown;
+    size_t     i;
+    int        more;
+    
+    width   = matches->widest + 3;
+    per_row = (editor->columns / width) ? editor->columns / width : 1;
+    shown   = (matches->count < EDITOR_LIST_MAX) ? matches->count : EDITOR_LIST_MAX;
+    
+    move_to(editor, editor->prompt_width + count_cells(editor->frame.data, editor->frame.length));
+    emit(editor, "\r\n", 2);
+    for (i = 0, name = matches->names.data; i < shown; ++i, name += strlen(name) + 1)
+    {
+        emit_visible(editor, name, strlen(name), false);
+        if (*(matches->kinds.data + i) == '/')
+        {
+            emit(editor, "/", 1);
+        }
+        if ((i + 1) % per_row == 0 || i + 1 == shown)
+        {
+            emit(editor, "\r\n", 2);
+            continue;
+        }
+        for (size_t pad = count_cells(name, strlen(name)) + (*(matches->kinds.data + i) == '/'); pad < width; ++pad)
+        {
+            emit(editor, " ", 1);
+        }
+    }
+    if (matches->count > shown)
+    {
+        more = snprintf(line, sizeof(line), "(%zu more)\r\n", matches->count - shown);
+        emit(editor, line, (size_t) more);
+    }
+    
+    editor->screen = 0;
+    full_redraw(editor, true);
+}
+
+const char *editor_pending(const struct line_editor *editor, size_t *length)
+{
+    *length = editor->pending.length - editor->pending_start;
+    
+    return editor->pending.data + editor->pending_start;
+}
+
+void editor_consume(struct line_editor *editor, size_t length)
+{
+    editor->pending_start += length;
+}
+
+void editor_destroy(struct supervisor *supvis, struct line_editor *editor)
+{
+    if (editor->search_started)
+    {
+        history_index_search_end(&editor->search);
+    }
+    free(editor->line.data);
+    free(editor->kill.data);
+    free(editor->prompt.data);
+    free(editor->label.data);
+    free(editor->frame.data);
+    free(editor->next.data);
+    free(editor->suggestion.data);
+    free(editor->output.data);
+    free(editor->draft.data);
+    free(editor->query.data);
+    free(editor->pending.data);
+    supvis->mm->mm_free(supvis->mm, editor);
+}
@@ -1,12 +1,22 @@
 #include "../include/builtins.h"
+#include "../include/command_hash.h"
 #include "../include/execute.h"
+#include "../include/file_cache.h"
 #include "../include/shell.h"
+#include "../include/subshell.h"
+#include "../include/tokenizer.h"
+#include "../include/util.h"
 
+#include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+extern char **environ;
+
 #define EXIT_EACCES 4
 #define EXIT_EFAULT 5
 #define EXIT_EINVAL 6
@@ -36,59 +46,158 @@ pid_t pid_global; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables):
  * @param supvis the supervisor object
  * @param state the state struct
  * @param command the command struct
- * @param path the path
  * @return DESTROY_STATE or RESET_STATE or ERROR
  */
-int execute(struct supervisor *supvis, struct state *state, struct command *command, char **path);
+int execute(struct supervisor *supvis, struct state *state, struct command *command);
 
 /**
- * fork_and_exec
+ * execute_pipeline
  * <p>
- * Fork the process and replace the child with the command process if found.
+ * Run the commands from first to last as a pipeline: every stage is expanded, then spawned (or
+ * forked, for builtins and groups), with a pipe from each stage to the next, before the shell
+ * waits for any of them. The status of the
+ * pipeline is that of its last stage, or with pipefail that of the last stage to fail.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param first the first stage
+ * @param last the last stage
+ * @return RESET_STATE if the pipeline succeeded, ERROR otherwise
+ */
+int execute_pipeline(struct supervisor *supvis, struct state *state, struct command *first, struct command *last);
+
+/**
+ * run_stage
+ * <p>
+ * In the child process of a pipeline stage, connect stdin and stdout to the pipes and run the
+ * command. Builtins run in the child, as their output may be piped. Never returns.
  * </p>
  * @param supvis the supervisor object
  * @param state the state object
  * @param command the command object
- * @param path the path upon which to find the object
+ * @param input the read end of the pipe from the previous stage, or -1
+ * @param output the write end of the pipe to the next stage, or -1
+ * @param unused the read end of the pipe to the next stage, which the child does not use, or -1
  */
-void fork_and_exec(struct supervisor *supvis, struct state *state, struct command *command, char **path);
+void run_stage(struct supervisor *supvis, struct state *state, struct command *command, int input, int output,
+               int unused);
 
 /**
- * child_parse_path_and_exec
+ * run_subshell
  * <p>
- * Parse the path to find the executable and execute the executable.
+ * Run a ( ... ) group. A group made only of builtins, redirecting at most its output, runs in
+ * the shell's own process; any other group runs in a child of the shell.
  * </p>
  * @param supvis the supervisor object
  * @param state the state object
+ * @param command the command holding the group
+ * @return the exit status of the group
+ */
+int run_subshell(struct supervisor *supvis, struct state *state, struct command *command);
+
+/**
+ * run_command
+ * <p>
+ * Run an external command and wait for it: spawned, or forked if the forkexec option is on.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param command the command object
+ */
+void run_command(struct supervisor *supvis, struct state *state, struct command *command);
+
+/**
+ * spawn_command
+ * <p>
+ * Find an external command and start it with posix_spawn. Unlike fork, posix_spawn does not copy
+ * the shell's memory or page tables (glibc uses clone with CLONE_VM | CLONE_VFORK), so starting a
+ * command costs the same however large the shell grows. The redirected files are opened by the
+ * shell, so a failure is reported for the file; they and the pipe ends are put on stdin, stdout
+ * and stderr by file actions, carried out in the child before it execs. If the command cannot be started, a
+ * message is printed to state->stdout and command->exit_code is set as the forked child would
+ * have exited.
+ * </p>
+ * @param state the state object
+ * @param command the command object
+ * @param input the descriptor to make stdin, or -1
+ * @param output the descriptor to make stdout, or -1
+ * @return the pid of the child, or -1 on failure
+ */
+pid_t spawn_command(struct state *state, struct command *command, int input, int output);
+
+/**
+ * open_redirections
+ * <p>
+ * Open the files a command redirects to, close-on-exec, setting the opened field of each, and
+ * check that every descriptor copied will be open. The files are opened above every descriptor
+ * the command redirects, so the dup2 of one cannot replace another. A file appended to is taken
+ * from state->file_cache if it accepts it and holds it above them too. On failure, a message is
+ * printed to state->stdout and the files already opened are closed.
+ * </p>
+ * @param state the state object
+ * @param command the command object
+ * @return 0 on success, -1 on failure
+ */
+int open_redirections(struct state *state, struct command *command);
+
+/**
+ * close_redirections
+ * <p>
+ * Close the files open_redirections opened, except those held by state->file_cache.
+ * </p>
+ * @param command the command object
+ */
+void close_redirections(struct command *command);
+
+/**
+ * descriptor_open
+ * <p>
+ * Check whether a descriptor will be open when a redirection of a command is done: whether the
+ * last redirection before it that changes the descriptor opens or copies it or, if none does,
+ * whether it is open in the shell. The shell's own descriptors are close-on-exec and count as
+ * closed, so they cannot be copied to a command.
+ * </p>
+ * @param command the command object
+ * @param until the redirection
+ * @param fd the descriptor
+ * @return true if it will be open, false otherwise
+ */
+bool descriptor_open(const struct command *command, const struct redirection *until, int fd);
+
+/**
+ * locate_command
+ * <p>
+ * Find the file to run for a command, in the order the forked child always tried them: the
+ * command as it is, then, if it has no '/', the file state->command_hash finds for it on the path.
+ * </p>
+ * @param state the state object
  * @param command the command object
- * @param path the path upon which to find the command
+ * @return the file, or NULL with errno set (ENOENT, EACCES, ENOMEM)
  */
-void child_parse_path_exec(struct supervisor *supvis, struct state *state, struct command *command, char **path);
+const char *locate_command(struct state *state, const struct command *command);
 
 /**
- * setup_redirection
+ * fork_and_exec
  * <p>
- * If redirection filenames are present, open the files; redirect the state's stdin, stdout, and stderr
- * to the files respectively.
+ * Fork the process and replace the child with the command process if found. Used instead of
+ * spawn_command when the forkexec option is on.
  * </p>
+ * @param supvis the supervisor object
  * @param state the state object
  * @param command the command object
- * @param streams an array holding the newly opened files
  */
-void setup_redirection(struct state *state, struct command *command, FILE **streams);
+void fork_and_exec(struct supervisor *supvis, struct state *state, struct command *command);
 
 /**
- * exec_command
+ * child_parse_path_and_exec
  * <p>
- * Attempt to execute a command.
+ * Find the executable through the command hash table and execute it.
  * </p>
+ * @param supvis the supervisor object
  * @param state the state object
- * @param command the command object; contains the command to execute
- * @param path the path upon which to search for the executable
- * @param cmd_len the length of the command field
- * @return 0 if process found and executed, or -1 if an error occurs
+ * @param command the command object
  */
-int exec_command(struct command *command, char *const *path, size_t cmd_len);
+void child_parse_path_exec(struct supervisor *supvis, struct state *state, struct command *command);
 
 /**
  * parent_wait
@@ -100,6 +209,18 @@ int exec_command(struct command *command, char *const *path, size_t cmd_len);
  */
 void parent_wait(struct state *state, struct command *command);
 
+/**
+ * child_exit
+ * <p>
+ * End a forked child of the shell: flush its streams, free what the memory manager holds and
+ * leave with _exit. The buffers the shell allocates outside the memory manager are left to the
+ * kernel, as exit would have a leak checker report them and change the status.
+ * </p>
+ * @param supvis the supervisor object
+ * @param exit_code the exit status of the child
+ */
+void child_exit(struct supervisor *supvis, int exit_code);
+
 /**
  * kill_child_handler
  * <p>
@@ -133,41 +254,276 @@ void print_err_message(int exit_code, const char *command, FILE *ostream);
 
 int do_execute_commands(struct supervisor *supvis, struct state *state)
 {
-    int ret_val;
+    struct command *command;
+    struct command *last;
+    int            ret_val;
+    int            status;
     
-    ret_val = execute(supvis, state, state->command, state->path);
+    ret_val = RESET_STATE;
+    status  = EXIT_SUCCESS;
+    for (command = state->commands; command; command = last->next)
+    {
+        for (last = command; last->next && last->next->separator == SEPARATOR_PIPE; last = last->next)
+        {
+        }
+        
+        // A pipeline skipped by && or || leaves the status of the last command run.
+        if ((command->separator == SEPARATOR_AND && status != EXIT_SUCCESS)
+            || (command->separator == SEPARATOR_OR && status == EXIT_SUCCESS))
+        {
+            continue;
+        }
+        
+        if (command != last)
+        {
+            ret_val = execute_pipeline(supvis, state, command, last);
+            if (state->fatal_error)
+            {
+                return ERROR;
+            }
+            status = state->exit_code;
+            continue;
+        }
+        
+        errno = 0; // a builtin run before may have left it set on success (eg. which, from access)
+        parse_command(supvis, state, command);
+        if (state->fatal_error)
+        {
+            return ERROR;
+        }
+        if (errno) // the words could not be expanded; the command fails and the list goes on
+        {
+            errno              = 0;
+            command->exit_code = EXIT_FAILURE;
+            state->exit_code   = EXIT_FAILURE;
+            status             = EXIT_FAILURE;
+            ret_val            = ERROR;
+            continue;
+        }
+        
+        ret_val = execute(supvis, state, command);
+        if (ret_val == DESTROY_STATE || state->fatal_error)
+        {
+            return ret_val;
+        }
+        status = command->exit_code;
+    }
     
     return ret_val;
 }
 
-int execute(struct supervisor *supvis, struct state *state, struct command *command, char **path)
+int execute(struct supervisor *supvis, struct state *state, struct command *command)
 {
     int ret_val;
     
+    if (command->subshell)
+    {
+        command->exit_code = run_subshell(supvis, state, command);
+        state->exit_code   = command->exit_code;
+        return (state->fatal_error || command->exit_code) ? ERROR : RESET_STATE;
+    }
+    
+    if (!command->command) // nothing to run, eg. a line holding only a redirection
+    {
+        return RESET_STATE;
+    }
+    
     if (strcmp(command->command, "cd") == 0)
     {
-        state->command->exit_code = builtin_cd(command, state->stdout);
-        ret_val = (state->command->exit_code) ? ERROR : RESET_STATE;
+        subshell_save(state);
+        command->exit_code = builtin_cd(command, state->stdout);
+        if (!command->exit_code)
+        {
+            (void) do_update_working_dir(supvis, state); // keeps the previous directory if this fails
+        }
+        ret_val = (command->exit_code) ? ERROR : RESET_STATE;
     } else if (strcmp(command->command, "exit") == 0)
     {
-        ret_val = DESTROY_STATE;
+        ret_val = (builtin_exit(state, command, state->stdout) == 0) ? DESTROY_STATE : ERROR;
+    } else if (strcmp(command->command, "compgen") == 0)
+    {
+        command->exit_code = builtin_compgen(state, command, state->stdout);
+        ret_val = (command->exit_code) ? ERROR : RESET_STATE;
+    } else if (strcmp(command->command, "history") == 0)
+    {
+        command->exit_code = builtin_history(state, command, state->stdout);
+        ret_val = (command->exit_code) ? ERROR : RESET_STATE;
+    } else if (strcmp(command->command, "set") == 0)
+    {
+        subshell_save(state);
+        command->exit_code = builtin_set(supvis, state, command, state->stdout);
+        ret_val = (command->exit_code) ? ERROR : RESET_STATE;
     } else if (strcmp(command->command, "which") == 0 || strcmp(command->command, "where") == 0)
     {
-        state->command->exit_code = builtin_which(*(command->argv + 1), path, state->stdout);
-        ret_val = (state->command->exit_code) ? ERROR : RESET_STATE;
+        command->exit_code = builtin_which(state, *(command->argv + 1), state->stdout);
+        ret_val = (command->exit_code) ? ERROR : RESET_STATE;
+    } else if (strcmp(command->command, "hash") == 0)
+    {
+        command->exit_code = builtin_hash(state, command, state->stdout);
+        ret_val = (command->exit_code) ? ERROR : RESET_STATE;
+    } else if (strcmp(command->command, "exec") == 0)
+    {
+        command->exit_code = builtin_exec(state, command, state->stdout);
+        ret_val = (command->exit_code) ? ERROR : RESET_STATE;
     } else
     {
-        fork_and_exec(supvis, state, command, path);
-        ret_val = (state->command->exit_code) ? ERROR : RESET_STATE;
+        run_command(supvis, state, command);
+        ret_val = (command->exit_code) ? ERROR : RESET_STATE;
     }
     
+    state->exit_code = command->exit_code;
+    
     return ret_val;
 }
 
-void fork_and_exec(struct supervisor *supvis, struct state *state, struct command *command, char **path)
+int execute_pipeline(struct supervisor *supvis, struct state *state, struct command *first, struct command *last)
 {
-    pid_global = fork();
+    struct command *command;
+    int            fds[2];
+    int            input;
+    int            status;
+    
+    errno = 0;
+    for (command = first; command != last->next; command = command->next)
+    {
+        parse_command(supvis, state, command);
+        if (state->fatal_error)
+        {
+            return ERROR;
+        }
+        if (errno) // the words could not be expanded; nothing is started
+        {
+            errno            = 0;
+            state->exit_code = EXIT_FAILURE;
+            return ERROR;
+        }
+    }
+    
+    // Output is fully buffered when not interactive; flush so the children do not inherit it.
+    (void) fflush(state->stdout);
+    (void) fflush(state->stderr);
+    
+    // Every stage is started before any is waited for, so the pipes never fill with no reader.
+    input = -1;
+    for (command = first; command != last->next; command = command->next)
+    {
+        *fds       = -1;
+        *(fds + 1) = -1;
+        if (command != last && open_pipe(state, fds) == -1)
+        {
+            (void) fprintf(state->stderr, "csh: could not create pipe: %s\n", strerror(errno));
+            errno = 0;
+            break;
+        }
+        
+        // Builtins and groups run in a copy of the shell; external commands are spawned.
+        if (!state->fork_exec && command->command && !command->subshell && !is_builtin(command->command))
+        {
+            command->pid = spawn_command(state, command, input, *(fds + 1));
+        } else
+        {
+            // Found by the shell rather than the child, so the entry outlives it.
+            if (command->command && !command->subshell && !is_builtin(command->command))
+            {
+                (void) locate_command(state, command);
+                errno = 0;
+            }
+            command->pid = fork();
+            if (command->pid == 0)
+            {
+                run_stage(supvis, state, command, input, *(fds + 1), *fds);
+            }
+        }
+        
+        if (input != -1)
+        {
+            (void) close(input);
+        }
+        if (*(fds + 1) != -1)
+        {
+            (void) close(*(fds + 1));
+        }
+        input = *fds;
+        
+        // A command that could not be spawned has its status; the rest of the pipeline still runs.
+        if (command->pid == -1 && command->exit_code)
+        {
+            errno = 0;
+        } else if (command->pid == -1)
+        {
+            (void) fprintf(state->stderr, "csh: could not fork process: %s\n", strerror(errno));
+            errno = 0;
+            break;
+        }
+    }
+    if (input != -1)
+    {
+        (void) close(input);
+    }
+    
+    // A stage that was never started fails; the ones before it are waited for all the same.
+    status = EXIT_SUCCESS;
+    for (command = first; command != last->next; command = command->next)
+    {
+        if (command->pid > 0)
+        {
+            pid_global = command->pid;
+            parent_wait(state, command);
+        } else if (!command->exit_code)
+        {
+            command->exit_code = EXIT_FAILURE;
+        }
+        
+        if ((state->pipefail) ? command->exit_code != EXIT_SUCCESS : command == last)
+        {
+            status = command->exit_code;
+        }
+    }
+    
+    state->exit_code = status;
+    
+    return (status) ? ERROR : RESET_STATE;
+}
 
+int run_subshell(struct supervisor *supvis, struct state *state, struct command *command)
+{
+    const struct redirection *redirection;
+    FILE                     *out;
+    int                      fd;
+    int                      exit_code;
+    
+    // Builtins write only to stdout, so a group redirecting nothing else runs with its output on the file.
+    redirection = command->redirections;
+    if (state->subshell
+        && (!redirection || (!redirection->next && redirection->fd == STDOUT_FILENO && redirection->kind == REDIRECT_FILE))
+        && subshell_can_run(state->subshell, command->subshell, command->subshell_length))
+    {
+        if (!redirection)
+        {
+            return subshell_run(supvis, state, command->subshell, command->subshell_length, state->stdout);
+        }
+        
+        // Opened as the child would open it; a descriptor it could not write to is left to the child.
+        fd  = shell_descriptor(open(redirection->file, redirection->flags | O_CLOEXEC, 0666));
+        out = (fd != -1 && (redirection->flags & O_ACCMODE) != O_RDONLY) ? fdopen(fd, "w") : NULL;
+        if (out)
+        {
+            exit_code = subshell_run(supvis, state, command->subshell, command->subshell_length, out);
+            (void) fclose(out);
+            return exit_code;
+        }
+        if (fd != -1)
+        {
+            (void) close(fd);
+        }
+        errno = 0; // the child fails in turn, or runs the group with the descriptor it opens
+    }
+    
+    // Output is fully buffered when not interactive; flush so the child does not inherit it.
+    (void) fflush(state->stdout);
+    (void) fflush(state->stderr);
+    
+    pid_global = fork();
     if (pid_global < 0)
     {
         (void) fprintf(state->stderr, "csh: fatal error: could not fork process\n");
@@ -175,90 +531,492 @@ void fork_and_exec(struct supervisor *supvis, struct state *state, struct comman
         command->exit_code = EXIT_FAILURE;
     } else if (pid_global == 0)
     {
-        child_parse_path_exec(supvis, state, command, path);
+        if (apply_redirections(state, command) == -1)
+        {
+            child_exit(supvis, EXIT_FAILURE);
+        }
+        execute_subshell(supvis, state, command->subshell, command->subshell_length);
     } else
     {
         parent_wait(state, command);
     }
+    
+    return command->exit_code;
+}
+
+void execute_subshell(struct supervisor *supvis, struct state *state, const char *text, size_t length)
+{
+    struct command *command;
+    char           *line;
+    size_t         offset;
+    size_t         consumed;
+    bool           complete;
+    int            exit_code;
+    
+    // The text may be a word of the tokenizer that is about to be reset, so it is copied first.
+    line = strndup(text, length);
+    if (!line)
+    {
+        child_exit(supvis, EXIT_FAILURE);
+    }
+    text = line;
+    
+    // Resetting the state drops the fields of the word the parent was expanding; they are its, not ours.
+    for (offset = 0; offset < length; offset += consumed)
+    {
+        do_reset_state(supvis, state);
+        consumed = tokenizer_feed(state->tokenizer, text + offset, length - offset, &complete);
+        if (!complete)
+        {
+            tokenizer_finish(state->tokenizer);
+        }
+        if (!state->tokenizer->token_count && !state->tokenizer->overflow)
+        {
+            continue;
+        }
+        
+        do_separate_commands(supvis, state);
+        if (!errno)
+        {
+            do_parse_commands(supvis, state);
+        }
+        if (errno) // the status is set by the step that failed
+        {
+            errno = 0;
+            continue;
+        }
+        
+        // A lone program at the end replaces this child instead of being forked from it, as in $(date).
+        command = state->commands;
+        if (offset + consumed >= length && !command->next)
+        {
+            parse_command(supvis, state, command);
+            if (!errno && command->command && !is_builtin(command->command))
+            {
+                child_parse_path_exec(supvis, state, command);
+            }
+            if (errno)
+            {
+                state->exit_code = EXIT_FAILURE;
+            } else if (command->command || command->subshell)
+            {
+                (void) execute(supvis, state, command);
+            }
+            break;
+        }
+        
+        if (do_execute_commands(supvis, state) == DESTROY_STATE || state->fatal_error)
+        {
+            break;
+        }
+    }
+    
+    exit_code = state->exit_code;
+    free(line);
+    child_exit(supvis, exit_code);
 }
 
-void child_parse_path_exec(struct supervisor *supvis, struct state *state, struct command *command, char **path)
+int open_pipe(const struct state *state, int *fds)
 {
-    size_t cmd_len;
-    int    status;
-    int    exit_code;
-    FILE   *streams[3];
+#if defined(__APPLE__)
+    if (pipe(fds) == -1)
+    {
+        return -1;
+    }
+    (void) fcntl(*fds, F_SETFD, FD_CLOEXEC);
+    (void) fcntl(*(fds + 1), F_SETFD, FD_CLOEXEC);
+#else
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        return -1;
+    }
+#endif
+
+#if defined(F_SETPIPE_SZ)
+    if (state->pipe_size)
+    {
+        int saved_errno;
+        
+        // The request fails past /proc/sys/fs/pipe-max-size unless privileged; the pipe is used as it is.
+        saved_errno = errno;
+        (void) fcntl(*(fds + 1), F_SETPIPE_SZ, state->pipe_size);
+        errno = saved_errno;
+    }
+#else
+    (void) state;
+#endif
+    
+    return 0;
+}
+
+void run_stage(struct supervisor *supvis, struct state *state, struct command *command, int input, int output,
+               int unused)
+{
+    int exit_code;
+    
+    if (unused != -1)
+    {
+        (void) close(unused);
+    }
+    
+    // dup2 leaves the new descriptors open across exec; the pipe ends themselves are closed.
+    if (input != -1)
+    {
+        (void) dup2(input, STDIN_FILENO);
+        (void) close(input);
+    }
+    if (output != -1)
+    {
+        (void) dup2(output, STDOUT_FILENO);
+        (void) close(output);
+    }
     
-    memset(streams, 0, sizeof(streams));
-    setup_redirection(state, command, streams);
+    exit_code = EXIT_SUCCESS; // a stage holding only a redirection
+    if (command->command && !command->subshell && !is_builtin(command->command))
+    {
+        child_parse_path_exec(supvis, state, command);
+    } else if (apply_redirections(state, command) == -1)
+    {
+        exit_code = EXIT_FAILURE;
+    } else if (command->subshell)
+    {
+        execute_subshell(supvis, state, command->subshell, command->subshell_length);
+    } else if (command->command)
+    {
+        (void) execute(supvis, state, command);
+        exit_code = command->exit_code;
+    }
     
-    status = execv(command->command, command->argv);
+    child_exit(supvis, exit_code);
+}
+
+void run_command(struct supervisor *supvis, struct state *state, struct command *command)
+{
+    if (state->fork_exec)
+    {
+        fork_and_exec(supvis, state, command);
+        return;
+    }
     
-    cmd_len = strlen(command->command);
+    // Output is fully buffered when not interactive; flush so it comes before the command's.
+    (void) fflush(state->stdout);
+    (void) fflush(state->stderr);
     
-    for (; *path && status != 0; ++path)
+    pid_global = spawn_command(state, command, -1, -1);
+    if (pid_global != -1)
     {
-        status = exec_command(command, path, cmd_len);
+        parent_wait(state, command);
     }
+}
+
+pid_t spawn_command(struct state *state, struct command *command, int input, int output)
+{
+    posix_spawn_file_actions_t actions;
+    const struct redirection   *redirection;
+    const char                 *file;
+    pid_t                      pid;
+    int                        error;
     
-    exit_code = get_exit_code(errno);
-    print_err_message(exit_code, state->command->command, state->stdout);
+    file = locate_command(state, command);
+    if (!file)
+    {
+        command->exit_code = get_exit_code(errno);
+        print_err_message(command->exit_code, command->command, state->stdout);
+        errno = 0;
+        return -1;
+    }
+    if (open_redirections(state, command) == -1)
+    {
+        command->exit_code = EXIT_FAILURE;
+        errno = 0;
+        return -1;
+    }
     
-    for (size_t i = 0; i < (sizeof(streams) / sizeof(*streams)); ++i) // NOLINT(bugprone-sizeof-expression): I know what I am doing
+    // Every descriptor is close-on-exec, so only their copies on stdin, stdout and stderr reach the command.
+    error = posix_spawn_file_actions_init(&actions);
+    if (!error && input != -1)
+    {
+        error = posix_spawn_file_actions_adddup2(&actions, input, STDIN_FILENO);
+    }
+    if (!error && output != -1)
     {
-        if (*(streams + i))
+        error = posix_spawn_file_actions_adddup2(&actions, output, STDOUT_FILENO);
+    }
+    for (redirection = command->redirections; redirection && !error; redirection = redirection->next)
+    {
+        switch (redirection->kind)
         {
-            (void) fclose(*(streams + i));
+            case REDIRECT_FILE:
+            {
+                error = posix_spawn_file_actions_adddup2(&actions, redirection->opened, redirection->fd);
+                break;
+            }
+            case REDIRECT_DUP:
+            {
+                error = posix_spawn_file_actions_adddup2(&actions, redirection->source, redirection->fd);
+                break;
+            }
+            case REDIRECT_CLOSE:
+            default:
+            {
+                error = posix_spawn_file_actions_addclose(&actions, redirection->fd);
+            }
         }
     }
-    supvis->mm->mm_free_all(supvis->mm);
-    free(supvis);
+    if (!error)
+    {
+        error = posix_spawn(&pid, file, &actions, NULL, command->argv, environ);
+    }
+    (void) posix_spawn_file_actions_destroy(&actions);
+    close_redirections(command);
     
-    exit(exit_code); // NOLINT(concurrency-mt-unsafe): no threads here
+    if (error)
+    {
+        command->exit_code = get_exit_code(error);
+        print_err_message(command->exit_code, command->command, state->stdout);
+        errno = 0;
+        return -1;
+    }
+    
+    return pid;
 }
 
-void setup_redirection(struct state *state, struct command *command, FILE **streams)
+int open_redirections(struct state *state, struct command *command)
 {
-    if (command->stdin_file)
+    int above;
+    int moved;
+    
+    // The files are opened above every descriptor redirected, so no dup2 replaces a file before it is copied.
+    above = STDERR_FILENO + 1;
+    for (const struct redirection *redirection = command->redirections; redirection; redirection = redirection->next)
     {
-        *streams = freopen(command->stdin_file, "r", state->stdin);
+        above = (redirection->fd >= above) ? redirection->fd + 1 : above;
     }
     
-    if (command->stdout_file)
+    file_cache_begin(state->file_cache);
+    for (struct redirection *redirection = command->redirections; redirection; redirection = redirection->next)
     {
-        const char *mode;
-        
-        mode = (command->stdout_overwrite) ? "w" : "a";
+        if (redirection->kind == REDIRECT_DUP && !descriptor_open(command, redirection, redirection->source))
+        {
+            (void) fprintf(state->stdout, "csh: %d: %s\n", redirection->source, strerror(EBADF));
+            close_redirections(command);
+            return -1;
+        }
+        if (redirection->kind != REDIRECT_FILE)
+        {
+            continue;
+        }
         
-        *(streams + 1) = freopen(command->stdout_file, mode, state->stdout);
+        redirection->cached = file_cache_accepts(state->file_cache, redirection->flags);
+        if (redirection->cached)
+        {
+            redirection->opened = file_cache_open(state->file_cache, redirection->file, redirection->flags);
+            if (redirection->opened != -1 && redirection->opened < above)
+            {
+                redirection->cached = false;
+            }
+        }
+        if (!redirection->cached)
+        {
+            redirection->opened = open(redirection->file, redirection->flags | O_CLOEXEC, 0666);
+            if (redirection->opened != -1 && redirection->opened < above)
+            {
+                moved = fcntl(redirection->opened, F_DUPFD_CLOEXEC, above);
+                (void) close(redirection->opened);
+                redirection->opened = moved;
+            }
+        }
+        if (redirection->opened == -1)
+        {
+            (void) fprintf(state->stdout, "csh: %s: %s\n", redirection->file, strerror(errno));
+            close_redirections(command);
+            return -1;
+        }
     }
     
-    if (command->stderr_file)
+    return 0;
+}
+
+void close_redirections(struct command *command)
+{
+    for (struct redirection *redirection = command->redirections; redirection; redirection = redirection->next)
     {
-        const char *mode;
-        
-        mode = (command->stderr_overwrite) ? "w" : "a";
+        if (redirection->opened != -1 && !redirection->cached)
+        {
+            (void) close(redirection->opened);
+        }
+        redirection->opened = -1;
+    }
+}
+
+bool descriptor_open(const struct command *command, const struct redirection *until, int fd)
+{
+    const struct redirection *last;
+    int                      flags;
     
-        *(streams + 2) = freopen(command->stderr_file, mode, state->stderr);
+    last = NULL;
+    for (const struct redirection *redirection = command->redirections; redirection != until; redirection = redirection->next)
+    {
+        last = (redirection->fd == fd) ? redirection : last;
     }
+    
+    if (last)
+    {
+        return last->kind != REDIRECT_CLOSE;
+    }
+    
+    flags = fcntl(fd, F_GETFD);
+    
+    return flags != -1 && !(flags & FD_CLOEXEC);
 }
 
-int exec_command(struct command *command, char *const *path, size_t cmd_len)
+const char *locate_command(struct state *state, const struct command *command)
 {
-    size_t len;
-    char   *path_and_cmd;
-    int    status;
+    const char *file;
+    int        error;
     
-    len          = strlen(*path) + cmd_len + 2;
-    path_and_cmd = (char *) malloc(len);
-    strcpy(path_and_cmd, *path);
-    strcat(path_and_cmd, "/");
-    strcat(path_and_cmd, command->command);
+    error = ENOENT;
+    if (command_executable(AT_FDCWD, command->command, &error))
+    {
+        return command->command;
+    }
+    if (strchr(command->command, '/'))
+    {
+        errno = error;
+        return NULL;
+    }
     
-    status = execv(path_and_cmd, command->argv);
+    file = command_hash_find(state->command_hash, command->command, &error);
+    if (!file)
+    {
+        errno = error;
+    }
     
-    free(path_and_cmd);
-    return status;
+    return file;
+}
+
+void fork_and_exec(struct supervisor *supvis, struct state *state, struct command *command)
+{
+    // Output is fully buffered when not interactive; flush so the child does not inherit it.
+    (void) fflush(state->stdout);
+    (void) fflush(state->stderr);
+    
+    // Found by the shell rather than the child, so the entry outlives it.
+    (void) locate_command(state, command);
+    errno = 0;
+    
+    pid_global = fork();
+    
+    if (pid_global < 0)
+    {
+        (void) fprintf(state->stderr, "csh: fatal error: could not fork process\n");
+        state->fatal_error = true;
+        command->exit_code = EXIT_FAILURE;
+    } else if (pid_global == 0)
+    {
+        child_parse_path_exec(supvis, state, command);
+    } else
+    {
+        parent_wait(state, command);
+    }
+}
+
+void child_parse_path_exec(struct supervisor *supvis, struct state *state, struct command *command)
+{
+    const char *file;
+    int        exit_code;
+    int        highest;
+    
+    // The directories of the path are held from SHELL_FD_MIN up, where a redirection such as 10>file lands.
+    highest = -1;
+    for (const struct redirection *redirection = command->redirections; redirection; redirection = redirection->next)
+    {
+        highest = (redirection->fd > highest) ? redirection->fd : highest;
+    }
+    if (command_hash_raise(state->command_hash, highest) == -1)
+    {
+        errno = 0; // out of descriptors; the directories stay where they are
+    }
+    
+    exit_code = EXIT_FAILURE;
+    if (apply_redirections(state, command) == 0)
+    {
+        // A command found on the path is run relative to the directory the table holds open for it.
+        file = locate_command(state, command);
+        if (file == command->command)
+        {
+            (void) execv(file, command->argv);
+        } else if (file)
+        {
+            (void) command_hash_exec(state->command_hash, command->command, command->argv);
+        }
+        
+        exit_code = get_exit_code(errno);
+        print_err_message(exit_code, command->command, state->stdout);
+    }
+    
+    child_exit(supvis, exit_code);
+}
+
+int apply_redirections(struct state *state, const struct command *command)
+{
+    int fd;
+    int status;
+    
+    for (const struct redirection *redirection = command->redirections; redirection; redirection = redirection->next)
+    {
+        switch (redirection->kind)
+        {
+            case REDIRECT_FILE:
+            {
+                fd = open(redirection->file, redirection->flags | O_CLOEXEC, 0666);
+                if (fd == -1)
+                {
+                    (void) fprintf(state->stdout, "csh: %s: %s\n", redirection->file, strerror(errno));
+                    return -1;
+                }
+                break;
+            }
+            case REDIRECT_DUP:
+            {
+                // As when spawning, the shell's own descriptors cannot be copied.
+                fd     = redirection->source;
+                status = fcntl(fd, F_GETFD);
+                if (status == -1 || (status & FD_CLOEXEC))
+                {
+                    (void) fprintf(state->stdout, "csh: %d: %s\n", fd, strerror(EBADF));
+                    return -1;
+                }
+                break;
+            }
+            case REDIRECT_CLOSE:
+            default:
+            {
+                (void) close(redirection->fd);
+                continue;
+            }
+        }
+        
+        // dup2 onto the descriptor itself would leave it close-on-exec, as the files are opened.
+        if (fd == redirection->fd)
+        {
+            status = fcntl(fd, F_SETFD, 0);
+        } else
+        {
+            status = dup2(fd, redirection->fd);
+        }
+        if (status == -1)
+        {
+            (void) fprintf(state->stdout, "csh: %d: %s\n", fd, strerror(errno));
+            return -1;
+        }
+        if (redirection->kind == REDIRECT_FILE && fd != redirection->fd)
+        {
+            (void) close(fd);
+        }
+    }
+    
+    return 0;
 }
 
 void parent_wait(struct state *state, struct command *command)
@@ -277,9 +1035,21 @@ void parent_wait(struct state *state, struct command *command)
     } else if (WIFEXITED(ret_val))
     {
         command->exit_code = WEXITSTATUS(ret_val);
+    } else if (WIFSIGNALED(ret_val))
+    {
+        command->exit_code = 128 + WTERMSIG(ret_val);
     }
 }
 
+void child_exit(struct supervisor *supvis, int exit_code)
+{
+    // _exit runs no atexit handlers, so nothing flushes the streams after this.
+    (void) fflush(NULL);
+    supvis->mm->mm_free_all(supvis->mm);
+    free(supvis);
+    
+    _exit(exit_code);
+}
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -0,0 +1,2094 @@
+#include "../include/arena.h"
+#include "../include/execute.h"
+#include "../include/expand.h"
+#include "../include/subshell.h"
+
+#include <ctype.h>
+#include <dc_posix/dc_stdlib.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/**
+ * The longest user name looked up for ~name.
+ */
+#define EXPANDER_LOGIN_MAX 256
+
+/**
+ * expand_text
+ * <p>
+ * Expand the part of a word between text and end into the field: quote removal, escapes and the
+ * expansions it holds. On a syntax error, print a message to state->stdout and set errno to EINVAL.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param word the whole word, for messages
+ * @param text the start of the part
+ * @param end the end of the part
+ * @param quoted whether the part is inside double quotes
+ * @return 0 on success, -1 on failure
+ */
+int expand_text(struct supervisor *supvis, struct state *state, const char *word, const char *text,
+                const char *end, bool quoted);
+
+/**
+ * expand_command
+ * <p>
+ * Expand the command substitution at the cursor: run the command in a child of the shell with
+ * its output on a pipe, and append the output, less its trailing newlines, as the value of the
+ * substitution. On a syntax error, print a message to state->stdout and set errno to EINVAL.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param cursor the position just past "$(" or '`', moved past the closing ')' or '`'
+ * @param quoted whether the substitution is in double quotes
+ * @param backquoted whether the substitution is `...` (vs. $(...))
+ * @return 0 on success, -1 on failure
+ */
+int expand_command(struct supervisor *supvis, struct state *state, const char **cursor, bool quoted,
+                   bool backquoted);
+
+/**
+ * expand_arithmetic
+ * <p>
+ * Expand the $((...)) at the cursor to the decimal value of its expression. The expression is
+ * compiled once and kept in expander->arith, so evaluating it again does not parse it. On an
+ * error, print a message to state->stdout and set errno to EINVAL.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param cursor the position just past "$((", moved past the closing "))"
+ * @param end the first ')' of the closing "))"
+ * @param quoted whether the expansion is inside double quotes
+ * @return 0 on success, -1 on failure
+ */
+int expand_arithmetic(struct supervisor *supvis, struct state *state, const char **cursor, const char *end,
+                      bool quoted);
+
+/**
+ * evaluate_expression
+ * <p>
+ * Compile an arithmetic expression, or find it compiled in expander->arith, and evaluate it.
+ * On an error, print a message to state->stdout and set errno to EINVAL.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param text the expression (not null terminated)
+ * @param length the length of the expression
+ * @param value set to the value of the expression
+ * @return 0 on success, -1 on failure
+ */
+int evaluate_expression(struct supervisor *supvis, struct state *state, const char *text, size_t length,
+                        int64_t *value);
+
+/**
+ * capture_output
+ * <p>
+ * Run a command and read all of its output into expander->capture: in the shell itself if it is
+ * made only of builtins, otherwise in a child of the shell. The exit status of the command
+ * becomes state->exit_code.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param command the command (not null terminated)
+ * @param length the length of the command
+ * @param backquoted whether the command is from `...`, in which '\' escapes '$', '`' and '\'
+ * @return the number of bytes of output, or -1 on failure
+ */
+ssize_t capture_output(struct supervisor *supvis, struct state *state, const char *command, size_t length,
+                       bool backquoted);
+
+/**
+ * capture_subshell
+ * <p>
+ * Run a command made only of builtins as a virtual subshell and copy its output into
+ * expander->capture. The exit status of the command becomes state->exit_code.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param line the command, as the child of the shell would run it
+ * @param length the length of the command
+ * @return the number of bytes of output, or -1 on failure
+ */
+ssize_t capture_subshell(struct supervisor *supvis, struct state *state, const char *line, size_t length);
+
+/**
+ * grow_capture
+ * <p>
+ * Double the mapping that holds the output of command substitutions. On Linux the pages are
+ * moved with mremap rather than copied.
+ * </p>
+ * @param expander the expander
+ * @return true on success, false if memory ran out
+ */
+bool grow_capture(struct expander *expander);
+
+/**
+ * expand_tilde
+ * <p>
+ * Expand the ~ or ~name at the start of a word to a home directory. The prefix is left alone
+ * if any of it is quoted or expanded, or if the user does not exist.
+ * </p>
+ * @param expander the expander
+ * @param cursor the position of the '~', moved past the prefix if it was expanded
+ */
+void expand_tilde(struct expander *expander, const char **cursor);
+
+/**
+ * expand_parameter
+ * <p>
+ * Expand the $NAME, ${NAME}, ${#NAME}, $? or $$ following a '$', or a ${NAME} with an operator.
+ * A '$' that starts none of these is itself. Positional parameters are never set, so $1 and the
+ * like expand to nothing.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param cursor the position after the '$', moved past the parameter
+ * @param quoted whether the parameter is inside double quotes
+ * @return 0 on success, -1 on failure
+ */
+int expand_parameter(struct supervisor *supvis, struct state *state, const char **cursor, bool quoted);
+
+/**
+ * parameter_value
+ * <p>
+ * Get the value of a parameter.
+ * </p>
+ * @param state the state object
+ * @param name the name of the parameter (not null terminated)
+ * @param length the length of the name
+ * @param number room for the value of $? or $$
+ * @param size the size of number
+ * @return the value, or NULL if the parameter is not set
+ */
+const char *parameter_value(const struct state *state, const char *name, size_t length, char *number,
+                            size_t size);
+
+/**
+ * expand_operator
+ * <p>
+ * Expand a ${NAME} that has an operator after the name: :-, -, :=, =, :+, +, :?, ?, #, ##, %,
+ * %%, /, //, /#, /% or a :offset:length substring. The operand is expanded only if the operator
+ * uses it. On an error, print a message to state->stdout and set errno to EINVAL.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param cursor the position of the '{', moved past the closing '}'
+ * @param name the name of the parameter
+ * @param length the length of the name
+ * @param quoted whether the parameter is inside double quotes
+ * @return 0 on success, -1 on failure
+ */
+int expand_operator(struct supervisor *supvis, struct state *state, const char **cursor, const char *name,
+                    size_t length, bool quoted);
+
+/**
+ * expand_default
+ * <p>
+ * Expand ${NAME-word}, ${NAME=word}, ${NAME+word} or ${NAME?word}, or their forms with a ':',
+ * which also treat an empty value as unset. An assignment in a virtual subshell is put back when
+ * the subshell ends.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param name the name of the parameter
+ * @param length the length of the name
+ * @param value the value of the parameter, or NULL if it is not set
+ * @param operator the operator: '-', '=', '+' or '?'
+ * @param colon whether the operator has a ':'
+ * @param operand the start of the word
+ * @param end the closing '}'
+ * @param quoted whether the parameter is inside double quotes
+ * @return 0 on success, -1 on failure
+ */
+int expand_default(struct supervisor *supvis, struct state *state, const char *name, size_t length,
+                   const char *value, char operator, bool colon, const char *operand, const char *end, bool quoted);
+
+/**
+ * expand_trim
+ * <p>
+ * Expand ${NAME#pattern}, ${NAME##pattern}, ${NAME%pattern} or ${NAME%%pattern}: the value less
+ * its shortest or longest prefix or suffix that the pattern matches.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param value the value of the parameter, or NULL if it is not set
+ * @param suffix whether to remove a suffix (vs. a prefix)
+ * @param longest whether to remove the longest match (vs. the shortest)
+ * @param operand the start of the pattern
+ * @param end the closing '}'
+ * @param quoted whether the parameter is inside double quotes
+ * @return 0 on success, -1 on failure
+ */
+int expand_trim(struct supervisor *supvis, struct state *state, const char *value, bool suffix, bool longest,
+                const char *operand, const char *end, bool quoted);
+
+/**
+ * expand_replace
+ * <p>
+ * Expand ${NAME/pattern/string}: the value with the longest match of the pattern replaced by the
+ * string. The mode selects which matches are replaced: '\0' the first, '/' all of them, '#' one
+ * at the start of the value and '%' one at its end.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param value the value of the parameter, or NULL if it is not set
+ * @param mode the byte after the first '/' if it is '/', '#' or '%', '\0' otherwise
+ * @param operand the start of the pattern
+ * @param end the closing '}'
+ * @param quoted whether the parameter is inside double quotes
+ * @return 0 on success, -1 on failure
+ */
+int expand_replace(struct supervisor *supvis, struct state *state, const char *value, char mode,
+                   const char *operand, const char *end, bool quoted);
+
+/**
+ * expand_substring
+ * <p>
+ * Expand ${NAME:offset} or ${NAME:offset:length}. Both are arithmetic expressions; a negative
+ * offset counts from the end of the value, and a negative length leaves that many bytes off its end.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param value the value of the parameter, or NULL if it is not set
+ * @param operand the start of the offset
+ * @param end the closing '}'
+ * @param quoted whether the parameter is inside double quotes
+ * @return 0 on success, -1 on failure
+ */
+int expand_substring(struct supervisor *supvis, struct state *state, const char *value, const char *operand,
+                     const char *end, bool quoted);
+
+/**
+ * evaluate_operand
+ * <p>
+ * Expand an operand of a ${...} and evaluate it as an arithmetic expression.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param text the start of the operand
+ * @param end the end of the operand
+ * @param value set to the value of the expression
+ * @return 0 on success, -1 on failure
+ */
+int evaluate_operand(struct supervisor *supvis, struct state *state, const char *text, const char *end,
+                     int64_t *value);
+
+/**
+ * operand_end
+ * <p>
+ * Find the end of the operand of a ${...}, skipping quoted and escaped bytes and the
+ * substitutions it holds.
+ * </p>
+ * @param text the operand
+ * @param stop a byte that also ends the operand (eg. the '/' after a pattern), or '\0'
+ * @return the '}' that closes the ${...} or the first stop byte, or NULL if there is neither
+ */
+const char *operand_end(const char *text, char stop);
+
+/**
+ * expand_operand
+ * <p>
+ * Expand an operand of a ${...} to a string in pattern form, as one field that is not split.
+ * The field being built is put aside meanwhile.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param text the start of the operand
+ * @param end the end of the operand
+ * @param result set to the string, null terminated, to be freed by the caller
+ * @param length set to the length of the string
+ * @return 0 on success, -1 on failure
+ */
+int expand_operand(struct supervisor *supvis, struct state *state, const char *text, const char *end,
+                   char **result, size_t *length);
+
+/**
+ * compile_operand
+ * <p>
+ * Expand the pattern operand of a ${...} and get its compiled form from expander->patterns.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param text the start of the pattern
+ * @param end the end of the pattern
+ * @return the compiled pattern, or NULL on failure
+ */
+const struct pattern *compile_operand(struct supervisor *supvis, struct state *state, const char *text,
+                                      const char *end);
+
+/**
+ * unescape
+ * <p>
+ * Remove the escapes of a string in pattern form, in place.
+ * </p>
+ * @param text the string, null terminated
+ * @param length the length of the string
+ * @return the length of the string without its escapes
+ */
+size_t unescape(char *text, size_t length);
+
+/**
+ * name_length
+ * <p>
+ * Get the length of the variable name at the start of text.
+ * </p>
+ * @param text the text
+ * @return the length of the name, 0 if text does not start with one
+ */
+size_t name_length(const char *text);
+
+/**
+ * lookup_variable
+ * <p>
+ * Find an environment variable by a name that is not null terminated.
+ * </p>
+ * @param name the name
+ * @param length the length of the name
+ * @return the value, or NULL if the variable is not set
+ */
+const char *lookup_variable(const char *name, size_t length);
+
+/**
+ * append_value
+ * <p>
+ * Add the value of an expansion to the field. Unless quoted, the value is split into fields at
+ * the bytes of IFS and its *, ? and [ are pattern characters.
+ * </p>
+ * @param expander the expander
+ * @param arena the arena to which completed fields are written
+ * @param value the value
+ * @param length the length of the value
+ * @param quoted whether the expansion is inside double quotes
+ */
+void append_value(struct expander *expander, struct arena *arena, const char *value, size_t length, bool quoted);
+
+/**
+ * append_literal
+ * <p>
+ * Add a byte that matches only itself to the field.
+ * </p>
+ * @param expander the expander
+ * @param c the byte
+ */
+void append_literal(struct expander *expander, char c);
+
+/**
+ * append_pattern
+ * <p>
+ * Add an unquoted byte to the field; *, ? and [ make the field a pattern.
+ * </p>
+ * @param expander the expander
+ * @param c the byte
+ */
+void append_pattern(struct expander *expander, char c);
+
+/**
+ * append_byte
+ * <p>
+ * Add a byte to the field buffer as it is.
+ * </p>
+ * @param expander the expander
+ * @param c the byte
+ */
+void append_byte(struct expander *expander, char c);
+
+/**
+ * append_run
+ * <p>
+ * Add bytes that need no escaping to the field as they are.
+ * </p>
+ * @param expander the expander
+ * @param text the bytes
+ * @param length the number of bytes
+ */
+void append_run(struct expander *expander, const char *text, size_t length);
+
+/**
+ * start_field
+ * <p>
+ * Mark the field as existing, even if it stays empty.
+ * </p>
+ * @param expander the expander
+ */
+void start_field(struct expander *expander);
+
+/**
+ * end_field
+ * <p>
+ * Write the field to the arena, or the pathnames it matches if it is a pattern, and begin
+ * the next one. Nothing is written if the field was never started.
+ * </p>
+ * @param expander the expander
+ * @param arena the arena
+ */
+void end_field(struct expander *expander, struct arena *arena);
+
+/**
+ * write_unescaped
+ * <p>
+ * Write the null terminated field to the arena without its escapes.
+ * </p>
+ * @param expander the expander
+ * @param arena the arena
+ */
+void write_unescaped(struct expander *expander, struct arena *arena);
+
+/**
+ * glob_field
+ * <p>
+ * Write the pathnames matching the field to the arena, sorted. If none match, the field is
+ * written as it is.
+ * </p>
+ * @param expander the expander
+ * @param arena the arena
+ */
+void glob_field(struct expander *expander, struct arena *arena);
+
+/**
+ * match_pattern
+ * <p>
+ * Collect the pathnames matching the rest of a pattern below the directory in expander->path.
+ * Only the components that have pattern characters are matched against directory listings.
+ * </p>
+ * @param expander the expander
+ * @param pattern the rest of the pattern; it is modified while matching and restored
+ * @param path_length the length of the directory in expander->path
+ */
+void match_pattern(struct expander *expander, char *pattern, size_t path_length);
+
+/**
+ * has_pattern
+ * <p>
+ * Check whether part of a pattern has an unescaped *, ? or [.
+ * </p>
+ * @param start the start of the part
+ * @param end the end of the part
+ * @return true if it does, false otherwise
+ */
+bool has_pattern(const char *start, const char *end);
+
+/**
+ * put_path
+ * <p>
+ * Write bytes at an offset of expander->path and null terminate it.
+ * </p>
+ * @param expander the expander
+ * @param offset the offset
+ * @param text the bytes
+ * @param length the number of bytes
+ * @param unescape whether to drop the escapes of the bytes
+ * @return the length of the path, or 0 on failure
+ */
+size_t put_path(struct expander *expander, size_t offset, const char *text, size_t length, bool unescape);
+
+/**
+ * add_match
+ * <p>
+ * Keep the pathname in expander->path as a match.
+ * </p>
+ * @param expander the expander
+ * @param length the length of the pathname
+ */
+void add_match(struct expander *expander, size_t length);
+
+/**
+ * compare_matches
+ * <p>
+ * Order two pathnames for qsort, as the current locale collates them.
+ * </p>
+ * @param a the first pathname
+ * @param b the second pathname
+ * @return less than, equal to or greater than 0 as a sorts before, with or after b
+ */
+int compare_matches(const void *a, const void *b);
+
+/**
+ * reserve
+ * <p>
+ * Grow a buffer to hold at least needed bytes.
+ * </p>
+ * @param buffer the buffer
+ * @param capacity the bytes allocated for the buffer, updated if it grows
+ * @param needed the bytes needed
+ * @return true on success, false on failure
+ */
+bool reserve(char **buffer, size_t *capacity, size_t needed);
+
+struct expander *expander_create(struct supervisor *supvis)
+{
+    return mm_calloc(1, sizeof(struct expander), supvis->mm, __FILE__, __func__, __LINE__);
+}
+
+ssize_t expand_word(struct supervisor *supvis, struct state *state, const char *word)
+{
+    struct expander *expander;
+    const char      *cursor;
+    
+    expander = state->expander;
+    expander->field_length  = 0;
+    expander->field_started = false;
+    expander->field_glob    = false;
+    expander->white_ended   = false;
+    expander->field_count   = 0;
+    expander->failed        = false;
+    
+    cursor = word;
+    if (*cursor == '~')
+    {
+        expand_tilde(expander, &cursor);
+    }
+    
+    if (expand_text(supvis, state, word, cursor, cursor + strlen(cursor), false) == -1)
+    {
+        return -1;
+    }
+    
+    end_field(expander, state->arena);
+    if (expander->failed)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    
+    return (ssize_t) expander->field_count;
+}
+
+int expand_text(struct supervisor *supvis, struct state *state, const char *word, const char *text,
+                const char *end, bool quoted)
+{
+    struct expander *expander;
+    const char      *cursor;
+    const char      *close;
+    bool            in_double;
+    bool            in_quotes;
+    char            c;
+    size_t          length;
+    
+    expander  = state->expander;
+    cursor    = text;
+    in_double = false;
+    while (cursor < end)
+    {
+        in_quotes = in_double || quoted;
+        c         = *cursor++;
+        switch (c)
+        {
+            case '\'':
+            {
+                if (in_quotes)
+                {
+                    append_literal(expander, c);
+                    break;
+                }
+                start_field(expander);
+                for (length = strcspn(cursor, "\'*?[]\\"); cursor + length < end && *(cursor + length) != '\'';
+                     length = strcspn(cursor, "\'*?[]\\"))
+                {
+                    append_run(expander, cursor, length);
+                    cursor += length;
+                    append_literal(expander, *cursor++);
+                }
+                if (cursor + length >= end)
+                {
+                    (void) fprintf(state->stdout, "csh: parse error in command near: \'%s\'\n", word);
+                    errno = EINVAL;
+                    return -1;
+                }
+                append_run(expander, cursor, length);
+                cursor += length + 1;
+                break;
+            }
+            case '"':
+            {
+                start_field(expander);
+                in_double = !in_double;
+                break;
+            }
+            case '\\':
+            {
+                // In double quotes, a backslash only escapes the bytes that are special there.
+                if (cursor == end || (in_quotes && !strchr("$`\"\\", *cursor)))
+                {
+                    append_literal(expander, c);
+                    break;
+                }
+                append_literal(expander, *cursor++);
+                break;
+            }
+            case '$':
+            {
+                // $((...)) is arithmetic only if the inner parentheses close at the outer ones, unlike $((a); b).
+                close = (*cursor == '(' && *(cursor + 1) == '(') ? substitution_end(cursor + 2, false) : NULL;
+                if (close && *(close + 1) == ')')
+                {
+                    cursor += 2;
+                    if (expand_arithmetic(supvis, state, &cursor, close, in_quotes) == -1)
+                    {
+                        return -1;
+                    }
+                    break;
+                }
+                if (*cursor == '(')
+                {
+                    ++cursor;
+                    if (expand_command(supvis, state, &cursor, in_quotes, false) == -1)
+                    {
+                        return -1;
+                    }
+                    break;
+                }
+                if (expand_parameter(supvis, state, &cursor, in_quotes) == -1)
+                {
+                    return -1;
+                }
+                break;
+            }
+            case '`':
+            {
+                if (expand_command(supvis, state, &cursor, in_quotes, true) == -1)
+                {
+                    return -1;
+                }
+                break;
+            }
+            default:
+            {
+                // Runs of bytes that need no escaping are copied at once.
+                length = strcspn(cursor - 1, (in_quotes) ? "\"\\$`*?[]" : "\'\"\\$`*?[]");
+                if (length > (size_t) (end - cursor + 1))
+                {
+                    length = (size_t) (end - cursor + 1);
+                }
+                if (length)
+                {
+                    append_run(expander, cursor - 1, length);
+                    cursor += length - 1;
+                    break;
+                }
+                if (in_quotes)
+                {
+                    append_literal(expander, c);
+                } else
+                {
+                    append_pattern(expander, c);
+                }
+            }
+        }
+    }
+    
+    if (in_double)
+    {
+        (void) fprintf(state->stdout, "csh: parse error in command near: \'%s\'\n", word);
+        errno = EINVAL;
+        return -1;
+    }
+    
+    return 0;
+}
+
+int expand_command(struct supervisor *supvis, struct state *state, const char **cursor, bool quoted,
+                   bool backquoted)
+{
+    const char *end;
+    ssize_t    length;
+    
+    end = substitution_end(*cursor, backquoted);
+    if (!end)
+    {
+        (void) fprintf(state->stdout, "csh: bad substitution: \'%s\'\n", *cursor - ((backquoted) ? 1 : 2));
+        errno = EINVAL;
+        return -1;
+    }
+    
+    length = capture_output(supvis, state, *cursor, (size_t) (end - *cursor), backquoted);
+    if (length == -1)
+    {
+        return -1;
+    }
+    *cursor = end + 1;
+    
+    while (length && *(state->expander->capture + length - 1) == '\n')
+    {
+        --length;
+    }
+    if (quoted)
+    {
+        start_field(state->expander);
+    }
+    append_value(state->expander, state->arena, state->expander->capture, (size_t) length, quoted);
+    
+    return 0;
+}
+
+int expand_arithmetic(struct supervisor *supvis, struct state *state, const char **cursor, const char *end,
+                      bool quoted)
+{
+    int64_t value;
+    char    number[24];
+    
+    if (evaluate_expression(supvis, state, *cursor, (size_t) (end - *cursor), &value) == -1)
+    {
+        return -1;
+    }
+    *cursor = end + 2;
+    
+    (void) snprintf(number, sizeof(number), "%" PRId64, value);
+    if (quoted)
+    {
+        start_field(state->expander);
+    }
+    append_value(state->expander, state->arena, number, strlen(number), quoted);
+    
+    return 0;
+}
+
+int evaluate_expression(struct supervisor *supvis, struct state *state, const char *text, size_t length,
+                        int64_t *value)
+{
+    struct expander          *expander;
+    const struct arith_entry *entry;
+    
+    expander = state->expander;
+    if (!expander->arith)
+    {
+        expander->arith = (struct arith_cache *) calloc(1, sizeof(struct arith_cache));
+        if (!expander->arith)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    
+    entry = arith_compile(expander->arith, text, length, state->stdout);
+    if (!entry || arith_evaluate(supvis, state, entry, value) == -1)
+    {
+        return -1;
+    }
+    
+    return 0;
+}
+
+const char *substitution_end(const char *text, bool backquoted)
+{
+    size_t depth;
+    char   quote;
+    
+    depth = 1;
+    quote = '\0';
+    for (const char *c = text; *c; ++c)
+    {
+        if (*c == '\\' && quote != '\'' && *(c + 1))
+        {
+            ++c;
+        } else if (backquoted)
+        {
+            if (*c == '`')
+            {
+                return c;
+            }
+        } else if (quote)
+        {
+            quote = (*c == quote) ? '\0' : quote;
+        } else if (*c == '\'' || *c == '"')
+        {
+            quote = *c;
+        } else if (*c == '(')
+        {
+            ++depth;
+        } else if (*c == ')' && --depth == 0)
+        {
+            return c;
+        }
+    }
+    
+    return NULL;
+}
+
+ssize_t capture_output(struct supervisor *supvis, struct state *state, const char *command, size_t length,
+                       bool backquoted)
+{
+    struct expander *expander;
+    char            *line;
+    int             fds[2];
+    pid_t           pid;
+    ssize_t         bytes;
+    size_t          used;
+    int             status;
+    
+    // The command is copied out of the tokenizer, which lexes it again; in `...`, \ escapes $, ` and \.
+    line = (char *) malloc(length + 1);
+    if (!line)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    used = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (backquoted && *(command + i) == '\\' && i + 1 < length && strchr("$`\\", *(command + i + 1)))
+        {
+            ++i;
+        }
+        *(line + used++) = *(command + i);
+    }
+    *(line + used) = '\0';
+    
+    if (state->subshell && subshell_can_run(state->subshell, line, used))
+    {
+        bytes = capture_subshell(supvis, state, line, used);
+        free(line);
+        return bytes;
+    }
+    
+    expander = state->expander;
+    if (open_pipe(state, fds) == -1)
+    {
+        (void) fprintf(state->stdout, "csh: command substitution: %s\n", strerror(errno));
+        free(line);
+        errno = EINVAL;
+        return -1;
+    }
+    
+    // Output is fully buffered when not interactive; flush so the child does not write it again.
+    (void) fflush(state->stdout);
+    (void) fflush(state->stderr);
+    
+    pid = fork();
+    if (pid == -1)
+    {
+        (void) fprintf(state->stdout, "csh: command substitution: %s\n", strerror(errno));
+        (void) close(*fds);
+        (void) close(*(fds + 1));
+        free(line);
+        errno = EINVAL;
+        return -1;
+    }
+    
+    if (pid == 0)
+    {
+        (void) close(*fds);
+        (void) dup2(*(fds + 1), STDOUT_FILENO);
+        (void) close(*(fds + 1));
+        execute_subshell(supvis, state, line, used);
+    }
+    
+    free(line);
+    (void) close(*(fds + 1));
+    
+    // The output is read straight into the mapping, which grows as needed; nothing goes through a file.
+    used = 0;
+    for (;;)
+    {
+        if (used == expander->capture_capacity && !grow_capture(expander))
+        {
+            expander->failed = true;
+            break;
+        }
+        bytes = read(*fds, expander->capture + used, expander->capture_capacity - used);
+        if (bytes == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            break;
+        }
+        used += (size_t) bytes;
+    }
+    (void) close(*fds);
+    
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+    {
+    }
+    state->exit_code = (WIFEXITED(status)) ? WEXITSTATUS(status)
+                       : (WIFSIGNALED(status)) ? 128 + WTERMSIG(status) : EXIT_FAILURE;
+    
+    if (expander->failed)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    errno = 0;
+    
+    return (ssize_t) used;
+}
+
+ssize_t capture_subshell(struct supervisor *supvis, struct state *state, const char *line, size_t length)
+{
+    struct expander *expander;
+    FILE            *out;
+    char            *output;
+    size_t          output_length;
+    
+    output        = NULL;
+    output_length = 0;
+    out           = open_memstream(&output, &output_length);
+    if (!out)
+    {
+        (void) fprintf(state->stdout, "csh: command substitution: %s\n", strerror(errno));
+        errno = EINVAL;
+        return -1;
+    }
+    
+    state->exit_code = subshell_run(supvis, state, line, length, out);
+    (void) fclose(out);
+    
+    expander = state->expander;
+    while (expander->capture_capacity < output_length)
+    {
+        if (!grow_capture(expander))
+        {
+            expander->failed = true;
+            free(output);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    if (output_length)
+    {
+        memcpy(expander->capture, output, output_length);
+    }
+    free(output);
+    
+    return (ssize_t) output_length;
+}
+
+bool grow_capture(struct expander *expander)
+{
+    size_t capacity;
+    void   *grown;
+    
+    capacity = (expander->capture_capacity) ? expander->capture_capacity * 2 : EXPANDER_CAPTURE_SIZE;
+    if (!expander->capture)
+    {
+        grown = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    } else
+    {
+#if defined(__linux__)
+        grown = mremap(expander->capture, expander->capture_capacity, capacity, MREMAP_MAYMOVE);
+#else
+        grown = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (grown != MAP_FAILED)
+        {
+            memcpy(grown, expander->capture, expander->capture_capacity);
+            (void) munmap(expander->capture, expander->capture_capacity);
+        }
+#endif
+    }
+    if (grown == MAP_FAILED)
+    {
+        return false;
+    }
+    
+    expander->capture          = (char *) grown;
+    expander->capture_capacity = capacity;
+    
+    return true;
+}
+
+void expand_tilde(struct expander *expander, const char **cursor)
+{
+    const char    *name;
+    const char    *end;
+    const char    *home;
+    struct passwd *entry;
+    char          login[EXPANDER_LOGIN_MAX];
+    
+    name = *cursor + 1;
+    for (end = name; *end && *end != '/'; ++end)
+    {
+        if (strchr("\'\"\\$`", *end))
+        {
+            return;
+        }
+    }
+    
+    if (end == name)
+    {
+        home = getenv("HOME"); // NOLINT(concurrency-mt-unsafe): no threads here
+        if (!home)
+        {
+            entry = getpwuid(getuid()); // NOLINT(concurrency-mt-unsafe): no threads here
+            home  = (entry) ? entry->pw_dir : NULL;
+        }
+    } else
+    {
+        if ((size_t) (end - name) >= sizeof(login))
+        {
+            return;
+        }
+        memcpy(login, name, (size_t) (end - name));
+        *(login + (end - name)) = '\0';
+        entry = getpwnam(login); // NOLINT(concurrency-mt-unsafe): no threads here
+        home  = (entry) ? entry->pw_dir : NULL;
+    }
+    
+    if (!home)
+    {
+        return;
+    }
+    
+    start_field(expander);
+    for (; *home; ++home)
+    {
+        append_literal(expander, *home);
+    }
+    *cursor = end;
+}
+
+int expand_parameter(struct supervisor *supvis, struct state *state, const char **cursor, bool quoted)
+{
+    const char *name;
+    const char *value;
+    size_t     length;
+    bool       braced;
+    bool       counted;
+    char       number[24];
+    char       count[24];
+    
+    name    = *cursor;
+    braced  = (*name == '{');
+    counted = braced && *(name + 1) == '#' && *(name + 2) != '}';
+    name += ((braced) ? 1 : 0) + ((counted) ? 1 : 0);
+    
+    if (*name == '?' || *name == '$' || isdigit((unsigned char) *name))
+    {
+        length = 1;
+    } else
+    {
+        length = name_length(name);
+    }
+    
+    if (braced && !counted && length && *(name + length) != '}')
+    {
+        return expand_operator(supvis, state, cursor, name, length, quoted);
+    }
+    if (braced && (length == 0 || *(name + length) != '}'))
+    {
+        (void) fprintf(state->stdout, "csh: bad substitution: \'%s\'\n", *cursor - 1);
+        errno = EINVAL;
+        return -1;
+    }
+    if (length == 0)
+    {
+        append_literal(state->expander, '$');
+        return 0;
+    }
+    *cursor = name + length + ((braced) ? 1 : 0);
+    
+    value = parameter_value(state, name, length, number, sizeof(number));
+    if (counted)
+    {
+        (void) snprintf(count, sizeof(count), "%zu", (value) ? strlen(value) : 0);
+        value = count;
+    }
+    
+    if (quoted)
+    {
+        start_field(state->expander);
+    }
+    if (value)
+    {
+        append_value(state->expander, state->arena, value, strlen(value), quoted);
+    }
+    
+    return 0;
+}
+
+const char *parameter_value(const struct state *state, const char *name, size_t length, char *number,
+                            size_t size)
+{
+    switch (*name)
+    {
+        case '?':
+        {
+            (void) snprintf(number, size, "%d", state->exit_code);
+            return number;
+        }
+        case '$':
+        {
+            (void) snprintf(number, size, "%ld", (long) getpid());
+            return number;
+        }
+        default:
+        {
+            return (isdigit((unsigned char) *name)) ? NULL : lookup_variable(name, length);
+        }
+    }
+}
+
+int expand_operator(struct supervisor *supvis, struct state *state, const char **cursor, const char *name,
+                    size_t length, bool quoted)
+{
+    const char *operator;
+    const char *operand;
+    const char *end;
+    const char *value;
+    bool       colon;
+    bool       doubled;
+    char       number[24];
+    
+    // An unterminated ${NAME has no operator; strchr would match its terminator.
+    operator = name + length;
+    if (!*operator)
+    {
+        (void) fprintf(state->stdout, "csh: bad substitution: \'%s\'\n", *cursor - 1);
+        errno = EINVAL;
+        return -1;
+    }
+    colon = (*operator == ':' && *(operator + 1) && strchr("-=+?", *(operator + 1)));
+    if (colon)
+    {
+        ++operator;
+    }
+    
+    // ## and %% take the longest match; //, /# and /% choose which matches / replaces.
+    doubled = ((*operator == '#' || *operator == '%') && *(operator + 1) == *operator)
+              || (*operator == '/' && *(operator + 1) && strchr("/#%", *(operator + 1)));
+    operand = operator + ((doubled) ? 2 : 1);
+    end     = (strchr("-=+?:#%/", *operator)) ? operand_end(operand, '\0') : NULL;
+    if (!end)
+    {
+        (void) fprintf(state->stdout, "csh: bad substitution: \'%s\'\n", *cursor - 1);
+        errno = EINVAL;
+        return -1;
+    }
+    *cursor = end + 1;
+    
+    value = parameter_value(state, name, length, number, sizeof(number));
+    switch (*operator)
+    {
+        case ':':
+        {
+            return expand_substring(supvis, state, value, operand, end, quoted);
+        }
+        case '#':
+        case '%':
+        {
+            return expand_trim(supvis, state, value, *operator == '%', doubled, operand, end, quoted);
+        }
+        case '/':
+        {
+            return expand_replace(supvis, state, value, (doubled) ? *(operator + 1) : '\0', operand, end, quoted);
+        }
+        default:
+        {
+            return expand_default(supvis, state, name, length, value, *operator, colon, operand, end, quoted);
+        }
+    }
+}
+
+int expand_default(struct supervisor *supvis, struct state *state, const char *name, size_t length,
+                   const char *value, char operator, bool colon, const char *operand, const char *end, bool quoted)
+{
+    char   *word;
+    char   *variable;
+    size_t word_length;
+    bool   set;
+    
+    set = value && (!colon || *value);
+    if (quoted)
+    {
+        start_field(state->expander);
+    }
+    
+    // The word of - and + is expanded in place, so its quoting holds as in the rest of the word.
+    if (operator == '+' || (operator == '-' && !set))
+    {
+        return (set || operator == '-') ? expand_text(supvis, state, operand, operand, end, quoted) : 0;
+    }
+    if (set)
+    {
+        append_value(state->expander, state->arena, value, strlen(value), quoted);
+        return 0;
+    }
+    
+    if (expand_operand(supvis, state, operand, end, &word, &word_length) == -1)
+    {
+        return -1;
+    }
+    word_length = unescape(word, word_length);
+    
+    if (operator == '?')
+    {
+        (void) fprintf(state->stdout, "csh: %.*s: %s\n", (int) length, name,
+                       (word_length) ? word : "parameter null or not set");
+        free(word);
+        errno = EINVAL;
+        return -1;
+    }
+    
+    if (name_length(name) != length)
+    {
+        (void) fprintf(state->stdout, "csh: $%.*s: cannot assign in this way\n", (int) length, name);
+        free(word);
+        errno = EINVAL;
+        return -1;
+    }
+    variable = strndup(name, length);
+    if (!variable)
+    {
+        free(word);
+        errno = ENOMEM;
+        return -1;
+    }
+    subshell_save(state);
+    dc_setenv(supvis->env, supvis->err, variable, word, true);
+    free(variable);
+    
+    append_value(state->expander, state->arena, word, word_length, quoted);
+    free(word);
+    
+    return 0;
+}
+
+int expand_trim(struct supervisor *supvis, struct state *state, const char *value, bool suffix, bool longest,
+                const char *operand, const char *end, bool quoted)
+{
+    const struct pattern *pattern;
+    size_t               length;
+    size_t               shortest;
+    size_t               widest;
+    size_t               size;
+    size_t               start;
+    size_t               stop;
+    
+    pattern = compile_operand(supvis, state, operand, end);
+    if (!pattern)
+    {
+        return -1;
+    }
+    
+    value  = (value) ? value : "";
+    length = strlen(value);
+    start  = 0;
+    stop   = length;
+    
+    // Only the sizes the pattern can match are tried: one if it has no *.
+    shortest = pattern->min_length;
+    widest   = (pattern->fixed) ? shortest : length;
+    for (size_t i = 0; shortest <= length && i <= widest - shortest; ++i)
+    {
+        size = (longest) ? widest - i : shortest + i;
+        if (suffix && pattern_match(pattern, value + length - size, size))
+        {
+            stop = length - size;
+            break;
+        }
+        if (!suffix && pattern_match(pattern, value, size))
+        {
+            start = size;
+            break;
+        }
+    }
+    
+    if (quoted)
+    {
+        start_field(state->expander);
+    }
+    append_value(state->expander, state->arena, value + start, stop - start, quoted);
+    
+    return 0;
+}
+
+int expand_replace(struct supervisor *supvis, struct state *state, const char *value, char mode,
+                   const char *operand, const char *end, bool quoted)
+{
+    const struct pattern *pattern;
+    const char           *separator;
+    char                 *replacement;
+    char                 *result;
+    size_t               replacement_length;
+    size_t               result_length;
+    size_t               result_capacity;
+    size_t               length;
+    size_t               copied;
+    size_t               size;
+    bool                 found;
+    
+    separator = operand_end(operand, '/');
+    pattern   = compile_operand(supvis, state, operand, separator);
+    if (!pattern)
+    {
+        return -1;
+    }
+    
+    replacement        = NULL;
+    replacement_length = 0;
+    if (separator < end)
+    {
+        if (expand_operand(supvis, state, separator + 1, end, &replacement, &replacement_length) == -1)
+        {
+            return -1;
+        }
+        replacement_length = unescape(replacement, replacement_length);
+    }
+    
+    value           = (value) ? value : "";
+    length          = strlen(value);
+    result          = NULL;
+    result_length   = 0;
+    result_capacity = 0;
+    copied          = 0;
+    for (size_t i = 0; i <= length && (mode != '#' || i == 0); ++i)
+    {
+        // The longest match at i; with %, only one that reaches the end.
+        found = false;
+        size  = (pattern->fixed && mode != '%') ? pattern->min_length : length - i;
+        while (size >= pattern->min_length && i + size <= length)
+        {
+            found = pattern_match(pattern, value + i, size);
+            if (found || pattern->fixed || mode == '%' || size == 0)
+            {
+                break;
+            }
+            --size;
+        }
+        
+        // An empty match replaces nothing, but anchors ${NAME/#/string} and ${NAME/%/string}.
+        if (!found || (size == 0 && mode != '#' && mode != '%'))
+        {
+            continue;
+        }
+        if (!reserve(&result, &result_capacity, result_length + (i - copied) + replacement_length))
+        {
+            free(result);
+            free(replacement);
+            errno = ENOMEM;
+            return -1;
+        }
+        memcpy(result + result_length, value + copied, i - copied);
+        result_length += i - copied;
+        if (replacement_length)
+        {
+            memcpy(result + result_length, replacement, replacement_length);
+        }
+        result_length += replacement_length;
+        copied = i + size;
+        if (mode != '/')
+        {
+            break;
+        }
+        i = (size) ? i + size - 1 : i;
+    }
+    free(replacement);
+    
+    if (quoted)
+    {
+        start_field(state->expander);
+    }
+    if (result)
+    {
+        append_value(state->expander, state->arena, result, result_length, quoted);
+        free(result);
+    }
+    append_value(state->expander, state->arena, value + copied, length - copied, quoted);
+    
+    return 0;
+}
+
+int expand_substring(struct supervisor *supvis, struct state *state, const char *value, const char *operand,
+                     const char *end, bool quoted)
+{
+    const char *separator;
+    int64_t    offset;
+    int64_t    count;
+    int64_t    length;
+    
+    separator = operand_end(operand, ':');
+    if (evaluate_operand(supvis, state, operand, separator, &offset) == -1)
+    {
+        return -1;
+    }
+    
+    value  = (value) ? value : "";
+    length = (int64_t) strlen(value);
+    offset = (offset < 0) ? length + offset : offset;
+    offset = (offset < 0 || offset > length) ? length : offset;
+    count  = length - offset;
+    if (separator < end)
+    {
+        if (evaluate_operand(supvis, state, separator + 1, end, &count) == -1)
+        {
+            return -1;
+        }
+        count = (count < 0) ? length - offset + count : count;
+        count = (count < 0) ? 0 : (count > length - offset) ? length - offset : count;
+    }
+    
+    if (quoted)
+    {
+        start_field(state->expander);
+    }
+    append_value(state->expander, state->arena, value + offset, (size_t) count, quoted);
+    
+    return 0;
+}
+
+int evaluate_operand(struct supervisor *supvis, struct state *state, const char *text, const char *end,
+                     int64_t *value)
+{
+    char   *expression;
+    size_t length;
+    int    status;
+    
+    if (expand_operand(supvis, state, text, end, &expression, &length) == -1)
+    {
+        return -1;
+    }
+    length = unescape(expression, length);
+    status = evaluate_expression(supvis, state, expression, length, value);
+    free(expression);
+    
+    return status;
+}
+
+const char *operand_end(const char *text, char stop)
+{
+    const char *c;
+    const char *end;
+    size_t     depth;
+    bool       in_double;
+    
+    depth     = 0;
+    in_double = false;
+    for (c = text; *c; ++c)
+    {
+        switch (*c)
+        {
+            case '\\':
+            {
+                c += (*(c + 1)) ? 1 : 0;
+                break;
+            }
+            case '\'':
+            {
+                end = (in_double) ? c : strchr(c + 1, '\'');
+                if (!end)
+                {
+                    return NULL;
+                }
+                c = end;
+                break;
+            }
+            case '"':
+            {
+                in_double = !in_double;
+                break;
+            }
+            case '`':
+            {
+                end = substitution_end(c + 1, true);
+                if (!end)
+                {
+                    return NULL;
+                }
+                c = end;
+                break;
+            }
+            case '$':
+            {
+                if (*(c + 1) == '(')
+                {
+                    end = substitution_end(c + 2, false);
+                    if (!end)
+                    {
+                        return NULL;
+                    }
+                    c = end;
+                } else if (*(c + 1) == '{')
+                {
+                    ++depth;
+                    ++c;
+                }
+                break;
+            }
+            case '}':
+            {
+                if (depth == 0 && !in_double)
+                {
+                    return c;
+                }
+                depth -= (depth) ? 1 : 0;
+                break;
+            }
+            default:
+            {
+                if (*c == stop && depth == 0 && !in_double)
+                {
+                    return c;
+                }
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+int expand_operand(struct supervisor *supvis, struct state *state, const char *text, const char *end,
+                   char **result, size_t *length)
+{
+    struct expander *expander;
+    char            *field;
+    size_t          field_length;
+    size_t          field_capacity;
+    bool            field_started;
+    bool            field_glob;
+    bool            white_ended;
+    bool            in_operand;
+    int             status;
+    
+    // The operand is built where fields are, so the field of the word is put aside until it is done.
+    expander       = state->expander;
+    field          = expander->field;
+    field_length   = expander->field_length;
+    field_capacity = expander->field_capacity;
+    field_started  = expander->field_started;
+    field_glob     = expander->field_glob;
+    white_ended    = expander->white_ended;
+    in_operand     = expander->in_operand;
+    
+    expander->field          = NULL;
+    expander->field_length   = 0;
+    expander->field_capacity = 0;
+    expander->in_operand     = true;
+    
+    status = expand_text(supvis, state, text, text, end, false);
+    append_byte(expander, '\0');
+    *result = expander->field;
+    *length = (expander->field_length) ? expander->field_length - 1 : 0;
+    if (status == 0 && expander->failed)
+    {
+        errno  = ENOMEM;
+        status = -1;
+    }
+    if (status == -1)
+    {
+        free(*result);
+        *result = NULL;
+    }
+    
+    expander->field          = field;
+    expander->field_length   = field_length;
+    expander->field_capacity = field_capacity;
+    expander->field_started  = field_started;
+    expander->field_glob     = field_glob;
+    expander->white_ended    = white_ended;
+    expander->in_operand     = in_operand;
+    
+    return status;
+}
+
+const struct pattern *compile_operand(struct supervisor *supvis, struct state *state, const char *text,
+                                      const char *end)
+{
+    struct expander      *expander;
+    const struct pattern *pattern;
+    char                 *operand;
+    size_t               length;
+    
+    expander = state->expander;
+    if (!expander->patterns)
+    {
+        expander->patterns = (struct pattern_cache *) calloc(1, sizeof(struct pattern_cache));
+        if (!expander->patterns)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    
+    if (expand_operand(supvis, state, text, end, &operand, &length) == -1)
+    {
+        return NULL;
+    }
+    pattern = pattern_compile(expander->patterns, operand, length);
+    free(operand);
+    
+    return pattern;
+}
+
+size_t unescape(char *text, size_t length)
+{
+    size_t used;
+    
+    used = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (*(text + i) == '\\' && i + 1 < length)
+        {
+            ++i;
+        }
+        *(text + used++) = *(text + i);
+    }
+    *(text + used) = '\0';
+    
+    return used;
+}
+
+size_t name_length(const char *text)
+{
+    size_t length;
+    
+    if (!isalpha((unsigned char) *text) && *text != '_')
+    {
+        return 0;
+    }
+    
+    for (length = 1; isalnum((unsigned char) *(text + length)) || *(text + length) == '_'; ++length)
+    {
+    }
+    
+    return length;
+}
+
+const char *lookup_variable(const char *name, size_t length)
+{
+    for (char **variable = environ; *variable; ++variable)
+    {
+        if (**variable == *name && strncmp(*variable, name, length) == 0 && *(*variable + length) == '=')
+        {
+            return *variable + length + 1;
+        }
+    }
+    
+    return NULL;
+}
+
+void append_value(struct expander *expander, struct arena *arena, const char *value, size_t length, bool quoted)
+{
+    char c;
+    
+    // Most commands have no unquoted expansion, so IFS is only looked up by those that do.
+    if (!quoted && !expander->ifs)
+    {
+        expander->ifs = getenv("IFS"); // NOLINT(concurrency-mt-unsafe): no threads here
+        if (!expander->ifs)
+        {
+            expander->ifs = EXPANDER_DEFAULT_IFS;
+        }
+    }
+    
+    for (size_t i = 0; i < length; ++i)
+    {
+        c = *(value + i);
+        if (quoted)
+        {
+            append_literal(expander, c);
+        } else if (expander->in_operand || !strchr(expander->ifs, c))
+        {
+            // A backslash from an expansion is an ordinary byte, not an escape.
+            if (c == '\\')
+            {
+                append_literal(expander, c);
+            } else
+            {
+                append_pattern(expander, c);
+            }
+        } else if (c == ' ' || c == '\t' || c == '\n')
+        {
+            if (expander->field_started)
+            {
+                end_field(expander, arena);
+                expander->white_ended = true;
+            }
+        } else
+        {
+            // Any other separator ends a field even if it is empty, unless white space just did.
+            if (expander->field_started || !expander->white_ended)
+            {
+                expander->field_started = true;
+                end_field(expander, arena);
+            }
+            expander->white_ended = false;
+        }
+    }
+}
+
+void append_literal(struct expander *expander, char c)
+{
+    if (strchr("*?[]\\", c))
+    {
+        append_byte(expander, '\\');
+    }
+    append_byte(expander, c);
+}
+
+void append_pattern(struct expander *expander, char c)
+{
+    if (c == '*' || c == '?' || c == '[')
+    {
+        expander->field_glob = true;
+    }
+    append_byte(expander, c);
+}
+
+void append_byte(struct expander *expander, char c)
+{
+    start_field(expander);
+    if (!reserve(&expander->field, &expander->field_capacity, expander->field_length + 1))
+    {
+        expander->failed = true;
+        return;
+    }
+    *(expander->field + expander->field_length++) = c;
+}
+
+void append_run(struct expander *expander, const char *text, size_t length)
+{
+    start_field(expander);
+    if (!reserve(&expander->field, &expander->field_capacity, expander->field_length + length))
+    {
+        expander->failed = true;
+        return;
+    }
+    memcpy(expander->field + expander->field_length, text, length);
+    expander->field_length += length;
+}
+
+void start_field(struct expander *expander)
+{
+    expander->field_started = true;
+    expander->white_ended   = false;
+}
+
+void end_field(struct expander *expander, struct arena *arena)
+{
+    if (!expander->field_started || expander->failed)
+    {
+        return;
+    }
+    
+    // The field is null terminated without being lengthened, to be matched or written with its end.
+    append_byte(expander, '\0');
+    --expander->field_length;
+    if (expander->failed)
+    {
+        return;
+    }
+    
+    if (expander->field_glob)
+    {
+        glob_field(expander, arena);
+    } else
+    {
+        write_unescaped(expander, arena);
+    }
+    
+    expander->field_length  = 0;
+    expander->field_started = false;
+    expander->field_glob    = false;
+}
+
+void write_unescaped(struct expander *expander, struct arena *arena)
+{
+    size_t start;
+    size_t end;
+    
+    // The bytes between escapes are written in runs; most fields have no escapes at all.
+    start = 0;
+    end   = 0;
+    while (end < expander->field_length)
+    {
+        if (*(expander->field + end) != '\\')
+        {
+            ++end;
+            continue;
+        }
+        if (arena_grow(arena, expander->field + start, end - start) == -1)
+        {
+            expander->failed = true;
+            return;
+        }
+        start = end + 1; // the escaped byte starts the next run
+        end += 2;
+    }
+    
+    if (arena_grow(arena, expander->field + start, expander->field_length - start + 1) == -1)
+    {
+        expander->failed = true;
+        return;
+    }
+    
+    ++expander->field_count;
+}
+
+void glob_field(struct expander *expander, struct arena *arena)
+{
+    size_t     length;
+    const char *name;
+    int        saved_errno;
+    
+    // Paths that cannot be listed or do not exist are not matches, not errors.
+    expander->names_length = 0;
+    expander->match_count  = 0;
+    saved_errno            = errno;
+    match_pattern(expander, expander->field, 0);
+    errno = saved_errno;
+    if (expander->failed)
+    {
+        return;
+    }
+    
+    if (expander->match_count == 0)
+    {
+        write_unescaped(expander, arena);
+        return;
+    }
+    
+    if (expander->match_count > expander->matches_capacity)
+    {
+        const char **matches;
+        
+        matches = (const char **) realloc(expander->matches, expander->match_count * sizeof(const char *));
+        if (!matches)
+        {
+            expander->failed = true;
+            return;
+        }
+        expander->matches          = matches;
+        expander->matches_capacity = expander->match_count;
+    }
+    
+    name = expander->names;
+    for (size_t match = 0; match < expander->match_count; ++match)
+    {
+        *(expander->matches + match) = name;
+        name += strlen(name) + 1;
+    }
+    qsort(expander->matches, expander->match_count, sizeof(const char *), compare_matches);
+    
+    for (size_t match = 0; match < expander->match_count; ++match)
+    {
+        length = strlen(*(expander->matches + match));
+        if (arena_grow(arena, *(expander->matches + match), length + 1) == -1)
+        {
+            expander->failed = true;
+            return;
+        }
+        ++expander->field_count;
+    }
+}
+
+void match_pattern(struct expander *expander, char *pattern, size_t path_length)
+{
+    char          *rest;
+    char          saved;
+    size_t        length;
+    DIR           *dir;
+    struct dirent *entry;
+    struct stat   status;
+    
+    for (length = 0; *(pattern + length) == '/'; ++length)
+    {
+    }
+    if (length)
+    {
+        path_length = put_path(expander, path_length, pattern, length, false);
+        pattern += length;
+        if (!path_length)
+        {
+            return;
+        }
+    }
+    
+    if (!*pattern)
+    {
+        if (lstat(expander->path, &status) == 0)
+        {
+            add_match(expander, path_length);
+        }
+        return;
+    }
+    
+    rest = strchr(pattern, '/');
+    if (!rest)
+    {
+        rest = pattern + strlen(pattern);
+    }
+    
+    if (!has_pattern(pattern, rest))
+    {
+        length = put_path(expander, path_length, pattern, (size_t) (rest - pattern), true);
+        if (length)
+        {
+            match_pattern(expander, rest, length);
+        }
+        return;
+    }
+    
+    dir = opendir((path_length) ? expander->path : ".");
+    if (!dir)
+    {
+        return;
+    }
+    
+    saved = *rest;
+    *rest = '\0';
+    while ((entry = readdir(dir)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0
+            || fnmatch(pattern, entry->d_name, FNM_PERIOD) != 0)
+        {
+            continue;
+        }
+        
+        length = put_path(expander, path_length, entry->d_name, strlen(entry->d_name), false);
+        if (!length)
+        {
+            break;
+        }
+        if (saved)
+        {
+            *rest = saved;
+            match_pattern(expander, rest, length);
+            *rest = '\0';
+        } else
+        {
+            add_match(expander, length);
+        }
+    }
+    *rest = saved;
+    
+    (void) closedir(dir);
+}
+
+bool has_pattern(const char *start, const char *end)
+{
+    for (const char *c = start; c < end; ++c)
+    {
+        if (*c == '\\')
+        {
+            ++c;
+        } else if (*c == '*' || *c == '?' || *c == '[')
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+size_t put_path(struct expander *expander, size_t offset, const char *text, size_t length, bool unescape)
+{
+    if (!reserve(&expander->path, &expander->path_capacity, offset + length + 1))
+    {
+        expander->failed = true;
+        return 0;
+    }
+    
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (unescape && *(text + i) == '\\' && i + 1 < length)
+        {
+            ++i;
+        }
+        *(expander->path + offset++) = *(text + i);
+    }
+    *(expander->path + offset) = '\0';
+    
+    return offset;
+}
+
+void add_match(struct expander *expander, size_t length)
+{
+    if (!reserve(&expander->names, &expander->names_capacity, expander->names_length + length + 1))
+    {
+        expander->failed = true;
+        return;
+    }
+    
+    memcpy(expander->names + expander->names_length, expander->path, length + 1);
+    expander->names_length += length + 1;
+    ++expander->match_count;
+}
+
+int compare_matches(const void *a, const void *b)
+{
+    return strcoll(*(const char *const *) a, *(const char *const *) b);
+}
+
+bool reserve(char **buffer, size_t *capacity, size_t needed)
+{
+    size_t size;
+    char   *grown;
+    
+    if (needed <= *capacity)
+    {
+        return true;
+    }
+    
+    for (size = (*capacity) ? *capacity * 2 : 256; size < needed; size *= 2)
+    {
+    }
+    grown = (char *) realloc(*buffer, size);
+    if (!grown)
+    {
+        return false;
+    }
+    *buffer   = grown;
+    *capacity = size;
+    
+    return true;
+}
+
+void expander_reset(struct expander *expander)
+{
+    expander->ifs = NULL;
+    if (expander->field_capacity > EXPANDER_RETAIN_SIZE)
+    {
+        free(expander->field);
+        expander->field          = NULL;
+        expander->field_capacity = 0;
+    }
+    if (expander->names_capacity > EXPANDER_RETAIN_SIZE)
+    {
+        free(expander->names);
+        expander->names          = NULL;
+        expander->names_capacity = 0;
+    }
+    if (expander->matches_capacity * sizeof(const char *) > EXPANDER_RETAIN_SIZE)
+    {
+        free(expander->matches);
+        expander->matches          = NULL;
+        expander->matches_capacity = 0;
+    }
+    if (expander->capture_capacity > EXPANDER_RETAIN_SIZE)
+    {
+        (void) munmap(expander->capture, expander->capture_capacity);
+        expander->capture          = NULL;
+        expander->capture_capacity = 0;
+    }
+}
+
+void expander_destroy(struct supervisor *supvis, struct expander *expander)
+{
+    free(expander->field);
+    free(expander->path);
+    free(expander->names);
+    free(expander->matches);
+    if (expander->capture)
+    {
+        (void) munmap(expander->capture, expander->capture_capacity);
+    }
+    if (expander->arith)
+    {
+        arith_cache_destroy(expander->arith);
+    }
+    if (expander->patterns)
+    {
+        pattern_cache_destroy(expander->patterns);
+    }
+    supvis->mm->mm_free(supvis->mm, expander);
+}
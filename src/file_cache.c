@@ -0,0 +1,235 @@
+#include "../include/file_cache.h"
+#include "../include/parse_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * find_open_file
+ * <p>
+ * Find the slot of the entry of a file opened with some flags.
+ * </p>
+ * @param cache the cache
+ * @param path the file
+ * @param hash the hash of the path
+ * @param flags the flags the file was opened with
+ * @return the slot, or NULL if the file is not in the cache
+ */
+struct file_cache_entry **find_open_file(struct file_cache *cache, const char *path, uint64_t hash, int flags);
+
+/**
+ * free_slot
+ * <p>
+ * Find an empty slot, emptying that of the least recently used entry if there is none. Entries
+ * held by the command being started were used last, so they are not emptied while any other is.
+ * </p>
+ * @param cache the cache, with a capacity
+ * @return the slot
+ */
+struct file_cache_entry **free_slot(struct file_cache *cache);
+
+/**
+ * drop_file
+ * <p>
+ * Close the file of an entry and free it.
+ * </p>
+ * @param cache the cache
+ * @param slot the slot of the entry, emptied
+ */
+void drop_file(struct file_cache *cache, struct file_cache_entry **slot);
+
+struct file_cache *file_cache_create(struct supervisor *supvis)
+{
+    return mm_calloc(1, sizeof(struct file_cache), supvis->mm, __FILE__, __func__, __LINE__);
+}
+
+int file_cache_resize(struct file_cache *cache, size_t capacity)
+{
+    struct file_cache_entry **entries;
+    
+    for (size_t i = 0; i < cache->capacity; ++i)
+    {
+        if (*(cache->entries + i))
+        {
+            drop_file(cache, cache->entries + i);
+        }
+    }
+    free(cache->entries);
+    cache->entries  = NULL;
+    cache->capacity = 0;
+    if (!capacity)
+    {
+        return 0;
+    }
+    
+    entries = (struct file_cache_entry **) calloc(capacity, sizeof(struct file_cache_entry *));
+    if (!entries)
+    {
+        return -1;
+    }
+    cache->entries  = entries;
+    cache->capacity = capacity;
+    
+    return 0;
+}
+
+bool file_cache_accepts(const struct file_cache *cache, int flags)
+{
+    if (!cache->capacity || flags != (O_WRONLY | O_CREAT | O_APPEND))
+    {
+        return false;
+    }
+    if (cache->count < cache->capacity)
+    {
+        return true;
+    }
+    
+    for (size_t i = 0; i < cache->capacity; ++i)
+    {
+        if ((*(cache->entries + i))->used < cache->pinned)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void file_cache_begin(struct file_cache *cache)
+{
+    cache->pinned = cache->clock + 1;
+}
+
+int file_cache_open(struct file_cache *cache, const char *path, int flags)
+{
+    struct file_cache_entry **slot;
+    struct file_cache_entry *entry;
+    struct stat             status;
+    uint64_t                hash;
+    size_t                  length;
+    int                     fd;
+    
+    length = strlen(path);
+    hash   = parse_cache_hash(path, length);
+    ++cache->clock;
+    
+    // One stat in place of an open and a close, as long as the path still names the file held.
+    slot = find_open_file(cache, path, hash, flags);
+    if (slot)
+    {
+        entry = *slot;
+        if (stat(path, &status) == 0 && status.st_dev == entry->device && status.st_ino == entry->inode)
+        {
+            entry->used = cache->clock;
+            ++cache->hits;
+            return entry->fd;
+        }
+        drop_file(cache, slot);
+    }
+    ++cache->misses;
+    
+    fd = shell_descriptor(open(path, flags | O_CLOEXEC, 0666));
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (fstat(fd, &status) == -1)
+    {
+        (void) close(fd);
+        return -1;
+    }
+    entry = (struct file_cache_entry *) calloc(1, sizeof(struct file_cache_entry) + length + 1);
+    if (!entry)
+    {
+        (void) close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    entry->hash   = hash;
+    entry->flags  = flags;
+    entry->fd     = fd;
+    entry->device = status.st_dev;
+    entry->inode  = status.st_ino;
+    entry->used   = cache->clock;
+    memcpy(entry->path, path, length + 1);
+    
+    slot  = free_slot(cache);
+    *slot = entry;
+    ++cache->count;
+    
+    return fd;
+}
+
+struct file_cache_entry **find_open_file(struct file_cache *cache, const char *path, uint64_t hash, int flags)
+{
+    struct file_cache_entry *entry;
+    
+    for (size_t i = 0; i < cache->capacity; ++i)
+    {
+        entry = *(cache->entries + i);
+        if (entry && entry->hash == hash && entry->flags == flags && strcmp(entry->path, path) == 0)
+        {
+            return cache->entries + i;
+        }
+    }
+    
+    return NULL;
+}
+
+struct file_cache_entry **free_slot(struct file_cache *cache)
+{
+    struct file_cache_entry **oldest;
+    
+    oldest = cache->entries;
+    for (size_t i = 0; i < cache->capacity; ++i)
+    {
+        if (!*(cache->entries + i))
+        {
+            return cache->entries + i;
+        }
+        if ((*(cache->entries + i))->used < (*oldest)->used)
+        {
+            oldest = cache->entries + i;
+        }
+    }
+    drop_file(cache, oldest);
+    
+    return oldest;
+}
+
+void drop_file(struct file_cache *cache, struct file_cache_entry **slot)
+{
+    (void) close((*slot)->fd);
+    free(*slot);
+    *slot = NULL;
+    --cache->count;
+}
+
+int shell_descriptor(int fd)
+{
+    int moved;
+    
+    if (fd == -1 || fd >= SHELL_FD_MIN)
+    {
+        return fd;
+    }
+    
+    moved = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_MIN);
+    if (moved == -1)
+    {
+        errno = 0;
+        return fd;
+    }
+    (void) close(fd);
+    
+    return moved;
+}
+
+void file_cache_destroy(struct supervisor *supvis, struct file_cache *cache)
+{
+    (void) file_cache_resize(cache, 0);
+    supvis->mm->mm_free(supvis->mm, cache);
+}
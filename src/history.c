@@ -0,0 +1,348 @@
+#include "../include/history.h"
+#include "../include/file_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * map_log
+ * <p>
+ * Map the whole log as it is now, replacing the previous mapping if the log has grown.
+ * </p>
+ * @param history the history
+ * @return 0 on success, -1 on failure
+ */
+int map_log(struct history *history);
+
+/**
+ * previous_record
+ * <p>
+ * Find the start of the record ending at end, checking that its trailer is well formed and
+ * that it does not reach below floor.
+ * </p>
+ * @param history the history
+ * @param end the offset just past the record's trailer
+ * @param floor the lowest offset the record may start at
+ * @param start set to the offset of the record's text
+ * @return true if there is a well formed record, false otherwise
+ */
+bool previous_record(const struct history *history, size_t end, size_t floor, size_t *start);
+
+/**
+ * skip_damage
+ * <p>
+ * Find the end of the newest well formed record below bytes that are not one, such as what is
+ * left of a record whose append was cut short. The bytes between are skipped.
+ * </p>
+ * @param history the history
+ * @param end the offset just past the damaged bytes
+ * @param floor the lowest offset a record may start at
+ * @param found set to the offset just past the record found
+ * @return true if there is such a record, false otherwise
+ */
+bool skip_damage(const struct history *history, size_t end, size_t floor, size_t *found);
+
+/**
+ * push_offset
+ * <p>
+ * Add an offset to the end of an array of offsets, growing it as needed.
+ * </p>
+ * @param offsets the array
+ * @param count the number of offsets in the array
+ * @param capacity the number of offsets allocated for the array
+ * @param offset the offset to add
+ * @return 0 on success, -1 on failure
+ */
+int push_offset(size_t **offsets, size_t *count, size_t *capacity, size_t offset);
+
+struct history *history_open(struct supervisor *supvis, const char *path)
+{
+    struct history *history;
+    
+    history = mm_calloc(1, sizeof(struct history), supvis->mm, __FILE__, __func__, __LINE__);
+    if (!history)
+    {
+        return NULL;
+    }
+    
+    history->fd = shell_descriptor(open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (history->fd == -1)
+    {
+        supvis->mm->mm_free(supvis->mm, history);
+        return NULL;
+    }
+    
+    if (map_log(history) == -1)
+    {
+        (void) close(history->fd);
+        supvis->mm->mm_free(supvis->mm, history);
+        return NULL;
+    }
+    
+    // Nothing is read yet; records are indexed from the end as they are asked for.
+    history->length  = history->map_length;
+    history->scanned = history->map_length;
+    
+    return history;
+}
+
+int map_log(struct history *history)
+{
+    struct stat status;
+    char        *map;
+    
+    if (fstat(history->fd, &status) == -1)
+    {
+        return -1;
+    }
+    
+    if ((size_t) status.st_size == history->map_length)
+    {
+        return 0;
+    }
+    
+    map = NULL;
+    if (status.st_size > 0)
+    {
+        map = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_SHARED, history->fd, 0);
+        if (map == MAP_FAILED)
+        {
+            return -1;
+        }
+    }
+    
+    if (history->map)
+    {
+        (void) munmap(history->map, history->map_length);
+    }
+    history->map        = map;
+    history->map_length = (size_t) status.st_size;
+    
+    return 0;
+}
+
+int history_append(struct history *history, const char *text, size_t length, int exit_code, time_t started,
+                   long duration)
+{
+    struct history_trailer trailer;
+    struct iovec           record[2];
+    ssize_t                written;
+    
+    if (length > UINT32_MAX)
+    {
+        errno = E2BIG;
+        return -1;
+    }
+    
+    trailer.length    = (uint32_t) length;
+    trailer.exit_code = (int32_t) exit_code;
+    trailer.started   = (int64_t) started;
+    trailer.duration  = (duration < 0) ? 0 : (duration > (long) UINT32_MAX) ? UINT32_MAX : (uint32_t) duration;
+    trailer.magic     = HISTORY_MAGIC;
+    
+    // One write per record: O_APPEND makes it land whole after every other session's records.
+    record[0].iov_base = (void *) (uintptr_t) text;
+    record[0].iov_len  = length;
+    record[1].iov_base = &trailer;
+    record[1].iov_len  = sizeof(trailer);
+    
+    written = writev(history->fd, record, 2);
+    if (written == -1)
+    {
+        return -1;
+    }
+    if ((size_t) written != length + sizeof(trailer))
+    {
+        errno = EIO;
+        return -1;
+    }
+    
+    return 0;
+}
+
+int history_refresh(struct history *history)
+{
+    size_t end;
+    size_t start;
+    size_t first;
+    
+    if (map_log(history) == -1)
+    {
+        return -1;
+    }
+    
+    // The log was truncated by hand; start over from its new end.
+    if (history->map_length < history->length)
+    {
+        history->older_count = 0;
+        history->newer_count = 0;
+        history->length      = history->map_length;
+        history->scanned     = history->map_length;
+        return 0;
+    }
+    
+    // Index the new records newest first, then reverse them so newer stays oldest first.
+    first = history->newer_count;
+    end   = history->map_length;
+    while (end > history->length)
+    {
+        if (!previous_record(history, end, history->length, &start))
+        {
+            if (!skip_damage(history, end, history->length, &end))
+            {
+                break;
+            }
+            continue;
+        }
+        if (push_offset(&history->newer, &history->newer_count, &history->newer_capacity, end) == -1)
+        {
+            return -1;
+        }
+        end = start;
+    }
+    for (size_t i = first, j = history->newer_count; i + 1 < j; ++i, --j)
+    {
+        size_t offset;
+        
+        offset                    = *(history->newer + i);
+        *(history->newer + i)     = *(history->newer + j - 1);
+        *(history->newer + j - 1) = offset;
+    }
+    history->length = history->map_length;
+    
+    return 0;
+}
+
+bool previous_record(const struct history *history, size_t end, size_t floor, size_t *start)
+{
+    struct history_trailer trailer;
+    
+    if (end < floor + sizeof(trailer))
+    {
+        return false;
+    }
+    
+    memcpy(&trailer, history->map + end - sizeof(trailer), sizeof(trailer));
+    if (trailer.magic != HISTORY_MAGIC || trailer.length > end - floor - sizeof(trailer))
+    {
+        return false;
+    }
+    
+    *start = end - sizeof(trailer) - trailer.length;
+    
+    return true;
+}
+
+bool skip_damage(const struct history *history, size_t end, size_t floor, size_t *found)
+{
+    const uint32_t magic = HISTORY_MAGIC;
+    size_t         candidate;
+    size_t         start;
+    
+    // Damage is rare and short, so looking for a trailer a byte at a time is cheap enough.
+    for (candidate = end; candidate > floor + sizeof(struct history_trailer);)
+    {
+        --candidate;
+        if (memcmp(history->map + candidate - sizeof(magic), &magic, sizeof(magic)) == 0
+            && previous_record(history, candidate, floor, &start))
+        {
+            *found = candidate;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+int push_offset(size_t **offsets, size_t *count, size_t *capacity, size_t offset)
+{
+    if (*count == *capacity)
+    {
+        size_t new_capacity;
+        size_t *new_offsets;
+        
+        new_capacity = (*capacity) ? *capacity * 2 : 64;
+        new_offsets  = (size_t *) realloc(*offsets, new_capacity * sizeof(size_t));
+        if (!new_offsets)
+        {
+            return -1;
+        }
+        *offsets  = new_offsets;
+        *capacity = new_capacity;
+    }
+    
+    *(*offsets + (*count)++) = offset;
+    
+    return 0;
+}
+
+bool history_get(struct history *history, size_t n, struct history_entry *entry)
+{
+    size_t start;
+    
+    if (n < history->newer_count)
+    {
+        history_read(history, *(history->newer + history->newer_count - 1 - n), entry);
+        return true;
+    }
+    n -= history->newer_count;
+    
+    // A damaged record is skipped, so the records before it stay in reach.
+    while (history->older_count <= n && history->scanned)
+    {
+        if (!previous_record(history, history->scanned, 0, &start))
+        {
+            if (!skip_damage(history, history->scanned, 0, &history->scanned))
+            {
+                history->scanned = 0;
+            }
+            continue;
+        }
+        if (push_offset(&history->older, &history->older_count, &history->older_capacity, history->scanned) == -1)
+        {
+            history->scanned = 0;
+            break;
+        }
+        history->scanned = start;
+    }
+    
+    if (n >= history->older_count)
+    {
+        return false;
+    }
+    
+    history_read(history, *(history->older + n), entry);
+    
+    return true;
+}
+
+void history_read(const struct history *history, size_t end, struct history_entry *entry)
+{
+    struct history_trailer trailer;
+    
+    memcpy(&trailer, history->map + end - sizeof(trailer), sizeof(trailer));
+    
+    entry->length    = trailer.length;
+    entry->text      = history->map + end - sizeof(trailer) - trailer.length;
+    entry->exit_code = trailer.exit_code;
+    entry->started   = (time_t) trailer.started;
+    entry->duration  = (long) trailer.duration;
+    entry->end       = end;
+}
+
+void history_close(struct supervisor *supvis, struct history *history)
+{
+    if (history->map)
+    {
+        (void) munmap(history->map, history->map_length);
+    }
+    (void) close(history->fd);
+    free(history->older);
+    free(history->newer);
+    supvis->mm->mm_free(supvis->mm, history);
+}
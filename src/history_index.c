@@ -0,0 +1,455 @@
+#include "../include/history_index.h"
+
+#include <string.h>
+
+/**
+ * struct sort_item
+ * <p>
+ * A command of the history while the index is being built.
+ * </p>
+ */
+struct sort_item
+{
+    const char *text;   // the command
+    size_t length;      // length of the command
+    size_t end;         // the command's record end
+    uint32_t age;       // how far back the command is in the history
+};
+
+/**
+ * build_index
+ * <p>
+ * Sort the distinct commands of the history and build the minimum age tree over them.
+ * </p>
+ * @param index the index
+ * @return 0 on success, -1 on failure
+ */
+int build_index(struct history_index *index);
+
+/**
+ * compare_items
+ * <p>
+ * Order commands by text, and the same text by age, for qsort.
+ * </p>
+ * @param a the first sort_item
+ * @param b the second sort_item
+ * @return less than, equal to or greater than 0 as a sorts before, with or after b
+ */
+int compare_items(const void *a, const void *b);
+
+/**
+ * compare_prefix
+ * <p>
+ * Compare an indexed command with a prefix.
+ * </p>
+ * @param index the index
+ * @param i the position of the command in the sorted order
+ * @param prefix the prefix
+ * @param prefix_length the length of the prefix
+ * @return less than 0 if the command sorts before every command starting with prefix, 0 if it
+ * starts with prefix, greater than 0 if it sorts after them
+ */
+int compare_prefix(const struct history_index *index, size_t i, const char *prefix, size_t prefix_length);
+
+/**
+ * starts_with
+ * <p>
+ * Check whether a command starts with a prefix.
+ * </p>
+ * @param entry the command
+ * @param prefix the prefix
+ * @param prefix_length the length of the prefix
+ * @return true if it does, false otherwise
+ */
+bool starts_with(const struct history_entry *entry, const char *prefix, size_t prefix_length);
+
+/**
+ * seen_fresh
+ * <p>
+ * Check whether a command is the same as one of the first limit commands added since the index
+ * was built, so that each distinct command is found by a search only once.
+ * </p>
+ * @param index the index
+ * @param limit the number of commands added since the index was built to compare with
+ * @param entry the command
+ * @return true if it is, false otherwise
+ */
+bool seen_fresh(const struct history_index *index, size_t limit, const struct history_entry *entry);
+
+/**
+ * heap_push
+ * <p>
+ * Add a tree node to a search's heap.
+ * </p>
+ * @param index the index
+ * @param search the search
+ * @param node the node
+ * @return 0 on success, -1 on failure
+ */
+int heap_push(const struct history_index *index, struct history_search *search, size_t node);
+
+/**
+ * heap_pop
+ * <p>
+ * Take the node with the lowest minimum age from a search's heap.
+ * </p>
+ * @param index the index
+ * @param search the search
+ * @return the node
+ */
+size_t heap_pop(const struct history_index *index, struct history_search *search);
+
+struct history_index *history_index_create(struct supervisor *supvis, struct history *history)
+{
+    struct history_index *index;
+    
+    index = mm_calloc(1, sizeof(struct history_index), supvis->mm, __FILE__, __func__, __LINE__);
+    if (index)
+    {
+        index->history = history;
+    }
+    
+    return index;
+}
+
+int build_index(struct history_index *index)
+{
+    struct history_entry entry;
+    struct sort_item     *items;
+    size_t               count;
+    size_t               capacity;
+    size_t               distinct;
+    
+    items    = NULL;
+    count    = 0;
+    capacity = 0;
+    for (; count < UINT32_MAX && history_get(index->history, count, &entry); ++count)
+    {
+        if (count == capacity)
+        {
+            struct sort_item *grown;
+            
+            capacity = (capacity) ? capacity * 2 : 1024;
+            grown    = (struct sort_item *) realloc(items, capacity * sizeof(struct sort_item));
+            if (!grown)
+            {
+                free(items);
+                return -1;
+            }
+            items = grown;
+        }
+        (items + count)->text   = entry.text;
+        (items + count)->length = entry.length;
+        (items + count)->end    = entry.end;
+        (items + count)->age    = (uint32_t) count;
+    }
+    
+    if (count)
+    {
+        qsort(items, count, sizeof(struct sort_item), compare_items);
+    }
+    
+    // Keep the most recent use of each command; it sorts first among its duplicates.
+    distinct = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (distinct && (items + distinct - 1)->length == (items + i)->length
+            && memcmp((items + distinct - 1)->text, (items + i)->text, (items + i)->length) == 0)
+        {
+            continue;
+        }
+        *(items + distinct++) = *(items + i);
+    }
+    
+    free(index->ends);
+    free(index->tree);
+    index->ends  = (size_t *) malloc((distinct + 1) * sizeof(size_t));
+    index->tree  = (uint32_t *) malloc((2 * distinct + 1) * sizeof(uint32_t));
+    index->count = 0;
+    if (!index->ends || !index->tree)
+    {
+        free(items);
+        return -1;
+    }
+    
+    for (size_t i = 0; i < distinct; ++i)
+    {
+        *(index->ends + i)            = (items + i)->end;
+        *(index->tree + distinct + i) = (items + i)->age;
+    }
+    for (size_t i = (distinct) ? distinct - 1 : 0; i > 0; --i)
+    {
+        uint32_t left;
+        uint32_t right;
+        
+        left               = *(index->tree + 2 * i);
+        right              = *(index->tree + 2 * i + 1);
+        *(index->tree + i) = (left < right) ? left : right;
+    }
+    free(items);
+    
+    index->count          = distinct;
+    index->newer_at_build = index->history->newer_count;
+    index->built          = true;
+    
+    return 0;
+}
+
+int compare_items(const void *a, const void *b)
+{
+    const struct sort_item *x;
+    const struct sort_item *y;
+    int                    order;
+    
+    x     = (const struct sort_item *) a;
+    y     = (const struct sort_item *) b;
+    order = memcmp(x->text, y->text, (x->length < y->length) ? x->length : y->length);
+    if (order)
+    {
+        return order;
+    }
+    if (x->length != y->length)
+    {
+        return (x->length < y->length) ? -1 : 1;
+    }
+    
+    return (x->age < y->age) ? -1 : (x->age > y->age) ? 1 : 0;
+}
+
+int compare_prefix(const struct history_index *index, size_t i, const char *prefix, size_t prefix_length)
+{
+    struct history_entry entry;
+    int                  order;
+    
+    history_read(index->history, *(index->ends + i), &entry);
+    order = memcmp(entry.text, prefix, (entry.length < prefix_length) ? entry.length : prefix_length);
+    if (order)
+    {
+        return order;
+    }
+    
+    return (entry.length < prefix_length) ? -1 : 0;
+}
+
+bool starts_with(const struct history_entry *entry, const char *prefix, size_t prefix_length)
+{
+    return entry->length >= prefix_length && memcmp(entry->text, prefix, prefix_length) == 0;
+}
+
+bool seen_fresh(const struct history_index *index, size_t limit, const struct history_entry *entry)
+{
+    struct history_entry fresh;
+    
+    for (size_t n = 0; n < limit; ++n)
+    {
+        (void) history_get(index->history, n, &fresh);
+        if (fresh.length == entry->length && memcmp(fresh.text, entry->text, entry->length) == 0)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+int history_index_search_start(struct history_index *index, struct history_search *search, const char *prefix,
+                               size_t prefix_length)
+{
+    size_t low;
+    size_t high;
+    size_t first;
+    size_t last;
+    
+    memset(search, 0, sizeof(struct history_search));
+    
+    // The history only loses records if the log was truncated; the index is then out of date.
+    if ((!index->built || index->history->newer_count < index->newer_at_build) && build_index(index) == -1)
+    {
+        return -1;
+    }
+    
+    search->prefix = (char *) malloc(prefix_length + 1);
+    if (!search->prefix)
+    {
+        return -1;
+    }
+    memcpy(search->prefix, prefix, prefix_length);
+    *(search->prefix + prefix_length) = '\0';
+    search->prefix_length = prefix_length;
+    search->fresh_count   = index->history->newer_count - index->newer_at_build;
+    
+    // The commands starting with prefix are those in [first, last) of the sorted order.
+    low  = 0;
+    high = index->count;
+    while (low < high)
+    {
+        size_t middle;
+        
+        middle = low + (high - low) / 2;
+        if (compare_prefix(index, middle, prefix, prefix_length) < 0)
+        {
+            low = middle + 1;
+        } else
+        {
+            high = middle;
+        }
+    }
+    first = low;
+    high  = index->count;
+    while (low < high)
+    {
+        size_t middle;
+        
+        middle = low + (high - low) / 2;
+        if (compare_prefix(index, middle, prefix, prefix_length) <= 0)
+        {
+            low = middle + 1;
+        } else
+        {
+            high = middle;
+        }
+    }
+    last = low;
+    
+    // Seed the heap with the tree nodes exactly covering the range.
+    for (first += index->count, last += index->count; first < last; first /= 2, last /= 2)
+    {
+        if ((first & 1) && heap_push(index, search, first++) == -1)
+        {
+            return -1;
+        }
+        if ((last & 1) && heap_push(index, search, --last) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+bool history_index_search_next(struct history_index *index, struct history_search *search,
+                               struct history_entry *entry)
+{
+    size_t node;
+    
+    // Commands added since the index was built are the most recent, so they come first.
+    while (search->fresh < search->fresh_count)
+    {
+        (void) history_get(index->history, search->fresh, entry);
+        if (starts_with(entry, search->prefix, search->prefix_length) && !seen_fresh(index, search->fresh, entry))
+        {
+            ++search->fresh;
+            return true;
+        }
+        ++search->fresh;
+    }
+    
+    while (search->heap_count)
+    {
+        node = heap_pop(index, search);
+        if (node < index->count)
+        {
+            if (heap_push(index, search, 2 * node) == -1 || heap_push(index, search, 2 * node + 1) == -1)
+            {
+                return false;
+            }
+            continue;
+        }
+        
+        history_read(index->history, *(index->ends + node - index->count), entry);
+        if (!seen_fresh(index, search->fresh_count, entry))
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+int heap_push(const struct history_index *index, struct history_search *search, size_t node)
+{
+    size_t child;
+    size_t parent;
+    
+    if (search->heap_count == search->heap_capacity)
+    {
+        size_t capacity;
+        size_t *heap;
+        
+        capacity = (search->heap_capacity) ? search->heap_capacity * 2 : 64;
+        heap     = (size_t *) realloc(search->heap, capacity * sizeof(size_t));
+        if (!heap)
+        {
+            return -1;
+        }
+        search->heap          = heap;
+        search->heap_capacity = capacity;
+    }
+    
+    for (child = search->heap_count++; child > 0; child = parent)
+    {
+        parent = (child - 1) / 2;
+        if (*(index->tree + *(search->heap + parent)) <= *(index->tree + node))
+        {
+            break;
+        }
+        *(search->heap + child) = *(search->heap + parent);
+    }
+    *(search->heap + child) = node;
+    
+    return 0;
+}
+
+size_t heap_pop(const struct history_index *index, struct history_search *search)
+{
+    size_t top;
+    size_t last;
+    size_t parent;
+    size_t child;
+    
+    top  = *search->heap;
+    last = *(search->heap + --search->heap_count);
+    for (parent = 0; (child = 2 * parent + 1) < search->heap_count; parent = child)
+    {
+        if (child + 1 < search->heap_count
+            && *(index->tree + *(search->heap + child + 1)) < *(index->tree + *(search->heap + child)))
+        {
+            ++child;
+        }
+        if (*(index->tree + last) <= *(index->tree + *(search->heap + child)))
+        {
+            break;
+        }
+        *(search->heap + parent) = *(search->heap + child);
+    }
+    *(search->heap + parent) = last;
+    
+    return top;
+}
+
+void history_index_search_end(struct history_search *search)
+{
+    free(search->prefix);
+    free(search->heap);
+    memset(search, 0, sizeof(struct history_search));
+}
+
+bool history_index_suggest(struct history_index *index, const char *prefix, size_t prefix_length,
+                           struct history_entry *entry)
+{
+    struct history_search search;
+    bool                  found;
+    
+    found = history_index_search_start(index, &search, prefix, prefix_length) == 0
+            && history_index_search_next(index, &search, entry);
+    history_index_search_end(&search);
+    
+    return found;
+}
+
+void history_index_destroy(struct supervisor *supvis, struct history_index *index)
+{
+    free(index->ends);
+    free(index->tree);
+    supvis->mm->mm_free(supvis->mm, index);
+}
@@ -1,72 +1,332 @@
 #include "../include/command.h"
+#include "../include/completion.h"
+#include "../include/editor.h"
 #include "../include/input.h"
+#include "../include/prompt.h"
+#include "../include/scanner.h"
+#include "../include/script_cache.h"
+#include "../include/tokenizer.h"
 
-#include <dc_util/filesystem.h>
+#include <errno.h>
+#include <unistd.h>
 
 /**
- * display_prompt
+ * write_prompt
  * <p>
- * Display the current working directory and the state->prompt on the state->stdout.
+ * Write the current working directory and the state->prompt on a stream. The prompt is rendered
+ * ahead of time (see do_update_working_dir), so this is a single write. If the prompt has
+ * segments, they are filled in: %? is the exit code of the last command, %b the VCS branch
+ * (waiting at most state->prompt_deadline for it) and %% a literal %.
  * </p>
- * @param supvis the supervisor object
  * @param state the state object
+ * @param stream the stream to write on
  */
-void display_prompt(struct supervisor *supvis, struct state *state);
+void write_prompt(struct state *state, FILE *stream);
 
 /**
- * read_command_line
+ * read_edited_command
  * <p>
- * Read the command line from the user.
+ * Feed the lines accepted by state->editor to the tokenizer until a command is complete. A new
+ * line is only edited when the lines already accepted (eg. pasted together) are used up, with
+ * the prompt before the first line of a command and "> " before the others.
  * </p>
- * @param istream the stream from which to read (eg. stdin)
- * @param line_size the maximum number of characters to read
- * @return the command line that the user entered, or NULL on failure
+ * @param state the state object
+ * @return the length of the command, 1 if it was cancelled, or 0 at the end of input
+ */
+size_t read_edited_command(struct state *state);
+
+/**
+ * edit_line
+ * <p>
+ * Have state->editor read a line, showing the prompt for a new command or a continuation prompt.
+ * </p>
+ * @param state the state object
+ * @return what editor_read_line returns
+ */
+int edit_line(struct state *state);
+
+/**
+ * read_script_line
+ * <p>
+ * Take the next statement from state->script and tokenize it with state->tokenizer, the same
+ * way commands read from stdin are. state->current_line points at the statement in the script.
+ * Boundaries are found through state->script_index, so newlines inside quotes do not end a
+ * statement. Blank lines and comments are skipped. A script with a compiled form has its
+ * statements' tokens loaded from state->script_cache instead. A script mapped from stdin keeps
+ * the offset of the descriptor just past the statement, so a command that reads stdin starts
+ * after it, and carries on from wherever such a command left it.
+ * </p>
+ * @param state the state object
+ * @return the length of the line including its terminator, or 0 at the end of the script
  */
-char *read_command_line(FILE *istream, size_t *line_size);
+size_t read_script_line(struct state *state);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
 
 size_t do_read_commands(struct supervisor *supvis, struct state *state)
 {
-    display_prompt(supvis, state);
+    if (state->script)
+    {
+        return read_script_line(state);
+    }
     
-    state->current_line_length = state->max_line_length;
+    if (state->editor)
+    {
+        return read_edited_command(state);
+    }
+    
+    if (state->interactive)
+    {
+        completion_refresh(state->completion);
+        write_prompt(state, state->stdout);
+    }
     
-    state->current_line = read_command_line(state->stdin, &state->current_line_length);
+    state->current_line = NULL;
     
-    if (!state->current_line)
+    switch (tokenizer_read_command(state->tokenizer))
     {
-        state->fatal_error = true;
-    } else
+        case 1:
+        {
+            // A command without tokens is reported as a lone newline so it is skipped.
+            state->current_line_length = (state->tokenizer->token_count || state->tokenizer->overflow)
+                                         ? state->tokenizer->consumed : 1;
+            break;
+        }
+        default: // end of input or read error
+        {
+            state->current_line_length = 0;
+            state->fatal_error = true;
+        }
+    }
+    
+    return state->current_line_length;
+}
+
+#pragma GCC diagnostic pop
+
+size_t read_edited_command(struct state *state)
+{
+    const char *pending;
+    size_t     length;
+    bool       complete;
+    
+    state->current_line = NULL;
+    
+    // Output of the last command still buffered by stdio must not land in the middle of the line.
+    (void) fflush(state->stdout);
+    
+    complete = false;
+    while (!complete)
     {
-        supvis->mm->mm_add(supvis->mm, state->current_line);
+        pending = editor_pending(state->editor, &length);
+        if (length)
+        {
+            editor_consume(state->editor, tokenizer_feed(state->tokenizer, pending, length, &complete));
+            continue;
+        }
+        
+        switch (edit_line(state))
+        {
+            case 1:
+            {
+                break;
+            }
+            case EDITOR_CANCELLED:
+            {
+                tokenizer_reset(state->tokenizer);
+                state->current_line_length = 1;
+                return state->current_line_length;
+            }
+            case 0:
+            {
+                if (!state->tokenizer->consumed)
+                {
+                    state->current_line_length = 0;
+                    state->fatal_error = true;
+                    return state->current_line_length;
+                }
+                tokenizer_finish(state->tokenizer); // the input ended inside a command
+                complete = true;
+                break;
+            }
+            default: // read error
+            {
+                state->current_line_length = 0;
+                state->fatal_error = true;
+                return state->current_line_length;
+            }
+        }
     }
     
+    // A command without tokens is reported as a lone newline so it is skipped.
+    state->current_line_length = (state->tokenizer->token_count || state->tokenizer->overflow)
+                                 ? state->tokenizer->consumed : 1;
+    
     return state->current_line_length;
 }
 
-void display_prompt(struct supervisor *supvis, struct state *state)
+int edit_line(struct state *state)
 {
-    char *cwd;
+    char   *prompt;
+    size_t prompt_length;
+    FILE   *stream;
+    int    result;
+    
+    if (state->tokenizer->consumed)
+    {
+        return editor_read_line(state->editor, state, "> ", 2);
+    }
+    
+    completion_refresh(state->completion);
+    if (!state->prompt_dynamic)
+    {
+        return editor_read_line(state->editor, state, state->prompt_line, state->prompt_line_length);
+    }
+    
+    prompt = NULL;
+    stream = open_memstream(&prompt, &prompt_length);
+    if (!stream)
+    {
+        return -1;
+    }
+    write_prompt(state, stream);
+    if (fclose(stream) == EOF)
+    {
+        free(prompt);
+        return -1;
+    }
     
-    cwd = dc_get_working_dir(supvis->env, supvis->err);
+    result = editor_read_line(state->editor, state, prompt, prompt_length);
+    free(prompt);
     
-    (void) fprintf(state->stdout, "[%s] %s", cwd, state->prompt);
+    return result;
 }
 
-char *read_command_line(FILE *istream, size_t *line_size)
+size_t read_script_line(struct state *state)
 {
-    char    *line;
-    size_t  len;
-    ssize_t result_len;
+    const struct cached_statement *cached;
+    struct statement              statement;
+    size_t                        start;
+    size_t                        cut;
+    off_t                         offset;
+    bool                          from_stdin;
     
-    line = NULL;
-    len  = (*line_size + 1);
+    if (state->script_cache)
+    {
+        cached = script_cache_next(state->script_cache);
+        if (!cached)
+        {
+            state->current_line        = NULL;
+            state->current_line_length = 0;
+            return 0;
+        }
+        
+        state->current_line        = state->script + cached->line_offset;
+        state->current_line_length = (size_t) cached->line_length + 1;
+        if (script_cache_load(state->script_cache, cached, state->tokenizer) == -1)
+        {
+            state->fatal_error = true;
+        }
+        
+        return state->current_line_length;
+    }
     
-    result_len = getline(&line, &len, istream);
-    if (result_len == -1)
+    // What the commands of the last statement read from stdin is not read again as script.
+    from_stdin = !state->script_path && !state->command_string;
+    if (from_stdin)
     {
-        return NULL;
+        offset = lseek(fileno(state->stdin), 0, SEEK_CUR);
+        if (offset > (off_t) state->script_offset && offset <= (off_t) state->script_length)
+        {
+            state->script_offset = (size_t) offset;
+        }
+        errno = 0;
     }
     
-    *line_size = result_len;
-    return line;
+    do
+    {
+        if (state->script_offset >= state->script_length)
+        {
+            state->current_line        = NULL;
+            state->current_line_length = 0;
+            return 0;
+        }
+        
+        start = state->script_offset;
+        scan_statement(state->script_index, state->script, start, state->script_length, &statement);
+        
+        // Any comment is dropped; the tokenizer would skip it anyway.
+        cut = (statement.comment < statement.end) ? statement.comment : statement.end;
+        
+        state->script_offset = statement.end + 1;
+    } while (cut == start); // blank line or comment
+    
+    if (from_stdin)
+    {
+        (void) lseek(fileno(state->stdin), (off_t) state->script_offset, SEEK_SET);
+        errno = 0;
+    }
+    
+    state->current_line        = state->script + start;
+    state->current_line_length = cut - start + 1;
+    
+    tokenizer_feed_line(state->tokenizer, state->current_line, cut - start);
+    
+    return state->current_line_length;
+}
+
+void write_prompt(struct state *state, FILE *stream)
+{
+    const char *c;
+    char       branch[PROMPT_BRANCH_MAX];
+    
+    if (!state->prompt_dynamic)
+    {
+        (void) fwrite(state->prompt_line, 1, state->prompt_line_length, stream);
+        (void) fflush(stream); // commands are read from the descriptor, bypassing stdio
+        return;
+    }
+    
+    // The segments are buffered by stdio, so the prompt is still written at once by the flush.
+    (void) fwrite(state->prompt_line, 1, state->prompt_prefix_length, stream);
+    for (c = state->prompt_line + state->prompt_prefix_length; *c; ++c)
+    {
+        if (*c != '%' || !*(c + 1))
+        {
+            (void) fputc(*c, stream);
+            continue;
+        }
+        
+        switch (*++c)
+        {
+            case '?':
+            {
+                (void) fprintf(stream, "%d", state->exit_code);
+                break;
+            }
+            case 'b':
+            {
+                if (state->prompt_worker)
+                {
+                    prompt_worker_branch(state->prompt_worker, state->cwd, state->prompt_deadline,
+                                         branch, sizeof(branch));
+                    (void) fputs(branch, stream);
+                }
+                break;
+            }
+            case '%':
+            {
+                (void) fputc('%', stream);
+                break;
+            }
+            default: // not a segment; shown as is
+            {
+                (void) fputc('%', stream);
+                (void) fputc(*c, stream);
+                break;
+            }
+        }
+    }
+    (void) fflush(stream); // commands are read from the descriptor, bypassing stdio
 }
@@ -1,10 +1,10 @@
 #include "../include/shell.h"
 
-int main(void)
+int main(int argc, char *argv[])
 {
     int exit_status;
     
-    exit_status = run();
+    exit_status = run(argc, argv);
     
     return exit_status;
 }
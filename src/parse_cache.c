@@ -0,0 +1,273 @@
+#include "../include/parse_cache.h"
+
+#include <string.h>
+
+/**
+ * FNV-1a 64-bit offset basis.
+ */
+#define FNV_OFFSET 14695981039346656037ULL
+
+/**
+ * FNV-1a 64-bit prime.
+ */
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * unlink_entry
+ * <p>
+ * Remove an entry from the list of entries by use.
+ * </p>
+ * @param cache the cache
+ * @param entry the entry
+ */
+void unlink_entry(struct parse_cache *cache, struct parse_cache_entry *entry);
+
+/**
+ * link_newest
+ * <p>
+ * Add an entry to the list of entries by use as the most recently used.
+ * </p>
+ * @param cache the cache
+ * @param entry the entry
+ */
+void link_newest(struct parse_cache *cache, struct parse_cache_entry *entry);
+
+/**
+ * evict_oldest
+ * <p>
+ * Drop the least recently used entry.
+ * </p>
+ * @param cache the cache
+ */
+void evict_oldest(struct parse_cache *cache);
+
+/**
+ * entry_line
+ * <p>
+ * Get the line of an entry.
+ * </p>
+ * @param entry the entry
+ * @return the line (not null terminated)
+ */
+const char *entry_line(const struct parse_cache_entry *entry);
+
+struct parse_cache *parse_cache_create(struct supervisor *supvis, size_t capacity)
+{
+    struct parse_cache *cache;
+    
+    cache = mm_calloc(1, sizeof(struct parse_cache), supvis->mm, __FILE__, __func__, __LINE__);
+    if (cache && parse_cache_resize(cache, capacity) == -1)
+    {
+        supvis->mm->mm_free(supvis->mm, cache);
+        return NULL;
+    }
+    
+    return cache;
+}
+
+uint64_t parse_cache_hash(const char *line, size_t length)
+{
+    uint64_t hash;
+    
+    hash = FNV_OFFSET;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= (unsigned char) *(line + i);
+        hash *= FNV_PRIME;
+    }
+    
+    return hash;
+}
+
+const struct parse_cache_entry *parse_cache_lookup(struct parse_cache *cache, const char *line, size_t length,
+                                                   uint64_t hash)
+{
+    struct parse_cache_entry *entry;
+    
+    if (!cache->capacity)
+    {
+        return NULL;
+    }
+    
+    for (entry = *(cache->buckets + (hash & (cache->bucket_count - 1))); entry; entry = entry->chain)
+    {
+        if (entry->hash == hash && entry->line_length == length && memcmp(entry_line(entry), line, length) == 0)
+        {
+            if (entry != cache->newest)
+            {
+                unlink_entry(cache, entry);
+                link_newest(cache, entry);
+            }
+            ++cache->hits;
+            return entry;
+        }
+    }
+    
+    ++cache->misses;
+    
+    return NULL;
+}
+
+void parse_cache_insert(struct parse_cache *cache, const char *line, size_t length, uint64_t hash,
+                        const struct tokenizer *tokenizer)
+{
+    struct parse_cache_entry *entry;
+    struct parse_cache_entry **bucket;
+    size_t                   tokens_size;
+    
+    // A line with no tokens costs nothing to lex again.
+    if (!cache->capacity || !tokenizer->token_count)
+    {
+        return;
+    }
+    
+    tokens_size = tokenizer->token_count * sizeof(struct token);
+    entry       = (struct parse_cache_entry *) malloc(sizeof(struct parse_cache_entry) + tokens_size + length
+                                                      + tokenizer->text_length);
+    if (!entry)
+    {
+        return;
+    }
+    
+    if (cache->count == cache->capacity)
+    {
+        evict_oldest(cache);
+    }
+    
+    entry->hash        = hash;
+    entry->line_length = length;
+    entry->text_length = tokenizer->text_length;
+    entry->token_count = tokenizer->token_count;
+    memcpy(entry->data, tokenizer->tokens, tokens_size);
+    memcpy((char *) entry->data + tokens_size, line, length);
+    if (tokenizer->text_length) // a line of operators only has no words, and may have no text
+    {
+        memcpy((char *) entry->data + tokens_size + length, tokenizer->text, tokenizer->text_length);
+    }
+    
+    bucket       = cache->buckets + (hash & (cache->bucket_count - 1));
+    entry->chain = *bucket;
+    *bucket      = entry;
+    link_newest(cache, entry);
+    ++cache->count;
+}
+
+const struct token *parse_cache_tokens(const struct parse_cache_entry *entry)
+{
+    return (const struct token *) (const void *) entry->data;
+}
+
+const char *entry_line(const struct parse_cache_entry *entry)
+{
+    return (const char *) entry->data + entry->token_count * sizeof(struct token);
+}
+
+const char *parse_cache_text(const struct parse_cache_entry *entry)
+{
+    return entry_line(entry) + entry->line_length;
+}
+
+int parse_cache_resize(struct parse_cache *cache, size_t capacity)
+{
+    struct parse_cache_entry **buckets;
+    struct parse_cache_entry *entry;
+    size_t                   bucket_count;
+    
+    while (cache->count > capacity)
+    {
+        evict_oldest(cache);
+    }
+    
+    // One bucket per entry at most; the chains are rebuilt from the list by use.
+    for (bucket_count = 1; bucket_count < capacity; bucket_count *= 2)
+    {
+    }
+    if (!capacity)
+    {
+        free(cache->buckets);
+        cache->buckets      = NULL;
+        cache->bucket_count = 0;
+        cache->capacity     = 0;
+        return 0;
+    }
+    
+    buckets = (struct parse_cache_entry **) calloc(bucket_count, sizeof(struct parse_cache_entry *));
+    if (!buckets)
+    {
+        return -1;
+    }
+    for (entry = cache->oldest; entry; entry = entry->newer)
+    {
+        entry->chain = *(buckets + (entry->hash & (bucket_count - 1)));
+        *(buckets + (entry->hash & (bucket_count - 1))) = entry;
+    }
+    
+    free(cache->buckets);
+    cache->buckets      = buckets;
+    cache->bucket_count = bucket_count;
+    cache->capacity     = capacity;
+    
+    return 0;
+}
+
+void unlink_entry(struct parse_cache *cache, struct parse_cache_entry *entry)
+{
+    if (entry->newer)
+    {
+        entry->newer->older = entry->older;
+    } else
+    {
+        cache->newest = entry->older;
+    }
+    if (entry->older)
+    {
+        entry->older->newer = entry->newer;
+    } else
+    {
+        cache->oldest = entry->newer;
+    }
+}
+
+void link_newest(struct parse_cache *cache, struct parse_cache_entry *entry)
+{
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest)
+    {
+        cache->newest->newer = entry;
+    } else
+    {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+void evict_oldest(struct parse_cache *cache)
+{
+    struct parse_cache_entry *entry;
+    struct parse_cache_entry **link;
+    
+    entry = cache->oldest;
+    for (link = cache->buckets + (entry->hash & (cache->bucket_count - 1)); *link != entry; link = &(*link)->chain)
+    {
+    }
+    *link = entry->chain;
+    
+    unlink_entry(cache, entry);
+    --cache->count;
+    free(entry);
+}
+
+void parse_cache_destroy(struct supervisor *supvis, struct parse_cache *cache)
+{
+    struct parse_cache_entry *entry;
+    
+    while (cache->oldest)
+    {
+        entry         = cache->oldest;
+        cache->oldest = entry->newer;
+        free(entry);
+    }
+    free(cache->buckets);
+    supvis->mm->mm_free(supvis->mm, cache);
+}
@@ -0,0 +1,439 @@
+#include "../include/parse_cache.h"
+#include "../include/pattern.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+
+/**
+ * compile_pattern
+ * <p>
+ * Compile the text of a pattern into its parts.
+ * </p>
+ * @param pattern the pattern, with its text set
+ * @return 0 on success, -1 if memory ran out
+ */
+int compile_pattern(struct pattern *pattern);
+
+/**
+ * add_element
+ * <p>
+ * Add a part to a pattern. The parts are allocated for the longest pattern of its length, so
+ * this cannot fail.
+ * </p>
+ * @param pattern the pattern
+ * @param kind the kind of part
+ * @return the part
+ */
+struct pattern_element *add_element(struct pattern *pattern, enum pattern_kind kind);
+
+/**
+ * add_literal
+ * <p>
+ * Add a byte that matches only itself to a pattern, extending the last part if it is literal.
+ * </p>
+ * @param pattern the pattern
+ * @param literals_length the bytes used in pattern->literals, updated
+ * @param c the byte
+ */
+void add_literal(struct pattern *pattern, size_t *literals_length, char c);
+
+/**
+ * compile_set
+ * <p>
+ * Compile the bracket expression at text into a set of bytes.
+ * </p>
+ * @param text the bracket expression, just past its '['
+ * @param set the set, one bit for each byte
+ * @return the position past the closing ']', or NULL if there is none (the '[' is then literal)
+ */
+const char *compile_set(const char *text, unsigned char *set);
+
+/**
+ * add_class
+ * <p>
+ * Add the bytes of a character class, such as the alpha of [:alpha:], to a set.
+ * </p>
+ * @param name the name of the class (not null terminated)
+ * @param length the length of the name
+ * @param set the set
+ * @return true if the class exists, false otherwise
+ */
+bool add_class(const char *name, size_t length, unsigned char *set);
+
+/**
+ * free_pattern
+ * <p>
+ * Free a compiled pattern.
+ * </p>
+ * @param pattern the pattern
+ */
+void free_pattern(struct pattern *pattern);
+
+const struct pattern *pattern_compile(struct pattern_cache *cache, const char *text, size_t length)
+{
+    struct pattern **slot;
+    struct pattern *pattern;
+    uint64_t       hash;
+    
+    hash    = parse_cache_hash(text, length);
+    slot    = cache->entries + (hash & (PATTERN_CACHE_SIZE - 1));
+    pattern = *slot;
+    if (pattern && pattern->hash == hash && pattern->length == length && memcmp(pattern->text, text, length) == 0)
+    {
+        ++cache->hits;
+        return pattern;
+    }
+    ++cache->misses;
+    
+    pattern = (struct pattern *) calloc(1, sizeof(struct pattern) + length + 1);
+    if (!pattern)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pattern->hash   = hash;
+    pattern->length = length;
+    memcpy(pattern->text, text, length);
+    *(pattern->text + length) = '\0';
+    
+    if (compile_pattern(pattern) == -1)
+    {
+        free_pattern(pattern);
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    if (*slot)
+    {
+        free_pattern(*slot);
+    }
+    *slot = pattern;
+    
+    return pattern;
+}
+
+int compile_pattern(struct pattern *pattern)
+{
+    struct pattern_element *element;
+    const char             *cursor;
+    const char             *end;
+    size_t                 literals_length;
+    unsigned char          set[32];
+    
+    // Every byte makes at most one part and one literal byte.
+    pattern->elements = (struct pattern_element *) calloc(pattern->length + 1, sizeof(struct pattern_element));
+    pattern->literals = (char *) malloc(pattern->length + 1);
+    if (!pattern->elements || !pattern->literals)
+    {
+        return -1;
+    }
+    
+    pattern->fixed  = true;
+    literals_length = 0;
+    cursor          = pattern->text;
+    while (*cursor)
+    {
+        switch (*cursor)
+        {
+            case '*':
+            {
+                if (!pattern->element_count
+                    || (pattern->elements + pattern->element_count - 1)->kind != PATTERN_STAR)
+                {
+                    (void) add_element(pattern, PATTERN_STAR);
+                }
+                pattern->fixed = false;
+                ++cursor;
+                break;
+            }
+            case '?':
+            {
+                (void) add_element(pattern, PATTERN_ANY);
+                ++pattern->min_length;
+                ++cursor;
+                break;
+            }
+            case '[':
+            {
+                end = compile_set(cursor + 1, set);
+                if (!end)
+                {
+                    add_literal(pattern, &literals_length, *cursor++);
+                    break;
+                }
+                element = add_element(pattern, PATTERN_SET);
+                memcpy(element->set, set, sizeof(set));
+                ++pattern->min_length;
+                cursor = end;
+                break;
+            }
+            case '\\':
+            {
+                if (*(cursor + 1))
+                {
+                    ++cursor;
+                }
+                add_literal(pattern, &literals_length, *cursor++);
+                break;
+            }
+            default:
+            {
+                add_literal(pattern, &literals_length, *cursor++);
+            }
+        }
+    }
+    
+    return 0;
+}
+
+struct pattern_element *add_element(struct pattern *pattern, enum pattern_kind kind)
+{
+    struct pattern_element *element;
+    
+    element       = pattern->elements + pattern->element_count++;
+    element->kind = kind;
+    
+    return element;
+}
+
+void add_literal(struct pattern *pattern, size_t *literals_length, char c)
+{
+    struct pattern_element *element;
+    
+    element = (pattern->element_count) ? pattern->elements + pattern->element_count - 1 : NULL;
+    if (!element || element->kind != PATTERN_LITERAL)
+    {
+        element         = add_element(pattern, PATTERN_LITERAL);
+        element->offset = *literals_length;
+    }
+    
+    *(pattern->literals + (*literals_length)++) = c;
+    ++element->length;
+    ++pattern->min_length;
+}
+
+const char *compile_set(const char *text, unsigned char *set)
+{
+    const char    *cursor;
+    const char    *end;
+    unsigned char low;
+    unsigned char high;
+    bool          negated;
+    
+    memset(set, 0, 32);
+    cursor  = text;
+    negated = (*cursor == '!' || *cursor == '^');
+    if (negated)
+    {
+        ++cursor;
+    }
+    
+    // A ']' first in the set is a member, not its end.
+    text = cursor;
+    while (*cursor && (*cursor != ']' || cursor == text))
+    {
+        if (*cursor == '[' && *(cursor + 1) == ':')
+        {
+            end = strstr(cursor + 2, ":]");
+            if (end && add_class(cursor + 2, (size_t) (end - cursor - 2), set))
+            {
+                cursor = end + 2;
+                continue;
+            }
+        }
+        
+        if (*cursor == '\\' && *(cursor + 1))
+        {
+            ++cursor;
+        }
+        low  = (unsigned char) *cursor++;
+        high = low;
+        if (*cursor == '-' && *(cursor + 1) && *(cursor + 1) != ']')
+        {
+            ++cursor;
+            if (*cursor == '\\' && *(cursor + 1))
+            {
+                ++cursor;
+            }
+            high = (unsigned char) *cursor++;
+        }
+        for (unsigned int byte = low; byte <= high; ++byte)
+        {
+            *(set + byte / 8) |= (unsigned char) (1U << (byte % 8));
+        }
+    }
+    
+    if (!*cursor)
+    {
+        return NULL;
+    }
+    
+    if (negated)
+    {
+        for (size_t i = 0; i < 32; ++i)
+        {
+            *(set + i) = (unsigned char) ~*(set + i);
+        }
+    }
+    
+    return cursor + 1;
+}
+
+bool add_class(const char *name, size_t length, unsigned char *set)
+{
+    int (*test)(int);
+    
+    test = NULL;
+    if (length == 5 && strncmp(name, "alnum", length) == 0)
+    {
+        test = isalnum;
+    } else if (length == 5 && strncmp(name, "alpha", length) == 0)
+    {
+        test = isalpha;
+    } else if (length == 5 && strncmp(name, "blank", length) == 0)
+    {
+        test = isblank;
+    } else if (length == 5 && strncmp(name, "cntrl", length) == 0)
+    {
+        test = iscntrl;
+    } else if (length == 5 && strncmp(name, "digit", length) == 0)
+    {
+        test = isdigit;
+    } else if (length == 5 && strncmp(name, "graph", length) == 0)
+    {
+        test = isgraph;
+    } else if (length == 5 && strncmp(name, "lower", length) == 0)
+    {
+        test = islower;
+    } else if (length == 5 && strncmp(name, "print", length) == 0)
+    {
+        test = isprint;
+    } else if (length == 5 && strncmp(name, "punct", length) == 0)
+    {
+        test = ispunct;
+    } else if (length == 5 && strncmp(name, "space", length) == 0)
+    {
+        test = isspace;
+    } else if (length == 5 && strncmp(name, "upper", length) == 0)
+    {
+        test = isupper;
+    } else if (length == 6 && strncmp(name, "xdigit", length) == 0)
+    {
+        test = isxdigit;
+    }
+    
+    if (!test)
+    {
+        return false;
+    }
+    
+    for (unsigned int byte = 0; byte < 256; ++byte)
+    {
+        if (test((int) byte))
+        {
+            *(set + byte / 8) |= (unsigned char) (1U << (byte % 8));
+        }
+    }
+    
+    return true;
+}
+
+bool pattern_match(const struct pattern *pattern, const char *text, size_t length)
+{
+    const struct pattern_element *element;
+    size_t                       part;
+    size_t                       position;
+    size_t                       star_part;
+    size_t                       star_position;
+    bool                         starred;
+    bool                         matched;
+    unsigned char                byte;
+    
+    if (length < pattern->min_length || (pattern->fixed && length != pattern->min_length))
+    {
+        return false;
+    }
+    
+    // On a mismatch, the last * takes one more byte and the parts after it are tried again.
+    part          = 0;
+    position      = 0;
+    star_part     = 0;
+    star_position = 0;
+    starred       = false;
+    while (part < pattern->element_count || position < length)
+    {
+        matched = false;
+        if (part < pattern->element_count)
+        {
+            element = pattern->elements + part;
+            switch (element->kind)
+            {
+                case PATTERN_STAR:
+                {
+                    starred       = true;
+                    star_part     = part;
+                    star_position = position;
+                    ++part;
+                    continue;
+                }
+                case PATTERN_LITERAL:
+                {
+                    matched = length - position >= element->length
+                              && memcmp(text + position, pattern->literals + element->offset, element->length) == 0;
+                    position += (matched) ? element->length : 0;
+                    break;
+                }
+                case PATTERN_ANY:
+                {
+                    matched = position < length;
+                    position += (matched) ? 1 : 0;
+                    break;
+                }
+                case PATTERN_SET:
+                {
+                    byte    = (position < length) ? (unsigned char) *(text + position) : 0;
+                    matched = position < length && (*(element->set + byte / 8) & (1U << (byte % 8)));
+                    position += (matched) ? 1 : 0;
+                    break;
+                }
+                default:
+                {
+                }
+            }
+        }
+        
+        if (matched)
+        {
+            ++part;
+            continue;
+        }
+        if (!starred || star_position >= length)
+        {
+            return false;
+        }
+        part     = star_part + 1;
+        position = ++star_position;
+    }
+    
+    return true;
+}
+
+void free_pattern(struct pattern *pattern)
+{
+    free(pattern->elements);
+    free(pattern->literals);
+    free(pattern);
+}
+
+void pattern_cache_destroy(struct pattern_cache *cache)
+{
+    for (size_t i = 0; i < PATTERN_CACHE_SIZE; ++i)
+    {
+        if (*(cache->entries + i))
+        {
+            free_pattern(*(cache->entries + i));
+        }
+    }
+    free(cache);
+}
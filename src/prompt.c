@@ -0,0 +1,308 @@
+#include "../include/prompt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GIT_HEADS_PREFIX "ref: refs/heads/"
+#define GIT_REF_PREFIX "ref: "
+#define GIT_DIR_PREFIX "gitdir: "
+#define GIT_ABBREV_LENGTH 7
+
+/**
+ * prompt_worker_run
+ * <p>
+ * The body of the worker's thread. Answer the latest request whenever it is newer than the
+ * last one answered, until told to stop.
+ * </p>
+ * @param arg the worker
+ * @return NULL
+ */
+void *prompt_worker_run(void *arg);
+
+/**
+ * read_small_file
+ * <p>
+ * Read a file of at most size - 1 bytes into a buffer and null terminate it, dropping a
+ * trailing newline.
+ * </p>
+ * @param path the file to read
+ * @param buffer the buffer into which to read
+ * @param size the size of the buffer
+ * @return the number of bytes kept, or -1 on failure
+ */
+ssize_t read_small_file(const char *path, char *buffer, size_t size);
+
+/**
+ * read_git_branch
+ * <p>
+ * Read the branch from the HEAD of a git repository whose top level is dir. Follows a .git file
+ * ("gitdir: path") as used by worktrees and submodules.
+ * </p>
+ * @param dir the directory
+ * @param branch the buffer into which to copy the branch
+ * @param size the size of the buffer
+ * @return true if dir is the top level of a git repository, false otherwise
+ */
+bool read_git_branch(const char *dir, char *branch, size_t size);
+
+/**
+ * read_hg_branch
+ * <p>
+ * Read the branch of a mercurial repository whose top level is dir.
+ * </p>
+ * @param dir the directory
+ * @param branch the buffer into which to copy the branch
+ * @param size the size of the buffer
+ * @return true if dir is the top level of a mercurial repository, false otherwise
+ */
+bool read_hg_branch(const char *dir, char *branch, size_t size);
+
+struct prompt_worker *prompt_worker_create(struct supervisor *supvis)
+{
+    struct prompt_worker *worker;
+    pthread_condattr_t   attr;
+    sigset_t             all_signals;
+    sigset_t             old_signals;
+    int                  status;
+    
+    worker = mm_calloc(1, sizeof(struct prompt_worker), supvis->mm, __FILE__, __func__, __LINE__);
+    if (!worker)
+    {
+        return NULL;
+    }
+    
+    (void) pthread_mutex_init(&worker->lock, NULL);
+    (void) pthread_cond_init(&worker->requested, NULL);
+    (void) pthread_condattr_init(&attr);
+    (void) pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    (void) pthread_cond_init(&worker->completed, &attr);
+    (void) pthread_condattr_destroy(&attr);
+    
+    // Signals such as SIGINT are for the shell's own thread; the worker never handles them.
+    (void) sigfillset(&all_signals);
+    (void) pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    status = pthread_create(&worker->thread, NULL, prompt_worker_run, worker);
+    (void) pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    
+    if (status != 0)
+    {
+        (void) pthread_cond_destroy(&worker->completed);
+        (void) pthread_cond_destroy(&worker->requested);
+        (void) pthread_mutex_destroy(&worker->lock);
+        supvis->mm->mm_free(supvis->mm, worker);
+        errno = status;
+        return NULL;
+    }
+    
+    return worker;
+}
+
+void *prompt_worker_run(void *arg)
+{
+    struct prompt_worker *worker;
+    char                 dir[PATH_MAX];
+    char                 branch[PROMPT_BRANCH_MAX];
+    unsigned long        request;
+    
+    worker = (struct prompt_worker *) arg;
+    
+    (void) pthread_mutex_lock(&worker->lock);
+    while (!worker->stop)
+    {
+        if (worker->answer == worker->request)
+        {
+            (void) pthread_cond_wait(&worker->requested, &worker->lock);
+            continue;
+        }
+        
+        request = worker->request;
+        memcpy(dir, worker->cwd, sizeof(dir));
+        (void) pthread_mutex_unlock(&worker->lock);
+        
+        if (!find_vcs_branch(dir, branch, sizeof(branch)))
+        {
+            *branch = '\0';
+        }
+        
+        (void) pthread_mutex_lock(&worker->lock);
+        memcpy(worker->branch, branch, sizeof(branch));
+        worker->answer = request;
+        (void) pthread_cond_broadcast(&worker->completed);
+    }
+    (void) pthread_mutex_unlock(&worker->lock);
+    
+    return NULL;
+}
+
+void prompt_worker_branch(struct prompt_worker *worker, const char *cwd, long deadline, char *branch, size_t size)
+{
+    struct timespec wait_until;
+    unsigned long   request;
+    
+    (void) clock_gettime(CLOCK_MONOTONIC, &wait_until);
+    wait_until.tv_sec  += deadline / 1000;
+    wait_until.tv_nsec += (deadline % 1000) * 1000000L;
+    if (wait_until.tv_nsec >= 1000000000L)
+    {
+        ++wait_until.tv_sec;
+        wait_until.tv_nsec -= 1000000000L;
+    }
+    
+    (void) pthread_mutex_lock(&worker->lock);
+    
+    (void) strncpy(worker->cwd, cwd, sizeof(worker->cwd) - 1);
+    request = ++worker->request;
+    (void) pthread_cond_signal(&worker->requested);
+    
+    while (worker->answer < request)
+    {
+        if (pthread_cond_timedwait(&worker->completed, &worker->lock, &wait_until) == ETIMEDOUT)
+        {
+            break; // show the last branch computed
+        }
+    }
+    
+    (void) strncpy(branch, worker->branch, size - 1);
+    *(branch + size - 1) = '\0';
+    
+    (void) pthread_mutex_unlock(&worker->lock);
+}
+
+void prompt_worker_destroy(struct supervisor *supvis, struct prompt_worker *worker)
+{
+    (void) pthread_mutex_lock(&worker->lock);
+    worker->stop = true;
+    (void) pthread_cond_signal(&worker->requested);
+    (void) pthread_mutex_unlock(&worker->lock);
+    
+    (void) pthread_join(worker->thread, NULL);
+    
+    (void) pthread_cond_destroy(&worker->completed);
+    (void) pthread_cond_destroy(&worker->requested);
+    (void) pthread_mutex_destroy(&worker->lock);
+    supvis->mm->mm_free(supvis->mm, worker);
+}
+
+bool find_vcs_branch(const char *dir, char *branch, size_t size)
+{
+    char   path[PATH_MAX];
+    char   *slash;
+    
+    (void) strncpy(path, dir, sizeof(path) - 1);
+    *(path + sizeof(path) - 1) = '\0';
+    
+    // Walk up from dir to the root, stopping at the first repository found.
+    for (;;)
+    {
+        if (read_git_branch(path, branch, size) || read_hg_branch(path, branch, size))
+        {
+            return true;
+        }
+        
+        slash = strrchr(path, '/');
+        if (!slash || (slash == path && !*(slash + 1)))
+        {
+            return false;
+        }
+        *(slash + ((slash == path) ? 1 : 0)) = '\0';
+    }
+}
+
+ssize_t read_small_file(const char *path, char *buffer, size_t size)
+{
+    int     fd;
+    ssize_t length;
+    
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    
+    length = read(fd, buffer, size - 1);
+    (void) close(fd);
+    if (length == -1)
+    {
+        return -1;
+    }
+    
+    if (length > 0 && *(buffer + length - 1) == '\n')
+    {
+        --length;
+    }
+    *(buffer + length) = '\0';
+    
+    return length;
+}
+
+bool read_git_branch(const char *dir, char *branch, size_t size)
+{
+    char path[PATH_MAX];
+    char git_dir[PATH_MAX];
+    char head[PROMPT_BRANCH_MAX + sizeof(GIT_HEADS_PREFIX)];
+    int  length;
+    
+    length = snprintf(path, sizeof(path), "%s/.git", (strcmp(dir, "/") == 0) ? "" : dir);
+    if (length < 0 || (size_t) length >= sizeof(path))
+    {
+        return false;
+    }
+    
+    // .git is usually a directory, but is a file naming the real one in worktrees and submodules.
+    if (read_small_file(path, git_dir, sizeof(git_dir)) > 0 && strncmp(git_dir, GIT_DIR_PREFIX, strlen(GIT_DIR_PREFIX)) == 0)
+    {
+        const char *target;
+        
+        target = git_dir + strlen(GIT_DIR_PREFIX);
+        length = (*target == '/') ? snprintf(path, sizeof(path), "%s/HEAD", target)
+                                  : snprintf(path, sizeof(path), "%s/%s/HEAD", dir, target);
+    } else
+    {
+        length = snprintf(path, sizeof(path), "%s/.git/HEAD", (strcmp(dir, "/") == 0) ? "" : dir);
+    }
+    if (length < 0 || (size_t) length >= sizeof(path) || read_small_file(path, head, sizeof(head)) == -1)
+    {
+        return false;
+    }
+    
+    if (strncmp(head, GIT_HEADS_PREFIX, strlen(GIT_HEADS_PREFIX)) == 0)
+    {
+        (void) strncpy(branch, head + strlen(GIT_HEADS_PREFIX), size - 1);
+    } else if (strncmp(head, GIT_REF_PREFIX, strlen(GIT_REF_PREFIX)) == 0)
+    {
+        (void) strncpy(branch, head + strlen(GIT_REF_PREFIX), size - 1);
+    } else // detached HEAD holds a commit hash
+    {
+        *(head + GIT_ABBREV_LENGTH) = '\0';
+        (void) strncpy(branch, head, size - 1);
+    }
+    *(branch + size - 1) = '\0';
+    
+    return true;
+}
+
+bool read_hg_branch(const char *dir, char *branch, size_t size)
+{
+    char path[PATH_MAX];
+    int  length;
+    
+    length = snprintf(path, sizeof(path), "%s/.hg", (strcmp(dir, "/") == 0) ? "" : dir);
+    if (length < 0 || (size_t) length >= sizeof(path) || access(path, F_OK) == -1)
+    {
+        return false;
+    }
+    
+    length = snprintf(path, sizeof(path), "%s/.hg/branch", (strcmp(dir, "/") == 0) ? "" : dir);
+    if (length < 0 || (size_t) length >= sizeof(path) || read_small_file(path, branch, size) <= 0)
+    {
+        (void) strncpy(branch, "default", size - 1); // no branch file until a named branch is used
+        *(branch + size - 1) = '\0';
+    }
+    
+    return true;
+}
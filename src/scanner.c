@@ -0,0 +1,379 @@
+#include "../include/scanner.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * is_structural
+ * <p>
+ * Check whether a byte belongs in the structural index.
+ * </p>
+ * @param c the byte
+ * @return true if the byte is structural, false otherwise
+ */
+bool is_structural(char c);
+
+/**
+ * reserve_positions
+ * <p>
+ * Make room in the index for more offsets.
+ * </p>
+ * @param index the index
+ * @param needed the number of offsets about to be added
+ * @return 0 on success, -1 on failure
+ */
+int reserve_positions(struct scan_index *index, size_t needed);
+
+/**
+ * push_mask
+ * <p>
+ * Add the offsets of the set bits of a block's match mask to the index.
+ * </p>
+ * @param index the index
+ * @param block the offset of the block
+ * @param mask one bit per byte of the block, set for structural bytes
+ * @return 0 on success, -1 on failure
+ */
+int push_mask(struct scan_index *index, size_t block, uint32_t mask);
+
+/**
+ * scan_scalar
+ * <p>
+ * Index structural bytes one at a time.
+ * </p>
+ * @param index the index
+ * @param text the script
+ * @param offset the offset at which to start
+ * @param length the length of the script
+ * @return 0 on success, -1 on failure
+ */
+int scan_scalar(struct scan_index *index, const char *text, size_t offset, size_t length);
+
+#if defined(__SSE2__)
+/**
+ * scan_sse2
+ * <p>
+ * Index structural bytes 16 at a time.
+ * </p>
+ * @param index the index
+ * @param text the script
+ * @param length the length of the script
+ * @param offset set to the offset of the first byte not scanned
+ * @return 0 on success, -1 on failure
+ */
+int scan_sse2(struct scan_index *index, const char *text, size_t length, size_t *offset);
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * scan_avx2
+ * <p>
+ * Index structural bytes 32 at a time. Only call if the processor supports AVX2.
+ * </p>
+ * @param index the index
+ * @param text the script
+ * @param length the length of the script
+ * @param offset set to the offset of the first byte not scanned
+ * @return 0 on success, -1 on failure
+ */
+int scan_avx2(struct scan_index *index, const char *text, size_t length, size_t *offset);
+#endif
+
+int scan_structure(struct scan_index *index, const char *text, size_t length)
+{
+    size_t offset;
+    int    status;
+    
+    index->count  = 0;
+    index->cursor = 0;
+    
+    // Most scripts are a few percent structural bytes; start from there and grow as needed.
+    if (reserve_positions(index, length / 16 + 32) == -1)
+    {
+        return -1;
+    }
+    
+    offset = 0;
+    status = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        status = scan_avx2(index, text, length, &offset);
+    }
+#endif
+#if defined(__SSE2__)
+    if (!status && offset == 0)
+    {
+        status = scan_sse2(index, text, length, &offset);
+    }
+#endif
+    
+    if (status == -1)
+    {
+        return -1;
+    }
+    
+    return scan_scalar(index, text, offset, length);
+}
+
+bool is_structural(char c)
+{
+    switch (c)
+    {
+        case '\n':
+        case '\'':
+        case '"':
+        case '\\':
+        case '#':
+        case '<':
+        case '>':
+        case '|':
+        case ';':
+        case '&':
+        {
+            return true;
+        }
+        default:
+        {
+            return false;
+        }
+    }
+}
+
+int reserve_positions(struct scan_index *index, size_t needed)
+{
+    size_t capacity;
+    size_t *positions;
+    
+    if (index->count + needed <= index->capacity)
+    {
+        return 0;
+    }
+    
+    capacity = (index->capacity) ? index->capacity : 32;
+    while (capacity < index->count + needed)
+    {
+        capacity *= 2;
+    }
+    
+    positions = (size_t *) realloc(index->positions, capacity * sizeof(size_t));
+    if (!positions)
+    {
+        return -1;
+    }
+    
+    index->positions = positions;
+    index->capacity  = capacity;
+    
+    return 0;
+}
+
+int push_mask(struct scan_index *index, size_t block, uint32_t mask)
+{
+    if (reserve_positions(index, (size_t) __builtin_popcount(mask)) == -1)
+    {
+        return -1;
+    }
+    
+    while (mask)
+    {
+        *(index->positions + index->count++) = block + (size_t) __builtin_ctz(mask);
+        mask &= mask - 1;
+    }
+    
+    return 0;
+}
+
+int scan_scalar(struct scan_index *index, const char *text, size_t offset, size_t length)
+{
+    for (; offset < length; ++offset)
+    {
+        if (!is_structural(*(text + offset)))
+        {
+            continue;
+        }
+        
+        if (reserve_positions(index, 1) == -1)
+        {
+            return -1;
+        }
+        *(index->positions + index->count++) = offset;
+    }
+    
+    return 0;
+}
+
+#if defined(__SSE2__)
+int scan_sse2(struct scan_index *index, const char *text, size_t length, size_t *offset)
+{
+    const __m128i newline   = _mm_set1_epi8('\n');
+    const __m128i squote    = _mm_set1_epi8('\'');
+    const __m128i dquote    = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i hash      = _mm_set1_epi8('#');
+    const __m128i less      = _mm_set1_epi8('<');
+    const __m128i great     = _mm_set1_epi8('>');
+    const __m128i pipe      = _mm_set1_epi8('|');
+    const __m128i semicolon = _mm_set1_epi8(';');
+    const __m128i ampersand = _mm_set1_epi8('&');
+    
+    for (*offset = 0; *offset + sizeof(__m128i) <= length; *offset += sizeof(__m128i))
+    {
+        __m128i  block;
+        __m128i  hits;
+        uint32_t mask;
+        
+        block = _mm_loadu_si128((const __m128i *) (const void *) (text + *offset));
+        hits  = _mm_or_si128(_mm_cmpeq_epi8(block, newline), _mm_cmpeq_epi8(block, squote));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(block, dquote));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(block, backslash));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(block, hash));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(block, less));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(block, great));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(block, pipe));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(block, semicolon));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(block, ampersand));
+        mask  = (uint32_t) _mm_movemask_epi8(hits);
+        
+        if (mask && push_mask(index, *offset, mask) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+int scan_avx2(struct scan_index *index, const char *text, size_t length, size_t *offset)
+{
+    const __m256i newline   = _mm256_set1_epi8('\n');
+    const __m256i squote    = _mm256_set1_epi8('\'');
+    const __m256i dquote    = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i hash      = _mm256_set1_epi8('#');
+    const __m256i less      = _mm256_set1_epi8('<');
+    const __m256i great     = _mm256_set1_epi8('>');
+    const __m256i pipe      = _mm256_set1_epi8('|');
+    const __m256i semicolon = _mm256_set1_epi8(';');
+    const __m256i ampersand = _mm256_set1_epi8('&');
+    
+    for (*offset = 0; *offset + sizeof(__m256i) <= length; *offset += sizeof(__m256i))
+    {
+        __m256i  block;
+        __m256i  hits;
+        uint32_t mask;
+        
+        block = _mm256_loadu_si256((const __m256i *) (const void *) (text + *offset));
+        hits  = _mm256_or_si256(_mm256_cmpeq_epi8(block, newline), _mm256_cmpeq_epi8(block, squote));
+        hits  = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, dquote));
+        hits  = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, backslash));
+        hits  = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, hash));
+        hits  = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, less));
+        hits  = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, great));
+        hits  = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, pipe));
+        hits  = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, semicolon));
+        hits  = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, ampersand));
+        mask  = (uint32_t) _mm256_movemask_epi8(hits);
+        
+        if (mask && push_mask(index, *offset, mask) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+#endif
+
+void scan_statement(struct scan_index *index, const char *text, size_t start, size_t length,
+                    struct statement *statement)
+{
+    size_t position;
+    char   quote;
+    char   c;
+    
+    statement->end     = length;
+    statement->comment = length;
+    
+    while (index->cursor < index->count && *(index->positions + index->cursor) < start)
+    {
+        ++index->cursor;
+    }
+    
+    quote = '\0';
+    for (; index->cursor < index->count; ++index->cursor)
+    {
+        position = *(index->positions + index->cursor);
+        c        = *(text + position);
+        
+        if (c == '\\' && quote != '\'')
+        {
+            // The escaped byte is only in the index if it is structural itself.
+            if (index->cursor + 1 < index->count && *(index->positions + index->cursor + 1) == position + 1)
+            {
+                ++index->cursor;
+            }
+            continue;
+        }
+        
+        if (quote)
+        {
+            if (c == quote)
+            {
+                quote = '\0';
+            }
+            continue;
+        }
+        
+        switch (c)
+        {
+            case '\'':
+            case '"':
+            {
+                quote = c;
+                break;
+            }
+            case '\n':
+            {
+                statement->end = position;
+                ++index->cursor;
+                return;
+            }
+            case '#':
+            {
+                // Only a '#' at the start of a word begins a comment; the comment runs to the newline.
+                if (position == start || strchr(" \t;&|<>", *(text + position - 1)))
+                {
+                    statement->comment = position;
+                    while (index->cursor + 1 < index->count
+                           && *(text + *(index->positions + index->cursor + 1)) != '\n')
+                    {
+                        ++index->cursor;
+                    }
+                }
+                break;
+            }
+            default: // the metacharacters are left to the tokenizer
+            {
+                break;
+            }
+        }
+    }
+}
+
+void scan_free(struct scan_index *index)
+{
+    free(index->positions);
+    index->positions = NULL;
+    index->count     = 0;
+    index->capacity  = 0;
+    index->cursor    = 0;
+}
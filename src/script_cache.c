@@ -0,0 +1,537 @@
+#include "../include/parse_cache.h"
+#include "../include/scanner.h"
+#include "../include/script_cache.h"
+
+#include <dc_posix/dc_stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * cache_path
+ * <p>
+ * Get the path of the compiled form of a script: a file in the cache directory named by a hash
+ * of the script's absolute path. The cache directory is created if needed.
+ * </p>
+ * @param supvis the supervisor object
+ * @param script_path the path of the script
+ * @param path filled with the path of the compiled script
+ * @param size the size of path
+ * @return 0 on success, -1 if there is no cache directory or the path does not fit in size
+ */
+int cache_path(struct supervisor *supvis, const char *script_path, char *path, size_t size);
+
+/**
+ * map_cache
+ * <p>
+ * Map a compiled script file and check that it was compiled from the script as it is now.
+ * </p>
+ * @param cache filled with the mapping
+ * @param path the path of the compiled script
+ * @param status the status of the script
+ * @param script_hash the hash of the script
+ * @return 0 if the file is up to date, -1 otherwise
+ */
+int map_cache(struct script_cache *cache, const char *path, const struct stat *status, uint64_t script_hash);
+
+/**
+ * check_cache
+ * <p>
+ * Check that the header of a compiled script matches the script and that every statement lies
+ * within the file, so a damaged file is rebuilt rather than trusted.
+ * </p>
+ * @param cache the compiled script, with data and length set
+ * @param status the status of the script
+ * @param script_hash the hash of the script
+ * @return 0 if the compiled script can be used, -1 otherwise
+ */
+int check_cache(struct script_cache *cache, const struct stat *status, uint64_t script_hash);
+
+/**
+ * compile_script
+ * <p>
+ * Tokenize every statement of a script, the way read_script_line does, into a compiled script
+ * held in memory.
+ * </p>
+ * @param supvis the supervisor object
+ * @param cache filled with the compiled script
+ * @param status the status of the script
+ * @param script the text of the script
+ * @param script_hash the hash of the script
+ * @param max_text_length the longest command accepted
+ * @return 0 on success, -1 on failure
+ */
+int compile_script(struct supervisor *supvis, struct script_cache *cache, const struct stat *status,
+                   const char *script, uint64_t script_hash, size_t max_text_length);
+
+/**
+ * append_bytes
+ * <p>
+ * Append bytes to a growable buffer.
+ * </p>
+ * @param buffer the buffer
+ * @param length the bytes used in buffer, updated
+ * @param capacity the bytes allocated for buffer, updated
+ * @param bytes the bytes to append
+ * @param count the number of bytes
+ * @return 0 on success, -1 on failure
+ */
+int append_bytes(char **buffer, size_t *length, size_t *capacity, const void *bytes, size_t count);
+
+/**
+ * write_cache
+ * <p>
+ * Write a compiled script to a file, replacing it atomically.
+ * </p>
+ * @param cache the compiled script
+ * @param path the path of the file
+ * @return 0 on success, -1 on failure
+ */
+int write_cache(const struct script_cache *cache, const char *path);
+
+/**
+ * set_sections
+ * <p>
+ * Point the statements, tokens and words of a compiled script into its data.
+ * </p>
+ * @param cache the compiled script
+ */
+void set_sections(struct script_cache *cache);
+
+struct script_cache *script_cache_open(struct supervisor *supvis, const char *path, const struct stat *status,
+                                       const char *script, size_t max_text_length)
+{
+    struct script_cache *cache;
+    char                file[PATH_MAX];
+    uint64_t            script_hash;
+    bool                cached;
+    
+    cache = mm_calloc(1, sizeof(struct script_cache), supvis->mm, __FILE__, __func__, __LINE__);
+    if (!cache)
+    {
+        errno = 0;
+        return NULL;
+    }
+    
+    script_hash = parse_cache_hash(script, (size_t) status->st_size);
+    cached      = cache_path(supvis, path, file, sizeof(file)) == 0;
+    if (cached && map_cache(cache, file, status, script_hash) == 0)
+    {
+        return cache;
+    }
+    
+    if (compile_script(supvis, cache, status, script, script_hash, max_text_length) == -1)
+    {
+        supvis->mm->mm_free(supvis->mm, cache);
+        errno = 0;
+        return NULL;
+    }
+    
+    if (cached)
+    {
+        (void) write_cache(cache, file);
+    }
+    errno = 0; // the script runs just the same if its compiled form could not be saved
+    
+    return cache;
+}
+
+int cache_path(struct supervisor *supvis, const char *script_path, char *path, size_t size)
+{
+    char     *dir;
+    char     *home;
+    char     real[PATH_MAX];
+    char     name[sizeof("/0123456789abcdef" SCRIPT_CACHE_SUFFIX)];
+    int      length;
+    size_t   used;
+    uint64_t hash;
+    
+    if (!realpath(script_path, real))
+    {
+        return -1;
+    }
+    hash = parse_cache_hash(real, strlen(real));
+    
+    dir = dc_getenv(supvis->env, "CSH_CACHE_DIR");
+    if (dir)
+    {
+        if (!*dir) // set but empty turns compiled scripts off
+        {
+            return -1;
+        }
+        (void) mkdir(dir, 0700);
+        length = snprintf(path, size, "%s/%016llx%s", dir, (unsigned long long) hash, SCRIPT_CACHE_SUFFIX);
+        return (length < 0 || (size_t) length >= size) ? -1 : 0;
+    }
+    
+    dir  = dc_getenv(supvis->env, "XDG_CACHE_HOME");
+    home = dc_getenv(supvis->env, "HOME");
+    if (dir && *dir)
+    {
+        length = snprintf(path, size, "%s", dir);
+    } else if (home)
+    {
+        length = snprintf(path, size, "%s/.cache", home);
+    } else
+    {
+        return -1;
+    }
+    if (length < 0 || (size_t) length >= size)
+    {
+        return -1;
+    }
+    (void) mkdir(path, 0700);
+    
+    // A path cut short would name some other directory or file, so the script is not cached.
+    used = (size_t) length;
+    if (used + strlen("/csh") >= size)
+    {
+        return -1;
+    }
+    memcpy(path + used, "/csh", strlen("/csh") + 1);
+    (void) mkdir(path, 0700);
+    
+    used += strlen("/csh");
+    length = snprintf(name, sizeof(name), "/%016llx%s", (unsigned long long) hash, SCRIPT_CACHE_SUFFIX);
+    if (length < 0 || used + (size_t) length >= size)
+    {
+        return -1;
+    }
+    memcpy(path + used, name, (size_t) length + 1);
+    
+    return 0;
+}
+
+int map_cache(struct script_cache *cache, const char *path, const struct stat *status, uint64_t script_hash)
+{
+    struct stat file_status;
+    int         fd;
+    void        *data;
+    
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (fstat(fd, &file_status) == -1 || (size_t) file_status.st_size < sizeof(struct script_cache_header))
+    {
+        (void) close(fd);
+        return -1;
+    }
+    
+    data = mmap(NULL, (size_t) file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void) close(fd);
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+    
+    cache->data   = (char *) data;
+    cache->length = (size_t) file_status.st_size;
+    cache->mapped = true;
+    if (check_cache(cache, status, script_hash) == -1)
+    {
+        (void) munmap(cache->data, cache->length);
+        cache->data   = NULL;
+        cache->length = 0;
+        cache->mapped = false;
+        return -1;
+    }
+    
+    return 0;
+}
+
+int check_cache(struct script_cache *cache, const struct stat *status, uint64_t script_hash)
+{
+    const struct script_cache_header *header;
+    const struct cached_statement    *statement;
+    size_t                           token_total;
+    size_t                           text_total;
+    
+    header = (const struct script_cache_header *) (const void *) cache->data;
+    if (memcmp(header->magic, SCRIPT_CACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SCRIPT_CACHE_VERSION || header->token_size != sizeof(struct token)
+        || header->length != cache->length || header->script_size != (uint64_t) status->st_size
+        || header->script_mtime != (int64_t) status->st_mtime || header->script_hash != script_hash
+#if defined(__linux__)
+        || header->script_mtime_nsec != (int64_t) status->st_mtim.tv_nsec
+#endif
+        )
+    {
+        return -1;
+    }
+    
+    if (header->statement_count > (cache->length - sizeof(struct script_cache_header))
+                                  / sizeof(struct cached_statement)
+        || header->tokens_offset != sizeof(struct script_cache_header)
+                                    + header->statement_count * sizeof(struct cached_statement)
+        || header->text_offset < header->tokens_offset || header->text_offset > cache->length
+        || (header->text_offset - header->tokens_offset) % sizeof(struct token) != 0)
+    {
+        return -1;
+    }
+    
+    set_sections(cache);
+    token_total = (size_t) (header->text_offset - header->tokens_offset) / sizeof(struct token);
+    text_total  = cache->length - (size_t) header->text_offset;
+    for (size_t i = 0; i < header->statement_count; ++i)
+    {
+        statement = cache->statements + i;
+        if (statement->line_offset > header->script_size
+            || statement->line_length > header->script_size - statement->line_offset
+            || statement->first_token > token_total || statement->token_count > token_total - statement->first_token
+            || statement->text_start > text_total || statement->text_length > text_total - statement->text_start
+            || (statement->text_length && *(cache->text + statement->text_start + statement->text_length - 1)))
+        {
+            return -1;
+        }
+        
+        // Every word must lie within the statement's words, which end with a null byte.
+        for (size_t token = 0; token < statement->token_count; ++token)
+        {
+            if ((cache->tokens + statement->first_token + token)->offset >= statement->text_length
+                && ((cache->tokens + statement->first_token + token)->type == TOKEN_WORD
+                    || (cache->tokens + statement->first_token + token)->type == TOKEN_SUBSHELL))
+            {
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+int compile_script(struct supervisor *supvis, struct script_cache *cache, const struct stat *status,
+                   const char *script, uint64_t script_hash, size_t max_text_length)
+{
+    struct script_cache_header header;
+    struct cached_statement    entry;
+    struct scan_index          index;
+    struct statement           statement;
+    struct tokenizer           *tokenizer;
+    char                       *statements;
+    char                       *tokens;
+    char                       *text;
+    size_t                     lengths[3];
+    size_t                     capacities[3];
+    size_t                     length;
+    size_t                     offset;
+    size_t                     cut;
+    int                        result;
+    
+    length = (size_t) status->st_size;
+    memset(&index, 0, sizeof(index));
+    if (scan_structure(&index, script, length) == -1)
+    {
+        return -1;
+    }
+    tokenizer = tokenizer_create(supvis, -1, max_text_length);
+    if (!tokenizer)
+    {
+        scan_free(&index);
+        return -1;
+    }
+    
+    statements = NULL;
+    tokens     = NULL;
+    text       = NULL;
+    memset(lengths, 0, sizeof(lengths));
+    memset(capacities, 0, sizeof(capacities));
+    result = 0;
+    for (offset = 0; offset < length && result == 0; offset = statement.end + 1)
+    {
+        scan_statement(&index, script, offset, length, &statement);
+        cut = (statement.comment < statement.end) ? statement.comment : statement.end;
+        if (cut == offset) // blank line or comment
+        {
+            continue;
+        }
+        
+        tokenizer_feed_line(tokenizer, script + offset, cut - offset);
+        if (tokenizer->overflow)
+        {
+            result = -1; // left for the shell to report when it reaches the statement
+            break;
+        }
+        
+        entry.line_offset = offset;
+        entry.line_length = cut - offset;
+        entry.first_token = *(lengths + 1) / sizeof(struct token);
+        entry.token_count = tokenizer->token_count;
+        entry.text_start  = *(lengths + 2);
+        entry.text_length = tokenizer->text_length;
+        result = append_bytes(&statements, lengths, capacities, &entry, sizeof(entry));
+        if (result == 0)
+        {
+            result = append_bytes(&tokens, lengths + 1, capacities + 1, tokenizer->tokens,
+                                  tokenizer->token_count * sizeof(struct token));
+        }
+        if (result == 0)
+        {
+            result = append_bytes(&text, lengths + 2, capacities + 2, tokenizer->text, tokenizer->text_length);
+        }
+        tokenizer_reset(tokenizer);
+    }
+    tokenizer_destroy(supvis, tokenizer);
+    scan_free(&index);
+    
+    if (result == 0)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SCRIPT_CACHE_MAGIC, sizeof(header.magic));
+        header.version           = SCRIPT_CACHE_VERSION;
+        header.token_size        = sizeof(struct token);
+        header.script_size       = length;
+        header.script_mtime      = (int64_t) status->st_mtime;
+#if defined(__linux__)
+        header.script_mtime_nsec = (int64_t) status->st_mtim.tv_nsec;
+#endif
+        header.script_hash       = script_hash;
+        header.statement_count   = *lengths / sizeof(struct cached_statement);
+        header.tokens_offset     = sizeof(header) + *lengths;
+        header.text_offset       = header.tokens_offset + *(lengths + 1);
+        header.length            = header.text_offset + *(lengths + 2);
+        
+        cache->data = (char *) malloc((size_t) header.length);
+        if (cache->data)
+        {
+            memcpy(cache->data, &header, sizeof(header));
+            memcpy(cache->data + sizeof(header), statements, *lengths);
+            memcpy(cache->data + header.tokens_offset, tokens, *(lengths + 1));
+            memcpy(cache->data + header.text_offset, text, *(lengths + 2));
+            cache->length = (size_t) header.length;
+            cache->mapped = false;
+            set_sections(cache);
+        } else
+        {
+            result = -1;
+        }
+    }
+    
+    free(statements);
+    free(tokens);
+    free(text);
+    
+    return result;
+}
+
+int append_bytes(char **buffer, size_t *length, size_t *capacity, const void *bytes, size_t count)
+{
+    size_t size;
+    char   *grown;
+    
+    if (*length + count > *capacity)
+    {
+        for (size = (*capacity) ? *capacity * 2 : 4096; size < *length + count; size *= 2)
+        {
+        }
+        grown = (char *) realloc(*buffer, size);
+        if (!grown)
+        {
+            return -1;
+        }
+        *buffer   = grown;
+        *capacity = size;
+    }
+    
+    if (count)
+    {
+        memcpy(*buffer + *length, bytes, count);
+        *length += count;
+    }
+    
+    return 0;
+}
+
+int write_cache(const struct script_cache *cache, const char *path)
+{
+    char    temporary[PATH_MAX];
+    int     fd;
+    size_t  written;
+    ssize_t bytes;
+    int     length;
+    
+    length = snprintf(temporary, sizeof(temporary), "%s.%ld", path, (long) getpid());
+    if (length < 0 || (size_t) length >= sizeof(temporary))
+    {
+        return -1;
+    }
+    
+    fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    
+    for (written = 0; written < cache->length; written += (size_t) bytes)
+    {
+        bytes = write(fd, cache->data + written, cache->length - written);
+        if (bytes == -1 && errno == EINTR)
+        {
+            bytes = 0;
+            continue;
+        }
+        if (bytes == -1)
+        {
+            (void) close(fd);
+            (void) unlink(temporary);
+            return -1;
+        }
+    }
+    
+    // Readers see either the old file or the whole new one, never a partly written file.
+    if (close(fd) == -1 || rename(temporary, path) == -1)
+    {
+        (void) unlink(temporary);
+        return -1;
+    }
+    
+    return 0;
+}
+
+void set_sections(struct script_cache *cache)
+{
+    const struct script_cache_header *header;
+    
+    header            = (const struct script_cache_header *) (const void *) cache->data;
+    cache->statements = (const struct cached_statement *) (const void *) (cache->data + sizeof(*header));
+    cache->tokens     = (const struct token *) (const void *) (cache->data + header->tokens_offset);
+    cache->text       = cache->data + header->text_offset;
+}
+
+const struct cached_statement *script_cache_next(struct script_cache *cache)
+{
+    const struct script_cache_header *header;
+    
+    header = (const struct script_cache_header *) (const void *) cache->data;
+    if (cache->next == header->statement_count)
+    {
+        return NULL;
+    }
+    
+    return cache->statements + cache->next++;
+}
+
+int script_cache_load(const struct script_cache *cache, const struct cached_statement *statement,
+                      struct tokenizer *tokenizer)
+{
+    return tokenizer_load(tokenizer, cache->tokens + statement->first_token, (size_t) statement->token_count,
+                          cache->text + statement->text_start, (size_t) statement->text_length,
+                          (size_t) statement->line_length + 1);
+}
+
+void script_cache_close(struct supervisor *supvis, struct script_cache *cache)
+{
+    if (cache->mapped)
+    {
+        (void) munmap(cache->data, cache->length);
+    } else
+    {
+        free(cache->data);
+    }
+    supvis->mm->mm_free(supvis->mm, cache);
+}
@@ -1,8 +1,10 @@
 #include "../include/command.h"
 #include "../include/shell.h"
 #include "../include/shell_impl.h"
+#include "../include/util.h"
 
 #include <string.h>
+#include <unistd.h>
 
 /**
  * run_shell
@@ -13,25 +15,56 @@
  * @param in the input stream
  * @param out the output stream
  * @param err the error stream
+ * @param script_path the script to run, or NULL
+ * @param command_string the command string to run, or NULL
  * @return the exit code of the shell
  */
-int run_shell(struct supervisor *supvis, FILE *in, FILE *out, FILE *err);
+int run_shell(struct supervisor *supvis, FILE *in, FILE *out, FILE *err, const char *script_path,
+              const char *command_string);
 
-int run(void)
+int run(int argc, char *argv[])
 {
     struct supervisor *supvis;
+    const char        *command_string;
+    const char        *script_path;
     int               exit_status;
+    int               opt;
+    
+    command_string = NULL;
+    script_path    = NULL;
+    while ((opt = getopt(argc, argv, "+c:")) != -1) // NOLINT(concurrency-mt-unsafe): no threads here
+    {
+        switch (opt)
+        {
+            case 'c':
+            {
+                command_string = optarg;
+                break;
+            }
+            default:
+            {
+                (void) fprintf(stderr, "usage: csh [-c command | script]\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    
+    if (!command_string && optind < argc)
+    {
+        script_path = *(argv + optind);
+    }
     
     supvis = init_supervisor();
     
-    exit_status = run_shell(supvis, stdin, stdout, stderr);
+    exit_status = run_shell(supvis, stdin, stdout, stderr, script_path, command_string);
     
     destroy_supervisor(supvis);
     
     return exit_status;
 }
 
-int run_shell(struct supervisor *supvis, FILE *in, FILE *out, FILE *err)
+int run_shell(struct supervisor *supvis, FILE *in, FILE *out, FILE *err, const char *script_path,
+              const char *command_string)
 {
     struct state state;
     int          next_state;
@@ -40,9 +73,11 @@ int run_shell(struct supervisor *supvis, FILE *in, FILE *out, FILE *err)
     
     memset(&state, 0, sizeof(struct state));
     
-    state.stdin  = in;
-    state.stdout = out;
-    state.stderr = err;
+    state.stdin          = in;
+    state.stdout         = out;
+    state.stderr         = err;
+    state.script_path    = script_path;
+    state.command_string = command_string;
     
     exit_status = EXIT_SUCCESS;
     run = 1;
@@ -59,6 +94,10 @@ int run_shell(struct supervisor *supvis, FILE *in, FILE *out, FILE *err)
             case READ_COMMANDS:
             {
                 next_state = read_commands(supvis, &state);
+                if (next_state == SEPARATE_COMMANDS)
+                {
+                    do_start_command(&state);
+                }
                 break;
             }
             case SEPARATE_COMMANDS:
@@ -74,6 +113,7 @@ int run_shell(struct supervisor *supvis, FILE *in, FILE *out, FILE *err)
             case EXECUTE_COMMANDS:
             {
                 next_state = execute_commands(supvis, &state);
+                do_record_history(&state);
                 break;
             }
             case RESET_STATE:
@@ -88,7 +128,7 @@ int run_shell(struct supervisor *supvis, FILE *in, FILE *out, FILE *err)
             }
             case DESTROY_STATE:
             {
-                exit_status = state.command->exit_code;
+                exit_status = state.exit_code;
                 destroy_state(supvis, &state);
                 run        = 0;
                 break;
@@ -26,6 +26,9 @@ int read_commands(struct supervisor *supvis, void *arg)
     if (errno)
     {
         ret_val = ERROR;
+    } else if (line_size == 0) // end of input
+    {
+        ret_val = DESTROY_STATE;
     } else if (line_size == 1)
     {
         ret_val = RESET_STATE;
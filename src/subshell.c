@@ -0,0 +1,431 @@
+#include "../include/builtins.h"
+#include "../include/command.h"
+#include "../include/execute.h"
+#include "../include/file_cache.h"
+#include "../include/parse_cache.h"
+#include "../include/shell.h"
+#include "../include/subshell.h"
+#include "../include/util.h"
+
+#include <dc_posix/dc_stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/**
+ * subshell_restore
+ * <p>
+ * Put back the working directory, the environment and the options saved by subshell_save.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @param subshell the subshell
+ */
+void subshell_restore(struct supervisor *supvis, struct state *state, struct subshell *subshell);
+
+/**
+ * save_environment
+ * <p>
+ * Copy the NAME=value strings of the environment into the subshell.
+ * </p>
+ * @param subshell the subshell
+ * @return 0 on success, -1 if memory ran out
+ */
+int save_environment(struct subshell *subshell);
+
+/**
+ * restore_environment
+ * <p>
+ * Make the environment what save_environment copied: unset the variables added since, and set
+ * back the ones changed or unset. The copies are freed.
+ * </p>
+ * @param supvis the supervisor object
+ * @param subshell the subshell
+ */
+void restore_environment(struct supervisor *supvis, struct subshell *subshell);
+
+/**
+ * was_saved
+ * <p>
+ * Check whether a variable was in the environment save_environment copied.
+ * </p>
+ * @param subshell the subshell
+ * @param variable the NAME=value string of the variable
+ * @param length the length of its name
+ * @return true if it was, false otherwise
+ */
+bool was_saved(const struct subshell *subshell, const char *variable, size_t length);
+
+struct subshell *subshell_create(struct supervisor *supvis, size_t max_text_length)
+{
+    struct subshell *subshell;
+    
+    subshell = mm_calloc(1, sizeof(struct subshell), supvis->mm, __FILE__, __func__, __LINE__);
+    if (!subshell)
+    {
+        return NULL;
+    }
+    
+    subshell->tokenizer = tokenizer_create(supvis, -1, max_text_length);
+    subshell->arena     = arena_create(supvis);
+    subshell->expander  = expander_create(supvis);
+    subshell->cwd_fd    = -1;
+    if (!subshell->tokenizer || !subshell->arena || !subshell->expander)
+    {
+        subshell_destroy(supvis, subshell);
+        return NULL;
+    }
+    
+    return subshell;
+}
+
+bool subshell_can_run(struct subshell *subshell, const char *text, size_t length)
+{
+    const struct tokenizer *tokenizer;
+    const struct token     *token;
+    const char             *word;
+    size_t                 offset;
+    size_t                 consumed;
+    bool                   complete;
+    bool                   first;
+    bool                   can_run;
+    
+    if (subshell->active)
+    {
+        return false;
+    }
+    
+    tokenizer = subshell->tokenizer;
+    can_run   = true;
+    for (offset = 0; offset < length && can_run; offset += consumed)
+    {
+        tokenizer_reset(subshell->tokenizer);
+        consumed = tokenizer_feed(subshell->tokenizer, text + offset, length - offset, &complete);
+        if (!complete)
+        {
+            tokenizer_finish(subshell->tokenizer);
+        }
+        
+        can_run = !tokenizer->overflow;
+        first   = true;
+        for (size_t i = 0; i < tokenizer->token_count && can_run; ++i)
+        {
+            token = tokenizer->tokens + i;
+            switch (token->type)
+            {
+                case TOKEN_WORD:
+                {
+                    // hash and exec change the command hash table and the descriptors, which are not saved.
+                    word    = tokenizer_word(tokenizer, token);
+                    can_run = !first
+                              || (is_builtin(word) && strcmp(word, "hash") != 0 && strcmp(word, "exec") != 0);
+                    first   = false;
+                    break;
+                }
+                case TOKEN_SEMI:
+                case TOKEN_AND_IF:
+                case TOKEN_OR_IF:
+                {
+                    first = true;
+                    break;
+                }
+                case TOKEN_LESS:
+                case TOKEN_GREAT:
+                case TOKEN_DGREAT:
+                case TOKEN_LESSAND:
+                case TOKEN_GREATAND:
+                case TOKEN_ANDGREAT:
+                case TOKEN_ANDDGREAT:
+                case TOKEN_AMP:
+                case TOKEN_PIPE:
+                case TOKEN_SUBSHELL:
+                default:
+                {
+                    can_run = false;
+                }
+            }
+        }
+    }
+    tokenizer_reset(subshell->tokenizer);
+    
+    return can_run;
+}
+
+int subshell_run(struct supervisor *supvis, struct state *state, const char *text, size_t length, FILE *out)
+{
+    struct subshell  *subshell;
+    struct tokenizer *tokenizer;
+    struct arena     *arena;
+    struct expander  *expander;
+    struct command   *commands;
+    FILE             *stream;
+    size_t           offset;
+    size_t           consumed;
+    bool             complete;
+    int              status;
+    
+    // The command holding the subshell keeps its tokens, words and fields; the subshell uses its own.
+    subshell         = state->subshell;
+    tokenizer        = state->tokenizer;
+    arena            = state->arena;
+    expander         = state->expander;
+    commands         = state->commands;
+    stream           = state->stdout;
+    state->tokenizer = subshell->tokenizer;
+    state->arena     = subshell->arena;
+    state->expander  = subshell->expander;
+    state->stdout    = out;
+    subshell->active = true;
+    subshell->saved  = false;
+    
+    for (offset = 0; offset < length; offset += consumed)
+    {
+        tokenizer_reset(state->tokenizer);
+        arena_reset(state->arena);
+        expander_reset(state->expander);
+        state->commands = NULL;
+        
+        consumed = tokenizer_feed(state->tokenizer, text + offset, length - offset, &complete);
+        if (!complete)
+        {
+            tokenizer_finish(state->tokenizer);
+        }
+        if (!state->tokenizer->token_count)
+        {
+            continue;
+        }
+        
+        do_separate_commands(supvis, state);
+        if (!errno)
+        {
+            do_parse_commands(supvis, state);
+        }
+        if (errno) // the status is set by the step that failed
+        {
+            errno = 0;
+            continue;
+        }
+        
+        // exit ends the subshell, as it would end a forked one.
+        if (do_execute_commands(supvis, state) == DESTROY_STATE || state->fatal_error)
+        {
+            break;
+        }
+    }
+    status = state->exit_code & 0xFF; // what a forked subshell would have exited with
+    
+    tokenizer_reset(state->tokenizer);
+    arena_reset(state->arena);
+    expander_reset(state->expander);
+    state->tokenizer = tokenizer;
+    state->arena     = arena;
+    state->expander  = expander;
+    state->commands  = commands;
+    state->stdout    = stream;
+    subshell->active = false;
+    if (subshell->saved)
+    {
+        subshell_restore(supvis, state, subshell);
+    }
+    ++subshell->runs;
+    errno = 0; // a failing command leaves only its status
+    
+    return status;
+}
+
+void subshell_save(struct state *state)
+{
+    struct subshell *subshell;
+    
+    subshell = state->subshell;
+    if (!subshell || !subshell->active || subshell->saved)
+    {
+        return;
+    }
+    
+    // A descriptor gets back to the directory even if it is renamed meanwhile.
+    subshell->cwd    = NULL;
+    subshell->cwd_fd = shell_descriptor(open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (subshell->cwd_fd == -1)
+    {
+        subshell->cwd = (state->cwd) ? strdup(state->cwd) : NULL;
+        errno = 0;
+    }
+    
+    // Without a copy the environment is left as the subshell leaves it, as it was before the copy was made.
+    if (save_environment(subshell) == -1)
+    {
+        errno = 0;
+    }
+    
+    subshell->export_pwd           = state->export_pwd;
+    subshell->fork_exec            = state->fork_exec;
+    subshell->pipefail             = state->pipefail;
+    subshell->pipe_size            = state->pipe_size;
+    subshell->prompt_deadline      = state->prompt_deadline;
+    subshell->parse_cache_capacity = state->parse_cache->capacity;
+    subshell->file_cache_capacity  = state->file_cache->capacity;
+    subshell->saved                = true;
+}
+
+void subshell_restore(struct supervisor *supvis, struct state *state, struct subshell *subshell)
+{
+    state->export_pwd      = subshell->export_pwd;
+    state->fork_exec       = subshell->fork_exec;
+    state->pipefail        = subshell->pipefail;
+    state->pipe_size       = subshell->pipe_size;
+    state->prompt_deadline = subshell->prompt_deadline;
+    if (state->parse_cache->capacity != subshell->parse_cache_capacity)
+    {
+        (void) parse_cache_resize(state->parse_cache, subshell->parse_cache_capacity);
+    }
+    if (state->file_cache->capacity != subshell->file_cache_capacity)
+    {
+        (void) file_cache_resize(state->file_cache, subshell->file_cache_capacity);
+    }
+    
+    if (subshell->cwd_fd != -1)
+    {
+        (void) fchdir(subshell->cwd_fd);
+        (void) close(subshell->cwd_fd);
+        subshell->cwd_fd = -1;
+    } else if (subshell->cwd)
+    {
+        (void) chdir(subshell->cwd);
+        free(subshell->cwd);
+        subshell->cwd = NULL;
+    }
+    (void) do_update_working_dir(supvis, state);
+    
+    // Updating the working directory may have exported it; the saved values win.
+    if (subshell->environment)
+    {
+        restore_environment(supvis, subshell);
+    }
+    subshell->saved = false;
+    errno = 0;
+}
+
+int save_environment(struct subshell *subshell)
+{
+    size_t count;
+    
+    count = 0;
+    while (*(environ + count))
+    {
+        ++count;
+    }
+    
+    subshell->environment       = (char **) malloc((count + 1) * sizeof(char *));
+    subshell->environment_count = 0;
+    if (!subshell->environment)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        *(subshell->environment + i) = strdup(*(environ + i));
+        if (!*(subshell->environment + i))
+        {
+            for (size_t j = 0; j < i; ++j)
+            {
+                free(*(subshell->environment + j));
+            }
+            free(subshell->environment);
+            subshell->environment = NULL;
+            return -1;
+        }
+    }
+    subshell->environment_count = count;
+    
+    return 0;
+}
+
+void restore_environment(struct supervisor *supvis, struct subshell *subshell)
+{
+    const char *entry;
+    const char *value;
+    char       *name;
+    char       *equals;
+    size_t     length;
+    size_t     i;
+    
+    // unsetenv moves the variables after the one removed down, so the walk stays where it is.
+    i = 0;
+    while (*(environ + i))
+    {
+        entry  = *(environ + i);
+        length = strcspn(entry, "=");
+        if (was_saved(subshell, entry, length))
+        {
+            ++i;
+            continue;
+        }
+        
+        name = strndup(entry, length);
+        if (name)
+        {
+            (void) unsetenv(name);
+            free(name);
+        }
+        if (*(environ + i) == entry) // not removed; leave it
+        {
+            ++i;
+        }
+    }
+    
+    for (i = 0; i < subshell->environment_count; ++i)
+    {
+        name   = *(subshell->environment + i);
+        equals = strchr(name, '=');
+        if (equals)
+        {
+            *equals = '\0';
+            value   = dc_getenv(supvis->env, name);
+            if (!value || strcmp(value, equals + 1) != 0)
+            {
+                dc_setenv(supvis->env, supvis->err, name, equals + 1, true);
+            }
+        }
+        free(name);
+    }
+    free(subshell->environment);
+    subshell->environment       = NULL;
+    subshell->environment_count = 0;
+}
+
+bool was_saved(const struct subshell *subshell, const char *variable, size_t length)
+{
+    const char *saved;
+    
+    for (size_t i = 0; i < subshell->environment_count; ++i)
+    {
+        saved = *(subshell->environment + i);
+        if (strncmp(saved, variable, length) == 0 && *(saved + length) == '=')
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void subshell_destroy(struct supervisor *supvis, struct subshell *subshell)
+{
+    if (subshell->tokenizer)
+    {
+        tokenizer_destroy(supvis, subshell->tokenizer);
+    }
+    if (subshell->arena)
+    {
+        arena_destroy(supvis, subshell->arena);
+    }
+    if (subshell->expander)
+    {
+        expander_destroy(supvis, subshell->expander);
+    }
+    supvis->mm->mm_free(supvis->mm, subshell);
+}
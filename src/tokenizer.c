@@ -0,0 +1,802 @@
+#include "../include/parse_cache.h"
+#include "../include/tokenizer.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * lex_input
+ * <p>
+ * Lex bytes of input, stopping after the newline that ends a command.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param input the bytes
+ * @param length the number of bytes
+ * @param complete set to true if a command was completed
+ * @return the number of bytes consumed
+ */
+size_t lex_input(struct tokenizer *tokenizer, const char *input, size_t length, bool *complete);
+
+/**
+ * replay_line
+ * <p>
+ * Load the tokens of a line from the cache as the tokens of the current command, which took the
+ * line and its newline.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param line the line, without its newline
+ * @param length the length of the line
+ * @param hash the hash of the line
+ * @return true if the line was in the cache, false otherwise
+ */
+bool replay_line(struct tokenizer *tokenizer, const char *line, size_t length, uint64_t hash);
+
+/**
+ * lex_char
+ * <p>
+ * Advance the lexer by one byte of input.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param c the byte
+ * @return true if the byte completed a command, false otherwise
+ */
+bool lex_char(struct tokenizer *tokenizer, char c);
+
+/**
+ * lex_substitution
+ * <p>
+ * Note a '$' that may start a command substitution or a ${...}, or start one on the '(' or '{'
+ * after it or on a '`'. The substitution becomes part of the current word, which is expanded when
+ * the command runs; the operand of a ${...} may hold blanks.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param c the byte just appended to the word: '$', '(', '{' or '`'
+ */
+void lex_substitution(struct tokenizer *tokenizer, char c);
+
+/**
+ * append_text
+ * <p>
+ * Append a byte to the word being accumulated, growing the buffer as needed. If the command
+ * grows beyond max_text_length, the byte is dropped and tokenizer->overflow is set.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param c the byte
+ */
+void append_text(struct tokenizer *tokenizer, char c);
+
+/**
+ * append_source
+ * <p>
+ * Keep bytes of input in tokenizer->source. Input beyond max_text_length is not kept.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param input the bytes
+ * @param length the number of bytes
+ */
+void append_source(struct tokenizer *tokenizer, const char *input, size_t length);
+
+/**
+ * push_token
+ * <p>
+ * Add a token to the current command. A TOKEN_WORD starts a new word at the end of the text.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @param type the kind of token
+ * @param io_number the fd a redirection applies to, or -1
+ */
+void push_token(struct tokenizer *tokenizer, enum token_type type, int io_number);
+
+/**
+ * start_word
+ * <p>
+ * Begin accumulating a word if one is not already being accumulated.
+ * </p>
+ * @param tokenizer the tokenizer
+ */
+void start_word(struct tokenizer *tokenizer);
+
+/**
+ * end_word
+ * <p>
+ * Null terminate the word being accumulated, if any.
+ * </p>
+ * @param tokenizer the tokenizer
+ */
+void end_word(struct tokenizer *tokenizer);
+
+/**
+ * take_io_number
+ * <p>
+ * If the word being accumulated is all digits, it is the fd of the redirection operator that
+ * immediately follows it (eg. the 2 of "2>"). Remove the word and return its value.
+ * </p>
+ * @param tokenizer the tokenizer
+ * @return the fd, or -1 if the word is not an io number
+ */
+int take_io_number(struct tokenizer *tokenizer);
+
+struct tokenizer *tokenizer_create(struct supervisor *supvis, int fd, size_t max_text_length)
+{
+    struct tokenizer *tokenizer;
+    
+    tokenizer = mm_calloc(1, sizeof(struct tokenizer), supvis->mm, __FILE__, __func__, __LINE__);
+    
+    if (tokenizer)
+    {
+        tokenizer->fd              = fd;
+        tokenizer->lex_state       = LEX_BLANK;
+        tokenizer->max_text_length = max_text_length;
+    }
+    
+    return tokenizer;
+}
+
+int tokenizer_read_command(struct tokenizer *tokenizer)
+{
+    ssize_t bytes;
+    bool    complete;
+    
+    complete = false;
+    while (!complete)
+    {
+        if (tokenizer->chunk_start == tokenizer->chunk_end)
+        {
+            bytes = read(tokenizer->fd, tokenizer->chunk, sizeof(tokenizer->chunk));
+            if (bytes == -1 && errno == EINTR)
+            {
+                errno = 0;
+                continue;
+            }
+            if (bytes == -1)
+            {
+                return -1;
+            }
+            if (bytes == 0)
+            {
+                if (!tokenizer->consumed)
+                {
+                    return 0;
+                }
+                tokenizer_finish(tokenizer);
+                return 1;
+            }
+            
+            tokenizer->chunk_start = 0;
+            tokenizer->chunk_end   = (size_t) bytes;
+        }
+        
+        tokenizer->chunk_start += tokenizer_feed(tokenizer, tokenizer->chunk + tokenizer->chunk_start,
+                                                 tokenizer->chunk_end - tokenizer->chunk_start, &complete);
+    }
+    
+    return 1;
+}
+
+size_t tokenizer_feed(struct tokenizer *tokenizer, const char *input, size_t length, bool *complete)
+{
+    const char *newline;
+    size_t     line_length;
+    uint64_t   hash;
+    size_t     consumed;
+    
+    newline     = NULL;
+    line_length = 0;
+    hash        = 0;
+    if (tokenizer->cache && tokenizer->consumed == 0)
+    {
+        newline = memchr(input, '\n', length);
+        if (newline)
+        {
+            line_length = (size_t) (newline - input);
+            hash        = parse_cache_hash(input, line_length);
+            if (replay_line(tokenizer, input, line_length, hash))
+            {
+                *complete = true;
+                if (tokenizer->keep_source)
+                {
+                    append_source(tokenizer, input, line_length + 1);
+                }
+                return line_length + 1;
+            }
+        }
+    }
+    
+    consumed = lex_input(tokenizer, input, length, complete);
+    
+    // Only a command that is exactly its first line is kept, so that replaying it consumes the same input.
+    if (newline && *complete && consumed == line_length + 1 && !tokenizer->overflow)
+    {
+        parse_cache_insert(tokenizer->cache, input, line_length, hash, tokenizer);
+    }
+    
+    return consumed;
+}
+
+void tokenizer_feed_line(struct tokenizer *tokenizer, const char *line, size_t length)
+{
+    uint64_t hash;
+    bool     complete;
+    bool     cacheable;
+    
+    hash = 0;
+    if (tokenizer->cache)
+    {
+        hash = parse_cache_hash(line, length);
+        if (replay_line(tokenizer, line, length, hash))
+        {
+            if (tokenizer->keep_source)
+            {
+                append_source(tokenizer, line, length);
+            }
+            return;
+        }
+    }
+    
+    (void) lex_input(tokenizer, line, length, &complete);
+    
+    // A line ending inside quotes or on a '\' would not end at a newline, so it is not shared with stdin.
+    cacheable = !tokenizer->escape && tokenizer->lex_state != LEX_SINGLE_QUOTE
+                && tokenizer->lex_state != LEX_DOUBLE_QUOTE && tokenizer->lex_state != LEX_SUBSTITUTION
+                && tokenizer->lex_state != LEX_BACKQUOTE && !complete;
+    tokenizer_finish(tokenizer);
+    if (tokenizer->cache && cacheable && !tokenizer->overflow)
+    {
+        parse_cache_insert(tokenizer->cache, line, length, hash, tokenizer);
+    }
+}
+
+bool replay_line(struct tokenizer *tokenizer, const char *line, size_t length, uint64_t hash)
+{
+    const struct parse_cache_entry *entry;
+    
+    entry = parse_cache_lookup(tokenizer->cache, line, length, hash);
+    
+    return entry && tokenizer_load(tokenizer, parse_cache_tokens(entry), entry->token_count, parse_cache_text(entry),
+                                   entry->text_length, length + 1) == 0;
+}
+
+int tokenizer_load(struct tokenizer *tokenizer, const struct token *tokens, size_t token_count, const char *text,
+                   size_t text_length, size_t consumed)
+{
+    if (text_length > tokenizer->text_capacity)
+    {
+        size_t capacity;
+        char   *grown;
+        
+        capacity = (tokenizer->text_capacity) ? tokenizer->text_capacity : TOKENIZER_CHUNK_SIZE;
+        while (capacity < text_length)
+        {
+            capacity *= 2;
+        }
+        grown = (char *) realloc(tokenizer->text, capacity);
+        if (!grown)
+        {
+            return -1;
+        }
+        tokenizer->text          = grown;
+        tokenizer->text_capacity = capacity;
+    }
+    if (token_count > tokenizer->token_capacity)
+    {
+        struct token *grown;
+        
+        grown = (struct token *) realloc(tokenizer->tokens, token_count * sizeof(struct token));
+        if (!grown)
+        {
+            return -1;
+        }
+        tokenizer->tokens         = grown;
+        tokenizer->token_capacity = token_count;
+    }
+    
+    memcpy(tokenizer->text, text, text_length);
+    memcpy(tokenizer->tokens, tokens, token_count * sizeof(struct token));
+    tokenizer->text_length = text_length;
+    tokenizer->token_count = token_count;
+    tokenizer->consumed    = consumed;
+    
+    return 0;
+}
+
+size_t lex_input(struct tokenizer *tokenizer, const char *input, size_t length, bool *complete)
+{
+    size_t i;
+    
+    *complete = false;
+    for (i = 0; i < length && !*complete; ++i)
+    {
+        ++tokenizer->consumed;
+        *complete = lex_char(tokenizer, *(input + i));
+    }
+    
+    if (tokenizer->keep_source)
+    {
+        append_source(tokenizer, input, i);
+    }
+    
+    return i;
+}
+
+void append_source(struct tokenizer *tokenizer, const char *input, size_t length)
+{
+    if (tokenizer->source_length + length > tokenizer->max_text_length)
+    {
+        return;
+    }
+    
+    if (tokenizer->source_length + length > tokenizer->source_capacity)
+    {
+        size_t capacity;
+        char   *source;
+        
+        capacity = (tokenizer->source_capacity) ? tokenizer->source_capacity : TOKENIZER_CHUNK_SIZE;
+        while (capacity < tokenizer->source_length + length)
+        {
+            capacity *= 2;
+        }
+        source = (char *) realloc(tokenizer->source, capacity);
+        if (!source)
+        {
+            return;
+        }
+        tokenizer->source          = source;
+        tokenizer->source_capacity = capacity;
+    }
+    
+    memcpy(tokenizer->source + tokenizer->source_length, input, length);
+    tokenizer->source_length += length;
+}
+
+const char *tokenizer_source(const struct tokenizer *tokenizer, size_t *length)
+{
+    *length = tokenizer->source_length;
+    if (*length && *(tokenizer->source + *length - 1) == '\n')
+    {
+        --*length;
+    }
+    
+    return tokenizer->source;
+}
+
+void tokenizer_finish(struct tokenizer *tokenizer)
+{
+    if (tokenizer->escape)
+    {
+        tokenizer->escape = false;
+        append_text(tokenizer, '\\');
+    }
+    end_word(tokenizer);
+    tokenizer->lex_state = LEX_BLANK;
+    ++tokenizer->consumed; // count the missing newline, as if the command had one
+}
+
+bool lex_char(struct tokenizer *tokenizer, char c)
+{
+    struct token *token;
+    int          io_number;
+    bool         dollar;
+    
+    dollar            = tokenizer->dollar;
+    tokenizer->dollar = false;
+    
+    if (tokenizer->escape)
+    {
+        tokenizer->escape = false;
+        if (c == '\n') // line continuation; drop both the backslash and the newline
+        {
+            return false;
+        }
+        if (tokenizer->lex_state == LEX_BLANK)
+        {
+            start_word(tokenizer);
+            tokenizer->lex_state = LEX_WORD;
+        }
+        append_text(tokenizer, '\\');
+        append_text(tokenizer, c);
+        return false;
+    }
+    
+    switch (tokenizer->lex_state)
+    {
+        case LEX_SINGLE_QUOTE:
+        {
+            append_text(tokenizer, c);
+            if (c == '\'')
+            {
+                tokenizer->lex_state = LEX_WORD;
+            }
+            return false;
+        }
+        case LEX_DOUBLE_QUOTE:
+        {
+            if (c == '\\')
+            {
+                tokenizer->escape = true;
+                return false;
+            }
+            append_text(tokenizer, c);
+            if (c == '"')
+            {
+                tokenizer->lex_state = LEX_WORD;
+            } else if (c == '$' || c == '`' || ((c == '(' || c == '{') && dollar))
+            {
+                lex_substitution(tokenizer, c);
+            }
+            return false;
+        }
+        case LEX_SUBSTITUTION:
+        {
+            // The command is lexed again when it runs; here it only has to be found whole.
+            if (c == '\\' && tokenizer->quote != '\'')
+            {
+                tokenizer->escape = true;
+                return false;
+            }
+            append_text(tokenizer, c);
+            if (tokenizer->quote)
+            {
+                tokenizer->quote = (c == tokenizer->quote) ? '\0' : tokenizer->quote;
+            } else if (c == '\'' || c == '"')
+            {
+                tokenizer->quote = c;
+            } else if (c == tokenizer->open)
+            {
+                ++tokenizer->depth;
+            } else if (c == ((tokenizer->open == '(') ? ')' : '}') && --tokenizer->depth == 0)
+            {
+                tokenizer->lex_state = tokenizer->outer_state;
+            }
+            return false;
+        }
+        case LEX_BACKQUOTE:
+        {
+            if (c == '\\')
+            {
+                tokenizer->escape = true;
+                return false;
+            }
+            append_text(tokenizer, c);
+            if (c == '`')
+            {
+                tokenizer->lex_state = tokenizer->outer_state;
+            }
+            return false;
+        }
+        case LEX_COMMENT:
+        {
+            if (c == '\n')
+            {
+                tokenizer->lex_state = LEX_BLANK;
+                return true;
+            }
+            return false;
+        }
+        case LEX_LESS:
+        {
+            tokenizer->lex_state = LEX_BLANK;
+            if (c == '&')
+            {
+                (tokenizer->tokens + tokenizer->token_count - 1)->type = TOKEN_LESSAND;
+                return false;
+            }
+            break; // any other byte is lexed as if between tokens
+        }
+        case LEX_GREAT:
+        {
+            tokenizer->lex_state = LEX_BLANK;
+            token                = tokenizer->tokens + tokenizer->token_count - 1;
+            if (c == '>')
+            {
+                token->type = (token->type == TOKEN_ANDGREAT) ? TOKEN_ANDDGREAT : TOKEN_DGREAT;
+                return false;
+            }
+            if (c == '&' && token->type == TOKEN_GREAT)
+            {
+                token->type = TOKEN_GREATAND;
+                return false;
+            }
+            break;
+        }
+        case LEX_AMP:
+        case LEX_PIPE:
+        {
+            if (c == ((tokenizer->lex_state == LEX_AMP) ? '&' : '|'))
+            {
+                tokenizer->lex_state = LEX_BLANK;
+                (tokenizer->tokens + tokenizer->token_count - 1)->type = (c == '&') ? TOKEN_AND_IF : TOKEN_OR_IF;
+                return false;
+            }
+            if (c == '>' && tokenizer->lex_state == LEX_AMP)
+            {
+                tokenizer->lex_state = LEX_GREAT;
+                (tokenizer->tokens + tokenizer->token_count - 1)->type = TOKEN_ANDGREAT;
+                return false;
+            }
+            tokenizer->lex_state = LEX_BLANK;
+            break;
+        }
+        case LEX_BLANK:
+        case LEX_WORD:
+        default:
+        {
+            break;
+        }
+    }
+    
+    switch (c)
+    {
+        case '\\':
+        {
+            tokenizer->escape = true;
+            break;
+        }
+        case ' ':
+        case '\t':
+        {
+            end_word(tokenizer);
+            tokenizer->lex_state = LEX_BLANK;
+            break;
+        }
+        case '\n':
+        {
+            end_word(tokenizer);
+            tokenizer->lex_state = LEX_BLANK;
+            return true;
+        }
+        case '<':
+        case '>':
+        {
+            io_number = take_io_number(tokenizer);
+            end_word(tokenizer);
+            push_token(tokenizer, (c == '<') ? TOKEN_LESS : TOKEN_GREAT, io_number);
+            tokenizer->lex_state = (c == '<') ? LEX_LESS : LEX_GREAT;
+            break;
+        }
+        case ';':
+        {
+            end_word(tokenizer);
+            push_token(tokenizer, TOKEN_SEMI, -1);
+            tokenizer->lex_state = LEX_BLANK;
+            break;
+        }
+        case '&':
+        case '|':
+        {
+            end_word(tokenizer);
+            push_token(tokenizer, (c == '&') ? TOKEN_AMP : TOKEN_PIPE, -1);
+            tokenizer->lex_state = (c == '&') ? LEX_AMP : LEX_PIPE;
+            break;
+        }
+        case '(':
+        {
+            // A ( ... ) group is one token holding the group, parentheses included.
+            if (tokenizer->lex_state == LEX_BLANK)
+            {
+                push_token(tokenizer, TOKEN_SUBSHELL, -1);
+                tokenizer->in_word = true;
+                append_text(tokenizer, c);
+                tokenizer->lex_state = LEX_WORD;
+                lex_substitution(tokenizer, c);
+                break;
+            }
+            start_word(tokenizer);
+            append_text(tokenizer, c);
+            tokenizer->lex_state = LEX_WORD;
+            if (dollar)
+            {
+                lex_substitution(tokenizer, c);
+            }
+            break;
+        }
+        case '#':
+        {
+            if (tokenizer->lex_state == LEX_BLANK)
+            {
+                tokenizer->lex_state = LEX_COMMENT;
+                break;
+            }
+            append_text(tokenizer, c);
+            break;
+        }
+        default:
+        {
+            start_word(tokenizer);
+            append_text(tokenizer, c);
+            if (c == '\'')
+            {
+                tokenizer->lex_state = LEX_SINGLE_QUOTE;
+            } else if (c == '"')
+            {
+                tokenizer->lex_state = LEX_DOUBLE_QUOTE;
+            } else
+            {
+                tokenizer->lex_state = LEX_WORD;
+                if (c == '$' || c == '`' || (c == '{' && dollar))
+                {
+                    lex_substitution(tokenizer, c);
+                }
+            }
+        }
+    }
+    
+    return false;
+}
+
+void lex_substitution(struct tokenizer *tokenizer, char c)
+{
+    if (c == '$')
+    {
+        tokenizer->dollar = true;
+        return;
+    }
+    
+    tokenizer->outer_state = tokenizer->lex_state;
+    tokenizer->lex_state   = (c == '`') ? LEX_BACKQUOTE : LEX_SUBSTITUTION;
+    tokenizer->open        = c;
+    tokenizer->depth       = 1;
+    tokenizer->quote       = '\0';
+}
+
+void append_text(struct tokenizer *tokenizer, char c)
+{
+    if (tokenizer->overflow)
+    {
+        return;
+    }
+    
+    if (tokenizer->text_length + 1 > tokenizer->max_text_length)
+    {
+        tokenizer->overflow = true;
+        return;
+    }
+    
+    if (tokenizer->text_length == tokenizer->text_capacity)
+    {
+        size_t capacity;
+        char   *text;
+        
+        capacity = (tokenizer->text_capacity) ? tokenizer->text_capacity * 2 : TOKENIZER_CHUNK_SIZE;
+        text     = (char *) realloc(tokenizer->text, capacity);
+        if (!text)
+        {
+            tokenizer->overflow = true;
+            return;
+        }
+        tokenizer->text          = text;
+        tokenizer->text_capacity = capacity;
+    }
+    
+    *(tokenizer->text + tokenizer->text_length++) = c;
+}
+
+void push_token(struct tokenizer *tokenizer, enum token_type type, int io_number)
+{
+    struct token *token;
+    
+    if (tokenizer->overflow)
+    {
+        return;
+    }
+    
+    if (tokenizer->token_count == tokenizer->token_capacity)
+    {
+        size_t       capacity;
+        struct token *tokens;
+        
+        capacity = (tokenizer->token_capacity) ? tokenizer->token_capacity * 2 : 16;
+        tokens   = (struct token *) realloc(tokenizer->tokens, capacity * sizeof(struct token));
+        if (!tokens)
+        {
+            tokenizer->overflow = true;
+            return;
+        }
+        tokenizer->tokens         = tokens;
+        tokenizer->token_capacity = capacity;
+    }
+    
+    token = tokenizer->tokens + tokenizer->token_count++;
+    token->type      = type;
+    token->io_number = io_number;
+    token->offset    = tokenizer->text_length;
+}
+
+void start_word(struct tokenizer *tokenizer)
+{
+    if (!tokenizer->in_word)
+    {
+        push_token(tokenizer, TOKEN_WORD, -1);
+        tokenizer->in_word = true;
+    }
+}
+
+void end_word(struct tokenizer *tokenizer)
+{
+    if (tokenizer->in_word)
+    {
+        append_text(tokenizer, '\0');
+        tokenizer->in_word = false;
+    }
+}
+
+int take_io_number(struct tokenizer *tokenizer)
+{
+    struct token *token;
+    size_t       length;
+    int          io_number;
+    
+    if (!tokenizer->in_word || tokenizer->lex_state != LEX_WORD || tokenizer->overflow)
+    {
+        return -1;
+    }
+    
+    token  = tokenizer->tokens + tokenizer->token_count - 1;
+    length = tokenizer->text_length - token->offset;
+    if (length == 0 || length > 4)
+    {
+        return -1;
+    }
+    
+    io_number = 0;
+    for (size_t i = token->offset; i < tokenizer->text_length; ++i)
+    {
+        if (!isdigit((unsigned char) *(tokenizer->text + i)))
+        {
+            return -1;
+        }
+        io_number = io_number * 10 + (*(tokenizer->text + i) - '0');
+    }
+    
+    tokenizer->text_length = token->offset;
+    --tokenizer->token_count;
+    tokenizer->in_word = false;
+    
+    return io_number;
+}
+
+const char *tokenizer_word(const struct tokenizer *tokenizer, const struct token *token)
+{
+    return tokenizer->text + token->offset;
+}
+
+void tokenizer_reset(struct tokenizer *tokenizer)
+{
+    tokenizer->lex_state     = LEX_BLANK;
+    tokenizer->escape        = false;
+    tokenizer->in_word       = false;
+    tokenizer->dollar        = false;
+    tokenizer->overflow      = false;
+    tokenizer->text_length   = 0;
+    tokenizer->token_count   = 0;
+    tokenizer->consumed      = 0;
+    tokenizer->source_length = 0;
+    
+    if (tokenizer->text_capacity > TOKENIZER_RETAIN_SIZE)
+    {
+        free(tokenizer->text);
+        tokenizer->text          = NULL;
+        tokenizer->text_capacity = 0;
+    }
+    if (tokenizer->token_capacity * sizeof(struct token) > TOKENIZER_RETAIN_SIZE)
+    {
+        free(tokenizer->tokens);
+        tokenizer->tokens         = NULL;
+        tokenizer->token_capacity = 0;
+    }
+    if (tokenizer->source_capacity > TOKENIZER_RETAIN_SIZE)
+    {
+        free(tokenizer->source);
+        tokenizer->source          = NULL;
+        tokenizer->source_capacity = 0;
+    }
+}
+
+void tokenizer_destroy(struct supervisor *supvis, struct tokenizer *tokenizer)
+{
+    free(tokenizer->text);
+    free(tokenizer->tokens);
+    free(tokenizer->source);
+    supvis->mm->mm_free(supvis->mm, tokenizer);
+}
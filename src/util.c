@@ -1,43 +1,30 @@
+#include "../include/arena.h"
 #include "../include/command.h"
+#include "../include/command_hash.h"
+#include "../include/completion.h"
+#include "../include/editor.h"
+#include "../include/expand.h"
+#include "../include/file_cache.h"
+#include "../include/history_index.h"
+#include "../include/parse_cache.h"
+#include "../include/prompt.h"
+#include "../include/scanner.h"
+#include "../include/script_cache.h"
+#include "../include/subshell.h"
+#include "../include/tokenizer.h"
 #include "../include/util.h"
 
 #include <dc_c/dc_stdlib.h>
 #include <dc_c/dc_string.h>
 #include <dc_posix/dc_stdlib.h>
+#include <dc_util/filesystem.h>
 
-#include <regex.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#define IN_DIRECT_REGEX "([ \t\f\v]<.*)"
-#define OUT_DIRECT_REGEX "([ \t\f\v][1]?>[>]?.*)"
-#define ERR_DIRECT_REGEX "([ \t\f\v]2>[>]?.*)"
-#define CMD_REGEX "([^<>]*).*"
-
-/**
- * set_regex
- * <p>
- * Set a regex_t to a pattern.
- * </p>
- * @param supvis the supervisor object
- * @param regex the regex_t to set
- * @param pattern the regex pattern
- * @param flags flags to be used
- * @return 0 on success, -1 on failure.
- */
-int set_regex(struct supervisor *supvis, regex_t **regex, const char *pattern, int flags);
-
-/**
- * set_state_regex
- * <p>
- * Set the regex patterns in the state object.
- * </p>
- * @param supvis the supervisor object
- * @param state the state object
- * @return 0 on success, -1 on error
- */
-int set_state_regex(struct supervisor *supvis, struct state *state);
-
 /**
  * set_state_path
  * <p>
@@ -86,6 +73,33 @@ size_t count_char_in_string(char c, char *str);
  */
 char **tokenize_path(struct supervisor *supvis, char *path_str_dup, size_t num_paths);
 
+/**
+ * set_state_script
+ * <p>
+ * Decide whether the shell is interactive and, when it is not, load the whole input into
+ * state->script. A command string (csh -c) is copied; a script file (csh script) or a regular
+ * file on stdin is mapped into memory. Input from a pipe is left to be read line by line.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @return 0 on success, -1 on failure
+ */
+int set_state_script(struct supervisor *supvis, struct state *state);
+
+/**
+ * map_script
+ * <p>
+ * Map the file open on fd privately into memory, followed by at least one zero byte so the last
+ * line is terminated even when the file does not end in a newline. Lines are terminated in place;
+ * the writes are never carried through to the file.
+ * </p>
+ * @param fd the file descriptor of the script
+ * @param length the length of the file
+ * @param map_length the length of the whole mapping, to be passed to munmap
+ * @return the mapped script, or NULL on failure
+ */
+char *map_script(int fd, size_t length, size_t *map_length);
+
 /**
  * get_prompt
  * <p>
@@ -97,21 +111,38 @@ char **tokenize_path(struct supervisor *supvis, char *path_str_dup, size_t num_p
 char *get_prompt(struct supervisor *supvis);
 
 /**
- * free_string_array
+ * render_prompt
  * <p>
- * Free all strings in a NULL-terminated array of strings and the array itself.
+ * Render "[cwd] prompt" into state->prompt_line, so displaying the prompt is a single write.
+ * Segments that change from command to command (%? and %b) are left for write_prompt.
  * </p>
- * @param array the array of strings
+ * @param supvis the supervisor object
+ * @param state the state object
+ * @return 0 on success, -1 on failure
+ */
+int render_prompt(struct supervisor *supvis, struct state *state);
+
+/**
+ * open_history
+ * <p>
+ * Open the history log named by HISTFILE, or ~/.csh_history, and its prefix index, and have
+ * the tokenizer keep the text of each command for it. The shell runs without history if the
+ * log cannot be opened.
+ * </p>
+ * @param supvis the supervisor object
+ * @param state the state object
  */
-void free_string_array(struct supervisor *supvis, char **array);
+void open_history(struct supervisor *supvis, struct state *state);
 
 struct state *do_init_state(struct supervisor *supvis, struct state *state)
 {
     if (state)
     {
         state->max_line_length = sysconf(_SC_ARG_MAX);
+        state->prompt_deadline = PROMPT_DEFAULT_DEADLINE;
         
-        if (set_state_regex(supvis, state) == -1)
+        state->arena = arena_create(supvis);
+        if (!state->arena)
         {
             state->fatal_error = true;
             return NULL;
@@ -129,54 +160,196 @@ struct state *do_init_state(struct supervisor *supvis, struct state *state)
             state->fatal_error = true;
             return NULL;
         }
+        
+        if (set_state_script(supvis, state) == -1)
+        {
+            (void) fprintf(state->stderr, "csh: %s: %s\n",
+                           (state->script_path) ? state->script_path : "stdin", strerror(errno));
+            state->fatal_error = true;
+            state->exit_code   = EXIT_FAILURE;
+            return NULL;
+        }
+        
+        if (do_update_working_dir(supvis, state) == -1)
+        {
+            state->fatal_error = true;
+            return NULL;
+        }
+        
+        // Finding the branch reads the repository's files, so it is only done if the prompt shows it.
+        if (state->interactive && strstr(state->prompt, "%b"))
+        {
+            state->prompt_worker = prompt_worker_create(supvis);
+            if (!state->prompt_worker)
+            {
+                state->fatal_error = true;
+                return NULL;
+            }
+        }
+        
+        if (state->script && !state->script_cache)
+        {
+            state->script_index = mm_calloc(1, sizeof(struct scan_index), supvis->mm, __FILE__, __func__, __LINE__);
+            if (!state->script_index
+                || scan_structure(state->script_index, state->script, state->script_length) == -1)
+            {
+                state->fatal_error = true;
+                return NULL;
+            }
+        }
+        
+        state->parse_cache = parse_cache_create(supvis, PARSE_CACHE_DEFAULT_CAPACITY);
+        if (!state->parse_cache)
+        {
+            state->fatal_error = true;
+            return NULL;
+        }
+        
+        // A script held in memory is fed to the tokenizer a statement at a time, so it reads nothing.
+        state->tokenizer = tokenizer_create(supvis, state->script ? -1 : fileno(state->stdin),
+                                            state->max_line_length);
+        if (!state->tokenizer)
+        {
+            state->fatal_error = true;
+            return NULL;
+        }
+        state->tokenizer->cache = state->parse_cache;
+        
+        state->expander = expander_create(supvis);
+        if (!state->expander)
+        {
+            state->fatal_error = true;
+            return NULL;
+        }
+        
+        state->subshell = subshell_create(supvis, state->max_line_length);
+        if (!state->subshell)
+        {
+            state->fatal_error = true;
+            return NULL;
+        }
+        
+        state->command_hash = command_hash_create(supvis);
+        if (!state->command_hash)
+        {
+            state->fatal_error = true;
+            return NULL;
+        }
+        
+        state->file_cache = file_cache_create(supvis);
+        if (!state->file_cache)
+        {
+            state->fatal_error = true;
+            return NULL;
+        }
+        
+        if (state->interactive)
+        {
+            open_history(supvis, state);
+            
+            // Directories are listed the first time something is completed, not at startup.
+            state->completion = completion_create(supvis, state->path);
+            if (!state->completion)
+            {
+                state->fatal_error = true;
+                return NULL;
+            }
+            
+            // Without an editor, lines are read with the terminal's own line editing.
+            state->editor = editor_create(supvis, fileno(state->stdin));
+            errno         = 0;
+        }
     }
     
     return state;
 }
 
-int set_state_regex(struct supervisor *supvis, struct state *state)
+void open_history(struct supervisor *supvis, struct state *state)
 {
-    int status;
+    char   *path;
+    char   *home;
+    size_t length;
     
-    status = set_regex(supvis, &state->in_redirect_regex, IN_DIRECT_REGEX, REG_EXTENDED);
-    if (status == -1)
+    path = dc_getenv(supvis->env, "HISTFILE");
+    if (path)
     {
-        return status;
-    }
-    status = set_regex(supvis, &state->out_redirect_regex, OUT_DIRECT_REGEX, REG_EXTENDED);
-    if (status == -1)
+        state->history = history_open(supvis, path);
+    } else
     {
-        regfree(state->in_redirect_regex);
-        return status;
+        home = dc_getenv(supvis->env, "HOME");
+        if (!home)
+        {
+            return;
+        }
+        
+        // "home/name", sized from the parts so the file opened is never a truncated name.
+        length = strlen(home);
+        path   = (char *) mm_malloc(length + strlen("/" HISTORY_FILE_NAME) + 1, supvis->mm, __FILE__, __func__,
+                                    __LINE__);
+        if (!path)
+        {
+            errno = 0;
+            return;
+        }
+        memcpy(path, home, length);
+        memcpy(path + length, "/" HISTORY_FILE_NAME, strlen("/" HISTORY_FILE_NAME) + 1);
+        state->history = history_open(supvis, path);
+        supvis->mm->mm_free(supvis->mm, path);
     }
-    status = set_regex(supvis, &state->err_redirect_regex, ERR_DIRECT_REGEX, REG_EXTENDED);
-    if (status == -1)
+    
+    if (!state->history)
     {
-        regfree(state->in_redirect_regex);
-        regfree(state->out_redirect_regex);
-        return status;
+        (void) fprintf(state->stderr, "csh: history: %s\n", strerror(errno));
+        errno = 0;
+        return;
     }
-    status = set_regex(supvis, &state->command_regex, CMD_REGEX, REG_EXTENDED);
-    if (status == -1)
+    
+    // Built the first time it is searched, so startup does not depend on the size of the history.
+    state->history_index = history_index_create(supvis, state->history);
+    if (!state->history_index)
     {
-        regfree(state->in_redirect_regex);
-        regfree(state->out_redirect_regex);
-        regfree(state->err_redirect_regex);
-        return status;
+        history_close(supvis, state->history);
+        state->history = NULL;
+        errno          = 0;
+        return;
     }
     
-    return status;
+    state->tokenizer->keep_source = true;
+}
+
+void do_start_command(struct state *state)
+{
+    state->command_time = time(NULL);
+    (void) clock_gettime(CLOCK_MONOTONIC, &state->command_started);
 }
 
-int set_regex(struct supervisor *supvis, regex_t **regex, const char *pattern, int flags)
+void do_record_history(struct state *state)
 {
-    int status;
+    struct timespec now;
+    const char      *text;
+    size_t          length;
+    long            duration;
+    int             saved_errno;
     
-    *regex = (regex_t *) mm_malloc(sizeof(regex_t), supvis->mm, __FILE__, __func__, __LINE__);
+    if (!state->history)
+    {
+        return;
+    }
     
-    status = regcomp(*regex, pattern, flags);
+    text = tokenizer_source(state->tokenizer, &length);
+    if (!text || !length)
+    {
+        return;
+    }
     
-    return status;
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    duration = (now.tv_sec - state->command_started.tv_sec) * 1000L
+               + (now.tv_nsec - state->command_started.tv_nsec) / 1000000L;
+    
+    // Failing to record a command is not an error in the command itself.
+    saved_errno = errno;
+    (void) history_append(state->history, text, length, state->exit_code, state->command_time, duration);
+    errno = saved_errno;
 }
 
 int set_state_path(struct supervisor *supvis, struct state *state)
@@ -257,6 +430,98 @@ size_t count_char_in_string(char c, char *str)
     return occurrences;
 }
 
+int set_state_script(struct supervisor *supvis, struct state *state)
+{
+    struct stat st;
+    int         fd;
+    off_t       offset;
+    
+    if (state->command_string)
+    {
+        state->script = strdup(state->command_string);
+        if (!state->script)
+        {
+            return -1;
+        }
+        supvis->mm->mm_add(supvis->mm, state->script);
+        state->script_length = strlen(state->script);
+        return 0;
+    }
+    
+    if (state->script_path)
+    {
+        fd = open(state->script_path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1 || fstat(fd, &st) == -1)
+        {
+            if (fd != -1)
+            {
+                (void) close(fd);
+            }
+            return -1;
+        }
+        
+        state->script = map_script(fd, (size_t) st.st_size, &state->script_map_length);
+        (void) close(fd);
+        if (!state->script)
+        {
+            return -1;
+        }
+        state->script_length = (size_t) st.st_size;
+        
+        // Without a compiled form the script is scanned and lexed as it runs, as input from stdin is.
+        state->script_cache = script_cache_open(supvis, state->script_path, &st, state->script,
+                                                state->max_line_length);
+        return 0;
+    }
+    
+    fd = fileno(state->stdin);
+    state->interactive = isatty(fd);
+    errno = 0; // isatty sets ENOTTY when stdin is not a terminal
+    
+    if (state->interactive || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        errno = 0;
+        return 0;
+    }
+    
+    // Start from wherever the stream is positioned, in case part of the file was already consumed.
+    offset = lseek(fd, 0, SEEK_CUR);
+    state->script = map_script(fd, (size_t) st.st_size, &state->script_map_length);
+    if (!state->script)
+    {
+        return -1;
+    }
+    state->script_length = (size_t) st.st_size;
+    state->script_offset = (offset > 0 && offset <= st.st_size) ? (size_t) offset : 0;
+    
+    return 0;
+}
+
+char *map_script(int fd, size_t length, size_t *map_length)
+{
+    char *script;
+    
+    // Reserve length + 1 zeroed bytes, then lay the file over the front of the reservation.
+    *map_length = length + 1;
+    script = mmap(NULL, *map_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (script == MAP_FAILED)
+    {
+        *map_length = 0;
+        return NULL;
+    }
+    
+    if (length && mmap(script, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        (void) munmap(script, *map_length);
+        *map_length = 0;
+        return NULL;
+    }
+    
+    (void) madvise(script, *map_length, MADV_SEQUENTIAL);
+    
+    return script;
+}
+
 char *get_prompt(struct supervisor *supvis)
 {
     char *prompt;
@@ -271,41 +536,83 @@ char *get_prompt(struct supervisor *supvis)
     return prompt;
 }
 
-void do_reset_state(struct supervisor *supvis, struct state *state)
+int do_update_working_dir(struct supervisor *supvis, struct state *state)
 {
+    char *cwd;
+    
+    cwd = dc_get_working_dir(supvis->env, supvis->err);
+    if (!cwd)
+    {
+        return -1;
+    }
+    supvis->mm->mm_add(supvis->mm, cwd);
+    
+    if (state->export_pwd)
+    {
+        if (state->cwd)
+        {
+            dc_setenv(supvis->env, supvis->err, "OLDPWD", state->cwd, true);
+        }
+        dc_setenv(supvis->env, supvis->err, "PWD", cwd, true);
+    }
+    
+    supvis->mm->mm_free(supvis->mm, state->cwd);
+    state->cwd = cwd;
+    
+    return (state->interactive) ? render_prompt(supvis, state) : 0;
+}
+
+int render_prompt(struct supervisor *supvis, struct state *state)
+{
+    char   *prompt_line;
+    size_t cwd_length;
+    size_t prompt_length;
+    size_t length;
+    
+    // "[cwd] prompt", sized from the parts so a long working directory is never cut short.
+    cwd_length    = strlen(state->cwd);
+    prompt_length = strlen(state->prompt);
+    length        = cwd_length + 3 + prompt_length;
     
-    supvis->mm->mm_free(supvis->mm, state->current_line);
+    prompt_line = (char *) mm_malloc(length + 1, supvis->mm, __FILE__, __func__, __LINE__);
+    if (!prompt_line)
+    {
+        return -1;
+    }
+    *prompt_line = '[';
+    memcpy(prompt_line + 1, state->cwd, cwd_length);
+    memcpy(prompt_line + 1 + cwd_length, "] ", 2);
+    memcpy(prompt_line + 3 + cwd_length, state->prompt, prompt_length + 1);
+    
+    supvis->mm->mm_free(supvis->mm, state->prompt_line);
+    state->prompt_line          = prompt_line;
+    state->prompt_line_length   = length;
+    state->prompt_prefix_length = length - prompt_length;
+    state->prompt_dynamic       = strchr(state->prompt, '%') != NULL;
+    
+    return 0;
+}
+
+void do_reset_state(struct supervisor *supvis, struct state *state)
+{
+    // Script lines point into state->script; everything else about the command is in the arena.
     state->current_line        = NULL;
     state->current_line_length = 0;
-    if (state->command)
+    state->commands            = NULL;
+    arena_reset(state->arena);
+    if (state->tokenizer)
     {
-        do_reset_command(supvis, state->command);
-        supvis->mm->mm_free(supvis->mm, state->command);
-        state->command     = NULL;
+        tokenizer_reset(state->tokenizer);
+    }
+    if (state->expander)
+    {
+        expander_reset(state->expander);
     }
     state->fatal_error = false;
     
     dc_error_reset(supvis->err);
 }
 
-void do_reset_command(struct supervisor *supvis, struct command *command)
-{
-    supvis->mm->mm_free(supvis->mm, command->line);
-    command->line    = NULL;
-    command->command = NULL;
-    command->argc    = 0;
-    free_string_array(supvis, command->argv);
-    supvis->mm->mm_free(supvis->mm, command->stdin_file);
-    command->stdin_file = NULL;
-    supvis->mm->mm_free(supvis->mm, command->stdout_file);
-    command->stdout_file      = NULL;
-    command->stdout_overwrite = false;
-    supvis->mm->mm_free(supvis->mm, command->stderr_file);
-    command->stderr_file      = NULL;
-    command->stderr_overwrite = false;
-    command->exit_code        = 0;
-}
-
 void do_destroy_state(struct supervisor *supvis, struct state *state)
 {
     if (state->stdin && state->stdin != stdin)
@@ -324,27 +631,16 @@ void do_destroy_state(struct supervisor *supvis, struct state *state)
         state->stderr = NULL;
     }
     
-    if (state->command_regex)
-    {
-        regfree(state->command_regex);
-        state->command_regex = NULL;
-    }
-    if (state->in_redirect_regex)
+    if (state->editor)
     {
-        regfree(state->in_redirect_regex);
-        state->in_redirect_regex = NULL;
+        editor_destroy(supvis, state->editor);
+        state->editor = NULL;
     }
-    if (state->out_redirect_regex)
+    if (state->completion)
     {
-        regfree(state->out_redirect_regex);
-        state->out_redirect_regex = NULL;
+        completion_destroy(supvis, state->completion);
+        state->completion = NULL;
     }
-    if (state->err_redirect_regex)
-    {
-        regfree(state->err_redirect_regex);
-        state->err_redirect_regex = NULL;
-    }
-    
     if (state->path)
     {
         supvis->mm->mm_free(supvis->mm, *state->path);
@@ -356,26 +652,88 @@ void do_destroy_state(struct supervisor *supvis, struct state *state)
     {
         state->prompt = NULL;
     }
-    
-    do_reset_state(supvis, state);
-}
-
-void free_string_array(struct supervisor *supvis, char **array)
-{
-    if (!array)
+    if (state->history_index)
     {
-        return;
+        history_index_destroy(supvis, state->history_index);
+        state->history_index = NULL;
     }
+    if (state->history)
+    {
+        history_close(supvis, state->history);
+        state->history = NULL;
+    }
+    if (state->prompt_worker)
+    {
+        prompt_worker_destroy(supvis, state->prompt_worker);
+        state->prompt_worker = NULL;
+    }
+    supvis->mm->mm_free(supvis->mm, state->prompt_line);
+    state->prompt_line          = NULL;
+    state->prompt_line_length   = 0;
+    state->prompt_prefix_length = 0;
+    supvis->mm->mm_free(supvis->mm, state->cwd);
+    state->cwd = NULL;
     
-    char **head_ptr;
-    
-    head_ptr = array;
+    do_reset_state(supvis, state);
     
-    while (*array)
+    if (state->script)
+    {
+        if (state->script_map_length)
+        {
+            (void) munmap(state->script, state->script_map_length);
+        } else
+        {
+            supvis->mm->mm_free(supvis->mm, state->script);
+        }
+        state->script            = NULL;
+        state->script_length     = 0;
+        state->script_offset     = 0;
+        state->script_map_length = 0;
+    }
+    if (state->script_index)
     {
-        supvis->mm->mm_free(supvis->mm, *array);
-        ++array;
+        scan_free(state->script_index);
+        supvis->mm->mm_free(supvis->mm, state->script_index);
+        state->script_index = NULL;
+    }
+    if (state->script_cache)
+    {
+        script_cache_close(supvis, state->script_cache);
+        state->script_cache = NULL;
+    }
+    if (state->tokenizer)
+    {
+        tokenizer_destroy(supvis, state->tokenizer);
+        state->tokenizer = NULL;
+    }
+    if (state->expander)
+    {
+        expander_destroy(supvis, state->expander);
+        state->expander = NULL;
+    }
+    if (state->subshell)
+    {
+        subshell_destroy(supvis, state->subshell);
+        state->subshell = NULL;
+    }
+    if (state->command_hash)
+    {
+        command_hash_destroy(supvis, state->command_hash);
+        state->command_hash = NULL;
+    }
+    if (state->file_cache)
+    {
+        file_cache_destroy(supvis, state->file_cache);
+        state->file_cache = NULL;
+    }
+    if (state->parse_cache)
+    {
+        parse_cache_destroy(supvis, state->parse_cache);
+        state->parse_cache = NULL;
+    }
+    if (state->arena)
+    {
+        arena_destroy(supvis, state->arena);
+        state->arena = NULL;
     }
-    
-    supvis->mm->mm_free(supvis->mm, head_ptr);
 }
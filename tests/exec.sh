@@ -0,0 +1,31 @@
+#!/bin/sh
+# Commands found on the path: they run relative to the directory the command hash table holds
+# open for them, which a redirection of the same descriptor must not replace.
+# usage: exec.sh <path of csh>
+
+csh=$1
+file=$(mktemp)
+failed=0
+
+# With a single directory on the path, a command cannot be found anywhere else instead.
+PATH=$(dirname "$(command -v ls)")
+export PATH
+
+# expect <name> <command line> <output> [<exit status>]
+expect()
+{
+    output=$("$csh" -c "$2" 2>&1)
+    status=$?
+    if [ "$output" != "$3" ] || [ "$status" -ne "${4:-0}" ]; then
+        printf '%s: %s\n  expected [%s] (%s), got [%s] (%s)\n' "$1" "$2" "$3" "${4:-0}" "$output" "$status"
+        failed=1
+    fi
+}
+
+expect "redirecting the descriptor of the path" "set -o forkexec; ls -d / 10>$file >&10; cat $file" "/"
+expect "closing the descriptor of the path" "set -o forkexec; ls -d / 10>&-" "/"
+expect "redirecting above the path" "set -o forkexec; ls -d / 12>$file 10>&12 11>&12 >&11; cat $file" "/"
+expect "not found" "set -o forkexec; no_such_command_here 10>$file" "csh: command not found: no_such_command_here" 127
+
+rm -f "$file"
+exit $failed
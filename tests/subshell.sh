@@ -0,0 +1,41 @@
+#!/bin/sh
+# Subshells: what a ( ... ) group or a command substitution changes, run in the shell's own
+# process or in a child, is not seen by the shell after it ends.
+# usage: subshell.sh <path of csh>
+
+csh=$1
+here=$(/bin/pwd)
+failed=0
+
+# expect <name> <command line> <output> [<exit status>]
+expect()
+{
+    output=$("$csh" -c "$2" 2>&1)
+    status=$?
+    if [ "$output" != "$3" ] || [ "$status" -ne "${4:-0}" ]; then
+        printf '%s: %s\n  expected [%s] (%s), got [%s] (%s)\n' "$1" "$2" "$3" "${4:-0}" "$output" "$status"
+        failed=1
+    fi
+}
+
+expect "cd in a group" '(cd /); /bin/pwd' "$here"
+expect "cd in a substitution" '/bin/echo x$(cd /); /bin/pwd' "x
+$here"
+expect "exported PWD" 'set -o exportpwd; cd /; (cd /usr); /bin/echo "$PWD"' "/"
+expect "options" '(set -o pipefail); /bin/false | /bin/true; /bin/echo $?' "0"
+expect "arithmetic assignment" '/bin/echo $((N=5)); /bin/echo N=$N' "5
+N=5"
+expect "arithmetic assignment in a group" '(cd / $((N=5))); /bin/echo N=$N' "N="
+expect "arithmetic assignment in a substitution" '/bin/echo x$(cd / $((N+=5))); /bin/echo N=$N' "x
+N="
+expect "default assignment" '/bin/echo ${Q:=/tmp}; /bin/echo Q=$Q' "/tmp
+Q=/tmp"
+expect "default assignment in a group" '(cd ${Q=/tmp}); /bin/echo Q=$Q' "Q="
+expect "default assignment in a substitution" '/bin/echo x$(cd ${Q:=/tmp}); /bin/echo Q=$Q' "x
+Q="
+expect "hash in a group" 'ls / >/dev/null; (hash -r); hash -d ls && /bin/echo kept' "kept"
+expect "exit status of a forked group" '(cd /; /bin/pwd)' "/"
+expect "exit status of a forked stage" '/bin/echo a | (cd /; /bin/cat)' "a"
+expect "exit in a group" '(exit 3)' "" 3
+
+exit $failed